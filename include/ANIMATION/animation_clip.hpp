@@ -0,0 +1,304 @@
+/*
+*	ANIMATION_CLIP.HPP
+*
+*	Keyframed joint animation in a compact form.
+*
+*	buildAnimationClip() takes per joint key lists (as they come out of the
+*	importer, times in seconds) and stores them as:
+*	- key times in uint16, normalized to the clip duration
+*	- rotations in 6 bytes, "smallest three": the largest component is
+*	  dropped (rebuilt from the unit length) and the other three are stored in
+*	  15 bits each, its index in the spare bits
+*	- translations and scales as vec3
+*	- without the keys linear interpolation between their neighbours already
+*	  reproduces within ANIMATION_*_TOLERANCE. Constant channels end up with a
+*	  single key, channels without keys use the skeleton's bind pose.
+*
+*	Every channel of every joint is one contiguous range of its arrays.
+*	sampleClip() finds the pair of keys around the time with a binary search
+*	per channel and interpolates them with the SSE pose kernels of
+*	ANIMATION/skeleton.hpp.
+*/
+
+#ifndef ANIMATION_CLIP_H
+#define ANIMATION_CLIP_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <ANIMATION/skeleton.hpp>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#define ANIMATION_TIME_STEPS 65535.0f
+#define ANIMATION_TRANSLATION_TOLERANCE 1e-4f
+#define ANIMATION_ROTATION_TOLERANCE 1e-5f		// 1 - |dot|, about 0.5 degree
+#define ANIMATION_SCALE_TOLERANCE 1e-4f
+
+// Smallest three quaternion, 15 bits per component, largest index in the low bits of x and y
+struct PackedQuat
+{
+	int16_t x, y, z;
+};
+
+// Keys [first, first + count) of one channel
+struct AnimationChannel
+{
+	uint32_t first;
+	uint32_t count;			// 0 uses the bind pose
+};
+
+struct JointTrack
+{
+	AnimationChannel translation, rotation, scale;
+};
+
+// Keys of one joint as imported, times in seconds
+struct RawJointTrack
+{
+	std::vector<float> translationTimes;
+	std::vector<glm::vec3> translations;
+	std::vector<float> rotationTimes;
+	std::vector<glm::quat> rotations;
+	std::vector<float> scaleTimes;
+	std::vector<glm::vec3> scales;
+};
+
+struct AnimationClip
+{
+	std::string name;
+	float duration;						// Seconds
+	std::vector<JointTrack> tracks;		// One per skeleton joint
+
+	std::vector<uint16_t> translationTimes, rotationTimes, scaleTimes;
+	std::vector<glm::vec3> translations, scales;
+	std::vector<PackedQuat> rotations;
+
+	size_t sourceKeys;					// Keys before compaction, all channels
+
+	inline size_t keyCount() const { return this->translations.size() + this->rotations.size() + this->scales.size(); }
+
+	size_t byteSize() const
+	{
+		return this->tracks.size() * sizeof(JointTrack)
+			+ (this->translationTimes.size() + this->rotationTimes.size() + this->scaleTimes.size()) * sizeof(uint16_t)
+			+ (this->translations.size() + this->scales.size()) * sizeof(glm::vec3) + this->rotations.size() * sizeof(PackedQuat);
+	}
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Animation clip utility functions"
+
+inline PackedQuat packQuat(const glm::quat& rotation)
+{
+	glm::quat q = glm::normalize(rotation);
+	float components[4] = { q.x, q.y, q.z, q.w };
+
+	int largest = 0;
+	for (int i = 1; i < 4; i++) if (std::fabs(components[i]) > std::fabs(components[largest])) largest = i;
+	// q and -q are the same rotation, the dropped component is kept positive
+	float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	int16_t values[3];
+	for (int i = 0, k = 0; i < 4; i++)
+	{
+		if (i == largest) continue;
+		// The other three lie in [-1/sqrt(2), 1/sqrt(2)]
+		long value = std::lround(glm::clamp(components[i] * sign * 1.41421356f, -1.0f, 1.0f) * 16383.0f);
+		int bit = k == 0 ? (largest & 1) : k == 1 ? (largest >> 1) : 0;
+		values[k++] = (int16_t)(value * 2 + bit);
+	}
+	return { values[0], values[1], values[2] };
+}
+
+// x, y, z, w
+inline glm::vec4 unpackQuat(const PackedQuat& packed)
+{
+	int bit0 = packed.x & 1, bit1 = packed.y & 1;
+	int largest = bit0 | (bit1 << 1);
+
+	const float scale = 1.0f / (16383.0f * 1.41421356f);
+	float a = (float)((packed.x - bit0) / 2) * scale;
+	float b = (float)((packed.y - bit1) / 2) * scale;
+	float c = (float)(packed.z / 2) * scale;
+
+	float components[4];
+	float rest[3] = { a, b, c };
+	for (int i = 0, k = 0; i < 4; i++)
+		components[i] = i == largest ? std::sqrt(std::max(0.0f, 1.0f - a * a - b * b - c * c)) : rest[k++];
+	return glm::vec4(components[0], components[1], components[2], components[3]);
+}
+
+inline uint16_t toClipTime(float seconds, float duration)
+{
+	return (uint16_t)std::lround(glm::clamp(duration > 0.0f ? seconds / duration : 0.0f, 0.0f, 1.0f) * ANIMATION_TIME_STEPS);
+}
+
+inline float vectorKeyError(const glm::vec3& expected, const glm::vec3& actual)
+{
+	return glm::length(expected - actual);
+}
+
+inline float rotationKeyError(const glm::quat& expected, const glm::quat& actual)
+{
+	return 1.0f - std::fabs(glm::dot(glm::normalize(expected), glm::normalize(actual)));
+}
+
+inline glm::vec3 interpolateKey(const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); }
+
+inline glm::quat interpolateKey(const glm::quat& a, const glm::quat& b, float t)
+{
+	glm::vec4 q = nlerpRotation(glm::vec4(a.x, a.y, a.z, a.w), glm::vec4(b.x, b.y, b.z, b.w), t);
+	return glm::quat(q.w, q.x, q.y, q.z);
+}
+
+/*
+*	Indices of the keys to keep: a key goes if interpolating between the last
+*	kept key and the next one reproduces it, and every key dropped since, within
+*	tolerance. Constant channels collapse to their first key.
+*/
+template<typename T, typename Error>
+std::vector<size_t> reduceKeys(const std::vector<float>& times, const std::vector<T>& values, float tolerance, Error error)
+{
+	std::vector<size_t> kept;
+	size_t count = std::min(times.size(), values.size());
+	if (count == 0) return kept;
+
+	kept.push_back(0);
+	for (size_t i = 1; i + 1 < count; i++)
+	{
+		size_t from = kept.back();
+		bool redundant = true;
+		for (size_t j = from + 1; j <= i && redundant; j++)
+		{
+			float span = times[i + 1] - times[from];
+			float t = span > 0.0f ? (times[j] - times[from]) / span : 0.0f;
+			redundant = error(values[j], interpolateKey(values[from], values[i + 1], t)) <= tolerance;
+		}
+		if (!redundant) kept.push_back(i);
+	}
+
+	if (count > 1)
+	{
+		// The last key only matters if the channel moves at all
+		bool constant = kept.size() == 1 && error(values[count - 1], values[0]) <= tolerance;
+		if (!constant) kept.push_back(count - 1);
+	}
+	return kept;
+}
+
+// Last key at or before time, times sorted
+inline uint32_t findKey(const uint16_t* times, uint32_t count, uint16_t time)
+{
+	const uint16_t* next = std::upper_bound(times, times + count, time);
+	return next == times ? 0 : (uint32_t)(next - times) - 1;
+}
+
+inline float keyFactor(const uint16_t* times, uint32_t key, uint32_t count, uint16_t time)
+{
+	if (key + 1 >= count) return 0.0f;
+	int span = (int)times[key + 1] - (int)times[key];
+	return span > 0 ? glm::clamp((float)((int)time - (int)times[key]) / (float)span, 0.0f, 1.0f) : 0.0f;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+// Compacted clip over a skeleton of jointCount joints, tracks[j] animates joint j
+inline AnimationClip buildAnimationClip(const std::string& name, float duration, const std::vector<RawJointTrack>& tracks, size_t jointCount)
+{
+	AnimationClip clip;
+	clip.name = name;
+	clip.duration = std::max(duration, 0.0f);
+	clip.tracks.assign(jointCount, JointTrack());
+	clip.sourceKeys = 0;
+
+	for (size_t j = 0; j < std::min(jointCount, tracks.size()); j++)
+	{
+		const RawJointTrack& raw = tracks[j];
+		JointTrack& track = clip.tracks[j];
+		clip.sourceKeys += raw.translations.size() + raw.rotations.size() + raw.scales.size();
+
+		std::vector<size_t> kept = reduceKeys(raw.translationTimes, raw.translations, ANIMATION_TRANSLATION_TOLERANCE, vectorKeyError);
+		track.translation = { (uint32_t)clip.translations.size(), (uint32_t)kept.size() };
+		for (size_t k : kept)
+		{
+			clip.translationTimes.push_back(toClipTime(raw.translationTimes[k], clip.duration));
+			clip.translations.push_back(raw.translations[k]);
+		}
+
+		kept = reduceKeys(raw.rotationTimes, raw.rotations, ANIMATION_ROTATION_TOLERANCE, rotationKeyError);
+		track.rotation = { (uint32_t)clip.rotations.size(), (uint32_t)kept.size() };
+		for (size_t k : kept)
+		{
+			clip.rotationTimes.push_back(toClipTime(raw.rotationTimes[k], clip.duration));
+			clip.rotations.push_back(packQuat(raw.rotations[k]));
+		}
+
+		kept = reduceKeys(raw.scaleTimes, raw.scales, ANIMATION_SCALE_TOLERANCE, vectorKeyError);
+		track.scale = { (uint32_t)clip.scales.size(), (uint32_t)kept.size() };
+		for (size_t k : kept)
+		{
+			clip.scaleTimes.push_back(toClipTime(raw.scaleTimes[k], clip.duration));
+			clip.scales.push_back(raw.scales[k]);
+		}
+	}
+
+	return clip;
+}
+
+/*
+*	Local pose of the skeleton at time (seconds), wrapped around the duration
+*	when looping and clamped otherwise. out holds skeleton.size() joints.
+*/
+inline void sampleClip(const AnimationClip& clip, const Skeleton& skeleton, float time, bool loop, JointPose* out)
+{
+	if (clip.duration > 0.0f)
+	{
+		time = loop ? std::fmod(time, clip.duration) : glm::clamp(time, 0.0f, clip.duration);
+		if (time < 0.0f) time += clip.duration;
+	}
+	uint16_t t = toClipTime(time, clip.duration);
+
+	size_t count = std::min(skeleton.joints.size(), clip.tracks.size());
+	for (size_t j = 0; j < count; j++)
+	{
+		const JointTrack& track = clip.tracks[j];
+		JointPose pose = skeleton.bindPose[j];
+
+		if (track.translation.count)
+		{
+			const uint16_t* times = clip.translationTimes.data() + track.translation.first;
+			const glm::vec3* keys = clip.translations.data() + track.translation.first;
+			uint32_t k = findKey(times, track.translation.count, t);
+			uint32_t n = std::min(k + 1, track.translation.count - 1);
+			pose.translation = lerpVector(glm::vec4(keys[k], 0.0f), glm::vec4(keys[n], 0.0f), keyFactor(times, k, track.translation.count, t));
+		}
+		if (track.rotation.count)
+		{
+			const uint16_t* times = clip.rotationTimes.data() + track.rotation.first;
+			const PackedQuat* keys = clip.rotations.data() + track.rotation.first;
+			uint32_t k = findKey(times, track.rotation.count, t);
+			uint32_t n = std::min(k + 1, track.rotation.count - 1);
+			pose.rotation = n == k ? unpackQuat(keys[k]) : nlerpRotation(unpackQuat(keys[k]), unpackQuat(keys[n]), keyFactor(times, k, track.rotation.count, t));
+		}
+		if (track.scale.count)
+		{
+			const uint16_t* times = clip.scaleTimes.data() + track.scale.first;
+			const glm::vec3* keys = clip.scales.data() + track.scale.first;
+			uint32_t k = findKey(times, track.scale.count, t);
+			uint32_t n = std::min(k + 1, track.scale.count - 1);
+			pose.scale = lerpVector(glm::vec4(keys[k], 0.0f), glm::vec4(keys[n], 0.0f), keyFactor(times, k, track.scale.count, t));
+		}
+
+		out[j] = pose;
+	}
+
+	for (size_t j = count; j < skeleton.joints.size(); j++) out[j] = skeleton.bindPose[j];
+}
+
+#endif // !ANIMATION_CLIP_H
@@ -0,0 +1,206 @@
+/*
+*	SKELETON.HPP
+*
+*	Joint hierarchy, poses and skinning matrix palettes.
+*
+*	A pose is one JointPose per joint: the local translation, rotation and
+*	scale, each held in a 16 byte vector so the interpolation and blending
+*	kernels work on whole SSE registers (lerp for translation and scale,
+*	shortest arc nlerp for rotation). Joints are stored parents first, so
+*	computePalette() turns a pose into world matrices in one forward pass and
+*	multiplies them by the inverse bind matrices:
+*
+*		palette[j] = globalInverse * global[j] * inverseBind[j]
+*
+*	which maps a bind pose vertex to its posed position in model space. The
+*	palette is what both skinning paths consume (ANIMATION/skinning.hpp on the
+*	CPU, skinned_model_shader.vert on the GPU).
+*/
+
+#ifndef SKELETON_H
+#define SKELETON_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <SIMD/simd.hpp>
+
+#include <vector>
+#include <string>
+#include <cmath>
+
+// Joint indices are stored in bytes (SkinWeights)
+#define SKELETON_MAX_JOINTS 256
+
+// Local transform of a joint
+struct JointPose
+{
+	glm::vec4 translation;	// xyz, w unused
+	glm::vec4 rotation;		// Unit quaternion x, y, z, w
+	glm::vec4 scale;		// xyz, w unused
+};
+
+struct Joint
+{
+	std::string name;
+	int parent;				// -1 for roots, always lower than the joint's own index
+	glm::mat4 inverseBind;	// Model space to joint space in the bind pose
+};
+
+struct Skeleton
+{
+	std::vector<Joint> joints;			// Parents first
+	std::vector<JointPose> bindPose;	// Local transforms used where a clip has no keys
+	glm::mat4 globalInverse;			// Inverse of the root transform of the file
+
+	int find(const std::string& name) const
+	{
+		for (size_t i = 0; i < this->joints.size(); i++) if (this->joints[i].name == name) return (int)i;
+		return -1;
+	}
+
+	inline size_t size() const { return this->joints.size(); }
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Pose utility functions"
+
+inline JointPose makeJointPose(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+	return { glm::vec4(translation, 0.0f), glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w), glm::vec4(scale, 0.0f) };
+}
+
+#ifdef SIMD_SSE
+// Dot product of two vec4, in every lane
+inline __m128 dot4(__m128 a, __m128 b)
+{
+	__m128 m = _mm_mul_ps(a, b);
+	m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// Normalized lerp along the shortest arc, b is flipped when it lies in the other hemisphere
+inline __m128 nlerpQuat(__m128 a, __m128 b, __m128 t)
+{
+	__m128 sign = _mm_and_ps(dot4(a, b), _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000)));
+	__m128 q = lerp4(a, _mm_xor_ps(b, sign), t);
+	return _mm_div_ps(q, _mm_sqrt_ps(dot4(q, q)));
+}
+
+// out = a * b for column major 4x4 matrices, one column per register
+inline void multiplyMat4(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+	__m128 a0 = _mm_loadu_ps(&a[0][0]), a1 = _mm_loadu_ps(&a[1][0]), a2 = _mm_loadu_ps(&a[2][0]), a3 = _mm_loadu_ps(&a[3][0]);
+	__m128 columns[4];
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 column = _mm_loadu_ps(&b[c][0]);
+		__m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2))));
+		columns[c] = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3))));
+	}
+	// out may alias a or b, it is only written once every column is done
+	for (int c = 0; c < 4; c++) _mm_storeu_ps(&out[c][0], columns[c]);
+}
+#else
+inline void multiplyMat4(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+	out = a * b;
+}
+#endif
+
+inline glm::vec4 lerpVector(const glm::vec4& a, const glm::vec4& b, float t)
+{
+#ifdef SIMD_SSE
+	glm::vec4 result;
+	_mm_storeu_ps(&result.x, lerp4(_mm_loadu_ps(&a.x), _mm_loadu_ps(&b.x), _mm_set1_ps(t)));
+	return result;
+#else
+	return a + (b - a) * t;
+#endif
+}
+
+// Quaternions as x, y, z, w
+inline glm::vec4 nlerpRotation(const glm::vec4& a, const glm::vec4& b, float t)
+{
+#ifdef SIMD_SSE
+	glm::vec4 result;
+	_mm_storeu_ps(&result.x, nlerpQuat(_mm_loadu_ps(&a.x), _mm_loadu_ps(&b.x), _mm_set1_ps(t)));
+	return result;
+#else
+	glm::vec4 q = a + ((glm::dot(a, b) < 0.0f ? -b : b) - a) * t;
+	return q / std::sqrt(glm::dot(q, q));
+#endif
+}
+
+/*
+*	out = a blended toward b by weight, joint by joint (cross fades, layered
+*	clips). out may be a or b.
+*/
+inline void blendPoses(const JointPose* a, const JointPose* b, float weight, JointPose* out, size_t count)
+{
+	size_t i = 0;
+
+#ifdef SIMD_SSE
+	__m128 t = _mm_set1_ps(weight);
+	for (; i < count; i++)
+	{
+		__m128 translation = lerp4(_mm_loadu_ps(&a[i].translation.x), _mm_loadu_ps(&b[i].translation.x), t);
+		__m128 rotation = nlerpQuat(_mm_loadu_ps(&a[i].rotation.x), _mm_loadu_ps(&b[i].rotation.x), t);
+		__m128 scale = lerp4(_mm_loadu_ps(&a[i].scale.x), _mm_loadu_ps(&b[i].scale.x), t);
+		_mm_storeu_ps(&out[i].translation.x, translation);
+		_mm_storeu_ps(&out[i].rotation.x, rotation);
+		_mm_storeu_ps(&out[i].scale.x, scale);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		out[i].translation = a[i].translation + (b[i].translation - a[i].translation) * weight;
+		out[i].rotation = nlerpRotation(a[i].rotation, b[i].rotation, weight);
+		out[i].scale = a[i].scale + (b[i].scale - a[i].scale) * weight;
+	}
+}
+
+inline glm::mat4 jointMatrix(const JointPose& pose)
+{
+	const glm::vec4& q = pose.rotation;
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	return glm::mat4(
+		glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * pose.scale.x,
+		glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * pose.scale.y,
+		glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * pose.scale.z,
+		glm::vec4(glm::vec3(pose.translation), 1.0f));
+}
+
+/*
+*	Skinning matrices of a pose. globals is scratch space of skeleton.size()
+*	matrices, left holding the model space joint transforms.
+*/
+inline void computePalette(const Skeleton& skeleton, const JointPose* pose, glm::mat4* globals, glm::mat4* palette)
+{
+	for (size_t j = 0; j < skeleton.joints.size(); j++)
+	{
+		const Joint& joint = skeleton.joints[j];
+		glm::mat4 local = jointMatrix(pose[j]);
+
+		if (joint.parent >= 0) multiplyMat4(globals[joint.parent], local, globals[j]);
+		else multiplyMat4(skeleton.globalInverse, local, globals[j]);
+
+		multiplyMat4(globals[j], joint.inverseBind, palette[j]);
+	}
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+#endif // !SKELETON_H
@@ -0,0 +1,115 @@
+/*
+*	SKINNING.HPP
+*
+*	CPU linear blend skinning of Vertex arrays.
+*
+*	Every vertex blends the palette matrices of its (up to four) joints by
+*	their weights and transforms its position and normal with the result. The
+*	SSE kernel keeps the four matrix columns in registers, reads a vertex as
+*	two 16 byte loads and writes it back as two 16 byte stores in memory order,
+*	so it can stream straight into write combined memory (a persistently mapped
+*	DynamicRingBuffer). Texture coordinates are copied through.
+*
+*	Normals are transformed by the blended matrix and renormalized, which is
+*	exact for rotations and uniform scales, the usual trade for skinning.
+*/
+
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <glm/glm.hpp>
+
+#include <SIMD/simd.hpp>
+#include <MESH/mesh_types.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <vector>
+#include <cmath>
+
+#define SKINNING_GRAIN 4096
+
+// Reference version, also the fallback without SSE
+inline void skinVerticesScalar(const Vertex* source, const SkinWeights* skin, const glm::mat4* palette, Vertex* out, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::mat4 m(0.0f);
+		for (int k = 0; k < 4 && skin[i].weights[k]; k++) m += palette[skin[i].joints[k]] * (skin[i].weights[k] * (1.0f / 255.0f));
+
+		glm::vec3 normal = glm::vec3(m * glm::vec4(source[i].normal, 0.0f));
+		float length = glm::length(normal);
+
+		Vertex vertex;
+		vertex.position = glm::vec3(m * glm::vec4(source[i].position, 1.0f));
+		vertex.normal = length > 0.0f ? normal / length : normal;
+		vertex.texCoords = source[i].texCoords;
+		out[i] = vertex;
+	}
+}
+
+inline void skinVertices(const Vertex* source, const SkinWeights* skin, const glm::mat4* palette, Vertex* out, size_t count)
+{
+#ifdef SIMD_SSE
+	static_assert(sizeof(Vertex) == 32, "The SSE skinning kernel reads a Vertex as two vec4");
+	const __m128 byteToWeight = _mm_set1_ps(1.0f / 255.0f);
+	const __m128 tiny = _mm_set1_ps(1e-30f);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const SkinWeights& influences = skin[i];
+
+		// Weighted sum of the joint matrices, influences are sorted so the first zero ends them
+		__m128 c0 = _mm_setzero_ps(), c1 = c0, c2 = c0, c3 = c0;
+		for (int k = 0; k < 4 && influences.weights[k]; k++)
+		{
+			const float* m = &palette[influences.joints[k]][0][0];
+			__m128 w = _mm_mul_ps(_mm_set1_ps((float)influences.weights[k]), byteToWeight);
+			c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(m), w));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(m + 4), w));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_loadu_ps(m + 8), w));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_loadu_ps(m + 12), w));
+		}
+
+		// (px, py, pz, nx) and (ny, nz, u, v)
+		const float* in = &source[i].position.x;
+		__m128 s0 = _mm_loadu_ps(in), s1 = _mm_loadu_ps(in + 4);
+
+		__m128 position = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_shuffle_ps(s0, s0, _MM_SHUFFLE(0, 0, 0, 0))));
+		position = _mm_add_ps(position, _mm_mul_ps(c1, _mm_shuffle_ps(s0, s0, _MM_SHUFFLE(1, 1, 1, 1))));
+		position = _mm_add_ps(position, _mm_mul_ps(c2, _mm_shuffle_ps(s0, s0, _MM_SHUFFLE(2, 2, 2, 2))));
+
+		__m128 normal = _mm_mul_ps(c0, _mm_shuffle_ps(s0, s0, _MM_SHUFFLE(3, 3, 3, 3)));
+		normal = _mm_add_ps(normal, _mm_mul_ps(c1, _mm_shuffle_ps(s1, s1, _MM_SHUFFLE(0, 0, 0, 0))));
+		normal = _mm_add_ps(normal, _mm_mul_ps(c2, _mm_shuffle_ps(s1, s1, _MM_SHUFFLE(1, 1, 1, 1))));
+
+		// w of the normal is 0 (no translation), so a 4 wide dot is its squared length
+		__m128 n2 = _mm_mul_ps(normal, normal);
+		n2 = _mm_add_ps(n2, _mm_shuffle_ps(n2, n2, _MM_SHUFFLE(2, 3, 0, 1)));
+		n2 = _mm_add_ps(n2, _mm_shuffle_ps(n2, n2, _MM_SHUFFLE(1, 0, 3, 2)));
+		normal = _mm_div_ps(normal, _mm_sqrt_ps(_mm_max_ps(n2, tiny)));
+
+		// Back to the interleaved layout
+		__m128 zx = _mm_shuffle_ps(position, normal, _MM_SHUFFLE(0, 0, 2, 2));
+		__m128 v0 = _mm_shuffle_ps(position, zx, _MM_SHUFFLE(2, 0, 1, 0));
+		__m128 v1 = _mm_shuffle_ps(normal, s1, _MM_SHUFFLE(3, 2, 2, 1));
+
+		float* o = &out[i].position.x;
+		_mm_storeu_ps(o, v0);
+		_mm_storeu_ps(o + 4, v1);
+	}
+#else
+	skinVerticesScalar(source, skin, palette, out, count);
+#endif
+}
+
+// skinVertices() split over a pool in SKINNING_GRAIN vertex chunks
+inline void skinVerticesParallel(const Vertex* source, const SkinWeights* skin, const glm::mat4* palette, Vertex* out, size_t count,
+	ThreadPool& pool = ThreadPool::shared())
+{
+	pool.parallelFor(count, SKINNING_GRAIN, [&](size_t begin, size_t end)
+	{
+		skinVertices(source + begin, skin + begin, palette, out + begin, end - begin);
+	});
+}
+
+#endif // !SKINNING_H
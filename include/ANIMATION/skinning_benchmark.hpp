@@ -0,0 +1,239 @@
+/*
+*	SKINNING_BENCHMARK.HPP
+*
+*	Per frame cost of a crowd of animated characters along both skinning
+*	paths of RENDER/skinned_renderer.hpp.
+*
+*	benchmarkSkinning() needs no GL context: it times the animation update
+*	shared by both paths (sampling, cross fade blending, palettes), the CPU
+*	path skinning every vertex of every character (SSE kernel, and the scalar
+*	reference for comparison) into a frame sized buffer, and the GPU path
+*	packing the palettes, with the bytes each path sends per frame. The SSE
+*	output of the last frame is checked against the scalar reference: largest
+*	position (relative to its magnitude, at least 1) and normal errors, and
+*	the vertices over SKINNING_BENCHMARK_TOLERANCE.
+*
+*	benchmarkSkinnedRenderer() runs the real draws on the GL thread and adds
+*	the GPU time of each path (GL_TIME_ELAPSED queries), the vertex shader
+*	skinning only shows up there.
+*
+*	Characters are spread over the clips with staggered times, every other one
+*	in a cross fade, so the update isn't one cached pose repeated.
+*/
+
+#ifndef SKINNING_BENCHMARK_H
+#define SKINNING_BENCHMARK_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <MODEL/animated_model.hpp>
+#include <ANIMATION/skinning.hpp>
+#include <RENDER/skinned_renderer.hpp>
+#include <SHADER/shader_s.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#define SKINNING_BENCHMARK_DELTA (1.0f / 60.0f)
+#define SKINNING_BENCHMARK_TOLERANCE 1e-4f		// Largest SSE / scalar difference of a position or normal
+
+struct SkinningBenchmarkResult
+{
+	size_t characters;
+	size_t joints, vertices;			// Per character
+	double animateMilliseconds;			// updateAnimations() of the whole crowd, both paths pay it
+	double cpuSkinMilliseconds;			// Parallel SSE skinning of every vertex
+	double scalarSkinMilliseconds;		// Same on one thread with the scalar kernel
+	double gpuPaletteMilliseconds;		// Palette copies of the GPU path
+	size_t cpuBytes, gpuBytes;			// Written per frame by each path
+	float maxPositionError;				// SSE against scalar, relative to max(1, |position|)
+	float maxNormalError;
+	size_t mismatches;					// Vertices over SKINNING_BENCHMARK_TOLERANCE
+};
+
+struct SkinnedRendererBenchmarkResult
+{
+	double cpuPathMilliseconds, gpuPathMilliseconds;	// CPU side of SkinnedRenderer::draw()
+	double cpuPathGpuMilliseconds, gpuPathGpuMilliseconds;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Skinning benchmark utility functions"
+
+inline std::vector<AnimatedInstance> makeBenchmarkCrowd(AnimatedModel& model, size_t characters)
+{
+	std::vector<AnimatedInstance> crowd;
+	crowd.reserve(characters);
+
+	int side = (int)std::ceil(std::sqrt((double)characters));
+	for (size_t i = 0; i < characters; i++)
+	{
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % side) * 2.0f, 0.0f, -(float)(i / side) * 2.0f));
+		crowd.push_back(AnimatedInstance(&model, transform));
+
+		if (model.clips.empty()) continue;
+		int clip = (int)(i % model.clips.size());
+		float offset = model.clips[clip].duration * (float)(i % 7) / 7.0f;
+		crowd.back().play(clip, 0.0f, offset);
+		if (i % 2) crowd.back().play((clip + 1) % (int)model.clips.size(), 1000.0f, offset);
+	}
+	return crowd;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+// Best of frames runs for each stage
+inline SkinningBenchmarkResult benchmarkSkinning(AnimatedModel& model, size_t characters, int frames = 10, ThreadPool& pool = ThreadPool::shared())
+{
+	SkinningBenchmarkResult result = {};
+	result.characters = characters;
+	result.joints = model.skeleton.size();
+	result.vertices = model.getStats().vertexCount;
+	result.animateMilliseconds = result.cpuSkinMilliseconds = result.scalarSkinMilliseconds = result.gpuPaletteMilliseconds = DBL_MAX;
+
+	std::vector<AnimatedInstance> crowd = makeBenchmarkCrowd(model, characters);
+	std::vector<Vertex> skinned(result.vertices * characters);
+	std::vector<glm::mat4> palettes(result.joints * characters);
+	result.cpuBytes = skinned.size() * sizeof(Vertex);
+	result.gpuBytes = palettes.size() * sizeof(glm::mat4);
+
+	for (int f = 0; f < frames; f++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		updateAnimations(crowd, SKINNING_BENCHMARK_DELTA, pool);
+		std::chrono::steady_clock::time_point animated = std::chrono::steady_clock::now();
+
+		// One job per character mesh, like SkinnedRenderer
+		pool.parallelFor(characters, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				Vertex* out = skinned.data() + i * result.vertices;
+				for (const std::unique_ptr<SkinnedMesh>& mesh : model.meshes)
+				{
+					skinVertices(mesh->vertices.data(), mesh->skin.data(), crowd[i].getPalette().data(), out, mesh->vertices.size());
+					out += mesh->vertices.size();
+				}
+			}
+		});
+		std::chrono::steady_clock::time_point skinnedTime = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < characters; i++)
+			std::memcpy(palettes.data() + i * result.joints, crowd[i].getPalette().data(), result.joints * sizeof(glm::mat4));
+		std::chrono::steady_clock::time_point copied = std::chrono::steady_clock::now();
+
+		result.animateMilliseconds = std::min(result.animateMilliseconds, std::chrono::duration<double, std::milli>(animated - start).count());
+		result.cpuSkinMilliseconds = std::min(result.cpuSkinMilliseconds, std::chrono::duration<double, std::milli>(skinnedTime - animated).count());
+		result.gpuPaletteMilliseconds = std::min(result.gpuPaletteMilliseconds, std::chrono::duration<double, std::milli>(copied - skinnedTime).count());
+	}
+
+	// The scalar reference is slow, one frame is enough, with the palettes of the last SSE frame
+	std::vector<Vertex> reference(skinned.size());
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < characters; i++)
+	{
+		Vertex* out = reference.data() + i * result.vertices;
+		for (const std::unique_ptr<SkinnedMesh>& mesh : model.meshes)
+		{
+			skinVerticesScalar(mesh->vertices.data(), mesh->skin.data(), crowd[i].getPalette().data(), out, mesh->vertices.size());
+			out += mesh->vertices.size();
+		}
+	}
+	result.scalarSkinMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	for (size_t v = 0; v < skinned.size(); v++)
+	{
+		const Vertex& fast = skinned[v], & exact = reference[v];
+		float positionError = glm::length(fast.position - exact.position) / std::max(1.0f, glm::length(exact.position));
+		float normalError = glm::length(fast.normal - exact.normal);
+
+		// NaN compares false, count it as a mismatch
+		if (!(positionError <= SKINNING_BENCHMARK_TOLERANCE && normalError <= SKINNING_BENCHMARK_TOLERANCE)) result.mismatches++;
+		result.maxPositionError = std::max(result.maxPositionError, positionError);
+		result.maxNormalError = std::max(result.maxNormalError, normalError);
+	}
+	if (result.mismatches)
+		std::cout << "ERROR::SKINNING_BENCHMARK::SSE_MISMATCH " << result.mismatches << " vertices differ from the scalar reference by more than "
+			<< SKINNING_BENCHMARK_TOLERANCE << '\n';
+
+	return result;
+}
+
+/*
+*	Both paths through SkinnedRenderer, must run on the GL thread with view and
+*	projection set on both shaders. modelShader is a regular mesh shader for
+*	the CPU path, skinnedShader uses skinned_model_shader.vert.
+*/
+inline SkinnedRendererBenchmarkResult benchmarkSkinnedRenderer(AnimatedModel& model, size_t characters, Shader& modelShader, Shader& skinnedShader,
+	int frames = 10, ThreadPool& pool = ThreadPool::shared())
+{
+	SkinnedRendererBenchmarkResult result = {};
+	std::vector<AnimatedInstance> crowd = makeBenchmarkCrowd(model, characters);
+
+	GLsizeiptr frameBytes = std::max<GLsizeiptr>(model.getStats().vertexCount * characters * sizeof(Vertex) + model.meshes.size() * characters * 256,
+		SKINNING_RING_SIZE);
+	SkinnedRenderer renderer(frameBytes);
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	const SkinningPath paths[2] = { skinning_cpu, skinning_gpu };
+	for (SkinningPath path : paths)
+	{
+		Shader& shader = path == skinning_cpu ? modelShader : skinnedShader;
+		shader.use();
+
+		double cpuBest = DBL_MAX, gpuBest = DBL_MAX;
+		for (int f = 0; f < frames; f++)
+		{
+			updateAnimations(crowd, SKINNING_BENCHMARK_DELTA, pool);
+
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			renderer.draw(crowd, shader, path, pool);
+			glEndQuery(GL_TIME_ELAPSED);
+
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+
+			const SkinnedRendererStats& stats = renderer.getStats();
+			cpuBest = std::min(cpuBest, stats.prepareMilliseconds + stats.submitMilliseconds);
+			gpuBest = std::min(gpuBest, nanoseconds / 1e6);
+		}
+
+		if (path == skinning_cpu) { result.cpuPathMilliseconds = cpuBest; result.cpuPathGpuMilliseconds = gpuBest; }
+		else { result.gpuPathMilliseconds = cpuBest; result.gpuPathGpuMilliseconds = gpuBest; }
+	}
+
+	glDeleteQueries(1, &query);
+	return result;
+}
+
+inline void printSkinningBenchmark(const std::string& path, const SkinningBenchmarkResult& result)
+{
+	std::cout << "Skinning benchmark: " << path << ", " << result.characters << " characters, " << result.joints << " joints, "
+		<< result.vertices << " vertices each" << '\n';
+	std::cout << "  animate:  " << result.animateMilliseconds << " ms (sample, blend, palettes)" << '\n';
+	std::cout << "  CPU path: " << result.cpuSkinMilliseconds << " ms skinning (scalar, one thread: " << result.scalarSkinMilliseconds
+		<< " ms), " << result.cpuBytes / 1024 << " KB per frame" << '\n';
+	std::cout << "  GPU path: " << result.gpuPaletteMilliseconds << " ms palette copies, " << result.gpuBytes / 1024 << " KB per frame" << '\n';
+	std::cout << "  SSE against scalar: " << result.maxPositionError << " max position error, " << result.maxNormalError
+		<< " max normal error, " << result.mismatches << " vertices over " << SKINNING_BENCHMARK_TOLERANCE << '\n';
+}
+
+inline void printSkinnedRendererBenchmark(const SkinnedRendererBenchmarkResult& result)
+{
+	std::cout << "  draw, CPU path: " << result.cpuPathMilliseconds << " ms CPU, " << result.cpuPathGpuMilliseconds << " ms GPU" << '\n';
+	std::cout << "  draw, GPU path: " << result.gpuPathMilliseconds << " ms CPU, " << result.gpuPathGpuMilliseconds << " ms GPU" << '\n';
+}
+
+#endif // !SKINNING_BENCHMARK_H
@@ -0,0 +1,464 @@
+/*
+*	VERTEX_ANIMATION.HPP
+*
+*	Vertex animation textures (VAT): animated meshes played back from baked
+*	per frame vertex positions and normals, for crowds where even a palette
+*	per instance is too much.
+*
+*	Files are written offline by bakeVertexAnimation() (see
+*	vertex_animation_bake.hpp) from an AnimatedModel, in the same mapped,
+*	sectioned layout as the baked models (MODEL/baked_model.hpp):
+*
+*		VertexAnimationHeader
+*		VertexAnimationClip[clipCount]	frame range and rate of every clip
+*		VertexAnimationMesh[meshCount]	index / vertex ranges, material, textures
+*		BakedTexture[textureCount]		type and path in the string blob
+*		strings
+*		texCoords						glm::vec2 per vertex, the only vertex attribute
+*		indices							GLuint, local to each mesh (base vertex draws)
+*		positions						16 bit unorm RGBA texels, xyz used, relative to bounds
+*		normals							half float RGBA texels, xyz used
+*
+*	The two texel sections are width x (frameCount * rowsPerFrame) images,
+*	RGBA16 for positions and RGBA16F for normals: frame f of vertex v sits at
+*	(v % width, f * rowsPerFrame + v / width), so models wider than a texture
+*	row still fit. They go from the mapping to glTextureSubImage2D without
+*	conversion. Positions are normalized to the header bounds and vat_shader.vert
+*	scales them back with the vatBoundsMin / vatBoundsExtent uniforms.
+*
+*	At runtime every instance is a transform plus its clip and playback
+*	offset in an SSBO (VERTEX_ANIMATION_INSTANCE_BINDING) that only changes
+*	when instances are added or edited. vat_shader.vert reads the instance
+*	from gl_InstanceID and interpolates the two frames around the "time"
+*	uniform, so a frame costs one uniform and one instanced draw per mesh, no
+*	matter how many instances.
+*
+*	Version 2 follows the Material flags and version 3 the normalized
+*	positions, older files are rejected and have to be baked again.
+*/
+
+#ifndef VERTEX_ANIMATION_H
+#define VERTEX_ANIMATION_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <IO/mapped_file.hpp>
+#include <MODEL/baked_model.hpp>
+#include <MESH/vertex_layout.hpp>
+#include <MATERIAL/material.hpp>
+#include <SHADER/shader_s.hpp>
+#include <TEXTURE/texture_s.hpp>
+#include <BOUNDS/bounds.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+#define VERTEX_ANIMATION_MAGIC 0x54415642u	// "BVAT"
+#define VERTEX_ANIMATION_VERSION 3
+#define VERTEX_ANIMATION_MAX_WIDTH 4096
+#define VERTEX_ANIMATION_MAX_HEIGHT 16384	// GL_MAX_TEXTURE_SIZE guaranteed by GL 4.6
+#define VERTEX_ANIMATION_INSTANCE_BINDING 5
+#define VERTEX_ANIMATION_MIN_CAPACITY 256
+
+struct VertexAnimationHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount, frameCount;
+	uint32_t width, rowsPerFrame;			// Texel layout, see above
+	uint32_t clipCount, meshCount, textureCount;
+	uint32_t padding;
+	uint64_t clipOffset, meshOffset, textureOffset;
+	uint64_t stringOffset, stringBytes;
+	uint64_t texCoordOffset, texCoordBytes;
+	uint64_t indexOffset, indexBytes;
+	uint64_t positionOffset, positionBytes;
+	uint64_t normalOffset, normalBytes;
+	AABB bounds;							// Model space, every frame of every clip
+};
+
+struct VertexAnimationClip
+{
+	uint32_t nameOffset, nameLength;		// In the string blob
+	uint32_t firstFrame, frameCount;
+	float duration;							// Seconds
+	float frameRate;						// (frameCount - 1) / duration, frames are evenly spread over the clip
+	uint32_t padding[2];
+};
+
+struct VertexAnimationMesh
+{
+	uint32_t baseVertex, vertexCount;
+	uint32_t firstIndex, indexCount;
+	uint32_t firstTexture, textureCount;
+	uint32_t padding[2];
+	Material material;
+};
+
+// std430 instance record of vat_shader.vert, keep both in sync
+struct VertexAnimationInstance
+{
+	glm::mat4 model;
+	glm::uvec2 frames;						// First frame and frame count of the clip
+	glm::vec2 playback;						// Frames per second (rate * speed) and start frame offset
+};
+
+static_assert(sizeof(VertexAnimationInstance) == 80, "VertexAnimationInstance must match the std430 layout");
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Vertex animation utility functions"
+
+// Texture rows of one frame when a row holds width vertices
+inline uint32_t vertexAnimationRows(uint32_t vertexCount, uint32_t width)
+{
+	return width > 0 ? (vertexCount + width - 1) / width : 0;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class VertexAnimation
+{
+public:
+
+	AABB bounds;
+
+	// Maps and validates the file and decodes the textures on the pool, no GL call
+	VertexAnimation(const std::string& path, ThreadPool& pool = ThreadPool::shared())
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		this->path = path;
+		this->bounds = emptyAABB();
+		this->VAO = this->texCoordVBO = this->EBO = 0;
+		this->positionTexture = this->normalTexture = 0;
+		this->instanceBuffer = 0;
+		this->instanceCapacity = 0;
+		this->instancesDirty = false;
+		this->width = this->rowsPerFrame = 0;
+		this->uploaded = false;
+		this->loadMilliseconds = this->uploadMilliseconds = 0.0;
+		this->file.reset(new MappedFile(path));
+
+		if (!this->file->isOpen() || !validate())
+		{
+			this->file.reset();
+			return;
+		}
+
+		const VertexAnimationHeader& header = getHeader();
+		this->bounds = header.bounds;
+		this->width = header.width;
+		this->rowsPerFrame = header.rowsPerFrame;
+
+		const VertexAnimationClip* clipTable = (const VertexAnimationClip*)(this->file->data() + header.clipOffset);
+		const VertexAnimationMesh* meshTable = (const VertexAnimationMesh*)(this->file->data() + header.meshOffset);
+		const BakedTexture* textureTable = (const BakedTexture*)(this->file->data() + header.textureOffset);
+		const char* strings = (const char*)(this->file->data() + header.stringOffset);
+
+		for (uint32_t c = 0; c < header.clipCount; c++)
+		{
+			VertexAnimationClip clip = clipTable[c];
+			bool inside = (uint64_t)clip.nameOffset + clip.nameLength <= header.stringBytes;
+			this->clipNames.push_back(inside ? std::string(strings + clip.nameOffset, clip.nameLength) : std::string());
+
+			// Frames past the texture would read outside it
+			if ((uint64_t)clip.firstFrame + clip.frameCount > header.frameCount) clip.frameCount = 0;
+			this->clips.push_back(clip);
+		}
+
+		uint64_t indexCount = header.indexBytes / sizeof(GLuint);
+		for (uint32_t m = 0; m < header.meshCount; m++)
+		{
+			MeshTextures mesh;
+			mesh.range = meshTable[m];
+			if ((uint64_t)mesh.range.firstIndex + mesh.range.indexCount > indexCount) mesh.range.indexCount = 0;
+
+			for (uint32_t t = mesh.range.firstTexture; t < mesh.range.firstTexture + mesh.range.textureCount && t < header.textureCount; t++)
+			{
+				bool inside = (uint64_t)textureTable[t].pathOffset + textureTable[t].pathLength <= header.stringBytes;
+				mesh.paths.push_back(inside ? std::string(strings + textureTable[t].pathOffset, textureTable[t].pathLength) : std::string());
+				mesh.types.push_back((TextureType)textureTable[t].type);
+			}
+			this->meshes.push_back(mesh);
+		}
+
+		for (const MeshTextures& mesh : this->meshes)
+			for (const std::string& file : mesh.paths)
+				if (std::find(this->texturePaths.begin(), this->texturePaths.end(), file) == this->texturePaths.end())
+					this->texturePaths.push_back(file);
+
+		this->textureImages.resize(this->texturePaths.size());
+		pool.parallelFor(this->texturePaths.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++) this->textureImages[i] = TextureImage::decode(this->texturePaths[i].c_str());
+		});
+
+		this->loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	~VertexAnimation()
+	{
+		GLuint buffers[3] = { this->texCoordVBO, this->EBO, this->instanceBuffer };
+		GLuint textures[2] = { this->positionTexture, this->normalTexture };
+		glDeleteVertexArrays(1, &this->VAO);
+		glDeleteBuffers(3, buffers);
+		glDeleteTextures(2, textures);
+	}
+
+	VertexAnimation(const VertexAnimation&) = delete;
+	VertexAnimation& operator=(const VertexAnimation&) = delete;
+
+	// Buffers and animation textures straight from the mapped ranges, must run on the GL thread
+	void upload()
+	{
+		if (this->uploaded || !this->file) return;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		const VertexAnimationHeader& header = getHeader();
+		const unsigned char* data = this->file->data();
+
+		glCreateBuffers(1, &this->texCoordVBO);
+		glNamedBufferStorage(this->texCoordVBO, header.texCoordBytes, data + header.texCoordOffset, 0);
+		glCreateBuffers(1, &this->EBO);
+		glNamedBufferStorage(this->EBO, header.indexBytes, data + header.indexOffset, 0);
+
+		glCreateVertexArrays(1, &this->VAO);
+		TexCoordLayout::apply(this->VAO, 0);
+		TexCoordLayout::bindBuffer(this->VAO, this->texCoordVBO, 0);
+		glVertexArrayElementBuffer(this->VAO, this->EBO);
+
+		// Fetched with texelFetch, no filtering or mipmaps
+		GLsizei height = (GLsizei)(header.frameCount * header.rowsPerFrame);
+		GLuint* targets[2] = { &this->positionTexture, &this->normalTexture };
+		const uint64_t offsets[2] = { header.positionOffset, header.normalOffset };
+		const GLenum formats[2] = { GL_RGBA16, GL_RGBA16F }, types[2] = { GL_UNSIGNED_SHORT, GL_HALF_FLOAT };
+		for (int i = 0; i < 2; i++)
+		{
+			glCreateTextures(GL_TEXTURE_2D, 1, targets[i]);
+			glTextureStorage2D(*targets[i], 1, formats[i], (GLsizei)header.width, height);
+			glTextureParameteri(*targets[i], GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTextureParameteri(*targets[i], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 8);
+			glTextureSubImage2D(*targets[i], 0, 0, 0, (GLsizei)header.width, height, GL_RGBA, types[i], data + offsets[i]);
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		this->file.reset();
+
+		GLenum textureConfig[4] = { GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR };
+		std::vector<Texture> textures;
+		for (size_t i = 0; i < this->textureImages.size(); i++)
+		{
+			if (!this->textureImages[i].pixels) std::cout << "ERROR::VERTEX_ANIMATION::TEXTURE_LOADING_FAILED " << this->texturePaths[i] << '\n';
+			textures.push_back(Texture(this->textureImages[i], GL_TEXTURE_2D, 0, textureConfig, texture_diffuse));
+		}
+		std::vector<TextureImage>().swap(this->textureImages);
+
+		for (MeshTextures& mesh : this->meshes)
+			for (const std::string& file : mesh.paths)
+			{
+				size_t index = std::find(this->texturePaths.begin(), this->texturePaths.end(), file) - this->texturePaths.begin();
+				mesh.textures.push_back(textures[index]);
+				mesh.IDs.push_back(textures[index].getID());
+			}
+
+		this->uploaded = true;
+		this->uploadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Index of the new instance, playing clip from timeOffset seconds at speed
+	size_t addInstance(const glm::mat4& transform, int clip = 0, float timeOffset = 0.0f, float speed = 1.0f)
+	{
+		this->instances.push_back(VertexAnimationInstance());
+		setInstance(this->instances.size() - 1, transform, clip, timeOffset, speed);
+		return this->instances.size() - 1;
+	}
+
+	void setInstance(size_t index, const glm::mat4& transform, int clip = 0, float timeOffset = 0.0f, float speed = 1.0f)
+	{
+		VertexAnimationInstance& instance = this->instances[index];
+		instance.model = transform;
+		instance.frames = glm::uvec2(0u);
+		instance.playback = glm::vec2(0.0f);
+
+		if (clip >= 0 && clip < (int)this->clips.size())
+		{
+			const VertexAnimationClip& source = this->clips[clip];
+			instance.frames = glm::uvec2(source.firstFrame, source.frameCount);
+			instance.playback = glm::vec2(source.frameRate * speed, timeOffset * source.frameRate * speed);
+		}
+		this->instancesDirty = true;
+	}
+
+	void clearInstances()
+	{
+		this->instances.clear();
+		this->instancesDirty = true;
+	}
+
+	/*
+	*	Every instance in one instanced draw per mesh. The shader must be in use
+	*	with view and projection set, time is in seconds.
+	*/
+	void draw(Shader& shader, float time, bool hasMaterial = false)
+	{
+		upload();
+		if (!this->uploaded || this->instances.empty()) return;
+		if (this->instancesDirty) uploadInstances();
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VERTEX_ANIMATION_INSTANCE_BINDING, this->instanceBuffer);
+
+		int positionUnit = shader.getSamplerUnit("vatPositions"), normalUnit = shader.getSamplerUnit("vatNormals");
+		if (positionUnit >= 0) glBindTextureUnit(positionUnit, this->positionTexture);
+		if (normalUnit >= 0) glBindTextureUnit(normalUnit, this->normalTexture);
+		shader.setFloatUniform("time", time);
+		shader.setIntUniform("vatWidth", (int)this->width);
+		shader.setIntUniform("vatRowsPerFrame", (int)this->rowsPerFrame);
+		shader.setVec3Uniform("vatBoundsMin", this->bounds.min);
+		shader.setVec3Uniform("vatBoundsExtent", this->bounds.max - this->bounds.min);
+
+		glBindVertexArray(this->VAO);
+		for (MeshTextures& mesh : this->meshes)
+		{
+			if (mesh.range.indexCount == 0) continue;
+
+			const std::vector<TextureBinding>& bindings = mesh.samplerBindings.get(shader, mesh.types.data(), mesh.IDs.data(), mesh.types.size(), hasMaterial);
+			for (const TextureBinding& binding : bindings) glBindTextureUnit(binding.unit, binding.textureID);
+
+			// gl_InstanceID picks the instance, the base instance still carries the material
+			glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, mesh.range.indexCount, GL_UNSIGNED_INT,
+				(void*)(mesh.range.firstIndex * sizeof(GLuint)), (GLsizei)this->instances.size(), mesh.range.baseVertex, mesh.materialIndex);
+		}
+		glBindVertexArray(0);
+	}
+
+	void bindMaterials(MaterialLibrary& library)
+	{
+		for (MeshTextures& mesh : this->meshes) mesh.materialIndex = library.add(mesh.range.material);
+	}
+
+	int findClip(const std::string& name) const
+	{
+		for (size_t i = 0; i < this->clipNames.size(); i++) if (this->clipNames[i] == name) return (int)i;
+		return -1;
+	}
+
+	// World space bounds of every instance, whatever frame it is on
+	AABB getInstanceBounds() const
+	{
+		AABB box = emptyAABB();
+		for (const VertexAnimationInstance& instance : this->instances) box = mergeAABB(box, transformAABB(this->bounds, instance.model));
+		return box;
+	}
+
+	inline bool isLoaded() const { return this->uploaded || this->file; }
+	inline const std::string& getPath() const { return this->path; }
+	inline size_t getInstanceCount() const { return this->instances.size(); }
+	inline const std::vector<VertexAnimationClip>& getClips() const { return this->clips; }
+	inline double getLoadMilliseconds() const { return this->loadMilliseconds; }
+	inline double getUploadMilliseconds() const { return this->uploadMilliseconds; }
+
+private:
+
+	typedef VertexLayout<Attr<TexCoords, glm::vec2>> TexCoordLayout;
+
+	struct MeshTextures
+	{
+		VertexAnimationMesh range;
+		GLuint materialIndex = 0;		// In the MaterialLibrary, see bindMaterials()
+		std::vector<std::string> paths;
+		std::vector<TextureType> types;
+		std::vector<Texture> textures;
+		std::vector<GLuint> IDs;		// GL textures, filled at upload()
+		SamplerBindingCache samplerBindings;
+	};
+
+	std::string path;
+	std::unique_ptr<MappedFile> file;
+	bool uploaded;
+	double loadMilliseconds, uploadMilliseconds;
+
+	GLuint VAO, texCoordVBO, EBO;
+	GLuint positionTexture, normalTexture;
+	uint32_t width, rowsPerFrame;
+
+	std::vector<VertexAnimationClip> clips;
+	std::vector<std::string> clipNames;
+	std::vector<MeshTextures> meshes;
+	std::vector<std::string> texturePaths;
+	std::vector<TextureImage> textureImages;
+
+	std::vector<VertexAnimationInstance> instances;
+	GLuint instanceBuffer;
+	size_t instanceCapacity;
+	bool instancesDirty;
+
+	// Static between edits, reallocated only when it has to grow
+	void uploadInstances()
+	{
+		if (this->instances.size() > this->instanceCapacity)
+		{
+			glDeleteBuffers(1, &this->instanceBuffer);
+			this->instanceCapacity = std::max<size_t>(VERTEX_ANIMATION_MIN_CAPACITY, this->instances.size() * 2);
+			glCreateBuffers(1, &this->instanceBuffer);
+			glNamedBufferStorage(this->instanceBuffer, this->instanceCapacity * sizeof(VertexAnimationInstance), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		}
+
+		glNamedBufferSubData(this->instanceBuffer, 0, this->instances.size() * sizeof(VertexAnimationInstance), this->instances.data());
+		this->instancesDirty = false;
+	}
+
+	inline const VertexAnimationHeader& getHeader() const { return *(const VertexAnimationHeader*)this->file->data(); }
+
+	bool validate() const
+	{
+		size_t size = this->file->size();
+		if (size < sizeof(VertexAnimationHeader))
+		{
+			std::cout << "ERROR::VERTEX_ANIMATION::TRUNCATED " << this->path << '\n';
+			return false;
+		}
+
+		const VertexAnimationHeader& header = getHeader();
+		if (header.magic != VERTEX_ANIMATION_MAGIC)
+		{
+			std::cout << "ERROR::VERTEX_ANIMATION::NOT_A_VERTEX_ANIMATION " << this->path << '\n';
+			return false;
+		}
+		if (header.version != VERTEX_ANIMATION_VERSION)
+		{
+			std::cout << "ERROR::VERTEX_ANIMATION::VERSION_MISMATCH " << this->path << " (" << header.version << ", expected "
+				<< VERTEX_ANIMATION_VERSION << ")" << '\n';
+			return false;
+		}
+
+		// Both images must hold every texel of every frame
+		uint64_t texelBytes = (uint64_t)header.width * header.rowsPerFrame * header.frameCount * 4 * sizeof(uint16_t);
+		bool valid = header.width > 0 && header.width <= VERTEX_ANIMATION_MAX_WIDTH
+			&& header.rowsPerFrame == vertexAnimationRows(header.vertexCount, header.width)
+			&& header.texCoordBytes == (uint64_t)header.vertexCount * sizeof(glm::vec2)
+			&& header.positionBytes == texelBytes && header.normalBytes == texelBytes
+			&& validBakedSection(header.clipOffset, (uint64_t)header.clipCount * sizeof(VertexAnimationClip), size)
+			&& validBakedSection(header.meshOffset, (uint64_t)header.meshCount * sizeof(VertexAnimationMesh), size)
+			&& validBakedSection(header.textureOffset, (uint64_t)header.textureCount * sizeof(BakedTexture), size)
+			&& validBakedSection(header.stringOffset, header.stringBytes, size)
+			&& validBakedSection(header.texCoordOffset, header.texCoordBytes, size)
+			&& validBakedSection(header.indexOffset, header.indexBytes, size)
+			&& validBakedSection(header.positionOffset, header.positionBytes, size)
+			&& validBakedSection(header.normalOffset, header.normalBytes, size);
+
+		if (!valid) std::cout << "ERROR::VERTEX_ANIMATION::CORRUPTED " << this->path << '\n';
+		return valid;
+	}
+};
+
+#endif // !VERTEX_ANIMATION_H
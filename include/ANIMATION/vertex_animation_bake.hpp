@@ -0,0 +1,234 @@
+/*
+*	VERTEX_ANIMATION_BAKE.HPP
+*
+*	Offline baker of vertex animation files (see vertex_animation.hpp).
+*
+*	Every clip of an AnimatedModel is sampled at framesPerSecond, evenly over
+*	its duration so the first and last frames are the clip's ends. Each frame
+*	is a full evaluation (sampleClip, computePalette) followed by the CPU
+*	skinning kernel, and frames are independent so they are spread over the
+*	pool. Positions are kept as floats until the bounds of every frame are
+*	known, then quantized to 16 bit unorm inside that AABB, so precision is
+*	even over the model instead of halving with every power of two away from
+*	the origin. Normals are stored as half floats. The vertex order is the
+*	meshes' concatenated, which is what gl_VertexID reads at runtime through
+*	base vertex draws. A model without clips gets a single "bind" frame.
+*/
+
+#ifndef VERTEX_ANIMATION_BAKE_H
+#define VERTEX_ANIMATION_BAKE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <ANIMATION/vertex_animation.hpp>
+#include <ANIMATION/skinning.hpp>
+#include <MODEL/animated_model.hpp>
+#include <MODEL/model_cook.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#define VERTEX_ANIMATION_DEFAULT_FPS 30.0f
+
+inline bool bakeVertexAnimation(const AnimatedModel& model, const std::string& outputPath, float framesPerSecond = VERTEX_ANIMATION_DEFAULT_FPS,
+	ThreadPool& pool = ThreadPool::shared())
+{
+	VertexAnimationHeader header = {};
+	std::vector<VertexAnimationClip> clips;
+	std::vector<VertexAnimationMesh> meshes;
+	std::vector<BakedTexture> textures;
+	std::string strings;
+	std::vector<glm::vec2> texCoords;
+	std::vector<GLuint> indices;
+
+	for (size_t m = 0; m < model.meshes.size(); m++)
+	{
+		const SkinnedMesh& source = *model.meshes[m];
+
+		VertexAnimationMesh mesh = {};
+		mesh.baseVertex = (uint32_t)texCoords.size();
+		mesh.vertexCount = (uint32_t)source.vertices.size();
+		mesh.firstIndex = (uint32_t)indices.size();
+		mesh.indexCount = (uint32_t)source.indices.size();
+		mesh.firstTexture = (uint32_t)textures.size();
+		mesh.material = model.getMaterial(m);
+
+		for (const ModelTextureRef& ref : model.getTextureRefs(m))
+		{
+			textures.push_back({ (uint32_t)ref.type, (uint32_t)strings.size(), (uint32_t)ref.path.size() });
+			strings += ref.path;
+		}
+		mesh.textureCount = (uint32_t)textures.size() - mesh.firstTexture;
+
+		for (const Vertex& vertex : source.vertices) texCoords.push_back(vertex.texCoords);
+		indices.insert(indices.end(), source.indices.begin(), source.indices.end());
+		meshes.push_back(mesh);
+	}
+
+	uint32_t vertexCount = (uint32_t)texCoords.size();
+	if (vertexCount == 0)
+	{
+		std::cout << "ERROR::VERTEX_ANIMATION_BAKE::NO_GEOMETRY " << model.getPath() << '\n';
+		return false;
+	}
+
+	// Frame ranges, every clip holds at least its two ends
+	uint32_t frameCount = 0;
+	for (const AnimationClip& source : model.clips)
+	{
+		VertexAnimationClip clip = {};
+		clip.nameOffset = (uint32_t)strings.size();
+		clip.nameLength = (uint32_t)source.name.size();
+		clip.firstFrame = frameCount;
+		clip.frameCount = std::max(2u, (uint32_t)std::ceil(source.duration * framesPerSecond) + 1);
+		clip.duration = source.duration;
+		clip.frameRate = source.duration > 0.0f ? (clip.frameCount - 1) / source.duration : 0.0f;
+		strings += source.name;
+		frameCount += clip.frameCount;
+		clips.push_back(clip);
+	}
+	if (clips.empty())
+	{
+		clips.push_back({ (uint32_t)strings.size(), 4, 0, 1, 0.0f, 0.0f, { 0, 0 } });
+		strings += "bind";
+		frameCount = 1;
+	}
+
+	uint32_t width = std::min<uint32_t>(vertexCount, VERTEX_ANIMATION_MAX_WIDTH);
+	uint32_t rowsPerFrame = vertexAnimationRows(vertexCount, width);
+	size_t frameTexels = (size_t)width * rowsPerFrame;
+
+	if ((uint64_t)frameCount * rowsPerFrame > VERTEX_ANIMATION_MAX_HEIGHT)
+	{
+		std::cout << "ERROR::VERTEX_ANIMATION_BAKE::TEXTURE_TOO_TALL " << (uint64_t)frameCount * rowsPerFrame << " rows, lower the frame rate" << '\n';
+		return false;
+	}
+
+	std::vector<uint16_t> positions(frameTexels * frameCount * 4, 0), normals(frameTexels * frameCount * 4, 0);
+	std::vector<glm::vec3> modelPositions(frameTexels * frameCount, glm::vec3(0.0f));
+	std::vector<AABB> frameBounds(frameCount, emptyAABB());
+
+	const Skeleton& skeleton = model.skeleton;
+	pool.parallelFor(frameCount, 1, [&](size_t begin, size_t end)
+	{
+		std::vector<JointPose> pose(skeleton.size());
+		std::vector<glm::mat4> globals(skeleton.size()), palette(skeleton.size());
+		std::vector<Vertex> skinned;
+
+		for (size_t f = begin; f < end; f++)
+		{
+			// Clip of this frame and its time
+			size_t c = 0;
+			while (c + 1 < clips.size() && f >= clips[c].firstFrame + clips[c].frameCount) c++;
+			uint32_t local = (uint32_t)f - clips[c].firstFrame;
+
+			if (c < model.clips.size())
+			{
+				float time = clips[c].frameRate > 0.0f ? local / clips[c].frameRate : 0.0f;
+				sampleClip(model.clips[c], skeleton, std::min(time, clips[c].duration), false, pose.data());
+			}
+			else pose = skeleton.bindPose;
+			computePalette(skeleton, pose.data(), globals.data(), palette.data());
+
+			glm::vec3* framePositions = modelPositions.data() + f * frameTexels;
+			uint16_t* normalTexels = normals.data() + f * frameTexels * 4;
+			for (size_t m = 0; m < model.meshes.size(); m++)
+			{
+				const SkinnedMesh& mesh = *model.meshes[m];
+				skinned.resize(mesh.vertices.size());
+				skinVertices(mesh.vertices.data(), mesh.skin.data(), palette.data(), skinned.data(), skinned.size());
+
+				for (size_t v = 0; v < skinned.size(); v++)
+				{
+					// Texels of a frame are row major, vertex i is texel i
+					size_t texel = meshes[m].baseVertex + v;
+					framePositions[texel] = skinned[v].position;
+					for (int k = 0; k < 3; k++) normalTexels[texel * 4 + k] = (uint16_t)glm::packHalf1x16(skinned[v].normal[k]);
+					frameBounds[f].min = glm::min(frameBounds[f].min, skinned[v].position);
+					frameBounds[f].max = glm::max(frameBounds[f].max, skinned[v].position);
+				}
+			}
+		}
+	});
+
+	header.magic = VERTEX_ANIMATION_MAGIC;
+	header.version = VERTEX_ANIMATION_VERSION;
+	header.vertexCount = vertexCount;
+	header.frameCount = frameCount;
+	header.width = width;
+	header.rowsPerFrame = rowsPerFrame;
+	header.clipCount = (uint32_t)clips.size();
+	header.meshCount = (uint32_t)meshes.size();
+	header.textureCount = (uint32_t)textures.size();
+	header.bounds = emptyAABB();
+	for (const AABB& box : frameBounds) header.bounds = mergeAABB(header.bounds, box);
+
+	// Unorm inside the bounds, a flat axis stays at 0 and decodes to its min
+	glm::vec3 extent = header.bounds.max - header.bounds.min;
+	glm::vec3 scale = glm::vec3(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+		extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+	pool.parallelFor(modelPositions.size(), VERTEX_ANIMATION_MAX_WIDTH, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			glm::vec3 unit = glm::clamp((modelPositions[i] - header.bounds.min) * scale, 0.0f, 1.0f);
+			for (int k = 0; k < 3; k++) positions[i * 4 + k] = (uint16_t)std::lround(unit[k] * 65535.0f);
+		}
+	});
+	std::vector<glm::vec3>().swap(modelPositions);
+
+	uint64_t offset = sizeof(VertexAnimationHeader);
+	header.clipOffset = offset = alignBakedOffset(offset);
+	offset += clips.size() * sizeof(VertexAnimationClip);
+	header.meshOffset = offset = alignBakedOffset(offset);
+	offset += meshes.size() * sizeof(VertexAnimationMesh);
+	header.textureOffset = offset = alignBakedOffset(offset);
+	offset += textures.size() * sizeof(BakedTexture);
+	header.stringOffset = offset = alignBakedOffset(offset);
+	header.stringBytes = strings.size();
+	offset += strings.size();
+	header.texCoordOffset = offset = alignBakedOffset(offset);
+	header.texCoordBytes = texCoords.size() * sizeof(glm::vec2);
+	offset += header.texCoordBytes;
+	header.indexOffset = offset = alignBakedOffset(offset);
+	header.indexBytes = indices.size() * sizeof(GLuint);
+	offset += header.indexBytes;
+	header.positionOffset = offset = alignBakedOffset(offset);
+	header.positionBytes = positions.size() * sizeof(uint16_t);
+	offset += header.positionBytes;
+	header.normalOffset = offset = alignBakedOffset(offset);
+	header.normalBytes = normals.size() * sizeof(uint16_t);
+
+	std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		std::cout << "ERROR::VERTEX_ANIMATION_BAKE::OPEN_FAILED " << outputPath << '\n';
+		return false;
+	}
+
+	out.write((const char*)&header, sizeof(header));
+	writeBakedSection(out, header.clipOffset, clips.data(), clips.size() * sizeof(VertexAnimationClip));
+	writeBakedSection(out, header.meshOffset, meshes.data(), meshes.size() * sizeof(VertexAnimationMesh));
+	writeBakedSection(out, header.textureOffset, textures.data(), textures.size() * sizeof(BakedTexture));
+	writeBakedSection(out, header.stringOffset, strings.data(), strings.size());
+	writeBakedSection(out, header.texCoordOffset, texCoords.data(), header.texCoordBytes);
+	writeBakedSection(out, header.indexOffset, indices.data(), header.indexBytes);
+	writeBakedSection(out, header.positionOffset, positions.data(), header.positionBytes);
+	writeBakedSection(out, header.normalOffset, normals.data(), header.normalBytes);
+
+	if (!out)
+	{
+		std::cout << "ERROR::VERTEX_ANIMATION_BAKE::WRITE_FAILED " << outputPath << '\n';
+		return false;
+	}
+	return true;
+}
+
+#endif // !VERTEX_ANIMATION_BAKE_H
@@ -0,0 +1,323 @@
+/*
+*	BOUNDS.HPP
+*
+*	Axis aligned bounding boxes and bounding spheres.
+*
+*	computeAABB() and computeBoundingSphere() work on any strided position array
+*	(interleaved Vertex data or a packed position stream) and use SSE when it is
+*	available. They are meant to run once at load time, the results are stored
+*	with the geometry.
+*
+*	transformAABB()/transformSphere() move local bounds to world space, and
+*	transformAABBs() does it for every instance of the same geometry in one pass.
+*
+*	surfaceArea() and the ray slab test intersectRayAABB() are shared by the
+*	scene and triangle BVHs.
+*/
+
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <SIMD/simd.hpp>
+#include <MESH/mesh_types.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+struct BoundingSphere
+{
+	glm::vec3 center;
+	float radius;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Bounds utility functions"
+
+// Inverted box, merging anything into it gives that thing back
+inline AABB emptyAABB() { return { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) }; }
+
+inline bool isEmpty(const AABB& box) { return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z; }
+
+inline AABB mergeAABB(const AABB& a, const AABB& b) { return { glm::min(a.min, b.min), glm::max(a.max, b.max) }; }
+
+inline BoundingSphere mergeSpheres(const BoundingSphere& a, const BoundingSphere& b)
+{
+	glm::vec3 offset = b.center - a.center;
+	float distance = glm::length(offset);
+
+	if (distance + b.radius <= a.radius) return a;
+	if (distance + a.radius <= b.radius) return b;
+
+	float radius = (distance + a.radius + b.radius) * 0.5f;
+	return { a.center + offset * ((radius - a.radius) / distance), radius };
+}
+
+inline BoundingSphere sphereFromAABB(const AABB& box)
+{
+	return { (box.min + box.max) * 0.5f, glm::length(box.max - box.min) * 0.5f };
+}
+
+// Largest scale of the upper 3x3, turns local radii and distances into world ones
+inline float maxAxisScale(const glm::mat4& m)
+{
+	return glm::sqrt(glm::max(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+		glm::max(glm::dot(glm::vec3(m[1]), glm::vec3(m[1])), glm::dot(glm::vec3(m[2]), glm::vec3(m[2])))));
+}
+
+inline glm::vec3 loadPosition(const unsigned char* data, size_t i, size_t stride)
+{
+	glm::vec3 p;
+	std::memcpy(&p, data + i * stride, sizeof(p));
+	return p;
+}
+
+inline float surfaceArea(const AABB& box)
+{
+	glm::vec3 d = box.max - box.min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+/*
+*	Slab test, entry distance of the ray in [0, maxDistance] or -1. The SSE
+*	path does the three slabs at once, the fourth lane holds the [0,
+*	maxDistance] range so the same reductions clamp the result.
+*/
+inline float intersectRayAABB(const AABB& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+{
+#ifdef SIMD_SSE
+	__m128 o = _mm_setr_ps(origin.x, origin.y, origin.z, 0.0f), inverse = _mm_setr_ps(inverseDirection.x, inverseDirection.y, inverseDirection.z, 1.0f);
+	__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(box.min.x, box.min.y, box.min.z, 0.0f), o), inverse);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_setr_ps(box.max.x, box.max.y, box.max.z, maxDistance), o), inverse);
+	__m128 tNear = _mm_min_ps(t0, t1), tFar = _mm_max_ps(t0, t1);
+	tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(2, 1, 0, 3)));
+	tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(1, 0, 3, 2)));
+	tFar = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(2, 1, 0, 3)));
+	tFar = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(1, 0, 3, 2)));
+	float enter = _mm_cvtss_f32(tNear), exit = _mm_cvtss_f32(tFar);
+	return enter <= exit ? enter : -1.0f;
+#else
+	glm::vec3 t0 = (box.min - origin) * inverseDirection, t1 = (box.max - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return enter <= exit ? enter : -1.0f;
+#endif
+}
+
+// Huge instead of infinite for axis parallel rays, 0 * inf would give NaNs in the slab test
+inline glm::vec3 inverseRayDirection(const glm::vec3& direction)
+{
+	glm::vec3 inverse;
+	for (int axis = 0; axis < 3; axis++) inverse[axis] = std::fabs(direction[axis]) > 1e-20f ? 1.0f / direction[axis] : std::copysign(1e30f, direction[axis]);
+	return inverse;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+/*
+*	Tight AABB of count positions placed every stride bytes (stride >= 12).
+*	The SSE path loads 4 floats per position, so the last one is read on its own
+*	to never touch memory past the array.
+*/
+inline AABB computeAABB(const void* positions, size_t count, size_t stride)
+{
+	AABB box = emptyAABB();
+	if (count == 0) return box;
+
+	const unsigned char* data = (const unsigned char*)positions;
+	size_t i = 0;
+
+#ifdef SIMD_SSE
+	// Two accumulator pairs so consecutive min/max don't wait on each other
+	__m128 min0 = _mm_set1_ps(FLT_MAX), max0 = _mm_set1_ps(-FLT_MAX);
+	__m128 min1 = min0, max1 = max0;
+
+	for (; i + 2 < count; i += 2)
+	{
+		__m128 p0 = _mm_loadu_ps((const float*)(data + i * stride));
+		__m128 p1 = _mm_loadu_ps((const float*)(data + (i + 1) * stride));
+		min0 = _mm_min_ps(min0, p0); max0 = _mm_max_ps(max0, p0);
+		min1 = _mm_min_ps(min1, p1); max1 = _mm_max_ps(max1, p1);
+	}
+
+	float minOut[4], maxOut[4];
+	_mm_storeu_ps(minOut, _mm_min_ps(min0, min1));
+	_mm_storeu_ps(maxOut, _mm_max_ps(max0, max1));
+	box.min = glm::vec3(minOut[0], minOut[1], minOut[2]);
+	box.max = glm::vec3(maxOut[0], maxOut[1], maxOut[2]);
+#endif
+
+	for (; i < count; i++)
+	{
+		glm::vec3 p = loadPosition(data, i, stride);
+		box.min = glm::min(box.min, p);
+		box.max = glm::max(box.max, p);
+	}
+
+	return box;
+}
+
+inline AABB computeAABB(const std::vector<Vertex>& vertices)
+{
+	return computeAABB(vertices.data(), vertices.size(), sizeof(Vertex));
+}
+
+// Largest squared distance from center to the positions
+inline float maxDistanceSquared(const void* positions, size_t count, size_t stride, const glm::vec3& center)
+{
+	const unsigned char* data = (const unsigned char*)positions;
+	float result = 0.0f;
+	size_t i = 0;
+
+#ifdef SIMD_SSE
+	__m128 c = _mm_setr_ps(center.x, center.y, center.z, 0.0f);
+	__m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 best = _mm_setzero_ps();
+
+	for (; i + 1 < count; i++)
+	{
+		__m128 d = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps((const float*)(data + i * stride)), c), mask);
+		d = _mm_mul_ps(d, d);
+
+		// Horizontal x + y + z
+		__m128 sum = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+		sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+		best = _mm_max_ps(best, sum);
+	}
+	result = _mm_cvtss_f32(best);
+#endif
+
+	for (; i < count; i++)
+	{
+		glm::vec3 d = loadPosition(data, i, stride) - center;
+		result = glm::max(result, glm::dot(d, d));
+	}
+
+	return result;
+}
+
+/*
+*	Bounding sphere of the positions: Ritter's sphere grown from the most distant
+*	pair of axis extremes, compared with the sphere centered on the AABB. The
+*	smaller one is kept.
+*/
+inline BoundingSphere computeBoundingSphere(const void* positions, size_t count, size_t stride)
+{
+	if (count == 0) return { glm::vec3(0.0f), 0.0f };
+
+	const unsigned char* data = (const unsigned char*)positions;
+
+	// Extreme points along each axis
+	size_t minIndex[3] = { 0, 0, 0 }, maxIndex[3] = { 0, 0, 0 };
+	glm::vec3 minPos = loadPosition(data, 0, stride), maxPos = minPos;
+	for (size_t i = 1; i < count; i++)
+	{
+		glm::vec3 p = loadPosition(data, i, stride);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (p[axis] < minPos[axis]) { minPos[axis] = p[axis]; minIndex[axis] = i; }
+			if (p[axis] > maxPos[axis]) { maxPos[axis] = p[axis]; maxIndex[axis] = i; }
+		}
+	}
+
+	int widest = 0;
+	float widestDistance = -1.0f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		glm::vec3 d = loadPosition(data, maxIndex[axis], stride) - loadPosition(data, minIndex[axis], stride);
+		if (glm::dot(d, d) > widestDistance) { widestDistance = glm::dot(d, d); widest = axis; }
+	}
+
+	glm::vec3 a = loadPosition(data, minIndex[widest], stride), b = loadPosition(data, maxIndex[widest], stride);
+	BoundingSphere ritter = { (a + b) * 0.5f, glm::length(b - a) * 0.5f };
+
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 d = loadPosition(data, i, stride) - ritter.center;
+		float distanceSquared = glm::dot(d, d);
+		if (distanceSquared <= ritter.radius * ritter.radius) continue;
+
+		float distance = std::sqrt(distanceSquared);
+		float radius = (ritter.radius + distance) * 0.5f;
+		ritter.center += d * ((radius - ritter.radius) / distance);
+		ritter.radius = radius;
+	}
+
+	glm::vec3 boxCenter = (minPos + maxPos) * 0.5f;
+	BoundingSphere boxSphere = { boxCenter, std::sqrt(maxDistanceSquared(positions, count, stride, boxCenter)) };
+
+	return boxSphere.radius < ritter.radius ? boxSphere : ritter;
+}
+
+inline BoundingSphere computeBoundingSphere(const std::vector<Vertex>& vertices)
+{
+	return computeBoundingSphere(vertices.data(), vertices.size(), sizeof(Vertex));
+}
+
+// World space AABB enclosing the transformed box (center / absolute extent form)
+inline AABB transformAABB(const AABB& box, const glm::mat4& m)
+{
+	if (isEmpty(box)) return box;
+
+	glm::vec3 center = (box.min + box.max) * 0.5f, extent = (box.max - box.min) * 0.5f;
+	glm::vec3 worldCenter = glm::vec3(m * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent = glm::abs(glm::vec3(m[0])) * extent.x + glm::abs(glm::vec3(m[1])) * extent.y + glm::abs(glm::vec3(m[2])) * extent.z;
+
+	return { worldCenter - worldExtent, worldCenter + worldExtent };
+}
+
+// Same box placed with count model matrices, out receives one world AABB per matrix
+inline void transformAABBs(const AABB& box, const glm::mat4* models, size_t count, AABB* out)
+{
+	if (isEmpty(box))
+	{
+		for (size_t i = 0; i < count; i++) out[i] = box;
+		return;
+	}
+
+	size_t i = 0;
+
+#ifdef SIMD_SSE
+	glm::vec3 center = (box.min + box.max) * 0.5f, extent = (box.max - box.min) * 0.5f;
+	__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	__m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	for (; i < count; i++)
+	{
+		const float* m = &models[i][0][0];
+		__m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+
+		__m128 worldCenter = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, c0), _mm_mul_ps(cy, c1)), _mm_add_ps(_mm_mul_ps(cz, c2), c3));
+		__m128 worldExtent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_and_ps(c0, absMask)), _mm_mul_ps(ey, _mm_and_ps(c1, absMask))),
+			_mm_mul_ps(ez, _mm_and_ps(c2, absMask)));
+
+		float minOut[4], maxOut[4];
+		_mm_storeu_ps(minOut, _mm_sub_ps(worldCenter, worldExtent));
+		_mm_storeu_ps(maxOut, _mm_add_ps(worldCenter, worldExtent));
+		out[i].min = glm::vec3(minOut[0], minOut[1], minOut[2]);
+		out[i].max = glm::vec3(maxOut[0], maxOut[1], maxOut[2]);
+	}
+#endif
+
+	for (; i < count; i++) out[i] = transformAABB(box, models[i]);
+}
+
+inline BoundingSphere transformSphere(const BoundingSphere& sphere, const glm::mat4& m)
+{
+	return { glm::vec3(m * glm::vec4(sphere.center, 1.0f)), sphere.radius * maxAxisScale(m) };
+}
+
+#endif // !BOUNDS_H
@@ -0,0 +1,160 @@
+/*
+*	DYNAMIC_RING_BUFFER.HPP
+*
+*	Persistently mapped buffer for data rewritten every frame (per instance
+*	transforms, indirect commands, debug lines, particles, UI...).
+*
+*	The buffer is created once with glBufferStorage and mapped with
+*	GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT, then split in frameCount
+*	regions. Each frame writes to its own region:
+*	- beginFrame() moves to the next region, waiting on its fence only if the
+*	  GPU is still reading it from frameCount frames ago
+*	- allocate() hands out aligned sub-allocations with a CPU pointer to write
+*	  to and the offset to bind or draw from
+*	- endFrame() fences the region once every command using it was issued
+*
+*	Allocations are bump allocated and only live until the region comes back.
+*	Frames that allocate nothing still call beginFrame() and endFrame(), so
+*	a region always comes back frameCount frames after it was fenced.
+*/
+
+#ifndef DYNAMIC_RING_BUFFER_H
+#define DYNAMIC_RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#define RING_BUFFER_FRAMES 3
+
+// One second, waiting longer than that means the GPU is lost anyway
+#define RING_BUFFER_WAIT_TIMEOUT 1000000000ull
+
+struct RingAllocation
+{
+	void* data;			// Write pointer, null if the allocation failed
+	GLintptr offset;	// Offset inside the buffer
+	GLsizeiptr size;
+};
+
+class DynamicRingBuffer
+{
+public:
+
+	DynamicRingBuffer(GLsizeiptr frameSize, int frameCount = RING_BUFFER_FRAMES)
+	{
+		GLint uniformAlignment = 256, storageAlignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+
+		// Any allocation can be bound as an UBO or SSBO range
+		this->alignment = std::max(std::max(uniformAlignment, storageAlignment), 16);
+		this->frameCount = std::max(frameCount, 1);
+		this->regionSize = alignUp(std::max<GLsizeiptr>(frameSize, 1), this->alignment);
+		this->frameIndex = this->frameCount - 1;
+		this->head = 0;
+		this->stallCount = 0;
+		this->lastStallMilliseconds = 0.0;
+		this->fences.assign(this->frameCount, (GLsync)0);
+
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, &this->ID);
+		glNamedBufferStorage(this->ID, this->regionSize * this->frameCount, nullptr, flags);
+		this->mapped = (unsigned char*)glMapNamedBufferRange(this->ID, 0, this->regionSize * this->frameCount, flags);
+
+		if (!this->mapped) std::cout << "ERROR::RING_BUFFER::MAPPING_FAILED" << '\n';
+	}
+
+	~DynamicRingBuffer()
+	{
+		for (GLsync fence : this->fences) if (fence) glDeleteSync(fence);
+		if (this->mapped) glUnmapNamedBuffer(this->ID);
+		glDeleteBuffers(1, &this->ID);
+	}
+
+	DynamicRingBuffer(const DynamicRingBuffer&) = delete;
+	DynamicRingBuffer& operator=(const DynamicRingBuffer&) = delete;
+
+	// Move to the next region, only blocks if the GPU hasn't finished with it yet
+	void beginFrame()
+	{
+		this->frameIndex = (this->frameIndex + 1) % this->frameCount;
+		this->head = 0;
+		this->lastStallMilliseconds = 0.0;
+
+		GLsync& fence = this->fences[this->frameIndex];
+		if (!fence) return;
+
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			this->stallCount++;
+
+			do status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, RING_BUFFER_WAIT_TIMEOUT);
+			while (status == GL_TIMEOUT_EXPIRED);
+
+			this->lastStallMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	// Call once every draw reading from this frame's region has been issued
+	void endFrame()
+	{
+		GLsync& fence = this->fences[this->frameIndex];
+		if (fence) glDeleteSync(fence);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// Aligned sub-allocation inside the current region, alignment 0 uses the buffer one
+	RingAllocation allocate(GLsizeiptr size, GLsizeiptr alignment = 0)
+	{
+		GLsizeiptr start = alignUp(this->head, alignment > 0 ? alignment : this->alignment);
+
+		if (!this->mapped || start + size > this->regionSize)
+		{
+			std::cout << "ERROR::RING_BUFFER::OUT_OF_SPACE" << '\n';
+			return { nullptr, 0, 0 };
+		}
+
+		this->head = start + size;
+
+		GLintptr offset = this->frameIndex * this->regionSize + start;
+		return { this->mapped + offset, offset, size };
+	}
+
+	inline GLuint getID() const { return this->ID; }
+	inline GLsizeiptr getRegionSize() const { return this->regionSize; }
+	inline GLsizeiptr getUsed() const { return this->head; }
+	inline GLsizeiptr getAlignment() const { return this->alignment; }
+	inline int getFrameIndex() const { return this->frameIndex; }
+	inline size_t getStallCount() const { return this->stallCount; }
+	inline double getLastStallMilliseconds() const { return this->lastStallMilliseconds; }
+
+private:
+
+	GLuint ID;
+	unsigned char* mapped;
+	GLsizeiptr alignment;
+	GLsizeiptr regionSize;
+	GLsizeiptr head;
+	int frameCount;
+	int frameIndex;
+	std::vector<GLsync> fences;
+
+	size_t stallCount;
+	double lastStallMilliseconds;
+
+	static GLsizeiptr alignUp(GLsizeiptr value, GLsizeiptr alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+};
+
+#endif // !DYNAMIC_RING_BUFFER_H
@@ -9,6 +9,15 @@
 *
 *   Input processing functions to be called in their 
 *   respective callback mangers
+*
+*   The camera also owns the projection (FOV, viewport aspect ratio and
+*   clip planes). View, projection, view-projection, its inverse and the
+*   frustum planes are cached and only recomputed when the position,
+*   orientation, FOV or viewport changed since they were last read.
+*   Every change bumps getGeneration(), so per frame work that only
+*   depends on the camera (uniforms, culling of static objects) can be
+*   skipped while it stays the same. unproject() goes back from the
+*   screen to the world through the cached inverse, e.g. for picking rays.
 */
 
 #ifndef BASE_CAMERA_H
@@ -20,6 +29,10 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <CULLING/frustum.hpp>
+
+#include <cstdint>
+
 
 #pragma region DEFAULT_CAMERA
 enum cameraDirection {
@@ -43,6 +56,11 @@ const glm::vec3 dPOSITION = glm::vec3(0.0f, 0.0f, 0.0f);
 #define dSPEED 2.5f
 #define dSENSITIVITY 0.1f
 #define dZOOM 45.0f
+
+// Default projection
+#define dASPECT (16.0f / 9.0f)
+#define dNEAR 0.1f
+#define dFAR 100.0f
 #pragma endregion "Camera movement options"
 
 class BaseCamera
@@ -61,6 +79,33 @@ protected:
     float camSpeed;         // Camera options
     float mouseDPI;
     float maxPitch = 80.0f; 
+    float fov;              // Projection, vertical FOV in degrees
+    float aspectRatio;
+    float nearPlane;
+    float farPlane;
+    int viewportHeight;     // Pixels, 0 until setViewport()
+
+    glm::mat4 view;              // Cached matrices and planes
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::mat4 inverseViewProjection;
+    Frustum frustum;
+    bool viewDirty;
+    bool projectionDirty;
+    bool combinedDirty;     // View-projection, inverse and frustum
+    uint64_t generation;
+
+    inline void markViewDirty() { this->viewDirty = this->combinedDirty = true; this->generation++; }
+    inline void markProjectionDirty() { this->projectionDirty = this->combinedDirty = true; this->generation++; }
+
+    void updateCombined()
+    {
+        if (!this->combinedDirty) return;
+        this->viewProjection = getProjectionMatrix() * getViewMatrix();
+        this->inverseViewProjection = glm::inverse(this->viewProjection);
+        this->frustum = extractFrustum(this->viewProjection);
+        this->combinedDirty = false;
+    }
     
     // Recalculate the camera direction vectors
     // when any Euler angle is updated
@@ -76,6 +121,7 @@ protected:
         this->front = glm::normalize(newFront);
         this->right = glm::normalize(glm::cross(this->front, this->worldUp)); // Re-calc horizontal vector
         this->up = glm::normalize(glm::cross(this->right, this->front));      // Re-calc up vector
+        markViewDirty();
     }
 
 public:
@@ -94,14 +140,50 @@ public:
 
         this->firstMouseInput = true;
 
+        this->fov = dZOOM;
+        this->aspectRatio = dASPECT;
+        this->nearPlane = dNEAR;
+        this->farPlane = dFAR;
+        this->viewportHeight = 0;
+        this->generation = 0;
+        markProjectionDirty();
+
         updateCameraVectors();
     }
 
     void resetMouseInput() {this->firstMouseInput = true;}
 
+    // World position of a point in normalized device coordinates, z is -1 on the near plane and 1 on the far one
+    glm::vec3 unproject(const glm::vec3& ndc)
+    {
+        glm::vec4 p = getInverseViewProjectionMatrix() * glm::vec4(ndc, 1.0f);
+        return glm::vec3(p) / p.w;
+    }
+
     #pragma region GETTERS
-    //inline glm::mat4 getViewMatrix() { return glm::lookAt(this->position, (this->position + this->front), this->up); }
-    inline glm::mat4 getViewMatrix() { return glm::lookAt(this->position, (this->position + this->front), this->up); }
+    inline const glm::mat4& getViewMatrix()
+    {
+        if (this->viewDirty) { this->view = glm::lookAt(this->position, (this->position + this->front), this->up); this->viewDirty = false; }
+        return this->view;
+    }
+    inline const glm::mat4& getProjectionMatrix()
+    {
+        if (this->projectionDirty)
+        {
+            this->projection = glm::perspective(glm::radians(this->fov), this->aspectRatio, this->nearPlane, this->farPlane);
+            this->projectionDirty = false;
+        }
+        return this->projection;
+    }
+    inline const glm::mat4& getViewProjectionMatrix() { updateCombined(); return this->viewProjection; }
+    inline const glm::mat4& getInverseViewProjectionMatrix() { updateCombined(); return this->inverseViewProjection; }
+    inline const Frustum& getFrustum() { updateCombined(); return this->frustum; }
+    inline uint64_t getGeneration() { return this->generation; }
+    inline float getFOV() { return this->fov; }
+    inline float getAspectRatio() { return this->aspectRatio; }
+    inline float getNearPlane() { return this->nearPlane; }
+    inline float getFarPlane() { return this->farPlane; }
+    inline int getViewportHeight() { return this->viewportHeight; }
     inline glm::vec3 getPosition() { return this->position; }
     inline float getYaw() { return this->yaw; }
     inline float getPitch() { return this->pitch; }
@@ -110,28 +192,47 @@ public:
     inline float getMouseDPI() { return this->mouseDPI; }
     #pragma endregion
     #pragma region SETTERS
-    inline void setPosition(glm::vec3 position) { this->position = position; }
-    inline void setPositionX(float x) { this->position.x = x; }
-    inline void setPositionY(float y) { this->position.y = y; }
-    inline void setPositionZ(float z) { this->position.z = z; }
-    inline void setFront(glm::vec3 front) { this->front = front; }
+    inline void setPosition(glm::vec3 position) { if (position != this->position) { this->position = position; markViewDirty(); } }
+    inline void setPositionX(float x) { setPosition(glm::vec3(x, this->position.y, this->position.z)); }
+    inline void setPositionY(float y) { setPosition(glm::vec3(this->position.x, y, this->position.z)); }
+    inline void setPositionZ(float z) { setPosition(glm::vec3(this->position.x, this->position.y, z)); }
+    inline void setFront(glm::vec3 front) { if (front != this->front) { this->front = front; markViewDirty(); } }
     inline void setYaw(float yaw) { this->yaw = yaw; updateCameraVectors(); }
     inline void setPitch(float pitch) { this->pitch = pitch; updateCameraVectors(); }
     inline void setCamSpeed(float camSpeed) { this->camSpeed = camSpeed; }
     inline void setMouseDPI(float mouseDPI) { this->mouseDPI = mouseDPI; }
+    inline void setFOV(float fov) { if (fov != this->fov) { this->fov = fov; markProjectionDirty(); } }
+    inline void setAspectRatio(float aspectRatio) { if (aspectRatio != this->aspectRatio) { this->aspectRatio = aspectRatio; markProjectionDirty(); } }
+    // Framebuffer size in pixels, a minimized window (zero size) keeps the last aspect ratio
+    inline void setViewport(int width, int height)
+    {
+        if (width <= 0 || height <= 0) return;
+        this->viewportHeight = height;
+        setAspectRatio((float)width / (float)height);
+    }
+    inline void setClipPlanes(float nearPlane, float farPlane)
+    {
+        if (nearPlane == this->nearPlane && farPlane == this->farPlane) return;
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+        markProjectionDirty();
+    }
     #pragma endregion
 
     #pragma region INPUT_PROCESSING
     void processKeyboard(cameraDirection direction, float deltaTime)
     {
         float camSpeed = this->camSpeed * deltaTime;
+        glm::vec3 position = this->position;
+
+        if (direction == FORWARD) position += this->front * camSpeed;
+        if (direction == BACKWARD) position -= this->front * camSpeed;
+        if (direction == LEFT) position -= this->right * camSpeed;
+        if (direction == RIGHT) position += this->right * camSpeed;
+        if (direction == UP) position.y += this->up.y * camSpeed;
+        if (direction == DOWN) position.y -= this->up.y * camSpeed;
 
-        if (direction == FORWARD)this->position += this->front * camSpeed;
-        if (direction == BACKWARD) this->position -= this->front * camSpeed;
-        if (direction == LEFT) this->position -= this->right * camSpeed;
-        if (direction == RIGHT) this->position += this->right * camSpeed;
-        if (direction == UP) this->position.y += this->up.y * camSpeed;
-        if (direction == DOWN) this->position.y -= this->up.y * camSpeed;
+        setPosition(position);
     }
 
     void processMouseMovement(float xPos, float yPos, bool lockPitch = true)
@@ -152,6 +253,7 @@ public:
         xOffset *= this->mouseDPI;
         yOffset *= this->mouseDPI;
 
+        float yaw = this->yaw, pitch = this->pitch;
         this->yaw += xOffset;
         this->pitch += yOffset;
 
@@ -162,7 +264,8 @@ public:
             if (this->pitch < -maxPitch) this->pitch = -maxPitch;
         }
 
-        updateCameraVectors();
+        // Pressed against the pitch limit or no movement, the cached matrices stay valid
+        if (this->yaw != yaw || this->pitch != pitch) updateCameraVectors();
     }
 
     void processMouseScroll(float yOffset)
@@ -0,0 +1,261 @@
+/*
+*	CULLING_BENCHMARK.HPP
+*
+*	Times the frustum culling kernels of CULLING/frustum_culling.hpp on a
+*	random field of objects: the scalar reference, the SIMD kernel on one
+*	thread and cullFrustum() over the pool, for both AABBs and spheres.
+*
+*	The objects are boxes of 0.5 to 2 units spread in a cube around a camera
+*	looking down -Z (45 degrees, 16:9, 0.1 to 100), the fixed seed makes runs
+*	comparable. Each timing is the best of runs, and the SIMD lists are
+*	compared with the scalar ones: a mismatch means the kernels disagree
+*	(objects exactly on a plane can legitimately differ when the compiler
+*	fuses the scalar multiply-adds).
+*
+*	benchmarkOcclusionCulling() puts a grid of wall boxes in front of the
+*	same camera as occluders, renders them into an OcclusionBuffer and tests
+*	what survives frustum culling against it. Every object it culls is then
+*	checked against the exact scene: rays from the eye to a grid of points on
+*	the object box, inside the view, must all hit a wall first. Any ray that
+*	gets through is an object the buffer hid although it can be seen.
+*/
+
+#ifndef CULLING_BENCHMARK_H
+#define CULLING_BENCHMARK_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <CULLING/frustum.hpp>
+#include <CULLING/frustum_culling.hpp>
+#include <CULLING/occlusion_culling.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+
+#define CULLING_BENCHMARK_FIELD 150.0f
+#define CULLING_BENCHMARK_WALLS 8			// Per side of the occluder grid
+#define CULLING_BENCHMARK_RAYS 5			// Per side of the ray grid on each face of a culled object
+
+struct FrustumCullingBenchmarkResult
+{
+	size_t objects;
+	size_t visibleAABBs, visibleSpheres;
+	double scalarAABBMilliseconds, simdAABBMilliseconds, parallelAABBMilliseconds;
+	double scalarSphereMilliseconds, simdSphereMilliseconds, parallelSphereMilliseconds;
+	size_t mismatches;				// Entries of the SIMD and parallel lists differing from the scalar ones
+};
+
+struct OcclusionCullingBenchmarkResult
+{
+	size_t objects;
+	size_t occluders, occluderTriangles;
+	size_t frustumVisible, occlusionVisible;
+	double renderMilliseconds;		// Setup, binning and rasterization of the occluders
+	double testMilliseconds;		// cullOccluded() of the frustum visible objects
+	size_t falselyOccluded;			// Culled objects some ray from the eye reaches past the walls
+	OcclusionStats stats;			// Of the best run
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Culling benchmark utility functions"
+
+inline CullingBounds makeBenchmarkField(size_t objects)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-CULLING_BENCHMARK_FIELD, CULLING_BENCHMARK_FIELD), size(0.25f, 1.0f);
+
+	CullingBounds bounds;
+	bounds.resize(objects);
+	for (size_t i = 0; i < objects; i++)
+	{
+		glm::vec3 center(position(random), position(random), position(random));
+		glm::vec3 extent(size(random), size(random), size(random));
+		bounds.set(i, AABB{ center - extent, center + extent });
+	}
+	return bounds;
+}
+
+inline size_t countMismatches(const std::vector<uint32_t>& reference, const std::vector<uint32_t>& other)
+{
+	size_t mismatches = reference.size() > other.size() ? reference.size() - other.size() : other.size() - reference.size();
+	for (size_t i = 0; i < std::min(reference.size(), other.size()); i++) mismatches += reference[i] != other[i];
+	return mismatches;
+}
+
+// Best of runs, in milliseconds
+template<typename F>
+inline double bestCullingTime(int runs, F&& fn)
+{
+	double best = DBL_MAX;
+	for (int r = 0; r < runs; r++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		fn();
+		best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+/*
+*	Exact reference for the occlusion benchmark, the eye is at the origin. A
+*	ray from it to a point of the box that hits no wall before reaching the
+*	point sees the object. Points outside the view volume are skipped.
+*/
+inline bool visibleToRays(const AABB& box, const std::vector<AABB>& walls, const glm::mat4& viewProjection, int rays = CULLING_BENCHMARK_RAYS)
+{
+	for (int axis = 0; axis < 3; axis++)
+		for (int side = 0; side < 2; side++)
+			for (int i = 0; i < rays; i++)
+				for (int j = 0; j < rays; j++)
+				{
+					int u = (axis + 1) % 3, v = (axis + 2) % 3;
+					glm::vec3 point;
+					point[axis] = side ? box.max[axis] : box.min[axis];
+					point[u] = box.min[u] + (box.max[u] - box.min[u]) * i / (rays - 1);
+					point[v] = box.min[v] + (box.max[v] - box.min[v]) * j / (rays - 1);
+
+					glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+					if (clip.w <= 0.0f || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w || clip.z < -clip.w || clip.z > clip.w) continue;
+
+					// Unnormalized direction, the point is at distance 1
+					glm::vec3 inverse = inverseRayDirection(point);
+					bool blocked = false;
+					for (size_t w = 0; w < walls.size() && !blocked; w++) blocked = intersectRayAABB(walls[w], glm::vec3(0.0f), inverse, 1.0f) >= 0.0f;
+					if (!blocked) return true;
+				}
+	return false;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+inline FrustumCullingBenchmarkResult benchmarkFrustumCulling(size_t objects, int runs = 10, ThreadPool& pool = ThreadPool::shared())
+{
+	FrustumCullingBenchmarkResult result = {};
+	result.objects = objects;
+
+	CullingBounds bounds = makeBenchmarkField(objects);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = extractFrustum(glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) * view);
+
+	std::vector<uint32_t> scalar(objects), simd(objects), parallel;
+	size_t scalarCount = 0, simdCount = 0;
+
+	result.scalarAABBMilliseconds = bestCullingTime(runs, [&]() { scalarCount = cullAABBsScalar(frustum, bounds, 0, objects, scalar.data()); });
+	result.simdAABBMilliseconds = bestCullingTime(runs, [&]() { simdCount = cullAABBs(frustum, bounds, 0, objects, simd.data()); });
+	result.parallelAABBMilliseconds = bestCullingTime(runs, [&]() { cullFrustum(frustum, bounds, culling_aabb, parallel, pool); });
+	scalar.resize(scalarCount);
+	simd.resize(simdCount);
+	result.visibleAABBs = scalarCount;
+	result.mismatches += countMismatches(scalar, simd) + countMismatches(scalar, parallel);
+
+	scalar.resize(objects);
+	simd.resize(objects);
+	result.scalarSphereMilliseconds = bestCullingTime(runs, [&]() { scalarCount = cullSpheresScalar(frustum, bounds, 0, objects, scalar.data()); });
+	result.simdSphereMilliseconds = bestCullingTime(runs, [&]() { simdCount = cullSpheres(frustum, bounds, 0, objects, simd.data()); });
+	result.parallelSphereMilliseconds = bestCullingTime(runs, [&]() { cullFrustum(frustum, bounds, culling_sphere, parallel, pool); });
+	scalar.resize(scalarCount);
+	simd.resize(simdCount);
+	result.visibleSpheres = scalarCount;
+	result.mismatches += countMismatches(scalar, simd) + countMismatches(scalar, parallel);
+
+	return result;
+}
+
+// Best of runs for the occluder rendering and the occludee tests
+inline OcclusionCullingBenchmarkResult benchmarkOcclusionCulling(size_t objects, int runs = 10, ThreadPool& pool = ThreadPool::shared())
+{
+	OcclusionCullingBenchmarkResult result = {};
+	result.objects = objects;
+	result.renderMilliseconds = result.testMilliseconds = DBL_MAX;
+
+	CullingBounds bounds = makeBenchmarkField(objects);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) * view;
+
+	std::vector<uint32_t> frustumVisible;
+	cullFrustum(extractFrustum(viewProjection), bounds, culling_aabb, frustumVisible, pool);
+	result.frustumVisible = frustumVisible.size();
+
+	// Wall boxes with gaps between them, 20 units away
+	std::vector<AABB> walls;
+	for (int y = 0; y < CULLING_BENCHMARK_WALLS; y++)
+		for (int x = 0; x < CULLING_BENCHMARK_WALLS; x++)
+		{
+			glm::vec3 corner(-16.0f + x * 4.0f, -9.0f + y * 2.25f, -21.0f);
+			walls.push_back({ corner, corner + glm::vec3(3.5f, 2.0f, 1.0f) });
+		}
+
+	OcclusionBuffer occlusion;
+	std::vector<uint32_t> visible;
+	for (int r = 0; r < runs; r++)
+	{
+		occlusion.begin(viewProjection);
+		for (const AABB& wall : walls) occlusion.addOccluder(wall, glm::mat4(1.0f));
+		occlusion.render(pool);
+
+		visible = frustumVisible;
+		occlusion.cullOccluded(bounds, visible, pool);
+
+		const OcclusionStats& stats = occlusion.getStats();
+		if (stats.setupMilliseconds + stats.rasterMilliseconds < result.renderMilliseconds) result.stats = stats;
+		result.renderMilliseconds = std::min(result.renderMilliseconds, stats.setupMilliseconds + stats.rasterMilliseconds);
+		result.testMilliseconds = std::min(result.testMilliseconds, stats.testMilliseconds);
+	}
+
+	result.occluders = walls.size();
+	result.occluderTriangles = occlusion.getStats().triangles;
+	result.occlusionVisible = visible.size();
+
+	// Reference check of what the buffer culled
+	std::vector<char> kept(objects, 0);
+	for (uint32_t o : visible) kept[o] = 1;
+	std::vector<uint32_t> culled;
+	for (uint32_t o : frustumVisible) if (!kept[o]) culled.push_back(o);
+
+	std::atomic<size_t> falselyOccluded(0);
+	pool.parallelFor(culled.size(), 256, [&](size_t begin, size_t end)
+	{
+		size_t count = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			uint32_t o = culled[i];
+			glm::vec3 center(bounds.centerX[o], bounds.centerY[o], bounds.centerZ[o]), extent(bounds.extentX[o], bounds.extentY[o], bounds.extentZ[o]);
+			count += visibleToRays({ center - extent, center + extent }, walls, viewProjection);
+		}
+		falselyOccluded += count;
+	});
+	result.falselyOccluded = falselyOccluded;
+	return result;
+}
+
+inline void printFrustumCullingBenchmark(const FrustumCullingBenchmarkResult& result)
+{
+	std::cout << "Frustum culling benchmark: " << result.objects << " objects, " << result.visibleAABBs << " visible boxes, "
+		<< result.visibleSpheres << " visible spheres" << '\n';
+	std::cout << "  AABB:   scalar " << result.scalarAABBMilliseconds << " ms, SIMD " << result.simdAABBMilliseconds << " ms, parallel "
+		<< result.parallelAABBMilliseconds << " ms" << '\n';
+	std::cout << "  sphere: scalar " << result.scalarSphereMilliseconds << " ms, SIMD " << result.simdSphereMilliseconds << " ms, parallel "
+		<< result.parallelSphereMilliseconds << " ms" << '\n';
+	if (result.mismatches) std::cout << "  " << result.mismatches << " indices differ from the scalar reference" << '\n';
+}
+
+inline void printOcclusionCullingBenchmark(const OcclusionCullingBenchmarkResult& result)
+{
+	std::cout << "Occlusion culling benchmark: " << result.objects << " objects, " << result.occluders << " occluders ("
+		<< result.occluderTriangles << " triangles, " << result.stats.rasterizedTriangles << " rasterized)" << '\n';
+	std::cout << "  render: " << result.renderMilliseconds << " ms (setup " << result.stats.setupMilliseconds << " ms, raster "
+		<< result.stats.rasterMilliseconds << " ms)" << '\n';
+	std::cout << "  test:   " << result.testMilliseconds << " ms, " << result.frustumVisible << " in the frustum -> "
+		<< result.occlusionVisible << " not occluded" << '\n';
+	if (result.falselyOccluded) std::cout << "  " << result.falselyOccluded << " occluded objects are visible to the ray reference" << '\n';
+}
+
+#endif // !CULLING_BENCHMARK_H
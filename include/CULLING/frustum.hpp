@@ -0,0 +1,95 @@
+/*
+*	FRUSTUM.HPP
+*
+*	View frustum as six world space planes, extracted from a view-projection
+*	matrix (Gribb / Hartmann) for OpenGL's -1..1 clip depth.
+*
+*	Planes are normalized, xyz the normal pointing inside and w the distance,
+*	so dot(plane.xyz, p) + plane.w is the signed distance of p. The tests here
+*	are the scalar reference, CULLING/frustum_culling.hpp runs the same math
+*	over whole arrays.
+*/
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <BOUNDS/bounds.hpp>
+
+enum FrustumPlane
+{
+	frustum_left,
+	frustum_right,
+	frustum_bottom,
+	frustum_top,
+	frustum_near,
+	frustum_far,
+	frustum_plane_count
+};
+
+struct Frustum
+{
+	glm::vec4 planes[frustum_plane_count];
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Frustum utility functions"
+
+inline glm::vec4 normalizePlane(const glm::vec4& plane)
+{
+	float length = glm::length(glm::vec3(plane));
+	return length > 0.0f ? plane / length : plane;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+// Planes of projection * view, in world space (or of projection * view * model, in model space)
+inline Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+	// glm is column major, row r is m[0][r], m[1][r], m[2][r], m[3][r]
+	glm::vec4 rows[4];
+	for (int r = 0; r < 4; r++) rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+	Frustum frustum;
+	frustum.planes[frustum_left] = normalizePlane(rows[3] + rows[0]);
+	frustum.planes[frustum_right] = normalizePlane(rows[3] - rows[0]);
+	frustum.planes[frustum_bottom] = normalizePlane(rows[3] + rows[1]);
+	frustum.planes[frustum_top] = normalizePlane(rows[3] - rows[1]);
+	frustum.planes[frustum_near] = normalizePlane(rows[3] + rows[2]);
+	frustum.planes[frustum_far] = normalizePlane(rows[3] - rows[2]);
+	return frustum;
+}
+
+inline bool intersectsFrustum(const Frustum& frustum, const glm::vec3& center, const glm::vec3& extent)
+{
+	for (int p = 0; p < frustum_plane_count; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+		if (distance + radius < 0.0f) return false;
+	}
+	return true;
+}
+
+// Conservative, a box just outside a frustum corner can still pass
+inline bool intersectsFrustum(const Frustum& frustum, const AABB& box)
+{
+	if (isEmpty(box)) return false;
+	return intersectsFrustum(frustum, (box.min + box.max) * 0.5f, (box.max - box.min) * 0.5f);
+}
+
+inline bool intersectsFrustum(const Frustum& frustum, const BoundingSphere& sphere)
+{
+	for (int p = 0; p < frustum_plane_count; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		float distance = plane.x * sphere.center.x + plane.y * sphere.center.y + plane.z * sphere.center.z + plane.w;
+		if (distance + sphere.radius < 0.0f) return false;
+	}
+	return true;
+}
+
+#endif // !FRUSTUM_H
@@ -0,0 +1,311 @@
+/*
+*	FRUSTUM_CULLING.HPP
+*
+*	Frustum culling of many bounding volumes at once.
+*
+*	CullingBounds keeps the volumes as SoA float arrays (centers, AABB half
+*	extents, sphere radii), so a kernel loads 4 (SSE) or 8 (AVX2) objects per
+*	register and tests them against the six broadcast planes without any
+*	shuffles. Every entry holds both forms: an AABB gets the sphere around it,
+*	a sphere the cube around it, so either test can run on any entry.
+*
+*	The kernels write the indices of the visible objects into a compacted
+*	list without branching on the result: each lane stores its index at the
+*	current end of the list and only advances it when visible. The scalar
+*	kernels are the reference, they give the same lists.
+*
+*	cullFrustum() splits the work over a ThreadPool in chunks of
+*	FRUSTUM_CULLING_GRAIN; each chunk compacts in place at its own offset and
+*	the chunks are then moved together, so the list stays in index order.
+*/
+
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <SIMD/simd.hpp>
+#include <BOUNDS/bounds.hpp>
+#include <CULLING/frustum.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+
+#define FRUSTUM_CULLING_GRAIN 16384
+
+enum CullingVolume
+{
+	culling_aabb,
+	culling_sphere
+};
+
+struct CullingBounds
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;	// AABB half sizes
+	std::vector<float> radius;						// Bounding sphere radii
+
+	inline size_t size() const { return this->centerX.size(); }
+
+	void reserve(size_t count)
+	{
+		this->centerX.reserve(count); this->centerY.reserve(count); this->centerZ.reserve(count);
+		this->extentX.reserve(count); this->extentY.reserve(count); this->extentZ.reserve(count);
+		this->radius.reserve(count);
+	}
+
+	void resize(size_t count)
+	{
+		this->centerX.resize(count); this->centerY.resize(count); this->centerZ.resize(count);
+		this->extentX.resize(count); this->extentY.resize(count); this->extentZ.resize(count);
+		this->radius.resize(count);
+	}
+
+	void clear() { resize(0); }
+
+	uint32_t add(const AABB& box)
+	{
+		uint32_t index = (uint32_t)size();
+		resize(index + 1);
+		set(index, box);
+		return index;
+	}
+
+	uint32_t add(const BoundingSphere& sphere)
+	{
+		uint32_t index = (uint32_t)size();
+		resize(index + 1);
+		set(index, sphere);
+		return index;
+	}
+
+	// An empty box can't be seen, it gets a negative radius and extent
+	void set(size_t i, const AABB& box)
+	{
+		glm::vec3 center = (box.min + box.max) * 0.5f, extent = (box.max - box.min) * 0.5f;
+		float boxRadius = glm::length(extent);
+		if (isEmpty(box)) { center = glm::vec3(0.0f); extent = glm::vec3(-FLT_MAX); boxRadius = -FLT_MAX; }
+
+		this->centerX[i] = center.x; this->centerY[i] = center.y; this->centerZ[i] = center.z;
+		this->extentX[i] = extent.x; this->extentY[i] = extent.y; this->extentZ[i] = extent.z;
+		this->radius[i] = boxRadius;
+	}
+
+	void set(size_t i, const BoundingSphere& sphere)
+	{
+		this->centerX[i] = sphere.center.x; this->centerY[i] = sphere.center.y; this->centerZ[i] = sphere.center.z;
+		this->extentX[i] = this->extentY[i] = this->extentZ[i] = sphere.radius;
+		this->radius[i] = sphere.radius;
+	}
+};
+
+/*
+*	Scalar reference kernels. They test objects [begin, end) and write the
+*	visible indices to visible[0...], returning how many. visible needs room
+*	for end - begin indices.
+*/
+inline size_t cullAABBsScalar(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint32_t* visible)
+{
+	size_t count = 0;
+	for (size_t i = begin; i < end; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < frustum_plane_count; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+			float radius = std::fabs(plane.x) * bounds.extentX[i] + std::fabs(plane.y) * bounds.extentY[i] + std::fabs(plane.z) * bounds.extentZ[i];
+			inside &= distance + radius >= 0.0f;
+		}
+		visible[count] = (uint32_t)i;
+		count += inside;
+	}
+	return count;
+}
+
+inline size_t cullSpheresScalar(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint32_t* visible)
+{
+	size_t count = 0;
+	for (size_t i = begin; i < end; i++)
+	{
+		bool inside = true;
+		for (int p = 0; p < frustum_plane_count; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+			inside &= distance + bounds.radius[i] >= 0.0f;
+		}
+		visible[count] = (uint32_t)i;
+		count += inside;
+	}
+	return count;
+}
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Frustum culling utility functions"
+
+// Appends the lanes set in mask, lane k being object first + k
+inline size_t compactVisible(int mask, int lanes, size_t first, uint32_t* visible, size_t count)
+{
+	for (int k = 0; k < lanes; k++)
+	{
+		visible[count] = (uint32_t)(first + k);
+		count += (mask >> k) & 1;
+	}
+	return count;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+/*
+*	SIMD kernels, same contract as the scalar ones. 8 objects per iteration
+*	with AVX2, 4 with SSE, the remainder goes through the scalar loop.
+*/
+inline size_t cullAABBs(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint32_t* visible)
+{
+	size_t count = 0, i = begin;
+
+#if defined(SIMD_AVX2)
+	__m256 nx[frustum_plane_count], ny[frustum_plane_count], nz[frustum_plane_count], nw[frustum_plane_count];
+	__m256 ax[frustum_plane_count], ay[frustum_plane_count], az[frustum_plane_count];
+	for (int p = 0; p < frustum_plane_count; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		nx[p] = _mm256_set1_ps(plane.x); ny[p] = _mm256_set1_ps(plane.y); nz[p] = _mm256_set1_ps(plane.z); nw[p] = _mm256_set1_ps(plane.w);
+		ax[p] = _mm256_set1_ps(std::fabs(plane.x)); ay[p] = _mm256_set1_ps(std::fabs(plane.y)); az[p] = _mm256_set1_ps(std::fabs(plane.z));
+	}
+	__m256 zero = _mm256_setzero_ps();
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&bounds.centerX[i]), cy = _mm256_loadu_ps(&bounds.centerY[i]), cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&bounds.extentX[i]), ey = _mm256_loadu_ps(&bounds.extentY[i]), ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < frustum_plane_count; p++)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)), _mm256_mul_ps(nz[p], cz)), nw[p]);
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)), _mm256_mul_ps(az[p], ez));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+		}
+		count = compactVisible(_mm256_movemask_ps(inside), 8, i, visible, count);
+	}
+#elif defined(SIMD_SSE)
+	__m128 nx[frustum_plane_count], ny[frustum_plane_count], nz[frustum_plane_count], nw[frustum_plane_count];
+	__m128 ax[frustum_plane_count], ay[frustum_plane_count], az[frustum_plane_count];
+	for (int p = 0; p < frustum_plane_count; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		nx[p] = _mm_set1_ps(plane.x); ny[p] = _mm_set1_ps(plane.y); nz[p] = _mm_set1_ps(plane.z); nw[p] = _mm_set1_ps(plane.w);
+		ax[p] = _mm_set1_ps(std::fabs(plane.x)); ay[p] = _mm_set1_ps(std::fabs(plane.y)); az[p] = _mm_set1_ps(std::fabs(plane.z));
+	}
+	__m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&bounds.centerX[i]), cy = _mm_loadu_ps(&bounds.centerY[i]), cz = _mm_loadu_ps(&bounds.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&bounds.extentX[i]), ey = _mm_loadu_ps(&bounds.extentY[i]), ez = _mm_loadu_ps(&bounds.extentZ[i]);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < frustum_plane_count; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)), _mm_mul_ps(nz[p], cz)), nw[p]);
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+		}
+		count = compactVisible(_mm_movemask_ps(inside), 4, i, visible, count);
+	}
+#endif
+
+	return count + cullAABBsScalar(frustum, bounds, i, end, visible + count);
+}
+
+inline size_t cullSpheres(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint32_t* visible)
+{
+	size_t count = 0, i = begin;
+
+#if defined(SIMD_AVX2)
+	__m256 nx[frustum_plane_count], ny[frustum_plane_count], nz[frustum_plane_count], nw[frustum_plane_count];
+	for (int p = 0; p < frustum_plane_count; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		nx[p] = _mm256_set1_ps(plane.x); ny[p] = _mm256_set1_ps(plane.y); nz[p] = _mm256_set1_ps(plane.z); nw[p] = _mm256_set1_ps(plane.w);
+	}
+	__m256 zero = _mm256_setzero_ps();
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&bounds.centerX[i]), cy = _mm256_loadu_ps(&bounds.centerY[i]), cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+		__m256 r = _mm256_loadu_ps(&bounds.radius[i]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < frustum_plane_count; p++)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)), _mm256_mul_ps(nz[p], cz)), nw[p]);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, r), zero, _CMP_GE_OQ));
+		}
+		count = compactVisible(_mm256_movemask_ps(inside), 8, i, visible, count);
+	}
+#elif defined(SIMD_SSE)
+	__m128 nx[frustum_plane_count], ny[frustum_plane_count], nz[frustum_plane_count], nw[frustum_plane_count];
+	for (int p = 0; p < frustum_plane_count; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		nx[p] = _mm_set1_ps(plane.x); ny[p] = _mm_set1_ps(plane.y); nz[p] = _mm_set1_ps(plane.z); nw[p] = _mm_set1_ps(plane.w);
+	}
+	__m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&bounds.centerX[i]), cy = _mm_loadu_ps(&bounds.centerY[i]), cz = _mm_loadu_ps(&bounds.centerZ[i]);
+		__m128 r = _mm_loadu_ps(&bounds.radius[i]);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < frustum_plane_count; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)), _mm_mul_ps(nz[p], cz)), nw[p]);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, r), zero));
+		}
+		count = compactVisible(_mm_movemask_ps(inside), 4, i, visible, count);
+	}
+#endif
+
+	return count + cullSpheresScalar(frustum, bounds, i, end, visible + count);
+}
+
+// Indices of every visible object of bounds, in order, replacing the contents of visible
+inline void cullFrustum(const Frustum& frustum, const CullingBounds& bounds, CullingVolume volume, std::vector<uint32_t>& visible,
+	ThreadPool& pool = ThreadPool::shared())
+{
+	size_t count = bounds.size();
+	size_t chunkCount = (count + FRUSTUM_CULLING_GRAIN - 1) / FRUSTUM_CULLING_GRAIN;
+	std::vector<size_t> chunkVisible(chunkCount, 0);
+	visible.resize(count);
+
+	// Chunk c compacts into visible[c * grain...], a chunk never writes past its own range
+	pool.parallelFor(count, FRUSTUM_CULLING_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t first = begin; first < end; first += FRUSTUM_CULLING_GRAIN)
+		{
+			size_t last = std::min(first + FRUSTUM_CULLING_GRAIN, end);
+			chunkVisible[first / FRUSTUM_CULLING_GRAIN] = volume == culling_aabb ? cullAABBs(frustum, bounds, first, last, visible.data() + first)
+				: cullSpheres(frustum, bounds, first, last, visible.data() + first);
+		}
+	});
+
+	size_t total = 0;
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		if (total != c * FRUSTUM_CULLING_GRAIN) std::memmove(visible.data() + total, visible.data() + c * FRUSTUM_CULLING_GRAIN, chunkVisible[c] * sizeof(uint32_t));
+		total += chunkVisible[c];
+	}
+	visible.resize(total);
+}
+
+#endif // !FRUSTUM_CULLING_H
@@ -0,0 +1,156 @@
+/*
+*	MODEL_OCCLUDERS.HPP
+*
+*	Occluder proxies built from a Model for the software occlusion buffer
+*	(CULLING/occlusion_culling.hpp).
+*
+*	An occluder must lie inside the object it stands for, otherwise it can
+*	hide what the object itself leaves visible. Simplified LODs don't give
+*	that guarantee, so innerOccluderBox() builds a dedicated proxy: the
+*	largest box of the shape of the model bounds, scaled around their center,
+*	that no triangle crosses. When the center is enclosed by the surface (rays
+*	along the six axes all hit it) that box is inside the model.
+*
+*	It runs once at load time on the model space LOD0 triangles, the scale is
+*	found by bisection with a separating axis box/triangle test.
+*
+*	addOccluder() also adds a Mesh LOD or a whole Model as triangle list
+*	occluders, the coarsest LOD by default. Simplification can move it
+*	outside the surface, so it may hide things that are actually visible.
+*/
+
+#ifndef MODEL_OCCLUDERS_H
+#define MODEL_OCCLUDERS_H
+
+#include <glm/glm.hpp>
+
+#include <BOUNDS/bounds.hpp>
+#include <CULLING/occlusion_culling.hpp>
+#include <MESH/mesh.hpp>
+#include <MESH/triangle_bvh.hpp>
+#include <MODEL/model.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#define OCCLUDER_BOX_ITERATIONS 16		// Bisection steps, the scale is found within 2^-16
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Model occluder utility functions"
+
+// Separating axis test of triangle (a, b, c) against the box center +- half
+inline bool triangleOverlapsBox(const glm::vec3& center, const glm::vec3& half, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	glm::vec3 v[3] = { a - center, b - center, c - center };
+
+	// Box face normals, the triangle bounds against the box
+	glm::vec3 low = glm::min(v[0], glm::min(v[1], v[2])), high = glm::max(v[0], glm::max(v[1], v[2]));
+	if (glm::any(glm::greaterThan(low, half)) || glm::any(glm::lessThan(high, -half))) return false;
+
+	// Triangle plane
+	glm::vec3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+	glm::vec3 normal = glm::cross(edges[0], edges[1]);
+	float distance = glm::dot(normal, v[0]), radius = glm::dot(half, glm::abs(normal));
+	if (std::fabs(distance) > radius) return false;
+
+	// Cross products of the box axes and the triangle edges
+	for (int e = 0; e < 3; e++)
+		for (int axis = 0; axis < 3; axis++)
+		{
+			glm::vec3 unit(0.0f);
+			unit[axis] = 1.0f;
+			glm::vec3 separating = glm::cross(unit, edges[e]);
+
+			float p0 = glm::dot(separating, v[0]), p1 = glm::dot(separating, v[1]), p2 = glm::dot(separating, v[2]);
+			float extent = glm::dot(half, glm::abs(separating));
+			if (std::min(p0, std::min(p1, p2)) > extent || std::max(p0, std::max(p1, p2)) < -extent) return false;
+		}
+	return true;
+}
+
+// LOD0 triangles of every mesh placed by its node, three positions per triangle
+inline void gatherModelTriangles(const Model& model, std::vector<glm::vec3>& triangles)
+{
+	triangles.clear();
+	for (const ModelNode& node : model.nodes)
+		for (GLuint m : node.meshes)
+		{
+			const Mesh& mesh = *model.meshes[m];
+			bool indexed = !mesh.indices.empty() && !mesh.lods.empty();
+			size_t count = indexed ? mesh.lods[0].indexCount : mesh.vertices.size();
+			const GLuint* indices = indexed ? mesh.indices.data() + mesh.lods[0].firstIndex : nullptr;
+
+			for (size_t i = 0; i < count - count % 3; i++)
+				triangles.push_back(glm::vec3(node.globalTransform * glm::vec4(mesh.vertices[indices ? indices[i] : i].position, 1.0f)));
+		}
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+/*
+*	Model space box inside the model, empty when the bounds center isn't
+*	enclosed by the surface or no box of that shape fits.
+*/
+inline AABB innerOccluderBox(const Model& model, int iterations = OCCLUDER_BOX_ITERATIONS)
+{
+	std::vector<glm::vec3> triangles;
+	gatherModelTriangles(model, triangles);
+	if (triangles.empty()) return emptyAABB();
+
+	AABB bounds = computeAABB(triangles.data(), triangles.size(), sizeof(glm::vec3));
+	glm::vec3 center = (bounds.min + bounds.max) * 0.5f, half = (bounds.max - bounds.min) * 0.5f;
+
+	// Open surfaces let some ray out, their inside isn't defined
+	const glm::vec3 directions[6] = { glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1) };
+	for (const glm::vec3& direction : directions)
+	{
+		bool hit = false;
+		for (size_t t = 0; t < triangles.size() && !hit; t += 3)
+		{
+			float u, v;
+			hit = intersectRayTriangle(center, direction, triangles[t], triangles[t + 1] - triangles[t], triangles[t + 2] - triangles[t], FLT_MAX, u, v) >= 0.0f;
+		}
+		if (!hit) return emptyAABB();
+	}
+
+	// Boxes are nested, so the scales where no triangle crosses form one interval from 0
+	float inside = 0.0f, crossing = 1.0f;
+	for (int i = 0; i < iterations; i++)
+	{
+		float scale = 0.5f * (inside + crossing);
+		bool crossed = false;
+		for (size_t t = 0; t < triangles.size() && !crossed; t += 3)
+			crossed = triangleOverlapsBox(center, half * scale, triangles[t], triangles[t + 1], triangles[t + 2]);
+
+		if (crossed) crossing = scale;
+		else inside = scale;
+	}
+
+	if (inside <= 0.0f) return emptyAABB();
+	return { center - half * inside, center + half * inside };
+}
+
+// A LOD of the mesh, the coarsest one by default
+inline void addOccluder(OcclusionBuffer& occlusion, const Mesh& mesh, const glm::mat4& model, int lod = -1, uint32_t owner = OCCLUSION_NO_OWNER)
+{
+	if (mesh.indices.empty() || mesh.lods.empty())
+	{
+		occlusion.addOccluder(mesh.vertices.data(), mesh.vertices.size(), sizeof(Vertex), nullptr, 0, model, owner);
+		return;
+	}
+
+	const MeshLod& level = mesh.lods[lod < 0 ? mesh.lods.size() - 1 : std::min((size_t)lod, mesh.lods.size() - 1)];
+	occlusion.addOccluder(mesh.vertices.data(), mesh.vertices.size(), sizeof(Vertex), mesh.indices.data() + level.firstIndex, level.indexCount, model, owner);
+}
+
+// Every mesh of the model placed by its nodes
+inline void addOccluder(OcclusionBuffer& occlusion, const Model& model, const glm::mat4& transform, int lod = -1, uint32_t owner = OCCLUSION_NO_OWNER)
+{
+	for (const ModelNode& node : model.nodes)
+		for (GLuint mesh : node.meshes) addOccluder(occlusion, *model.meshes[mesh], transform * node.globalTransform, lod, owner);
+}
+
+#endif // !MODEL_OCCLUDERS_H
@@ -0,0 +1,625 @@
+/*
+*	OCCLUSION_CULLING.HPP
+*
+*	CPU software occlusion culling against a small hierarchical depth buffer.
+*
+*	A frame goes:
+*	- begin(viewProjection), then addOccluder() for the few big objects that
+*	  hide others, ideally low poly proxies lying inside the object (boxes,
+*	  see innerOccluderBox(), or any triangle list). Meshes and models are
+*	  added through CULLING/model_occluders.hpp
+*	- render(pool): occluders are transformed and their triangles set up in
+*	  parallel, binned to screen bins of OCCLUSION_BIN_WIDTH x
+*	  OCCLUSION_BIN_HEIGHT pixels, and every bin is rasterized by its own
+*	  thread. The rasterizer evaluates the edge functions and the depth plane
+*	  for 8 (AVX2) or 4 (SSE) pixels of a row at once and keeps the nearest
+*	  depth through the coverage mask. Each bin then reduces its pixels to
+*	  the farthest depth of every OCCLUSION_TILE_WIDTH x OCCLUSION_TILE_HEIGHT
+*	  tile, the level above the pixels.
+*	- isOccluded() / cullOccluded(): the screen rectangle and nearest depth of
+*	  an occludee AABB are tested against the tile level first, only tiles
+*	  whose farthest depth is behind the box go down to the pixels.
+*
+*	An occluder can be tagged with an owner, the index of the object it stands
+*	for. Every pixel remembers the owner of its nearest occluder and the tests
+*	of that object count those pixels as uncovered, so an object is never
+*	hidden by its own proxy.
+*
+*	Everything stays conservative: a box is only reported occluded when every
+*	pixel it can touch is covered by something nearer. Occluders only cover
+*	pixels their outline encloses entirely, with the farthest depth they have
+*	over them (see outlineOcclusionTriangles()), so gaps thinner than a pixel
+*	between occluders stay open. Occluder triangles that cross the near or
+*	far plane, back faces and pixels exactly on an edge are not rasterized,
+*	and boxes crossing the near plane are visible.
+*	Depth is the 0..1 window depth of the GL projection.
+*/
+
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <SIMD/simd.hpp>
+#include <BOUNDS/bounds.hpp>
+#include <CULLING/frustum_culling.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#define OCCLUSION_WIDTH 320
+#define OCCLUSION_HEIGHT 192
+#define OCCLUSION_BIN_WIDTH 64
+#define OCCLUSION_BIN_HEIGHT 32
+#define OCCLUSION_TILE_WIDTH 8
+#define OCCLUSION_TILE_HEIGHT 4
+#define OCCLUSION_TEST_GRAIN 1024
+#define OCCLUSION_NO_OWNER UINT32_MAX
+#define OCCLUSION_MAX_EDGES 9			// Own edges and the outline edges of the triangles around its corners
+
+#if defined(SIMD_AVX2)
+#define OCCLUSION_LANES 8
+#elif defined(SIMD_SSE)
+#define OCCLUSION_LANES 4
+#else
+#define OCCLUSION_LANES 1
+#endif
+
+struct OcclusionStats
+{
+	size_t occluders;
+	size_t triangles;				// Submitted by the occluders
+	size_t rasterizedTriangles;		// Front facing, inside the depth range and on screen
+	size_t binnedTriangles;			// Triangle and bin pairs
+	size_t tested, occluded;		// By the last cullOccluded()
+	double setupMilliseconds;		// Transform, triangle setup and binning
+	double rasterMilliseconds;		// Rasterization and tile depths
+	double testMilliseconds;
+};
+
+// Screen space triangle ready for the rasterizer: edge functions, depth plane and pixel bounds
+struct OcclusionTriangle
+{
+	float edgeA[OCCLUSION_MAX_EDGES], edgeB[OCCLUSION_MAX_EDGES], edgeC[OCCLUSION_MAX_EDGES];	// Inside when a * x + b * y + c > 0 for all of them
+	int edges;							// The first three are its own
+	float depthX, depthY, depthC;		// depth = depthX * x + depthY * y + depthC
+	int minX, minY, maxX, maxY;			// Inclusive pixels, clamped to the buffer
+	uint32_t owner;						// Of its occluder, OCCLUSION_NO_OWNER when untagged
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Occlusion culling utility functions"
+
+// Unit cube proxy for box occluders, corner i has bit 0 set for +x, bit 1 for +y, bit 2 for +z
+const glm::vec3 OCCLUDER_CUBE_CORNERS[8] = {
+	glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, -0.5f, -0.5f), glm::vec3(-0.5f, 0.5f, -0.5f), glm::vec3(0.5f, 0.5f, -0.5f),
+	glm::vec3(-0.5f, -0.5f, 0.5f), glm::vec3(0.5f, -0.5f, 0.5f), glm::vec3(-0.5f, 0.5f, 0.5f), glm::vec3(0.5f, 0.5f, 0.5f)
+};
+
+// Counter clockwise seen from outside: +z, -z, +x, -x, +y, -y
+const GLuint OCCLUDER_CUBE_INDICES[36] = {
+	4, 5, 7, 4, 7, 6,	0, 2, 3, 0, 3, 1,
+	1, 3, 7, 1, 7, 5,	0, 4, 6, 0, 6, 2,
+	2, 6, 7, 2, 7, 3,	0, 1, 5, 0, 5, 4
+};
+
+inline int roundUpTo(int value, int multiple) { return (value + multiple - 1) / multiple * multiple; }
+
+// False when the triangle can't be rasterized: back facing, degenerate, off screen or clipped by a depth plane
+inline bool setupOcclusionTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, int width, int height, OcclusionTriangle& triangle)
+{
+	const glm::vec4* clip[3] = { &c0, &c1, &c2 };
+	glm::vec3 screen[3];
+	for (int v = 0; v < 3; v++)
+	{
+		const glm::vec4& c = *clip[v];
+		if (c.w <= 0.0f || c.z < -c.w || c.z > c.w) return false;
+
+		float inverseW = 1.0f / c.w;
+		screen[v] = glm::vec3((c.x * inverseW * 0.5f + 0.5f) * width, (c.y * inverseW * 0.5f + 0.5f) * height, c.z * inverseW * 0.5f + 0.5f);
+	}
+
+	glm::vec3 e1 = screen[1] - screen[0], e2 = screen[2] - screen[0];
+	float area = e1.x * e2.y - e1.y * e2.x;
+	if (!(area > 0.0f)) return false;
+
+	float minX = std::min(screen[0].x, std::min(screen[1].x, screen[2].x)), maxX = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+	float minY = std::min(screen[0].y, std::min(screen[1].y, screen[2].y)), maxY = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+	if (maxX <= 0.0f || maxY <= 0.0f || minX >= (float)width || minY >= (float)height) return false;
+
+	triangle.minX = std::max((int)std::floor(minX), 0);
+	triangle.minY = std::max((int)std::floor(minY), 0);
+	triangle.maxX = std::min((int)std::ceil(maxX), width - 1);
+	triangle.maxY = std::min((int)std::ceil(maxY), height - 1);
+
+	// Edge v -> v + 1, positive on the inner side of a counter clockwise triangle
+	for (int v = 0; v < 3; v++)
+	{
+		const glm::vec3& p = screen[v];
+		const glm::vec3& q = screen[(v + 1) % 3];
+		triangle.edgeA[v] = p.y - q.y;
+		triangle.edgeB[v] = q.x - p.x;
+		triangle.edgeC[v] = -(triangle.edgeA[v] * p.x + triangle.edgeB[v] * p.y);
+	}
+	triangle.edges = 3;
+
+	triangle.depthX = ((screen[1].z - screen[0].z) * e2.y - (screen[2].z - screen[0].z) * e1.y) / area;
+	triangle.depthY = ((screen[2].z - screen[0].z) * e1.x - (screen[1].z - screen[0].z) * e2.x) / area;
+	// Farthest depth of the plane over the pixel instead of at its center
+	triangle.depthC = screen[0].z - triangle.depthX * screen[0].x - triangle.depthY * screen[0].y + 0.5f * (std::fabs(triangle.depthX) + std::fabs(triangle.depthY));
+	return true;
+}
+
+// Moves edge v half a pixel inwards, a pixel whose center passes it then lies entirely on its inner side
+inline void shrinkOcclusionEdge(OcclusionTriangle& triangle, int v)
+{
+	triangle.edgeC[v] -= 0.5f * (std::fabs(triangle.edgeA[v]) + std::fabs(triangle.edgeB[v]));
+}
+
+// Edges of indexed triangles by vertex pair, the low 32 bits of the pair hold triangle * 3 + edge
+inline uint64_t occlusionEdgeKey(size_t a, size_t b) { return ((uint64_t)std::min(a, b) << 32) | (uint64_t)std::max(a, b); }
+
+/*
+*	Pixel center coverage would fill gaps thinner than a pixel between
+*	occluders, so the outline of an occluder (edges no other of its
+*	rasterized triangles shares) is shrunk to cover only whole pixels.
+*	Shared edges stay as they are, their union covers the pixels across them,
+*	but a pixel could cross a shared edge and leave through the outline of
+*	the neighbour (next to a corner, or across a neighbour thinner than a
+*	pixel): every triangle also tests the outline edges of the triangles
+*	around its corners. One with more than fit is dropped, a box never has.
+*
+*	A pixel over a shared edge takes the depth plane of one triangle only,
+*	each triangle is pushed back by how far the plane of a neighbour can get
+*	behind its own within a pixel of the edge.
+*
+*	edges holds the key and triangle * 3 + edge of every edge, corners the
+*	three vertex indices of every triangle.
+*/
+inline void outlineOcclusionTriangles(std::vector<OcclusionTriangle>& triangles, std::vector<std::pair<uint64_t, uint32_t>>& edges, const std::vector<size_t>& corners)
+{
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<uint8_t> shared(triangles.size() * 3, 0);
+	std::vector<float> crease(triangles.size(), 0.0f);
+	for (size_t e = 0; e + 1 < edges.size(); e++)
+	{
+		if (edges[e].first != edges[e + 1].first) continue;
+		uint32_t t0 = edges[e].second / 3, t1 = edges[e + 1].second / 3;
+		float behind = std::fabs(triangles[t0].depthX - triangles[t1].depthX) + std::fabs(triangles[t0].depthY - triangles[t1].depthY);
+		crease[t0] = std::max(crease[t0], behind);
+		crease[t1] = std::max(crease[t1], behind);
+		shared[edges[e].second] = shared[edges[e + 1].second] = 1;
+	}
+
+	// Triangles by corner
+	std::vector<std::pair<size_t, uint32_t>> fans;
+	for (size_t t = 0; t < triangles.size(); t++)
+	{
+		triangles[t].depthC += crease[t];
+		for (int v = 0; v < 3; v++)
+		{
+			if (!shared[t * 3 + v]) shrinkOcclusionEdge(triangles[t], v);
+			fans.push_back({ corners[t * 3 + v], (uint32_t)t });
+		}
+	}
+	std::sort(fans.begin(), fans.end());
+
+	std::vector<uint8_t> fitting(triangles.size(), 1);
+	for (size_t t = 0; t < triangles.size(); t++)
+	{
+		OcclusionTriangle& triangle = triangles[t];
+		bool fits = true;
+		for (int v = 0; v < 3 && fits; v++)
+		{
+			std::vector<std::pair<size_t, uint32_t>>::const_iterator it = std::lower_bound(fans.begin(), fans.end(), std::make_pair(corners[t * 3 + v], (uint32_t)0));
+			for (; it != fans.end() && it->first == corners[t * 3 + v] && fits; ++it)
+			{
+				const OcclusionTriangle& source = triangles[it->second];
+				for (int edge = 0; edge < 3 && fits; edge++)
+				{
+					if (it->second == t || shared[it->second * 3 + edge]) continue;
+
+					// Neighbours share outline edges and corners, every edge is taken once
+					bool known = false;
+					for (int e = 3; e < triangle.edges && !known; e++)
+						known = triangle.edgeA[e] == source.edgeA[edge] && triangle.edgeB[e] == source.edgeB[edge] && triangle.edgeC[e] == source.edgeC[edge];
+					if (known) continue;
+
+					fits = triangle.edges < OCCLUSION_MAX_EDGES;
+					if (!fits) break;
+					triangle.edgeA[triangle.edges] = source.edgeA[edge];
+					triangle.edgeB[triangle.edges] = source.edgeB[edge];
+					triangle.edgeC[triangle.edges] = source.edgeC[edge];
+					triangle.edges++;
+				}
+			}
+		}
+		fitting[t] = fits;
+	}
+
+	size_t kept = 0;
+	for (size_t t = 0; t < triangles.size(); t++) if (fitting[t]) triangles[kept++] = triangles[t];
+	triangles.resize(kept);
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class OcclusionBuffer
+{
+public:
+
+	// The size is rounded up to whole bins, it only sets the resolution: the buffer always covers the viewport
+	explicit OcclusionBuffer(int width = OCCLUSION_WIDTH, int height = OCCLUSION_HEIGHT)
+	{
+		this->width = roundUpTo(std::max(width, 1), OCCLUSION_BIN_WIDTH);
+		this->height = roundUpTo(std::max(height, 1), OCCLUSION_BIN_HEIGHT);
+		this->binsX = this->width / OCCLUSION_BIN_WIDTH;
+		this->binsY = this->height / OCCLUSION_BIN_HEIGHT;
+		this->tilesX = this->width / OCCLUSION_TILE_WIDTH;
+		this->tilesY = this->height / OCCLUSION_TILE_HEIGHT;
+
+		this->depth.assign((size_t)this->width * this->height, 1.0f);
+		this->owners.assign((size_t)this->width * this->height, OCCLUSION_NO_OWNER);
+		this->tileDepth.assign((size_t)this->tilesX * this->tilesY, 1.0f);
+		this->bins.resize((size_t)this->binsX * this->binsY);
+		this->viewProjection = glm::mat4(1.0f);
+		this->stats = OcclusionStats();
+	}
+
+	// Starts a frame, the occluders of the previous one are dropped
+	void begin(const glm::mat4& viewProjection)
+	{
+		this->viewProjection = viewProjection;
+		this->occluders.clear();
+		this->stats = OcclusionStats();
+	}
+
+	/*
+	*	Triangle list occluder, positions are read every stride bytes and
+	*	indices may be null for consecutive triangles. Nothing is copied, the
+	*	arrays must stay alive until render(). owner is the index of the object
+	*	the occluder belongs to, its own tests ignore it.
+	*/
+	void addOccluder(const void* positions, size_t vertexCount, size_t stride, const GLuint* indices, size_t indexCount, const glm::mat4& model,
+		uint32_t owner = OCCLUSION_NO_OWNER)
+	{
+		if (!positions || vertexCount == 0) return;
+		if (!indices) indexCount = vertexCount;
+		this->occluders.push_back({ (const unsigned char*)positions, vertexCount, stride, indices, indexCount - indexCount % 3, model, owner });
+	}
+
+	// Low poly proxy: the box, in the space of model
+	void addOccluder(const AABB& box, const glm::mat4& model, uint32_t owner = OCCLUSION_NO_OWNER)
+	{
+		if (isEmpty(box)) return;
+		glm::mat4 placement = glm::scale(glm::translate(model, (box.min + box.max) * 0.5f), box.max - box.min);
+		addOccluder(OCCLUDER_CUBE_CORNERS, 8, sizeof(glm::vec3), OCCLUDER_CUBE_INDICES, 36, placement, owner);
+	}
+
+	// Rasterizes the occluders added since begin()
+	void render(ThreadPool& pool = ThreadPool::shared())
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		this->stats.occluders = this->occluders.size();
+
+		// Transform and triangle setup, one occluder per job
+		this->triangles.resize(this->occluders.size());
+		pool.parallelFor(this->occluders.size(), 1, [&](size_t begin, size_t end)
+		{
+			std::vector<glm::vec4> clip;
+			std::vector<std::pair<uint64_t, uint32_t>> edges;
+			std::vector<size_t> corners;
+			for (size_t o = begin; o < end; o++)
+			{
+				const Occluder& occluder = this->occluders[o];
+				glm::mat4 m = this->viewProjection * occluder.model;
+
+				clip.resize(occluder.vertexCount);
+				for (size_t v = 0; v < occluder.vertexCount; v++) clip[v] = m * glm::vec4(loadPosition(occluder.positions, v, occluder.stride), 1.0f);
+
+				std::vector<OcclusionTriangle>& out = this->triangles[o];
+				out.clear();
+				edges.clear();
+				corners.clear();
+				OcclusionTriangle triangle;
+				for (size_t i = 0; i + 2 < occluder.indexCount; i += 3)
+				{
+					size_t c[3] = { occluder.indices ? occluder.indices[i] : i, occluder.indices ? occluder.indices[i + 1] : i + 1,
+						occluder.indices ? occluder.indices[i + 2] : i + 2 };
+					if (c[0] >= clip.size() || c[1] >= clip.size() || c[2] >= clip.size()) continue;
+					if (!setupOcclusionTriangle(clip[c[0]], clip[c[1]], clip[c[2]], this->width, this->height, triangle)) continue;
+					triangle.owner = occluder.owner;
+
+					for (int v = 0; v < 3; v++)
+					{
+						edges.push_back({ occlusionEdgeKey(c[v], c[(v + 1) % 3]), (uint32_t)(out.size() * 3 + v) });
+						corners.push_back(c[v]);
+					}
+					out.push_back(triangle);
+				}
+				outlineOcclusionTriangles(out, edges, corners);
+			}
+		});
+
+		// Binning is serial, occluders are few and low poly
+		for (std::vector<const OcclusionTriangle*>& bin : this->bins) bin.clear();
+		for (size_t o = 0; o < this->occluders.size(); o++)
+		{
+			this->stats.triangles += this->occluders[o].indexCount / 3;
+			this->stats.rasterizedTriangles += this->triangles[o].size();
+
+			for (const OcclusionTriangle& triangle : this->triangles[o])
+			{
+				for (int by = triangle.minY / OCCLUSION_BIN_HEIGHT; by <= triangle.maxY / OCCLUSION_BIN_HEIGHT; by++)
+					for (int bx = triangle.minX / OCCLUSION_BIN_WIDTH; bx <= triangle.maxX / OCCLUSION_BIN_WIDTH; bx++)
+					{
+						this->bins[by * this->binsX + bx].push_back(&triangle);
+						this->stats.binnedTriangles++;
+					}
+			}
+		}
+
+		std::chrono::steady_clock::time_point binned = std::chrono::steady_clock::now();
+
+		// Bins own disjoint pixels and tiles, they run in parallel without synchronization
+		pool.parallelFor(this->bins.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t b = begin; b < end; b++) rasterizeBin((int)(b % this->binsX), (int)(b / this->binsX));
+		});
+
+		this->stats.setupMilliseconds = std::chrono::duration<double, std::milli>(binned - start).count();
+		this->stats.rasterMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - binned).count();
+	}
+
+	// Box given by center and half extent, in world space. Occluders of owner don't count
+	bool isOccluded(const glm::vec3& center, const glm::vec3& extent, uint32_t owner = OCCLUSION_NO_OWNER) const
+	{
+		// Screen rectangle and nearest depth of the 8 corners
+		// Clip space center and axes, every corner is center +- each axis
+		glm::vec4 clipCenter = this->viewProjection * glm::vec4(center, 1.0f);
+		glm::vec4 axes[3] = { this->viewProjection[0] * extent.x, this->viewProjection[1] * extent.y, this->viewProjection[2] * extent.z };
+
+		float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec4 c = clipCenter + ((corner & 1) ? axes[0] : -axes[0]) + ((corner & 2) ? axes[1] : -axes[1]) + ((corner & 4) ? axes[2] : -axes[2]);
+			if (c.w <= 0.0f || c.z < -c.w) return false;
+
+			float inverseW = 1.0f / c.w;
+			float x = (c.x * inverseW * 0.5f + 0.5f) * this->width, y = (c.y * inverseW * 0.5f + 0.5f) * this->height;
+			minX = std::min(minX, x); maxX = std::max(maxX, x);
+			minY = std::min(minY, y); maxY = std::max(maxY, y);
+			nearest = std::min(nearest, c.z * inverseW * 0.5f + 0.5f);
+		}
+
+		// Off screen is the frustum culler's business
+		if (maxX < 0.0f || maxY < 0.0f || minX >= (float)this->width || minY >= (float)this->height) return false;
+
+		// Every pixel the box can touch
+		int x0 = std::max((int)std::floor(minX), 0), x1 = std::min((int)std::floor(maxX), this->width - 1);
+		int y0 = std::max((int)std::floor(minY), 0), y1 = std::min((int)std::floor(maxY), this->height - 1);
+
+		for (int ty = y0 / OCCLUSION_TILE_HEIGHT; ty <= y1 / OCCLUSION_TILE_HEIGHT; ty++)
+			for (int tx = x0 / OCCLUSION_TILE_WIDTH; tx <= x1 / OCCLUSION_TILE_WIDTH; tx++)
+			{
+				// The whole tile is nearer than the box, unless some of it may be the object's own occluder
+				if (owner == OCCLUSION_NO_OWNER && this->tileDepth[ty * this->tilesX + tx] <= nearest) continue;
+				if (tileSeesDepth(tx, ty, x0, x1, y0, y1, nearest, owner)) return false;
+			}
+		return true;
+	}
+
+	inline bool isOccluded(const AABB& box, uint32_t owner = OCCLUSION_NO_OWNER) const
+	{
+		return !isEmpty(box) && isOccluded((box.min + box.max) * 0.5f, (box.max - box.min) * 0.5f, owner);
+	}
+
+	/*
+	*	Removes the occluded objects from visible, indices into bounds (the
+	*	list cullFrustum() produces). The order is kept. Each object is its
+	*	own owner: occluders added with owner i never hide object i.
+	*/
+	void cullOccluded(const CullingBounds& bounds, std::vector<uint32_t>& visible, ThreadPool& pool = ThreadPool::shared())
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		this->occludedFlags.assign(visible.size(), 0);
+
+		pool.parallelFor(visible.size(), OCCLUSION_TEST_GRAIN, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t o = visible[i];
+				this->occludedFlags[i] = isOccluded(glm::vec3(bounds.centerX[o], bounds.centerY[o], bounds.centerZ[o]),
+					glm::vec3(bounds.extentX[o], bounds.extentY[o], bounds.extentZ[o]), o);
+			}
+		});
+
+		size_t count = 0;
+		for (size_t i = 0; i < visible.size(); i++)
+		{
+			visible[count] = visible[i];
+			count += !this->occludedFlags[i];
+		}
+
+		this->stats.tested = visible.size();
+		this->stats.occluded = visible.size() - count;
+		visible.resize(count);
+		this->stats.testMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	inline int getWidth() const { return this->width; }
+	inline int getHeight() const { return this->height; }
+	// Row major, row 0 at the bottom of the screen like GL
+	inline const std::vector<float>& getDepth() const { return this->depth; }
+	inline const std::vector<float>& getTileDepth() const { return this->tileDepth; }
+	inline const OcclusionStats& getStats() const { return this->stats; }
+
+private:
+
+	struct Occluder
+	{
+		const unsigned char* positions;
+		size_t vertexCount;
+		size_t stride;
+		const GLuint* indices;
+		size_t indexCount;
+		glm::mat4 model;
+		uint32_t owner;
+	};
+
+	int width, height;
+	int binsX, binsY;
+	int tilesX, tilesY;
+	std::vector<float> depth;
+	std::vector<uint32_t> owners;		// Owner of each pixel's nearest occluder
+	std::vector<float> tileDepth;		// Farthest depth of each tile
+	glm::mat4 viewProjection;
+	std::vector<Occluder> occluders;
+	std::vector<std::vector<OcclusionTriangle>> triangles;	// Per occluder
+	std::vector<std::vector<const OcclusionTriangle*>> bins;
+	std::vector<uint8_t> occludedFlags;
+	OcclusionStats stats;
+
+	void rasterizeBin(int bx, int by)
+	{
+		int binX0 = bx * OCCLUSION_BIN_WIDTH, binY0 = by * OCCLUSION_BIN_HEIGHT;
+		int binX1 = binX0 + OCCLUSION_BIN_WIDTH - 1, binY1 = binY0 + OCCLUSION_BIN_HEIGHT - 1;
+
+		for (int y = binY0; y <= binY1; y++)
+		{
+			std::fill(this->depth.begin() + (size_t)y * this->width + binX0, this->depth.begin() + (size_t)y * this->width + binX1 + 1, 1.0f);
+			std::fill(this->owners.begin() + (size_t)y * this->width + binX0, this->owners.begin() + (size_t)y * this->width + binX1 + 1, OCCLUSION_NO_OWNER);
+		}
+
+		for (const OcclusionTriangle* triangle : this->bins[by * this->binsX + bx])
+		{
+			// Rows start lane aligned, bins are multiples of the lane count so no lane leaves the bin
+			int x0 = std::max(triangle->minX, binX0) / OCCLUSION_LANES * OCCLUSION_LANES, x1 = std::min(triangle->maxX, binX1);
+			int y0 = std::max(triangle->minY, binY0), y1 = std::min(triangle->maxY, binY1);
+
+			for (int y = y0; y <= y1; y++) rasterizeRow(*triangle, y, x0, x1);
+		}
+
+		// Tile level, the farthest depth of each tile
+		for (int ty = binY0 / OCCLUSION_TILE_HEIGHT; ty <= binY1 / OCCLUSION_TILE_HEIGHT; ty++)
+			for (int tx = binX0 / OCCLUSION_TILE_WIDTH; tx <= binX1 / OCCLUSION_TILE_WIDTH; tx++)
+			{
+				float farthest = 0.0f;
+				for (int y = ty * OCCLUSION_TILE_HEIGHT; y < (ty + 1) * OCCLUSION_TILE_HEIGHT; y++)
+				{
+					const float* row = this->depth.data() + (size_t)y * this->width + tx * OCCLUSION_TILE_WIDTH;
+					for (int x = 0; x < OCCLUSION_TILE_WIDTH; x++) farthest = std::max(farthest, row[x]);
+				}
+				this->tileDepth[ty * this->tilesX + tx] = farthest;
+			}
+	}
+
+	// Pixels [x0, x1] of row y, pixel centers at + 0.5
+	void rasterizeRow(const OcclusionTriangle& t, int y, int x0, int x1)
+	{
+		float* row = this->depth.data() + (size_t)y * this->width;
+		uint32_t* ownerRow = this->owners.data() + (size_t)y * this->width;
+		float py = (float)y + 0.5f;
+		float rowEdge[OCCLUSION_MAX_EDGES];
+		for (int e = 0; e < t.edges; e++) rowEdge[e] = t.edgeB[e] * py + t.edgeC[e];
+		float rowDepth = t.depthY * py + t.depthC;
+		int x = x0;
+
+#if defined(SIMD_AVX2)
+		__m256 lanes = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		__m256 a0 = _mm256_set1_ps(t.edgeA[0]), a1 = _mm256_set1_ps(t.edgeA[1]), a2 = _mm256_set1_ps(t.edgeA[2]);
+		__m256 r0 = _mm256_set1_ps(rowEdge[0]), r1 = _mm256_set1_ps(rowEdge[1]), r2 = _mm256_set1_ps(rowEdge[2]);
+		__m256 dx = _mm256_set1_ps(t.depthX), rd = _mm256_set1_ps(rowDepth), zero = _mm256_setzero_ps();
+		__m256 owner = _mm256_castsi256_ps(_mm256_set1_epi32((int)t.owner));
+
+		for (; x <= x1; x += 8)
+		{
+			__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), lanes);
+			__m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a0, px), r0), zero, _CMP_GT_OQ),
+				_mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a1, px), r1), zero, _CMP_GT_OQ)), _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a2, px), r2), zero, _CMP_GT_OQ));
+			for (int e = 3; e < t.edges; e++)
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.edgeA[e]), px), _mm256_set1_ps(rowEdge[e])), zero, _CMP_GT_OQ));
+			if (_mm256_movemask_ps(inside) == 0) continue;
+
+			// Owners follow the depth, they only change where this triangle is strictly nearer
+			__m256 current = _mm256_loadu_ps(row + x), candidate = _mm256_add_ps(_mm256_mul_ps(dx, px), rd);
+			__m256 nearer = _mm256_and_ps(inside, _mm256_cmp_ps(candidate, current, _CMP_LT_OQ));
+			_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, candidate, nearer));
+			_mm256_storeu_ps((float*)(ownerRow + x), _mm256_blendv_ps(_mm256_loadu_ps((const float*)(ownerRow + x)), owner, nearer));
+		}
+#elif defined(SIMD_SSE)
+		__m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		__m128 a0 = _mm_set1_ps(t.edgeA[0]), a1 = _mm_set1_ps(t.edgeA[1]), a2 = _mm_set1_ps(t.edgeA[2]);
+		__m128 r0 = _mm_set1_ps(rowEdge[0]), r1 = _mm_set1_ps(rowEdge[1]), r2 = _mm_set1_ps(rowEdge[2]);
+		__m128 dx = _mm_set1_ps(t.depthX), rd = _mm_set1_ps(rowDepth), zero = _mm_setzero_ps();
+		__m128 owner = _mm_castsi128_ps(_mm_set1_epi32((int)t.owner));
+
+		for (; x <= x1; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+				_mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero)), _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+			for (int e = 3; e < t.edges; e++)
+				inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[e]), px), _mm_set1_ps(rowEdge[e])), zero));
+			if (_mm_movemask_ps(inside) == 0) continue;
+
+			// SSE2 has no blend, select through the mask
+			__m128 current = _mm_loadu_ps(row + x), candidate = _mm_add_ps(_mm_mul_ps(dx, px), rd);
+			__m128 nearer = _mm_and_ps(inside, _mm_cmplt_ps(candidate, current));
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(nearer, candidate), _mm_andnot_ps(nearer, current)));
+			__m128 currentOwner = _mm_loadu_ps((const float*)(ownerRow + x));
+			_mm_storeu_ps((float*)(ownerRow + x), _mm_or_ps(_mm_and_ps(nearer, owner), _mm_andnot_ps(nearer, currentOwner)));
+		}
+#endif
+
+		for (; x <= x1; x++)
+		{
+			float px = (float)x + 0.5f;
+			float candidate = t.depthX * px + rowDepth;
+			bool inside = true;
+			for (int e = 0; e < t.edges && inside; e++) inside = t.edgeA[e] * px + rowEdge[e] > 0.0f;
+			if (inside && candidate < row[x])
+			{
+				row[x] = candidate;
+				ownerRow[x] = t.owner;
+			}
+		}
+	}
+
+	// True when a pixel of tile (tx, ty) inside [x0, x1] x [y0, y1] is farther than depth or covered by owner
+	bool tileSeesDepth(int tx, int ty, int x0, int x1, int y0, int y1, float nearest, uint32_t owner) const
+	{
+		int px0 = std::max(tx * OCCLUSION_TILE_WIDTH, x0), px1 = std::min((tx + 1) * OCCLUSION_TILE_WIDTH - 1, x1);
+		int py0 = std::max(ty * OCCLUSION_TILE_HEIGHT, y0), py1 = std::min((ty + 1) * OCCLUSION_TILE_HEIGHT - 1, y1);
+
+		for (int y = py0; y <= py1; y++)
+		{
+			const float* row = this->depth.data() + (size_t)y * this->width;
+			int x = px0;
+			if (owner != OCCLUSION_NO_OWNER)
+			{
+				const uint32_t* ownerRow = this->owners.data() + (size_t)y * this->width;
+				for (; x <= px1; x++) if (row[x] > nearest || ownerRow[x] == owner) return true;
+				continue;
+			}
+#ifdef SIMD_SSE
+			__m128 limit = _mm_set1_ps(nearest);
+			for (; x + 3 <= px1; x += 4)
+				if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(row + x), limit))) return true;
+#endif
+			for (; x <= px1; x++) if (row[x] > nearest) return true;
+		}
+		return false;
+	}
+};
+
+#endif // !OCCLUSION_CULLING_H
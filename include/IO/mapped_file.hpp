@@ -0,0 +1,137 @@
+/*
+*	MAPPED_FILE.HPP
+*
+*	Read only memory mapped file (MapViewOfFile on _WIN32, mmap elsewhere).
+*
+*	The whole file is mapped at construction, data() and size() give access
+*	to it until the object is destroyed or close() is called. Pages are only
+*	read from disk when touched, so loaders can hand mapped ranges straight to
+*	the GPU or to parser threads without an intermediate copy.
+*
+*	On _WIN32 it includes windows.h, which defines APIENTRY unconditionally:
+*	translation units include this header before glad.h (see main.cpp), so
+*	glad keeps the windows.h definition instead of having it redefined (C4005).
+*/
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include <iostream>
+#include <string>
+
+class MappedFile
+{
+public:
+
+	explicit MappedFile(const std::string& path)
+	{
+		this->mapped = nullptr;
+		this->length = 0;
+
+#ifdef _WIN32
+		this->file = INVALID_HANDLE_VALUE;
+		this->mapping = NULL;
+
+		this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (this->file == INVALID_HANDLE_VALUE)
+		{
+			std::cout << "ERROR::MAPPED_FILE::OPEN_FAILED " << path << '\n';
+			return;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(this->file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			close();
+			return;
+		}
+		this->length = (size_t)fileSize.QuadPart;
+
+		this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (this->mapping) this->mapped = (const unsigned char*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		this->descriptor = open(path.c_str(), O_RDONLY);
+		if (this->descriptor < 0)
+		{
+			std::cout << "ERROR::MAPPED_FILE::OPEN_FAILED " << path << '\n';
+			return;
+		}
+
+		struct stat status;
+		if (fstat(this->descriptor, &status) != 0 || status.st_size == 0)
+		{
+			close();
+			return;
+		}
+		this->length = (size_t)status.st_size;
+
+		void* view = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, this->descriptor, 0);
+		if (view != MAP_FAILED) this->mapped = (const unsigned char*)view;
+#endif
+
+		if (!this->mapped)
+		{
+			std::cout << "ERROR::MAPPED_FILE::MAPPING_FAILED " << path << '\n';
+			close();
+		}
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Unmaps the file, pointers obtained from data() become invalid
+	void close()
+	{
+#ifdef _WIN32
+		if (this->mapped) UnmapViewOfFile(this->mapped);
+		if (this->mapping) CloseHandle(this->mapping);
+		if (this->file != INVALID_HANDLE_VALUE) CloseHandle(this->file);
+		this->mapping = NULL;
+		this->file = INVALID_HANDLE_VALUE;
+#else
+		if (this->mapped) munmap((void*)this->mapped, this->length);
+		if (this->descriptor >= 0) ::close(this->descriptor);
+		this->descriptor = -1;
+#endif
+		this->mapped = nullptr;
+		this->length = 0;
+	}
+
+	inline bool isOpen() const { return this->mapped != nullptr; }
+	inline const unsigned char* data() const { return this->mapped; }
+	inline size_t size() const { return this->length; }
+
+private:
+
+	const unsigned char* mapped;
+	size_t length;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int descriptor;
+#endif
+};
+
+#endif // !MAPPED_FILE_H
@@ -0,0 +1,208 @@
+/*
+*	MATERIAL.HPP
+*
+*	Surface parameters shared by every draw path, stored on the GPU.
+*
+*	Material is laid out for std430 (three vec4 and a flags word padded to a
+*	fourth) and MaterialLibrary packs the
+*	materials of a whole scene into one SSBO bound at MATERIAL_BINDING. Adding
+*	a material returns its index in that array, identical materials share one
+*	slot. Draws carry only the index:
+*	- Mesh::render() and BakedModel::draw() pass it as the base instance, the
+*	  vertex shader forwards gl_BaseInstance (see model_shader.vert)
+*	- MeshBatch stores it in the per-draw record (BatchDrawData::materialIndex)
+*	so no material uniform is set per draw, the buffer is bound once.
+*
+*	add() can be called from loader threads, upload() and bind() need the GL
+*	thread. upload() only touches the GPU when materials were added since the
+*	last call and reallocates when the buffer is too small.
+*/
+
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <mutex>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+#define MATERIAL_BINDING 1
+#define MATERIAL_MIN_CAPACITY 64
+
+// Material::flags bits, mirrored in the shaders
+#define MATERIAL_NORMAL_MAPPED 1u		// Samples texture_normal1 through the tangent frame of the draw
+
+// std430 Material of the shaders, keep both in sync
+struct Material
+{
+	glm::vec4 ambient;		// rgb, w unused
+	glm::vec4 diffuse;		// rgb, opacity in w
+	glm::vec4 specular;		// rgb, shininess exponent in w
+	uint32_t flags;			// MATERIAL_* bits
+	uint32_t padding[3];
+};
+
+static_assert(sizeof(Material) == 64, "Material must match the std430 layout");
+
+struct MaterialLibraryStats
+{
+	size_t requests;		// add() calls
+	size_t materials;		// Unique materials stored
+	size_t capacity;		// Materials the GPU buffer can hold
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Material utility functions"
+
+inline Material makeMaterial(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular, float shininess, float opacity = 1.0f,
+	uint32_t flags = 0)
+{
+	Material material;
+	material.ambient = glm::vec4(ambient, 0.0f);
+	material.diffuse = glm::vec4(diffuse, opacity);
+	material.specular = glm::vec4(specular, shininess);
+	material.flags = flags;
+	material.padding[0] = material.padding[1] = material.padding[2] = 0;
+	return material;
+}
+
+// Neutral white material, index 0 of every library
+inline Material defaultMaterial()
+{
+	return makeMaterial(glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(1.0f), 32.0f);
+}
+
+struct MaterialHash
+{
+	size_t operator()(const Material& material) const
+	{
+		// FNV-1a over the 12 floats and the flags, -0.0 folded into 0.0 so equal values hash equally
+		const float* values = &material.ambient.x;
+		uint64_t hash = 14695981039346656037ull;
+		for (int i = 0; i < 12; i++)
+		{
+			float value = values[i] == 0.0f ? 0.0f : values[i];
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			hash = (hash ^ bits) * 1099511628211ull;
+		}
+		hash = (hash ^ material.flags) * 1099511628211ull;
+		return (size_t)hash;
+	}
+};
+
+struct MaterialEqual
+{
+	bool operator()(const Material& a, const Material& b) const
+	{
+		return a.ambient == b.ambient && a.diffuse == b.diffuse && a.specular == b.specular && a.flags == b.flags;
+	}
+};
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class MaterialLibrary
+{
+public:
+
+	MaterialLibrary()
+	{
+		this->buffer = 0;
+		this->capacity = 0;
+		this->uploadedCount = 0;
+		this->requests = 0;
+
+		add(defaultMaterial());
+		this->requests = 0;
+	}
+
+	~MaterialLibrary()
+	{
+		glDeleteBuffers(1, &this->buffer);
+	}
+
+	MaterialLibrary(const MaterialLibrary&) = delete;
+	MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+	// Index of the material in the GPU array, an identical one is reused
+	GLuint add(const Material& material)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->requests++;
+
+		std::unordered_map<Material, GLuint, MaterialHash, MaterialEqual>::iterator found = this->indices.find(material);
+		if (found != this->indices.end()) return found->second;
+
+		GLuint index = (GLuint)this->materials.size();
+		this->materials.push_back(material);
+		this->indices.emplace(material, index);
+		return index;
+	}
+
+	// Sends the materials added since the last call, must run on the GL thread
+	void upload()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		size_t count = this->materials.size();
+		if (count == this->uploadedCount && this->buffer) return;
+
+		if (count > this->capacity)
+		{
+			// Immutable storage can't grow, the whole array goes to a bigger buffer
+			glDeleteBuffers(1, &this->buffer);
+			this->capacity = std::max<size_t>(MATERIAL_MIN_CAPACITY, count * 2);
+			glCreateBuffers(1, &this->buffer);
+			glNamedBufferStorage(this->buffer, this->capacity * sizeof(Material), nullptr, GL_DYNAMIC_STORAGE_BIT);
+			this->uploadedCount = 0;
+		}
+
+		glNamedBufferSubData(this->buffer, this->uploadedCount * sizeof(Material), (count - this->uploadedCount) * sizeof(Material),
+			this->materials.data() + this->uploadedCount);
+		this->uploadedCount = count;
+	}
+
+	// Binds the material array for every following draw, uploads pending materials first
+	void bind(GLuint binding = MATERIAL_BINDING)
+	{
+		upload();
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, this->buffer);
+	}
+
+	Material get(GLuint index) const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return index < this->materials.size() ? this->materials[index] : this->materials[0];
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->materials.size();
+	}
+
+	MaterialLibraryStats getStats() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return { this->requests, this->materials.size(), this->capacity };
+	}
+
+private:
+
+	mutable std::mutex mutex;
+	std::vector<Material> materials;
+	std::unordered_map<Material, GLuint, MaterialHash, MaterialEqual> indices;
+	size_t requests;
+
+	GLuint buffer;
+	size_t capacity;
+	size_t uploadedCount;
+};
+
+#endif // !MATERIAL_H
@@ -1,6 +1,10 @@
+#ifndef MESH_H
+#define MESH_H
+
 #include <iostream>
 #include <vector>
 #include <string>
+#include <algorithm>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,12 +15,120 @@
 
 #include <TEXTURE/texture_s.hpp>
 #include <SHADER/shader_s.hpp>
+#include <MESH/mesh_types.hpp>
+#include <MESH/meshlet.hpp>
+#include <MESH/mesh_lod.hpp>
+#include <MESH/mesh_tangents.hpp>
+#include <MESH/mesh_weld.hpp>
+#include <MESH/vertex_layout.hpp>
+#include <BOUNDS/bounds.hpp>
 
-struct Vertex
+// Texture to be bound to the unit its sampler was assigned in a shader
+struct TextureBinding
 {
-	glm::vec3 position;
-	glm::vec3 normal;
-	glm::vec2 texCoords;
+	GLuint unit;
+	GLuint textureID;
+};
+
+/*
+*	Sampler bindings of a texture list resolved against the shaders it has been
+*	drawn with. Resolution builds the sampler names following the naming
+*	convention below and happens once per shader, after that get() only walks
+*	a short list and returns the cached bindings. Entries also keep the texture
+*	types and IDs they were resolved from, so a texture list edited after the
+*	first draw (textures pushed at upload, swapped materials) is resolved again
+*	instead of binding stale IDs.
+*
+* 	Naming convention for textures:
+* 	- diffuse: texture_diffuseN
+*	- specular: texture_specularN
+*	- normal: texture_normalN
+*	- height: texture_heightN
+*	Prefixed with "material." when hasMaterial is set
+*/
+class SamplerBindingCache
+{
+public:
+
+	const std::vector<TextureBinding>& get(Shader& shader, const TextureType* types, const GLuint* IDs, size_t count, bool hasMaterial)
+	{
+		Entry* entry = find(shader, hasMaterial);
+		if (entry && entry->IDs.size() == count && std::equal(IDs, IDs + count, entry->IDs.begin())
+			&& std::equal(types, types + count, entry->types.begin())) return entry->bindings;
+
+		// Same shader with another texture list replaces its entry
+		if (!entry)
+		{
+			this->entries.push_back(Entry());
+			entry = &this->entries.back();
+			entry->shaderSerial = shader.getSerial();
+			entry->hasMaterial = hasMaterial;
+		}
+		entry->types.assign(types, types + count);
+		entry->IDs.assign(IDs, IDs + count);
+		entry->bindings.clear();
+
+		int diffuseNr = 1, specularNr = 1, normalNr = 1, heightNr = 1;
+		for (size_t i = 0; i < count; i++)
+		{
+			std::string name;
+			switch (types[i])
+			{
+				case texture_diffuse: name = "texture_diffuse" + std::to_string(diffuseNr++); break;
+				case texture_specular: name = "texture_specular" + std::to_string(specularNr++); break;
+				case texture_normal: name = "texture_normal" + std::to_string(normalNr++); break;
+				case texture_height: name = "texture_height" + std::to_string(heightNr++); break;
+			}
+			if (hasMaterial) name = "material." + name;
+
+			// Textures the shader doesn't sample are never bound
+			int unit = shader.getSamplerUnit(name);
+			if (unit >= 0) entry->bindings.push_back({ (GLuint)unit, IDs[i] });
+		}
+
+		return entry->bindings;
+	}
+
+	const std::vector<TextureBinding>& get(Shader& shader, const std::vector<Texture>& textures, bool hasMaterial)
+	{
+		Entry* entry = find(shader, hasMaterial);
+		bool same = entry && entry->IDs.size() == textures.size();
+		for (size_t i = 0; same && i < textures.size(); i++)
+			same = entry->IDs[i] == textures[i].getID() && entry->types[i] == textures[i].sType;
+		if (same) return entry->bindings;
+
+		std::vector<TextureType> types;
+		std::vector<GLuint> IDs;
+		for (const Texture& texture : textures)
+		{
+			types.push_back(texture.sType);
+			IDs.push_back(texture.getID());
+		}
+
+		return get(shader, types.data(), IDs.data(), textures.size(), hasMaterial);
+	}
+
+	void clear() { this->entries.clear(); }
+
+private:
+
+	struct Entry
+	{
+		GLuint shaderSerial;
+		bool hasMaterial;
+		std::vector<TextureType> types;		// Texture list the bindings were resolved from
+		std::vector<GLuint> IDs;
+		std::vector<TextureBinding> bindings;
+	};
+
+	std::vector<Entry> entries;
+
+	Entry* find(Shader& shader, bool hasMaterial)
+	{
+		for (Entry& entry : this->entries)
+			if (entry.shaderSerial == shader.getSerial() && entry.hasMaterial == hasMaterial) return &entry;
+		return nullptr;
+	}
 };
 
 
@@ -27,114 +139,274 @@ public:
 	std::vector<Vertex> vertices;
 	std::vector<GLuint> indices;
 	std::vector<Texture> textures;
+	std::vector<Meshlet> meshlets;
+	std::vector<MeshLod> lods;	// LOD0 plus its simplified levels, appended in indices
+
+	// Optional tangent frame stream, only generated for normal mapped meshes
+	std::vector<QTangent> tangents;
 
-	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+	// Object space bounds, computed once at construction
+	AABB bounds;
+	BoundingSphere boundingSphere;
+
+	// Index in the bound MaterialLibrary, handed to the shader as the base instance
+	GLuint materialIndex = 0;
+
+	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures,
+		VertexStreamLayout layout = stream_interleaved)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
 		this->textures = textures;
 
+		bool normalMapped = false;
+		for (const Texture& texture : this->textures) normalMapped |= texture.sType == texture_normal;
+
+		processGeometry(vertices, indices, normalMapped, layout);
+		upload();
+	}
+
+	/*
+	*	CPU only construction: the geometry is processed but no GL object is
+	*	created, so it can run on any thread. Textures are assigned afterwards and
+	*	upload() is called on the GL thread before the first draw.
+	*/
+	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, bool normalMapped,
+		VertexStreamLayout layout = stream_interleaved)
+	{
+		processGeometry(vertices, indices, normalMapped, layout);
+	}
+
+	/*
+	*	CPU only construction from geometry processed beforehand (a baked model,
+	*	see MODEL/baked_model.hpp): taken as is, only the bounds are given too.
+	*/
+	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<MeshLod> lods, std::vector<Meshlet> meshlets,
+		std::vector<QTangent> tangents, const AABB& bounds, const BoundingSphere& boundingSphere, VertexStreamLayout layout = stream_interleaved)
+	{
+		this->vertices.swap(vertices);
+		this->indices.swap(indices);
+		this->lods.swap(lods);
+		this->meshlets.swap(meshlets);
+		this->tangents.swap(tangents);
+		this->bounds = bounds;
+		this->boundingSphere = boundingSphere;
+		this->layout = layout;
+	}
+
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+
+	// Create the GL buffers and VAOs, must run on the thread owning the context
+	void upload()
+	{
+		if (this->uploaded) return;
+
 		setupMesh();
+		this->uploaded = true;
 	}
 
-	void render(Shader& shader, bool hasMaterial = false)
+	inline bool isUploaded() const { return this->uploaded; }
+
+	void render(Shader& shader, bool hasMaterial = false, int lod = 0)
 	{
-		int diffuseNr = 1, specularNr = 1, normalNr = 1, heightNr = 1;
+		bindTextures(shader, hasMaterial);
 
-		/*
-		*	Naming convention for textures:
-		* 	- diffuse: texture_diffuseN
-		*	- specular: texture_specularN
-		*	- normal: texture_normalN
-		*	- height: texture_heightN
-		*/
+		glBindVertexArray(this->VAO);
+		drawBound(lod);
+		glBindVertexArray(0);
+	}
+
+	/*
+	*	The two halves of render() for callers tracking GL state themselves
+	*	(see RENDER/render_queue.hpp): texture binds, then the draw call alone
+	*	with the mesh VAO (getVAO()) already bound.
+	*/
+	void bindTextures(Shader& shader, bool hasMaterial = false)
+	{
+		// Sampler names are resolved the first time the mesh meets this shader,
+		// every draw after that is just texture binds
+		const std::vector<TextureBinding>& bindings = this->samplerBindings.get(shader, this->textures, hasMaterial);
+		for (const TextureBinding& binding : bindings) glBindTextureUnit(binding.unit, binding.textureID);
+	}
 
-		for (int i = 0; i < this->textures.size(); i++)
+	void drawBound(int lod = 0)
+	{
+		if(this->indices.empty()) glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, this->vertices.size(), 1, this->materialIndex);
+		else
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
+			const MeshLod& level = this->lods[glm::clamp(lod, 0, (int)this->lods.size() - 1)];
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)(level.firstIndex * sizeof(GLuint)),
+				1, this->materialIndex);
+		}
+	}
 
-			std::string number;
-			std::string name = this->textures[i].getTextureType();
+	inline GLuint getVAO() const { return this->VAO; }
 
-			switch (this->textures[i].sType)
-			{
-				case texture_diffuse:
-				{
-					number = std::to_string(diffuseNr++); break;
-					name = "texture_diffuse";
-				}
-				case texture_specular:
-				{
-					number = std::to_string(specularNr++); break;
-					name = "texture_specular";
-				}
-				case texture_normal:
-				{
-					number = std::to_string(normalNr++); break;
-					name = "texture_normal";
-				}
-				case texture_height:
-				{
-					number = std::to_string(heightNr++); break;
-					name = "texture_height";
-				}
-			}
+	/*
+	*	Position only draw for depth prepass, shadow and occlusion passes. Uses
+	*	the depth VAO, which only enables attribute 0 (see depth_shader.vert), and
+	*	binds no texture. With stream_split_positions it reads the packed position
+	*	stream alone.
+	*/
+	void renderDepth(int lod = 0)
+	{
+		glBindVertexArray(this->depthVAO);
+		if (this->indices.empty()) glDrawArrays(GL_TRIANGLES, 0, this->vertices.size());
+		else
+		{
+			const MeshLod& level = this->lods[glm::clamp(lod, 0, (int)this->lods.size() - 1)];
+			glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)(level.firstIndex * sizeof(GLuint)));
+		}
+		glBindVertexArray(0);
+	}
 
-			if(hasMaterial) shader.setFloatUniform(("material." + name + number).c_str(), i);
-			else shader.setFloatUniform((name + number).c_str(), i);
+	inline VertexStreamLayout getLayout() const { return this->layout; }
 
-			this->textures[i].bind();
-		}
+	// LOD for this mesh placed with the given model matrix, see selectLod()
+	int selectLod(BaseCamera& camera, const glm::mat4& model, float fovY, float viewportHeight, float maxPixelError = 1.0f) const
+	{
+		return ::selectLod(this->lods, camera, model, this->boundingSphere, fovY, viewportHeight, maxPixelError);
+	}
+
+	int selectLod(const glm::vec3& viewer, const glm::mat4& model, float fovY, float viewportHeight, float maxPixelError = 1.0f) const
+	{
+		return ::selectLod(this->lods, viewer, model, this->boundingSphere, fovY, viewportHeight, maxPixelError);
+	}
+
+	// Draw only the given meshlets (see cullMeshlets) with a single multi-draw call
+	void renderClusters(Shader& shader, const std::vector<GLuint>& visibleMeshlets, bool hasMaterial = false)
+	{
+		buildMeshletCommands(this->meshlets, visibleMeshlets, this->clusterCommands, 0, this->materialIndex);
+		if (this->clusterCommands.empty()) return;
 
-		glActiveTexture(GL_TEXTURE0);
+		const std::vector<TextureBinding>& bindings = this->samplerBindings.get(shader, this->textures, hasMaterial);
+		for (const TextureBinding& binding : bindings) glBindTextureUnit(binding.unit, binding.textureID);
+
+		glNamedBufferData(this->indirectBuffer, this->clusterCommands.size() * sizeof(DrawElementsIndirectCommand),
+			this->clusterCommands.data(), GL_STREAM_DRAW);
 
 		glBindVertexArray(this->VAO);
-		if(this->indices.empty()) glDrawArrays(GL_TRIANGLES, 0, this->vertices.size());
-		else glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)this->clusterCommands.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 		glBindVertexArray(0);
 	}
 
 	~Mesh()
 	{
+		// Meshes imported before the context and never uploaded own no GL object
+		if (!this->VAO) return;
+
 		glDeleteVertexArrays(1, &this->VAO);
+		glDeleteVertexArrays(1, &this->depthVAO);
 		glDeleteBuffers(1, &this->VBO);
+		glDeleteBuffers(1, &this->positionVBO);
 		glDeleteBuffers(1, &this->EBO);
+		glDeleteBuffers(1, &this->indirectBuffer);
+		glDeleteBuffers(1, &this->tangentVBO);
 	}
 
 private:
 
-	GLuint VAO, VBO, EBO;
+	GLuint VAO = 0, VBO = 0, EBO = 0;
+	GLuint depthVAO = 0;
+	GLuint positionVBO = 0;		// Only with stream_split_positions, VBO then holds VertexAttributes
+	GLuint indirectBuffer = 0;
+	bool uploaded = false;
+	VertexStreamLayout layout;
+	GLuint tangentVBO = 0;
+	std::vector<DrawElementsIndirectCommand> clusterCommands;
+	SamplerBindingCache samplerBindings;
+
+	void processGeometry(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, bool normalMapped, VertexStreamLayout layout)
+	{
+		this->vertices.swap(vertices);
+		this->indices.swap(indices);
+		this->layout = layout;
+
+		// Unindexed input (e.g. a plain triangle list) is welded into an indexed mesh
+		if (this->indices.empty() && !this->vertices.empty())
+			this->vertices = weldVertices(this->vertices, this->indices);
+
+		// One handedness per tangent frame, mirrored UVs get their own vertices before anything else indexes them
+		if (normalMapped) splitMirroredVertices(this->vertices, this->indices);
+
+		// Both reorder or extend the indices, they have to run before the upload.
+		// Meshlets cover LOD0 only, LODs are appended after it
+		this->meshlets = buildMeshlets(this->vertices, this->indices);
+		this->lods = buildLodChain(this->vertices, this->indices);
+
+		this->bounds = computeAABB(this->vertices);
+		this->boundingSphere = computeBoundingSphere(this->vertices);
+
+		if (normalMapped && !this->lods.empty())
+			this->tangents = generateTangents(this->vertices, this->indices.data(), this->lods[0].indexCount);
+	}
 
 	void setupMesh()
 	{
 		// Framebuffers creation
-		glGenVertexArrays(1, &this->VAO);
-		glGenBuffers(1, &this->VBO);
-		glGenBuffers(1, &this->EBO);
+		glCreateVertexArrays(1, &this->VAO);
+		glCreateVertexArrays(1, &this->depthVAO);
+		glCreateBuffers(1, &this->VBO);
+		glCreateBuffers(1, &this->EBO);
+		glCreateBuffers(1, &this->indirectBuffer);
 
-		// Bind VAO
-		glBindVertexArray(this->VAO);
+		// Load data into EBO, shared by both VAOs
+		glNamedBufferData(this->EBO, this->indices.size() * sizeof(unsigned int), this->indices.data(), GL_STATIC_DRAW);
+		glVertexArrayElementBuffer(this->VAO, this->EBO);
+		glVertexArrayElementBuffer(this->depthVAO, this->EBO);
 
-		// Load data into VBO
-		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		// Attribute formats come from the layouts (see vertex_layout.hpp),
+		// binding 0 is the stream holding positions
+		GLuint positionBuffer = this->VBO;
+		GLsizei positionStride = MeshVertexLayout::stride;
 
-		// Load data into EBO
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(unsigned int), &this->indices[0], GL_STATIC_DRAW);
+		if (this->layout == stream_split_positions)
+		{
+			// Deinterleave: packed positions in their own buffer, the rest in VBO
+			std::vector<glm::vec3> positions(this->vertices.size());
+			std::vector<VertexAttributes> attributes(this->vertices.size());
+			for (size_t i = 0; i < this->vertices.size(); i++)
+			{
+				positions[i] = this->vertices[i].position;
+				attributes[i] = { this->vertices[i].normal, this->vertices[i].texCoords };
+			}
+
+			glCreateBuffers(1, &this->positionVBO);
+			glNamedBufferData(this->positionVBO, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+			glNamedBufferData(this->VBO, attributes.size() * sizeof(VertexAttributes), attributes.data(), GL_STATIC_DRAW);
 
-		// Set vertex attribute pointers
-		glEnableVertexArrayAttrib(this->VAO, 0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+			positionBuffer = this->positionVBO;
+			positionStride = PositionLayout::stride;
 
-		// Set normal attribute pointers
-		glEnableVertexArrayAttrib(this->VAO, 1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+			PositionLayout::apply(this->VAO, 0);
+			PositionLayout::bindBuffer(this->VAO, this->positionVBO, 0);
+			AttributeLayout::apply(this->VAO, 1);
+			AttributeLayout::bindBuffer(this->VAO, this->VBO, 1);
+		}
+		else
+		{
+			// Load data into VBO
+			glNamedBufferData(this->VBO, this->vertices.size() * sizeof(Vertex), this->vertices.data(), GL_STATIC_DRAW);
 
-		// Set texture cordinates attribute pointers
-		glEnableVertexArrayAttrib(this->VAO, 2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+			MeshVertexLayout::apply(this->VAO, 0);
+			MeshVertexLayout::bindBuffer(this->VAO, this->VBO, 0);
+		}
 
-		glBindVertexArray(0);
+		// Tangent frames live in their own buffer, normalized shorts decoded in the shader
+		if (!this->tangents.empty())
+		{
+			glCreateBuffers(1, &this->tangentVBO);
+			glNamedBufferData(this->tangentVBO, this->tangents.size() * sizeof(QTangent), this->tangents.data(), GL_STATIC_DRAW);
+
+			TangentLayout::apply(this->VAO, 2);
+			TangentLayout::bindBuffer(this->VAO, this->tangentVBO, 2);
+		}
+
+		// Depth VAO: same indices, positions only
+		PositionLayout::apply(this->depthVAO, 0);
+		glVertexArrayVertexBuffer(this->depthVAO, 0, positionBuffer, 0, positionStride);
 	}
-};
\ No newline at end of file
+};
+
+#endif // !MESH_H
\ No newline at end of file
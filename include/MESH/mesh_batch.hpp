@@ -0,0 +1,420 @@
+/*
+*	MESH_BATCH.HPP
+*
+*	Batched submission path for meshes that share a shader and the Vertex layout.
+*
+*	addMesh() copies the mesh geometry into one shared vertex/index buffer pair
+*	and returns a handle; build() uploads it once all meshes are registered.
+*
+*	Every frame the visible meshes are pushed with submit() along with their
+*	model matrix, material index and LOD. render() sorts the submissions, merges
+*	repeated meshes into instanced commands, fills a DrawElementsIndirectCommand
+*	buffer and issues a single glMultiDrawElementsIndirect call per texture set.
+*
+*	The per-draw data and the commands are written straight into a persistently
+*	mapped DynamicRingBuffer, each render() call using the next region of it,
+*	including calls with nothing to draw.
+*
+*	Per-draw data is bound as an SSBO range at BATCH_DRAW_DATA_BINDING and is
+*	fetched in the vertex shader with gl_BaseInstance + gl_InstanceID
+*	(see shaders/vertex/model_batch_shader.vert). The base instance is used
+*	instead of gl_DrawID because it stays valid across several multi-draw calls
+*	and lets instances of the same mesh share one command.
+*
+*	Tangent frames (Mesh::tangents) go to a second stream when any mesh has
+*	them, meshes without one get identity frames their materials never read.
+*
+*	A batch built with batch_vertex_pulling stores no vertex attributes: each
+*	mesh is encoded in its own VertexFormat into a shared SSBO and the vertex
+*	shader decodes it from gl_VertexID (see MESH/vertex_pulling.hpp). Meshes of
+*	any format then go through the same VAO and multi-draw.
+*/
+
+#ifndef MESH_BATCH_H
+#define MESH_BATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <MESH/mesh.hpp>
+#include <MESH/vertex_pulling.hpp>
+#include <SHADER/shader_s.hpp>
+#include <BUFFER/dynamic_ring_buffer.hpp>
+
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+
+#define BATCH_DRAW_DATA_BINDING 0
+
+// Per-draw record, matches the std430 DrawData struct of the batch shaders
+struct BatchDrawData
+{
+	glm::mat4 model;
+	glm::mat4 normalMatrix;
+	GLuint materialIndex;
+	GLuint meshIndex;		// PulledMeshRecord of the mesh, only read when pulling
+	GLuint padding[2];
+};
+
+enum BatchVertexMode
+{
+	batch_vertex_attributes,	// Shared Vertex buffer behind a regular VAO
+	batch_vertex_pulling		// Encoded vertices in an SSBO, fetched by gl_VertexID
+};
+
+class MeshBatch
+{
+public:
+
+	MeshBatch(BatchVertexMode mode = batch_vertex_attributes)
+	{
+		this->mode = mode;
+		this->VAO = 0;
+		this->VBO = 0;
+		this->EBO = 0;
+		this->meshRecordBuffer = 0;
+		this->tangentVBO = 0;
+		this->hasTangents = false;
+		this->built = false;
+		this->lastCallCount = 0;
+		this->lastCommandCount = 0;
+	}
+
+	~MeshBatch()
+	{
+		glDeleteVertexArrays(1, &this->VAO);
+		glDeleteBuffers(1, &this->VBO);
+		glDeleteBuffers(1, &this->EBO);
+		glDeleteBuffers(1, &this->meshRecordBuffer);
+		glDeleteBuffers(1, &this->tangentVBO);
+	}
+
+	MeshBatch(const MeshBatch&) = delete;
+	MeshBatch& operator=(const MeshBatch&) = delete;
+
+	/*
+	*	Append the mesh geometry to the shared buffers, returns the handle used by
+	*	submit(). format is only used in batch_vertex_pulling mode.
+	*/
+	int addMesh(const Mesh& mesh, VertexFormat format = vertex_format_float)
+	{
+		if (this->built)
+		{
+			std::cout << "ERROR::MESH_BATCH::ADD_AFTER_BUILD" << '\n';
+			return -1;
+		}
+
+		BatchedMesh batched;
+		GLuint firstIndex = (GLuint)this->indices.size();
+		batched.textureSet = findTextureSet(mesh);
+
+		// Pulled meshes keep local indices, the shader adds the first word of their record
+		if (this->mode == batch_vertex_pulling)
+		{
+			batched.baseVertex = 0;
+			this->meshRecords.push_back(encodeVertices(mesh.vertices, format, mesh.bounds, this->vertexWords));
+		}
+		else
+		{
+			batched.baseVertex = (GLint)this->vertices.size();
+			this->vertices.insert(this->vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+
+			this->hasTangents |= mesh.tangents.size() == mesh.vertices.size() && !mesh.tangents.empty();
+			if (mesh.tangents.size() == mesh.vertices.size()) this->tangents.insert(this->tangents.end(), mesh.tangents.begin(), mesh.tangents.end());
+			else this->tangents.resize(this->tangents.size() + mesh.vertices.size(), QTangent(0, 0, 0, 32767));
+		}
+
+		// Non indexed meshes get a sequential index range so every draw is indexed
+		if (mesh.indices.empty())
+		{
+			for (GLuint i = 0; i < (GLuint)mesh.vertices.size(); i++) this->indices.push_back(i);
+			batched.lods.push_back({ firstIndex, (GLuint)mesh.vertices.size(), 0.0f });
+		}
+		else
+		{
+			// The whole index buffer goes in, LOD ranges are just shifted
+			this->indices.insert(this->indices.end(), mesh.indices.begin(), mesh.indices.end());
+			for (MeshLod lod : mesh.lods)
+			{
+				lod.firstIndex += firstIndex;
+				batched.lods.push_back(lod);
+			}
+		}
+
+		this->meshes.push_back(batched);
+		return (int)this->meshes.size() - 1;
+	}
+
+	// Upload the shared geometry, no more meshes can be added afterwards
+	void build()
+	{
+		if (this->built || this->indices.empty()) return;
+
+		glCreateVertexArrays(1, &this->VAO);
+		glCreateBuffers(1, &this->VBO);
+		glCreateBuffers(1, &this->EBO);
+
+		glNamedBufferStorage(this->EBO, this->indices.size() * sizeof(GLuint), this->indices.data(), 0);
+
+		if (this->mode == batch_vertex_pulling)
+		{
+			// The VAO only provides the indices, VBO holds the encoded words
+			glCreateBuffers(1, &this->meshRecordBuffer);
+			glNamedBufferStorage(this->VBO, this->vertexWords.size() * sizeof(GLuint), this->vertexWords.data(), 0);
+			glNamedBufferStorage(this->meshRecordBuffer, this->meshRecords.size() * sizeof(PulledMeshRecord), this->meshRecords.data(), 0);
+			glVertexArrayElementBuffer(this->VAO, this->EBO);
+
+			std::vector<GLuint>().swap(this->vertexWords);
+			std::vector<GLuint>().swap(this->indices);
+
+			this->built = true;
+			return;
+		}
+
+		glNamedBufferStorage(this->VBO, this->vertices.size() * sizeof(Vertex), this->vertices.data(), 0);
+
+		glVertexArrayElementBuffer(this->VAO, this->EBO);
+		MeshVertexLayout::apply(this->VAO, 0);
+		MeshVertexLayout::bindBuffer(this->VAO, this->VBO, 0);
+
+		if (this->hasTangents)
+		{
+			glCreateBuffers(1, &this->tangentVBO);
+			glNamedBufferStorage(this->tangentVBO, this->tangents.size() * sizeof(QTangent), this->tangents.data(), 0);
+			TangentLayout::apply(this->VAO, 1);
+			TangentLayout::bindBuffer(this->VAO, this->tangentVBO, 1);
+		}
+
+		// CPU copies are no longer needed once the data lives in the GPU
+		std::vector<Vertex>().swap(this->vertices);
+		std::vector<QTangent>().swap(this->tangents);
+		std::vector<GLuint>().swap(this->indices);
+
+		this->built = true;
+	}
+
+	void submit(int handle, const glm::mat4& model, GLuint materialIndex = 0, int lod = 0)
+	{
+		if (handle < 0 || handle >= (int)this->meshes.size()) return;
+
+		Submission submission;
+		submission.mesh = handle;
+		submission.lod = glm::clamp(lod, 0, (int)this->meshes[handle].lods.size() - 1);
+		submission.data.model = model;
+		submission.data.normalMatrix = glm::transpose(glm::inverse(model));
+		submission.data.materialIndex = materialIndex;
+		submission.data.meshIndex = (GLuint)handle;
+		submission.data.padding[0] = submission.data.padding[1] = 0;
+
+		this->submissions.push_back(submission);
+	}
+
+	// Draw everything submitted since the last render() and clear the submission list
+	void render(Shader& shader, bool hasMaterial = false)
+	{
+		this->lastCallCount = 0;
+		this->lastCommandCount = 0;
+
+		// Submissions never carry over to the next frame, even when nothing is drawn.
+		// Empty frames still advance and fence the ring so its regions stay one per frame
+		if (!this->built || this->submissions.empty())
+		{
+			if (this->ring)
+			{
+				this->ring->beginFrame();
+				this->ring->endFrame();
+			}
+			this->submissions.clear();
+			return;
+		}
+
+		// Group by texture set first so each set is one contiguous command range,
+		// then by mesh and LOD so repeated meshes can be merged into instanced commands
+		std::sort(this->submissions.begin(), this->submissions.end(),
+			[this](const Submission& a, const Submission& b)
+			{
+				int setA = this->meshes[a.mesh].textureSet, setB = this->meshes[b.mesh].textureSet;
+				if (setA != setB) return setA < setB;
+				if (a.mesh != b.mesh) return a.mesh < b.mesh;
+				return a.lod < b.lod;
+			});
+
+		this->drawData.clear();
+		this->commands.clear();
+		this->ranges.clear();
+
+		for (size_t i = 0; i < this->submissions.size(); i++)
+		{
+			const Submission& submission = this->submissions[i];
+			const BatchedMesh& mesh = this->meshes[submission.mesh];
+
+			const MeshLod& lod = mesh.lods[submission.lod];
+
+			bool sameMesh = i > 0 && this->submissions[i - 1].mesh == submission.mesh && this->submissions[i - 1].lod == submission.lod;
+			bool sameSet = !this->ranges.empty() && this->ranges.back().textureSet == mesh.textureSet;
+
+			if (sameMesh) this->commands.back().instanceCount++;
+			else
+			{
+				DrawElementsIndirectCommand command;
+				command.count = lod.indexCount;
+				command.instanceCount = 1;
+				command.firstIndex = lod.firstIndex;
+				command.baseVertex = mesh.baseVertex;
+				command.baseInstance = (GLuint)this->drawData.size();
+				this->commands.push_back(command);
+
+				if (sameSet) this->ranges.back().commandCount++;
+				else this->ranges.push_back({ mesh.textureSet, (GLuint)this->commands.size() - 1, 1 });
+			}
+
+			this->drawData.push_back(submission.data);
+		}
+
+		// Write both arrays straight into this frame's region of the ring
+		GLsizeiptr drawSize = this->drawData.size() * sizeof(BatchDrawData);
+		GLsizeiptr commandSize = this->commands.size() * sizeof(DrawElementsIndirectCommand);
+		reserveRing(drawSize + commandSize);
+
+		this->ring->beginFrame();
+		RingAllocation draws = this->ring->allocate(drawSize);
+		RingAllocation commandData = this->ring->allocate(commandSize, sizeof(GLuint));
+		if (!draws.data || !commandData.data)
+		{
+			this->ring->endFrame();
+			this->submissions.clear();
+			return;
+		}
+
+		std::memcpy(draws.data, this->drawData.data(), drawSize);
+		std::memcpy(commandData.data, this->commands.data(), commandSize);
+
+		shader.use();
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BATCH_DRAW_DATA_BINDING, this->ring->getID(), draws.offset, drawSize);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->ring->getID());
+		glBindVertexArray(this->VAO);
+
+		if (this->mode == batch_vertex_pulling)
+		{
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_VERTEX_BINDING, this->VBO);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PULL_MESH_BINDING, this->meshRecordBuffer);
+		}
+
+		for (const CommandRange& range : this->ranges)
+		{
+			bindTextureSet(shader, this->textureSets[range.textureSet], hasMaterial);
+
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				(void*)(commandData.offset + range.firstCommand * sizeof(DrawElementsIndirectCommand)), range.commandCount, 0);
+			this->lastCallCount++;
+		}
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		this->ring->endFrame();
+
+		this->lastCommandCount = this->commands.size();
+		this->submissions.clear();
+	}
+
+	inline BatchVertexMode getMode() const { return this->mode; }
+	inline size_t getMeshCount() const { return this->meshes.size(); }
+	inline size_t getLastCallCount() const { return this->lastCallCount; }
+	inline size_t getLastCommandCount() const { return this->lastCommandCount; }
+
+private:
+
+	struct BatchedMesh
+	{
+		std::vector<MeshLod> lods;
+		GLint baseVertex;
+		int textureSet;
+	};
+
+	// Textures shared by every draw of a multi-draw call
+	struct TextureSet
+	{
+		std::vector<GLuint> IDs;
+		std::vector<TextureType> types;
+		SamplerBindingCache samplerBindings;
+	};
+
+	struct Submission
+	{
+		int mesh;
+		int lod;
+		BatchDrawData data;
+	};
+
+	struct CommandRange
+	{
+		int textureSet;
+		GLuint firstCommand;
+		GLuint commandCount;
+	};
+
+	BatchVertexMode mode;
+	GLuint VAO, VBO, EBO;
+	GLuint meshRecordBuffer;
+	GLuint tangentVBO;
+	std::unique_ptr<DynamicRingBuffer> ring;
+	bool hasTangents;
+	bool built;
+	size_t lastCallCount, lastCommandCount;
+
+	std::vector<Vertex> vertices;
+	std::vector<QTangent> tangents;
+	std::vector<GLuint> indices;
+	std::vector<GLuint> vertexWords;
+	std::vector<PulledMeshRecord> meshRecords;
+	std::vector<BatchedMesh> meshes;
+	std::vector<TextureSet> textureSets;
+
+	std::vector<Submission> submissions;
+	std::vector<BatchDrawData> drawData;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<CommandRange> ranges;
+
+	// Regions hold both arrays plus alignment padding, grown to twice the need when too small
+	void reserveRing(GLsizeiptr size)
+	{
+		GLsizeiptr needed = size + 2 * 256;
+		if (this->ring && this->ring->getRegionSize() >= needed) return;
+
+		this->ring.reset(new DynamicRingBuffer(needed * 2));
+	}
+
+	int findTextureSet(const Mesh& mesh)
+	{
+		for (size_t i = 0; i < this->textureSets.size(); i++)
+		{
+			const TextureSet& set = this->textureSets[i];
+			if (set.IDs.size() != mesh.textures.size()) continue;
+
+			bool equal = true;
+			for (size_t j = 0; j < set.IDs.size() && equal; j++) equal = set.IDs[j] == mesh.textures[j].getID();
+			if (equal) return (int)i;
+		}
+
+		TextureSet set;
+		for (const Texture& texture : mesh.textures)
+		{
+			set.IDs.push_back(texture.getID());
+			set.types.push_back(texture.sType);
+		}
+
+		this->textureSets.push_back(set);
+		return (int)this->textureSets.size() - 1;
+	}
+
+	void bindTextureSet(Shader& shader, TextureSet& set, bool hasMaterial)
+	{
+		const std::vector<TextureBinding>& bindings = set.samplerBindings.get(shader, set.types.data(), set.IDs.data(), set.IDs.size(), hasMaterial);
+		for (const TextureBinding& binding : bindings) glBindTextureUnit(binding.unit, binding.textureID);
+	}
+};
+
+#endif // !MESH_BATCH_H
@@ -0,0 +1,435 @@
+/*
+*	MESH_LOD.HPP
+*
+*	Load time level of detail generation and runtime LOD selection.
+*
+*	simplifyMesh() reduces an indexed triangle list with quadric error metrics
+*	through half-edge collapses. Vertices are never moved or created, so every
+*	LOD is just another index list over the original vertex buffer.
+*	- UV seams and hard edges (vertices sharing a position) are locked
+*	- Open borders only collapse along themselves and carry extra edge planes
+*	- Collapses are penalised by the normal and UV difference of their endpoints
+*
+*	buildLodChain() appends the LOD index ranges after LOD0 in the index buffer,
+*	each level simplified from the previous one. Meshes under LOD_MIN_TRIANGLES
+*	(a cube, a quad) keep LOD0 alone and the chain stops at a level under it:
+*	they cost a draw call either way, simplifying them only costs load time.
+*	The position groups are built once for the whole chain.
+*
+*	selectLod() picks the coarsest level whose error, projected on screen from
+*	the camera distance and FOV, stays below a pixel threshold.
+*/
+
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <MESH/mesh_types.hpp>
+#include <BOUNDS/bounds.hpp>
+#include <CAMERA/base_camera.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+
+#define LOD_DEFAULT_LEVELS 4
+#define LOD_MAX_LEVELS 5
+#define LOD_MIN_TRIANGLES 512		// Smaller levels aren't simplified further
+
+// Border planes weight relative to the surface planes
+#define LOD_BORDER_WEIGHT 10.0
+
+struct MeshLod
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	float error;	// Object space deviation from LOD0
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Quadric simplification utility functions"
+
+// Symmetric 4x4 plane quadric plus the accumulated weight used to normalize it
+struct Quadric
+{
+	double a2, ab, ac, ad;
+	double b2, bc, bd;
+	double c2, cd;
+	double d2;
+	double w;
+};
+
+inline Quadric makePlaneQuadric(const glm::vec3& n, float d, double weight)
+{
+	Quadric q;
+	q.a2 = n.x * n.x * weight; q.ab = n.x * n.y * weight; q.ac = n.x * n.z * weight; q.ad = n.x * d * weight;
+	q.b2 = n.y * n.y * weight; q.bc = n.y * n.z * weight; q.bd = n.y * d * weight;
+	q.c2 = n.z * n.z * weight; q.cd = n.z * d * weight;
+	q.d2 = (double)d * d * weight;
+	q.w = weight;
+	return q;
+}
+
+inline void addQuadric(Quadric& to, const Quadric& q)
+{
+	to.a2 += q.a2; to.ab += q.ab; to.ac += q.ac; to.ad += q.ad;
+	to.b2 += q.b2; to.bc += q.bc; to.bd += q.bd;
+	to.c2 += q.c2; to.cd += q.cd;
+	to.d2 += q.d2;
+	to.w += q.w;
+}
+
+// Weighted average squared distance from p to the quadric planes
+inline double quadricError(const Quadric& q, const glm::vec3& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double r = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z
+		+ 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+		+ 2.0 * (q.ad * x + q.bd * y + q.cd * z)
+		+ q.d2;
+	return q.w > 0.0 ? std::fabs(r) / q.w : 0.0;
+}
+
+enum LodVertexKind : uint8_t
+{
+	lod_manifold,
+	lod_border,
+	lod_locked
+};
+
+struct PositionKey
+{
+	uint32_t x, y, z;
+	bool operator==(const PositionKey& o) const { return x == o.x && y == o.y && z == o.z; }
+};
+
+struct PositionKeyHash
+{
+	size_t operator()(const PositionKey& k) const
+	{
+		return (size_t)((k.x * 73856093u) ^ (k.y * 19349663u) ^ (k.z * 83492791u));
+	}
+};
+
+inline uint64_t edgeKey(GLuint a, GLuint b) { return ((uint64_t)a << 32) | b; }
+
+// Vertices sharing a position, the same for every LOD of a vertex buffer
+struct LodPositionGroups
+{
+	std::vector<GLuint> ids;		// Group of each vertex
+	std::vector<GLuint> sizes;		// Vertices in each group
+};
+
+inline LodPositionGroups groupLodPositions(const std::vector<Vertex>& vertices)
+{
+	LodPositionGroups groups;
+	groups.ids.resize(vertices.size());
+
+	std::unordered_map<PositionKey, GLuint, PositionKeyHash> keys;
+	keys.reserve(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++)
+	{
+		PositionKey key;
+		std::memcpy(&key, &vertices[v].position, sizeof(key));
+		std::unordered_map<PositionKey, GLuint, PositionKeyHash>::iterator it = keys.find(key);
+		if (it == keys.end())
+		{
+			it = keys.insert({ key, (GLuint)groups.sizes.size() }).first;
+			groups.sizes.push_back(0);
+		}
+		groups.ids[v] = it->second;
+		groups.sizes[it->second]++;
+	}
+	return groups;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+/*
+*	Simplifies indices (a triangle list over vertices) until it reaches
+*	targetIndexCount or no collapse under targetError (object space distance)
+*	is left. Returns the new index list, resultError receives the largest
+*	error introduced. positionGroups (groupLodPositions() of vertices) can be
+*	shared by several calls over the same vertices, it is built here otherwise.
+*/
+inline std::vector<GLuint> simplifyMesh(const std::vector<Vertex>& vertices, const GLuint* indices, size_t indexCount,
+	size_t targetIndexCount, float targetError = FLT_MAX, float attributeWeight = 1.0f, float* resultError = nullptr,
+	const LodPositionGroups* positionGroups = nullptr)
+{
+	std::vector<GLuint> result(indices, indices + indexCount - indexCount % 3);
+	size_t vertexCount = vertices.size();
+	double maxError = 0.0;
+	double errorLimit = targetError >= FLT_MAX ? DBL_MAX : (double)targetError * targetError;
+
+	// Vertices sharing a position are seams or hard edges
+	LodPositionGroups localGroups;
+	if (!positionGroups)
+	{
+		localGroups = groupLodPositions(vertices);
+		positionGroups = &localGroups;
+	}
+	const std::vector<GLuint>& positionIDs = positionGroups->ids;
+	const std::vector<GLuint>& groupSizes = positionGroups->sizes;
+
+	// Classify positions from their directed edges, borders have no opposite edge
+	std::vector<uint8_t> kinds(vertexCount, lod_manifold);
+	std::unordered_map<uint64_t, int> edges;
+	{
+		edges.reserve(result.size());
+		for (size_t i = 0; i < result.size(); i += 3)
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint a = positionIDs[result[i + k]], b = positionIDs[result[i + (k + 1) % 3]];
+				if (a != b) edges[edgeKey(a, b)]++;
+			}
+
+		std::vector<int> borderEdges(groupSizes.size(), 0);
+		std::vector<bool> complex(groupSizes.size(), false);
+		for (const std::pair<const uint64_t, int>& edge : edges)
+		{
+			GLuint a = (GLuint)(edge.first >> 32), b = (GLuint)edge.first;
+			if (edge.second > 1) complex[a] = complex[b] = true;
+			if (edges.find(edgeKey(b, a)) == edges.end()) { borderEdges[a]++; borderEdges[b]++; }
+		}
+
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			GLuint p = positionIDs[v];
+			if (groupSizes[p] > 1 || complex[p] || (borderEdges[p] != 0 && borderEdges[p] != 2)) kinds[v] = lod_locked;
+			else if (borderEdges[p] == 2) kinds[v] = lod_border;
+		}
+	}
+
+	// Area weighted plane quadrics, plus perpendicular planes along borders
+	std::vector<Quadric> quadrics(vertexCount);
+	std::memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		const glm::vec3& p0 = vertices[result[i]].position;
+		const glm::vec3& p1 = vertices[result[i + 1]].position;
+		const glm::vec3& p2 = vertices[result[i + 2]].position;
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length <= 0.0f) continue;
+		normal /= length;
+
+		Quadric q = makePlaneQuadric(normal, -glm::dot(normal, p0), length * 0.5);
+		for (int k = 0; k < 3; k++) addQuadric(quadrics[result[i + k]], q);
+
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint a = result[i + k], b = result[i + (k + 1) % 3];
+			if (edges.find(edgeKey(positionIDs[b], positionIDs[a])) != edges.end()) continue;
+
+			glm::vec3 edge = vertices[b].position - vertices[a].position;
+			glm::vec3 borderNormal = glm::cross(edge, normal);
+			float borderLength = glm::length(borderNormal);
+			if (borderLength <= 0.0f) continue;
+			borderNormal /= borderLength;
+
+			Quadric border = makePlaneQuadric(borderNormal, -glm::dot(borderNormal, vertices[a].position),
+				glm::dot(edge, edge) * LOD_BORDER_WEIGHT);
+			addQuadric(quadrics[a], border);
+			addQuadric(quadrics[b], border);
+		}
+	}
+
+	struct Collapse
+	{
+		GLuint from, to;
+		double error;
+	};
+
+	std::vector<Collapse> collapses;
+	std::vector<GLuint> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<GLuint> starOffsets(vertexCount + 1), star;
+
+	while (result.size() > targetIndexCount)
+	{
+		// Vertex -> triangle adjacency of the current triangles
+		std::fill(starOffsets.begin(), starOffsets.end(), 0);
+		for (GLuint index : result) starOffsets[index + 1]++;
+		for (size_t v = 0; v < vertexCount; v++) starOffsets[v + 1] += starOffsets[v];
+		star.resize(result.size());
+		std::vector<GLuint> fill(starOffsets.begin(), starOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++) star[fill[result[i]]++] = (GLuint)(i / 3);
+
+		edges.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+			for (int k = 0; k < 3; k++) edges[edgeKey(positionIDs[result[i + k]], positionIDs[result[i + (k + 1) % 3]])]++;
+
+		// Candidate collapses over both directions of every edge
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint a = result[i + k], b = result[i + (k + 1) % 3];
+				for (int dir = 0; dir < 2; dir++)
+				{
+					GLuint from = dir ? b : a, to = dir ? a : b;
+					if (kinds[from] == lod_locked) continue;
+
+					// Borders only slide along border edges
+					GLuint fromPosition = positionIDs[from], toPosition = positionIDs[to];
+					bool borderEdge = edges.find(edgeKey(toPosition, fromPosition)) == edges.end() || edges.find(edgeKey(fromPosition, toPosition)) == edges.end();
+					if (kinds[from] == lod_border && !borderEdge) continue;
+
+					Quadric q = quadrics[from];
+					addQuadric(q, quadrics[to]);
+					double error = quadricError(q, vertices[to].position);
+
+					glm::vec3 offset = vertices[to].position - vertices[from].position;
+					glm::vec3 normalDelta = vertices[to].normal - vertices[from].normal;
+					glm::vec2 uvDelta = vertices[to].texCoords - vertices[from].texCoords;
+					error += attributeWeight * (glm::dot(normalDelta, normalDelta) + glm::dot(uvDelta, uvDelta)) * glm::dot(offset, offset);
+
+					if (error <= errorLimit) collapses.push_back({ from, to, error });
+				}
+			}
+
+		if (collapses.empty()) break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		// Each collapse removes about two triangles
+		size_t budget = (result.size() - targetIndexCount) / 6 + 1;
+		size_t applied = 0;
+		for (size_t v = 0; v < vertexCount; v++) remap[v] = (GLuint)v;
+		std::fill(touched.begin(), touched.end(), false);
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (applied == budget) break;
+			if (touched[collapse.from] || touched[collapse.to]) continue;
+
+			// Reject collapses that flip any triangle staying around the vertex
+			bool flips = false;
+			for (GLuint s = starOffsets[collapse.from]; s < starOffsets[collapse.from + 1] && !flips; s++)
+			{
+				const GLuint* tri = &result[star[s] * 3];
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) continue;
+
+				glm::vec3 before[3], after[3];
+				for (int k = 0; k < 3; k++)
+				{
+					before[k] = vertices[tri[k]].position;
+					after[k] = tri[k] == collapse.from ? vertices[collapse.to].position : before[k];
+				}
+				glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+				flips = glm::dot(n0, n1) <= 0.0f;
+			}
+			if (flips) continue;
+
+			remap[collapse.from] = collapse.to;
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.error);
+			applied++;
+
+			// Lock the whole neighbourhood for this pass, its adjacency is now stale
+			for (GLuint s = starOffsets[collapse.from]; s < starOffsets[collapse.from + 1]; s++)
+				for (int k = 0; k < 3; k++) touched[result[star[s] * 3 + k]] = true;
+		}
+
+		if (applied == 0) break;
+
+		// Apply the collapses and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			GLuint a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (a == b || b == c || a == c) continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (resultError) *resultError = (float)std::sqrt(maxError);
+	return result;
+}
+
+/*
+*	Builds up to levels LODs (LOD0 included) from the triangle list in indices,
+*	appending every simplified level to it. Each level targets reduction times
+*	the triangles of the previous one and the chain stops early once a level no
+*	longer gets meaningfully smaller (e.g. everything left is locked) or has
+*	fewer than minTriangles.
+*/
+inline std::vector<MeshLod> buildLodChain(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+	int levels = LOD_DEFAULT_LEVELS, float reduction = 0.5f, float attributeWeight = 1.0f, size_t minTriangles = LOD_MIN_TRIANGLES)
+{
+	std::vector<MeshLod> lods;
+	if (indices.empty()) return lods;
+
+	lods.push_back({ 0, (GLuint)indices.size(), 0.0f });
+	levels = std::min(levels, LOD_MAX_LEVELS);
+	if (levels < 2 || indices.size() / 3 < minTriangles) return lods;
+
+	LodPositionGroups positionGroups = groupLodPositions(vertices);
+
+	std::vector<GLuint> source(indices.begin(), indices.end());
+	for (int level = 1; level < levels && source.size() / 3 >= minTriangles; level++)
+	{
+		size_t target = (size_t)(source.size() / 3 * reduction) * 3;
+		float error = 0.0f;
+		std::vector<GLuint> simplified = simplifyMesh(vertices, source.data(), source.size(), target, FLT_MAX, attributeWeight, &error,
+			&positionGroups);
+
+		if (simplified.empty() || simplified.size() > source.size() * 0.95f) break;
+
+		lods.push_back({ (GLuint)indices.size(), (GLuint)simplified.size(), lods.back().error + error });
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		source.swap(simplified);
+	}
+
+	return lods;
+}
+
+/*
+*	Coarsest LOD whose error, projected to the screen, stays under maxPixelError.
+*	fovY in degrees, as used by glm::perspective callers in this project
+*/
+inline int selectLod(const std::vector<MeshLod>& lods, float distance, float fovY, float viewportHeight, float maxPixelError = 1.0f)
+{
+	if (lods.empty()) return 0;
+
+	float pixelsPerUnit = viewportHeight / (2.0f * std::tan(glm::radians(fovY) * 0.5f) * std::max(distance, 1e-4f));
+
+	int lod = 0;
+	for (size_t i = 1; i < lods.size(); i++)
+	{
+		if (lods[i].error * pixelsPerUnit > maxPixelError) break;
+		lod = (int)i;
+	}
+	return lod;
+}
+
+// Same as above measuring the distance from the viewer to the closest point of the bounding sphere
+inline int selectLod(const std::vector<MeshLod>& lods, const glm::vec3& viewer, const glm::mat4& model, const BoundingSphere& bounds,
+	float fovY, float viewportHeight, float maxPixelError = 1.0f)
+{
+	BoundingSphere world = transformSphere(bounds, model);
+	float distance = std::max(glm::length(world.center - viewer) - world.radius, 0.0f);
+
+	// Errors are in object space, bring the distance to the same space
+	return selectLod(lods, distance / std::max(maxAxisScale(model), 1e-6f), fovY, viewportHeight, maxPixelError);
+}
+
+inline int selectLod(const std::vector<MeshLod>& lods, BaseCamera& camera, const glm::mat4& model, const BoundingSphere& bounds,
+	float fovY, float viewportHeight, float maxPixelError = 1.0f)
+{
+	return selectLod(lods, camera.getPosition(), model, bounds, fovY, viewportHeight, maxPixelError);
+}
+
+#endif // !MESH_LOD_H
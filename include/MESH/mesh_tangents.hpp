@@ -0,0 +1,213 @@
+/*
+*	MESH_TANGENTS.HPP
+*
+*	Import time tangent space generation for normal mapped meshes.
+*
+*	generateTangents() works on the vertices of an indexed mesh: per triangle
+*	tangents from the UV gradients, projected on each vertex normal and
+*	accumulated with corner angle weights, then orthogonalized, with
+*	bitangent = sign * cross(normal, tangent). Triangles and vertices are
+*	processed in parallel on a ThreadPool.
+*
+*	A vertex has a single handedness, so splitMirroredVertices() runs first and
+*	gives the mirrored triangles (negative UV area) their own copy of every
+*	vertex they share with regular ones. That is the only split: vertices are
+*	not divided into smoothing groups the way MikkTSpace does it, so the frames
+*	match MikkTSpace where the UVs are continuous but are not bit compatible
+*	with normal maps baked by MikkTSpace tools across hard UV seams.
+*
+*	The output is an optional per vertex stream of QTangents: the tangent frame
+*	stored as a quaternion in 4 snorm16 values, handedness in the sign of w.
+*	Shaders decode it with decodeQTangent() (see shaders/vertex/model_shader.vert).
+*/
+
+#ifndef MESH_TANGENTS_H
+#define MESH_TANGENTS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include <MESH/mesh_types.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+typedef glm::i16vec4 QTangent;
+
+#define TANGENT_GRAIN 4096
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Tangent frame encoding utility functions"
+
+inline glm::vec3 anyPerpendicular(const glm::vec3& n)
+{
+	glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	return glm::normalize(glm::cross(axis, n));
+}
+
+inline QTangent encodeQTangent(const glm::vec3& normal, const glm::vec3& tangent, float handedness)
+{
+	glm::vec3 n = glm::normalize(normal);
+	glm::vec3 t = tangent - n * glm::dot(n, tangent);
+	t = glm::dot(t, t) > 1e-12f ? glm::normalize(t) : anyPerpendicular(n);
+
+	// Columns tangent, cross(n, t), normal form a proper rotation
+	glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, glm::cross(n, t), n)));
+	if (q.w < 0.0f) q = -q;
+
+	// snorm16 has no negative zero, keep w away from it so its sign survives
+	const float bias = 1.0f / 32767.0f;
+	if (q.w < bias)
+	{
+		float scale = std::sqrt(1.0f - bias * bias);
+		q = glm::quat(bias, q.x * scale, q.y * scale, q.z * scale);
+	}
+	if (handedness < 0.0f) q = -q;
+
+	return QTangent((short)std::lround(q.x * 32767.0f), (short)std::lround(q.y * 32767.0f),
+		(short)std::lround(q.z * 32767.0f), (short)std::lround(q.w * 32767.0f));
+}
+
+inline void decodeQTangent(const QTangent& encoded, glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent)
+{
+	glm::quat q = glm::normalize(glm::quat(encoded.w / 32767.0f, encoded.x / 32767.0f, encoded.y / 32767.0f, encoded.z / 32767.0f));
+	glm::mat3 frame = glm::mat3_cast(q);
+
+	tangent = frame[0];
+	normal = frame[2];
+	bitangent = frame[1] * (encoded.w < 0 ? -1.0f : 1.0f);
+}
+
+// Twice the signed UV area of a triangle, negative for mirrored UVs
+inline float uvArea(const Vertex& a, const Vertex& b, const Vertex& c)
+{
+	glm::vec2 duv1 = b.texCoords - a.texCoords, duv2 = c.texCoords - a.texCoords;
+	return duv1.x * duv2.y - duv2.x * duv1.y;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+/*
+*	Duplicates the vertices shared by regular and mirrored triangles, the
+*	mirrored ones are rewired to the copies. Triangles without UV area take no
+*	side. Returns the number of vertices added at the end.
+*/
+inline size_t splitMirroredVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+{
+	size_t vertexCount = vertices.size();
+	size_t triangleCount = indices.size() / 3;
+
+	// Bit 0: used by a regular triangle, bit 1: by a mirrored one
+	std::vector<unsigned char> sides(vertexCount, 0), triangleSides(triangleCount, 0);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		float area = uvArea(vertices[indices[t * 3]], vertices[indices[t * 3 + 1]], vertices[indices[t * 3 + 2]]);
+		triangleSides[t] = area > 1e-20f ? 1 : (area < -1e-20f ? 2 : 0);
+		for (int k = 0; k < 3; k++) sides[indices[t * 3 + k]] |= triangleSides[t];
+	}
+
+	std::vector<GLuint> copies(vertexCount, UINT32_MAX);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (triangleSides[t] != 2) continue;
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint v = indices[t * 3 + k];
+			if (sides[v] != 3) continue;
+			if (copies[v] == UINT32_MAX)
+			{
+				copies[v] = (GLuint)vertices.size();
+				vertices.push_back(vertices[v]);
+			}
+			indices[t * 3 + k] = copies[v];
+		}
+	}
+	return vertices.size() - vertexCount;
+}
+
+// Run splitMirroredVertices() on the indices first, a vertex used by both sides gets an averaged frame
+inline std::vector<QTangent> generateTangents(const std::vector<Vertex>& vertices, const GLuint* indices, size_t indexCount,
+	ThreadPool& pool = ThreadPool::shared())
+{
+	size_t vertexCount = vertices.size();
+	size_t triangleCount = indexCount / 3;
+	std::vector<QTangent> tangents(vertexCount);
+	if (vertexCount == 0) return tangents;
+
+	// Per corner angle weighted tangent and bitangent, projected on the corner vertex normal
+	std::vector<glm::vec3> cornerTangents(triangleCount * 3), cornerBitangents(triangleCount * 3);
+
+	pool.parallelFor(triangleCount, TANGENT_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			const Vertex* v[3] = { &vertices[indices[t * 3]], &vertices[indices[t * 3 + 1]], &vertices[indices[t * 3 + 2]] };
+
+			glm::vec3 dp1 = v[1]->position - v[0]->position, dp2 = v[2]->position - v[0]->position;
+			glm::vec2 duv1 = v[1]->texCoords - v[0]->texCoords, duv2 = v[2]->texCoords - v[0]->texCoords;
+			float area = uvArea(*v[0], *v[1], *v[2]);
+
+			glm::vec3 triTangent = glm::vec3(0.0f), triBitangent = glm::vec3(0.0f);
+			if (std::fabs(area) > 1e-20f)
+			{
+				float sign = area > 0.0f ? 1.0f : -1.0f;
+				triTangent = (dp1 * duv2.y - dp2 * duv1.y) * sign;
+				triBitangent = (dp2 * duv1.x - dp1 * duv2.x) * sign;
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				glm::vec3 e0 = v[(k + 1) % 3]->position - v[k]->position, e1 = v[(k + 2) % 3]->position - v[k]->position;
+				float lengths = glm::length(e0) * glm::length(e1);
+				float angle = lengths > 0.0f ? std::acos(glm::clamp(glm::dot(e0, e1) / lengths, -1.0f, 1.0f)) : 0.0f;
+
+				glm::vec3 n = v[k]->normal;
+				glm::vec3 tangent = triTangent - n * glm::dot(n, triTangent);
+				glm::vec3 bitangent = triBitangent - n * glm::dot(n, triBitangent);
+				if (glm::dot(tangent, tangent) > 0.0f) tangent = glm::normalize(tangent);
+				if (glm::dot(bitangent, bitangent) > 0.0f) bitangent = glm::normalize(bitangent);
+
+				cornerTangents[t * 3 + k] = tangent * angle;
+				cornerBitangents[t * 3 + k] = bitangent * angle;
+			}
+		}
+	});
+
+	// Vertex -> corner adjacency, CSR layout
+	std::vector<GLuint> offsets(vertexCount + 1, 0), corners(triangleCount * 3);
+	for (size_t i = 0; i < triangleCount * 3; i++) offsets[indices[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+	{
+		std::vector<GLuint> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++) corners[fill[indices[i]]++] = (GLuint)i;
+	}
+
+	pool.parallelFor(vertexCount, TANGENT_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			glm::vec3 tangent = glm::vec3(0.0f), bitangent = glm::vec3(0.0f);
+			for (GLuint c = offsets[v]; c < offsets[v + 1]; c++)
+			{
+				tangent += cornerTangents[corners[c]];
+				bitangent += cornerBitangents[corners[c]];
+			}
+
+			glm::vec3 n = vertices[v].normal;
+			if (glm::dot(n, n) <= 0.0f) n = glm::vec3(0.0f, 0.0f, 1.0f);
+
+			float handedness = glm::dot(glm::cross(n, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+			tangents[v] = encodeQTangent(n, tangent, handedness);
+		}
+	});
+
+	return tangents;
+}
+
+#endif // !MESH_TANGENTS_H
@@ -0,0 +1,52 @@
+/*
+*	MESH_TYPES.HPP
+*
+*	Plain data types shared by Mesh and the geometry processing stages
+*	(batching, clustering...) that need them without pulling in Mesh itself.
+*/
+
+#ifndef MESH_TYPES_H
+#define MESH_TYPES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+struct Vertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texCoords;
+};
+
+// Non position part of a Vertex, used when positions live in their own stream
+struct VertexAttributes
+{
+	glm::vec3 normal;
+	glm::vec2 texCoords;
+};
+
+// Up to four joint influences of a skinned vertex, strongest first, weights in unorm8 summing to 255
+struct SkinWeights
+{
+	GLubyte joints[4];
+	GLubyte weights[4];
+};
+
+// How Mesh lays out its vertex buffers
+enum VertexStreamLayout
+{
+	stream_interleaved,		// One buffer of Vertex
+	stream_split_positions	// Packed positions + VertexAttributes, depth passes fetch 12 bytes per vertex
+};
+
+// Command layout consumed by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+#endif // !MESH_TYPES_H
\ No newline at end of file
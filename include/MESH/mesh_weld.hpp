@@ -0,0 +1,255 @@
+/*
+*	MESH_WELD.HPP
+*
+*	Vertex welding: merges duplicated vertices and rewrites the index buffer.
+*
+*	Every vertex is turned into a 8 x 32 bit key, the raw float bits or, with an
+*	epsilon, the attributes quantized to a grid of that size (vertices closer than
+*	epsilon but on different sides of a cell border are not merged). Keys and
+*	their hashes are computed with SSE. Skinned meshes pass their SkinWeights,
+*	which become two more lanes compared exactly.
+*
+*	Vertices are then split in partitions by hash and each partition is
+*	deduplicated on its own, so both stages run in parallel over chunks on a
+*	ThreadPool. The first occurrence of a vertex is kept and output vertices keep
+*	the input order.
+*/
+
+#ifndef MESH_WELD_H
+#define MESH_WELD_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <SIMD/simd.hpp>
+#include <MESH/mesh_types.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#define WELD_GRAIN 16384
+#define WELD_PARTITION_BITS 6
+
+struct WeldStats
+{
+	size_t inputVertices;
+	size_t outputVertices;
+	float dedupRatio;		// Output / input vertices
+	double milliseconds;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Weld utility functions"
+
+struct WeldKey
+{
+	uint32_t lanes[10];		// 8 Vertex floats, then the SkinWeights bytes (zero without skin)
+};
+
+static_assert(sizeof(Vertex) == 8 * sizeof(uint32_t), "Weld keys expect a 8 float Vertex");
+static_assert(sizeof(SkinWeights) == 2 * sizeof(uint32_t), "Weld keys expect 8 bytes of SkinWeights");
+
+inline uint64_t mixHash(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+// Key and hash of one vertex, invEpsilon 0 keeps the exact float bits, skin may be null
+inline uint64_t makeWeldKey(const Vertex& vertex, const SkinWeights* skin, float invEpsilon, WeldKey& key)
+{
+	uint64_t h;
+#ifdef SIMD_SSE
+	__m128 lo = _mm_loadu_ps((const float*)&vertex);
+	__m128 hi = _mm_loadu_ps((const float*)&vertex + 4);
+	__m128i a, b;
+
+	if (invEpsilon > 0.0f)
+	{
+		__m128 scale = _mm_set1_ps(invEpsilon);
+		a = _mm_cvtps_epi32(_mm_mul_ps(lo, scale));
+		b = _mm_cvtps_epi32(_mm_mul_ps(hi, scale));
+	}
+	else
+	{
+		// +0 and -0 must weld, adding zero turns -0 into +0
+		a = _mm_castps_si128(_mm_add_ps(lo, _mm_setzero_ps()));
+		b = _mm_castps_si128(_mm_add_ps(hi, _mm_setzero_ps()));
+	}
+
+	_mm_storeu_si128((__m128i*)key.lanes, a);
+	_mm_storeu_si128((__m128i*)(key.lanes + 4), b);
+
+	// Fold the 8 lanes into 4 with a rotate-xor, then finish in scalar
+	__m128i x = _mm_xor_si128(a, _mm_or_si128(_mm_slli_epi32(b, 13), _mm_srli_epi32(b, 19)));
+	x = _mm_add_epi32(x, _mm_setr_epi32(0x9e3779b1, 0x85ebca77, 0xc2b2ae3d, 0x27d4eb2f));
+
+	uint32_t folded[4];
+	_mm_storeu_si128((__m128i*)folded, x);
+	h = ((uint64_t)folded[0] << 32 | folded[1]) ^ mixHash((uint64_t)folded[2] << 32 | folded[3]);
+#else
+	const float* values = (const float*)&vertex;
+	for (int i = 0; i < 8; i++)
+	{
+		if (invEpsilon > 0.0f) key.lanes[i] = (uint32_t)(int32_t)std::nearbyint(values[i] * invEpsilon);
+		else
+		{
+			float value = values[i] + 0.0f;
+			std::memcpy(&key.lanes[i], &value, sizeof(float));
+		}
+	}
+
+	h = 0;
+	for (int i = 0; i < 8; i++) h = mixHash(h ^ ((uint64_t)key.lanes[i] * 0x9e3779b97f4a7c15ull + i));
+#endif
+
+	key.lanes[8] = key.lanes[9] = 0;
+	if (skin) std::memcpy(key.lanes + 8, skin, sizeof(SkinWeights));
+	return mixHash(h ^ ((uint64_t)key.lanes[8] << 32 | key.lanes[9]));
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+/*
+*	Welds vertices and returns the unique ones. indices is rewritten to point to
+*	them; when it is empty the input is treated as an unindexed triangle list
+*	and receives a fresh index buffer. With skin (one per vertex) only vertices
+*	with the same influences merge, and it is compacted like the vertices.
+*/
+inline std::vector<Vertex> weldVertices(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices, float epsilon = 0.0f,
+	WeldStats* stats = nullptr, ThreadPool& pool = ThreadPool::shared(), std::vector<SkinWeights>* skin = nullptr)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	size_t vertexCount = vertices.size();
+	float invEpsilon = epsilon > 0.0f ? 1.0f / epsilon : 0.0f;
+
+	std::vector<WeldKey> keys(vertexCount);
+	std::vector<uint64_t> hashes(vertexCount);
+	pool.parallelFor(vertexCount, WELD_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++) hashes[v] = makeWeldKey(vertices[v], skin ? skin->data() + v : nullptr, invEpsilon, keys[v]);
+	});
+
+	// Scatter vertices to partitions by the top hash bits, keeping input order inside each one
+	const size_t partitionCount = (size_t)1 << WELD_PARTITION_BITS;
+	size_t chunkCount = (vertexCount + WELD_GRAIN - 1) / WELD_GRAIN;
+	std::vector<size_t> histogram(chunkCount * partitionCount, 0);
+
+	pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; chunk++)
+			for (size_t v = chunk * WELD_GRAIN; v < std::min(vertexCount, (chunk + 1) * WELD_GRAIN); v++)
+				histogram[chunk * partitionCount + (hashes[v] >> (64 - WELD_PARTITION_BITS))]++;
+	});
+
+	std::vector<size_t> partitionOffsets(partitionCount + 1, 0);
+	{
+		size_t offset = 0;
+		for (size_t p = 0; p < partitionCount; p++)
+		{
+			partitionOffsets[p] = offset;
+			for (size_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				size_t count = histogram[chunk * partitionCount + p];
+				histogram[chunk * partitionCount + p] = offset;
+				offset += count;
+			}
+		}
+		partitionOffsets[partitionCount] = offset;
+	}
+
+	std::vector<GLuint> partitioned(vertexCount);
+	pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; chunk++)
+			for (size_t v = chunk * WELD_GRAIN; v < std::min(vertexCount, (chunk + 1) * WELD_GRAIN); v++)
+				partitioned[histogram[chunk * partitionCount + (hashes[v] >> (64 - WELD_PARTITION_BITS))]++] = (GLuint)v;
+	});
+
+	// Each partition finds the first occurrence of its vertices with an open addressing table
+	std::vector<GLuint> representative(vertexCount);
+	pool.parallelFor(partitionCount, 1, [&](size_t begin, size_t end)
+	{
+		std::vector<GLuint> table;
+		for (size_t p = begin; p < end; p++)
+		{
+			size_t count = partitionOffsets[p + 1] - partitionOffsets[p];
+			if (count == 0) continue;
+
+			size_t capacity = 16;
+			while (capacity < count * 2) capacity <<= 1;
+			table.assign(capacity, UINT32_MAX);
+
+			for (size_t i = partitionOffsets[p]; i < partitionOffsets[p + 1]; i++)
+			{
+				GLuint v = partitioned[i];
+				size_t slot = (size_t)hashes[v] & (capacity - 1);
+
+				while (true)
+				{
+					GLuint candidate = table[slot];
+					if (candidate == UINT32_MAX)
+					{
+						table[slot] = v;
+						representative[v] = v;
+						break;
+					}
+					if (hashes[candidate] == hashes[v] && std::memcmp(&keys[candidate], &keys[v], sizeof(WeldKey)) == 0)
+					{
+						representative[v] = candidate;
+						break;
+					}
+					slot = (slot + 1) & (capacity - 1);
+				}
+			}
+		}
+	});
+
+	// Representatives always come first, so one ordered pass numbers the output
+	std::vector<GLuint> remap(vertexCount);
+	std::vector<Vertex> welded;
+	welded.reserve(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (representative[v] == v)
+		{
+			remap[v] = (GLuint)welded.size();
+			welded.push_back(vertices[v]);
+			if (skin) (*skin)[remap[v]] = (*skin)[v];
+		}
+		else remap[v] = remap[representative[v]];
+	}
+	if (skin) skin->resize(welded.size());
+
+	if (indices.empty()) indices.swap(remap);
+	else
+	{
+		pool.parallelFor(indices.size(), WELD_GRAIN, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++) indices[i] = remap[indices[i]];
+		});
+	}
+
+	if (stats)
+	{
+		stats->inputVertices = vertexCount;
+		stats->outputVertices = welded.size();
+		stats->dedupRatio = vertexCount ? (float)welded.size() / (float)vertexCount : 1.0f;
+		stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	return welded;
+}
+
+#endif // !MESH_WELD_H
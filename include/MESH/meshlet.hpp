@@ -0,0 +1,297 @@
+/*
+*	MESHLET.HPP
+*
+*	Clustering stage that splits an indexed triangle list into meshlets of at most
+*	MESHLET_MAX_VERTICES unique vertices and MESHLET_MAX_TRIANGLES triangles.
+*
+*	buildMeshlets() grows each meshlet greedily through shared vertices and
+*	reorders the index buffer in place so every meshlet ends up as a contiguous
+*	index range. A meshlet can then be drawn straight from the mesh EBO.
+*
+*	Every meshlet stores a bounding sphere and a backface cone:
+*	- cullMeshlets() tests them against the camera frustum and position and
+*	  writes the indices of the meshlets that survive
+*	- buildMeshletCommands() turns that list into indirect draw commands
+*/
+
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <MESH/mesh_types.hpp>
+
+#include <vector>
+#include <cmath>
+#include <climits>
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct Meshlet
+{
+	// Index range inside the mesh index buffer
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLuint vertexCount;
+
+	// Object space bounding sphere
+	glm::vec3 center;
+	float radius;
+
+	// Backface cone, every triangle faces away from a viewer inside it.
+	// A cutoff above 1 means the normals are too spread to ever cull the meshlet
+	glm::vec3 coneApex;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Meshlet build utility functions"
+
+inline void computeMeshletBounds(Meshlet& meshlet, const std::vector<Vertex>& vertices, const GLuint* indices, const std::vector<GLuint>& meshletVertices)
+{
+	// Sphere around the center of the vertex AABB
+	glm::vec3 minPos = vertices[meshletVertices[0]].position, maxPos = minPos;
+	for (GLuint v : meshletVertices)
+	{
+		minPos = glm::min(minPos, vertices[v].position);
+		maxPos = glm::max(maxPos, vertices[v].position);
+	}
+
+	meshlet.center = (minPos + maxPos) * 0.5f;
+	meshlet.radius = 0.0f;
+	for (GLuint v : meshletVertices)
+		meshlet.radius = glm::max(meshlet.radius, glm::length(vertices[v].position - meshlet.center));
+
+	// Cone axis is the average of the triangle normals
+	size_t triangleCount = meshlet.indexCount / 3;
+	std::vector<glm::vec3> normals(triangleCount, glm::vec3(0.0f));
+	glm::vec3 axis = glm::vec3(0.0f);
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+		const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+		const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f) normals[t] = normal / length;
+		axis += normals[t];
+	}
+
+	meshlet.coneApex = meshlet.center;
+	meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.coneCutoff = 2.0f;
+
+	float axisLength = glm::length(axis);
+	if (axisLength <= 0.0f) return;
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	for (const glm::vec3& normal : normals)
+		if (normal != glm::vec3(0.0f)) minDot = glm::min(minDot, glm::dot(axis, normal));
+
+	// Normals spread over a hemisphere or more, no viewer sees all of them from behind
+	if (minDot <= 0.0f) return;
+
+	// Apex is the point along -axis that lies behind every triangle plane
+	float maxT = 0.0f;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (normals[t] == glm::vec3(0.0f)) continue;
+		const glm::vec3& p0 = vertices[indices[t * 3]].position;
+		float t0 = glm::dot(meshlet.center - p0, normals[t]) / glm::dot(axis, normals[t]);
+		maxT = glm::max(maxT, t0);
+	}
+
+	meshlet.coneApex = meshlet.center - axis * maxT;
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+/*
+*	Splits the triangle list into meshlets and reorders indices so that each
+*	meshlet is a contiguous range. Triangles are added by the fewest new vertices
+*	they bring in, among those sharing a vertex with the meshlet; when there are
+*	none left the next unused triangle in index order starts filling it.
+*/
+inline std::vector<Meshlet> buildMeshlets(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+	size_t maxVertices = MESHLET_MAX_VERTICES, size_t maxTriangles = MESHLET_MAX_TRIANGLES)
+{
+	std::vector<Meshlet> meshlets;
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || vertices.empty() || maxVertices < 3 || maxTriangles < 1) return meshlets;
+
+	// Vertex -> triangle adjacency, CSR layout
+	std::vector<GLuint> adjacencyOffsets(vertices.size() + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++) adjacencyOffsets[indices[i] + 1]++;
+	for (size_t v = 0; v < vertices.size(); v++) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+	std::vector<GLuint> adjacency(triangleCount * 3);
+	std::vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = (GLuint)t;
+
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<GLuint> vertexStamp(vertices.size(), UINT_MAX); // Last meshlet that used the vertex
+	std::vector<GLuint> reordered;
+	std::vector<GLuint> meshletVertices, candidates;
+	reordered.reserve(triangleCount * 3);
+
+	size_t scan = 0;
+	while (true)
+	{
+		while (scan < triangleCount && emitted[scan]) scan++;
+		if (scan == triangleCount) break;
+
+		GLuint stamp = (GLuint)meshlets.size();
+		Meshlet meshlet;
+		meshlet.firstIndex = (GLuint)reordered.size();
+		meshletVertices.clear();
+		candidates.clear();
+
+		size_t next = scan, triangles = 0;
+		while (true)
+		{
+			emitted[next] = true;
+			triangles++;
+
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint v = indices[next * 3 + k];
+				reordered.push_back(v);
+				if (vertexStamp[v] == stamp) continue;
+
+				vertexStamp[v] = stamp;
+				meshletVertices.push_back(v);
+				for (GLuint a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; a++)
+					if (!emitted[adjacency[a]]) candidates.push_back(adjacency[a]);
+			}
+
+			if (triangles == maxTriangles) break;
+
+			// Connected triangle that adds the fewest vertices
+			long best = -1;
+			size_t bestCost = 4;
+			for (size_t c = 0; c < candidates.size();)
+			{
+				GLuint t = candidates[c];
+				if (emitted[t])
+				{
+					candidates[c] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+
+				size_t cost = 0;
+				for (int k = 0; k < 3; k++) cost += vertexStamp[indices[t * 3 + k]] != stamp;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					best = (long)t;
+					if (cost == 0) break;
+				}
+				c++;
+			}
+
+			// Nothing connected left, keep filling with the next unused triangle
+			if (best < 0)
+			{
+				while (scan < triangleCount && emitted[scan]) scan++;
+				if (scan == triangleCount) break;
+				best = (long)scan;
+				bestCost = 0;
+				for (int k = 0; k < 3; k++) bestCost += vertexStamp[indices[scan * 3 + k]] != stamp;
+			}
+
+			if (meshletVertices.size() + bestCost > maxVertices) break;
+			next = (size_t)best;
+		}
+
+		meshlet.indexCount = (GLuint)reordered.size() - meshlet.firstIndex;
+		meshlet.vertexCount = (GLuint)meshletVertices.size();
+		computeMeshletBounds(meshlet, vertices, reordered.data() + meshlet.firstIndex, meshletVertices);
+		meshlets.push_back(meshlet);
+	}
+
+	// Trailing indices that don't form a full triangle are kept at the end
+	for (size_t i = triangleCount * 3; i < indices.size(); i++) reordered.push_back(indices[i]);
+
+	indices.swap(reordered);
+	return meshlets;
+}
+
+/*
+*	Frustum and backface cone culling of a mesh placed with the given model matrix.
+*	Planes are extracted from viewProjection * model and the camera is moved to
+*	object space, so both tests run on the untransformed meshlet data.
+*	Returns the number of visible meshlets written to visible.
+*/
+inline size_t cullMeshlets(const std::vector<Meshlet>& meshlets, const glm::mat4& model, const glm::mat4& viewProjection,
+	const glm::vec3& cameraPosition, std::vector<GLuint>& visible)
+{
+	visible.clear();
+
+	glm::mat4 mvp = viewProjection * model;
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) rows[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+
+	glm::vec4 planes[6] = {
+		rows[3] + rows[0], rows[3] - rows[0],	// Left, right
+		rows[3] + rows[1], rows[3] - rows[1],	// Bottom, top
+		rows[3] + rows[2], rows[3] - rows[2]	// Near, far
+	};
+	for (glm::vec4& plane : planes) plane /= glm::length(glm::vec3(plane));
+
+	glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+
+	for (size_t i = 0; i < meshlets.size(); i++)
+	{
+		const Meshlet& meshlet = meshlets[i];
+
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+			inside = glm::dot(glm::vec3(planes[p]), meshlet.center) + planes[p].w >= -meshlet.radius;
+		if (!inside) continue;
+
+		if (meshlet.coneCutoff <= 1.0f)
+		{
+			glm::vec3 toApex = meshlet.coneApex - camera;
+			float distance = glm::length(toApex);
+			if (distance > 0.0f && glm::dot(toApex / distance, meshlet.coneAxis) >= meshlet.coneCutoff) continue;
+		}
+
+		visible.push_back((GLuint)i);
+	}
+
+	return visible.size();
+}
+
+// Indirect commands for the visible meshlets, consecutive meshlets are merged into one command
+inline void buildMeshletCommands(const std::vector<Meshlet>& meshlets, const std::vector<GLuint>& visible,
+	std::vector<DrawElementsIndirectCommand>& commands, GLint baseVertex = 0, GLuint baseInstance = 0)
+{
+	commands.clear();
+
+	for (size_t i = 0; i < visible.size(); i++)
+	{
+		const Meshlet& meshlet = meshlets[visible[i]];
+
+		if (i > 0 && visible[i] == visible[i - 1] + 1)
+		{
+			commands.back().count += meshlet.indexCount;
+			continue;
+		}
+
+		commands.push_back({ meshlet.indexCount, 1, meshlet.firstIndex, baseVertex, baseInstance });
+	}
+}
+
+#endif // !MESHLET_H
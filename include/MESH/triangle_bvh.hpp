@@ -0,0 +1,435 @@
+/*
+*	TRIANGLE_BVH.HPP
+*
+*	Static bounding volume hierarchy over the triangles of one mesh, in the
+*	mesh's own space, for exact ray queries (picking, line of sight, tools).
+*
+*	build() is a top down binned SAH build over the triangle centroids. The
+*	split cost counts leaves in packets of TRIANGLE_PACKET triangles, and
+*	ranges keep being split until they fit in one packet, so each leaf is a
+*	single TrianglePacket: the first vertex and both edges of up to 8
+*	triangles, stored per component so one Moller-Trumbore test covers the
+*	whole leaf (8 lanes with AVX2, two halves of 4 with SSE, a loop without).
+*
+*	Nodes are stored depth first with the two children of a node next to
+*	each other, intersect() walks them near child first and skips any node
+*	beyond the closest hit so far. Triangles are reported by their index in
+*	the index range given to build(), barycentrics are the weights of the
+*	triangle's second and third vertices. Both faces are hit.
+*/
+
+#ifndef TRIANGLE_BVH_H
+#define TRIANGLE_BVH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <SIMD/simd.hpp>
+#include <BOUNDS/bounds.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+
+#define TRIANGLE_PACKET 8				// Triangles of a leaf, tested together
+#define TRIANGLE_BVH_BINS 12
+#define TRIANGLE_BVH_STACK 64			// Traversal stack, the build stops splitting at this depth
+#define TRIANGLE_NONE UINT32_MAX
+#define TRIANGLE_EPSILON 1e-20f			// Below it the ray is taken as parallel to the triangle
+
+struct TriangleBVHNode
+{
+	AABB box;
+	uint32_t first;						// Left child, the right one follows it, or the leaf's packet
+	uint32_t count;						// Triangles of the leaf, 0 for inner nodes
+};
+
+// Unused lanes have null edges, which the test never reports
+struct TrianglePacket
+{
+	float v0[3][TRIANGLE_PACKET];
+	float e1[3][TRIANGLE_PACKET];
+	float e2[3][TRIANGLE_PACKET];
+	uint32_t triangle[TRIANGLE_PACKET];
+};
+
+struct TriangleHit
+{
+	float distance;						// In units of the ray direction's length
+	uint32_t triangle;
+	glm::vec2 barycentrics;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Triangle BVH utility functions"
+
+/*
+*	Moller-Trumbore, both faces. Returns the hit distance in [0, maxDistance)
+*	or -1, u and v are written on hits only.
+*/
+inline float intersectRayTriangle(const glm::vec3& origin, const glm::vec3& direction,
+	const glm::vec3& v0, const glm::vec3& e1, const glm::vec3& e2, float maxDistance, float& u, float& v)
+{
+	glm::vec3 p = glm::cross(direction, e2);
+	float det = glm::dot(e1, p);
+	if (std::fabs(det) <= TRIANGLE_EPSILON) return -1.0f;
+
+	float inverse = 1.0f / det;
+	glm::vec3 s = origin - v0;
+	float hitU = glm::dot(s, p) * inverse;
+	if (hitU < 0.0f || hitU > 1.0f) return -1.0f;
+
+	glm::vec3 q = glm::cross(s, e1);
+	float hitV = glm::dot(direction, q) * inverse;
+	if (hitV < 0.0f || hitU + hitV > 1.0f) return -1.0f;
+
+	float t = glm::dot(e2, q) * inverse;
+	if (t < 0.0f || t >= maxDistance) return -1.0f;
+
+	u = hitU;
+	v = hitV;
+	return t;
+}
+
+inline glm::vec3 loadTriangleVertex(const unsigned char* data, size_t stride, const GLuint* indices, size_t corner)
+{
+	return loadPosition(data, indices ? indices[corner] : corner, stride);
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class TriangleBVH
+{
+public:
+
+	TriangleBVH() { this->triangleCount = 0; }
+
+	/*
+	*	positions: vertexCount positions every stride bytes. indices: three per
+	*	triangle, or nullptr for a plain triangle list over the positions.
+	*/
+	void build(const void* positions, size_t vertexCount, size_t stride, const GLuint* indices, size_t indexCount)
+	{
+		this->nodes.clear();
+		this->packets.clear();
+		this->triangleCount = (indices ? indexCount : vertexCount) / 3;
+		if (this->triangleCount == 0) return;
+
+		const unsigned char* data = (const unsigned char*)positions;
+		std::vector<BuildTriangle> items(this->triangleCount);
+		for (size_t t = 0; t < this->triangleCount; t++)
+		{
+			glm::vec3 a = loadTriangleVertex(data, stride, indices, 3 * t), b = loadTriangleVertex(data, stride, indices, 3 * t + 1), c = loadTriangleVertex(data, stride, indices, 3 * t + 2);
+			items[t].box = { glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)) };
+			items[t].centroid = (items[t].box.min + items[t].box.max) * 0.5f;
+			items[t].triangle = (uint32_t)t;
+		}
+
+		this->nodes.reserve(2 * (this->triangleCount / (TRIANGLE_PACKET / 2) + 1));
+		this->packets.reserve(this->triangleCount / (TRIANGLE_PACKET / 2) + 1);
+
+		struct Task { uint32_t node; size_t begin, end; int depth; };
+		std::vector<Task> tasks;
+		this->nodes.push_back(TriangleBVHNode());
+		tasks.push_back({ 0, 0, items.size(), 0 });
+
+		while (!tasks.empty())
+		{
+			Task task = tasks.back();
+			tasks.pop_back();
+
+			AABB box = emptyAABB();
+			for (size_t i = task.begin; i < task.end; i++) box = mergeAABB(box, items[i].box);
+			this->nodes[task.node].box = box;
+
+			size_t count = task.end - task.begin;
+			if (count <= TRIANGLE_PACKET || task.depth >= TRIANGLE_BVH_STACK - 2)
+			{
+				// Ranges cut off by the depth limit take as many packets as they need
+				this->nodes[task.node].first = (uint32_t)this->packets.size();
+				this->nodes[task.node].count = (uint32_t)count;
+				for (size_t i = task.begin; i < task.end; i += TRIANGLE_PACKET)
+					addPacket(data, stride, indices, items, i, std::min(i + TRIANGLE_PACKET, task.end));
+				continue;
+			}
+
+			size_t middle = splitTriangles(items, task.begin, task.end);
+			uint32_t left = (uint32_t)this->nodes.size();
+			this->nodes.push_back(TriangleBVHNode());
+			this->nodes.push_back(TriangleBVHNode());
+			this->nodes[task.node].first = left;
+			this->nodes[task.node].count = 0;
+
+			tasks.push_back({ left + 1, middle, task.end, task.depth + 1 });
+			tasks.push_back({ left, task.begin, middle, task.depth + 1 });
+		}
+	}
+
+	/*
+	*	Closest triangle the ray hits before maxDistance. The direction does not
+	*	need to be normalized, distances are in units of its length, which keeps
+	*	them equal to world distances when a world ray is moved to mesh space.
+	*/
+	bool intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, TriangleHit& hit) const
+	{
+		if (this->nodes.empty()) return false;
+		glm::vec3 inverse = inverseRayDirection(direction);
+
+		struct Entry { uint32_t node; float distance; };
+		Entry stack[TRIANGLE_BVH_STACK];
+		int top = 0;
+
+		float rootDistance = intersectRayAABB(this->nodes[0].box, origin, inverse, maxDistance);
+		if (rootDistance < 0.0f) return false;
+		stack[top++] = { 0, rootDistance };
+
+		bool found = false;
+		while (top > 0)
+		{
+			Entry entry = stack[--top];
+			if (entry.distance >= maxDistance) continue;
+
+			const TriangleBVHNode& node = this->nodes[entry.node];
+			if (node.count > 0)
+			{
+				for (uint32_t p = 0; p * TRIANGLE_PACKET < node.count; p++)
+					found |= intersectPacket(this->packets[node.first + p], origin, direction, maxDistance, hit);
+				continue;
+			}
+
+			float d0 = intersectRayAABB(this->nodes[node.first].box, origin, inverse, maxDistance);
+			float d1 = intersectRayAABB(this->nodes[node.first + 1].box, origin, inverse, maxDistance);
+
+			// Far child first so the near one is popped next
+			if (d0 >= 0.0f && d1 >= 0.0f)
+			{
+				bool nearFirst = d0 <= d1;
+				stack[top++] = { node.first + (nearFirst ? 1 : 0), nearFirst ? d1 : d0 };
+				stack[top++] = { node.first + (nearFirst ? 0 : 1), nearFirst ? d0 : d1 };
+			}
+			else if (d0 >= 0.0f) stack[top++] = { node.first, d0 };
+			else if (d1 >= 0.0f) stack[top++] = { node.first + 1, d1 };
+		}
+		return found;
+	}
+
+	inline bool empty() const { return this->nodes.empty(); }
+	inline size_t getTriangleCount() const { return this->triangleCount; }
+	inline const AABB& getBounds() const { return this->nodes[0].box; }
+	inline const std::vector<TriangleBVHNode>& getNodes() const { return this->nodes; }
+	inline const std::vector<TrianglePacket>& getPackets() const { return this->packets; }
+
+private:
+
+	struct BuildTriangle
+	{
+		AABB box;
+		glm::vec3 centroid;
+		uint32_t triangle;
+	};
+
+	std::vector<TriangleBVHNode> nodes;
+	std::vector<TrianglePacket> packets;
+	size_t triangleCount;
+
+	void addPacket(const unsigned char* data, size_t stride, const GLuint* indices, const std::vector<BuildTriangle>& items, size_t begin, size_t end)
+	{
+		TrianglePacket packet = {};
+		for (size_t i = begin; i < end; i++)
+		{
+			size_t lane = i - begin, t = items[i].triangle;
+			glm::vec3 a = loadTriangleVertex(data, stride, indices, 3 * t), b = loadTriangleVertex(data, stride, indices, 3 * t + 1), c = loadTriangleVertex(data, stride, indices, 3 * t + 2);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				packet.v0[axis][lane] = a[axis];
+				packet.e1[axis][lane] = b[axis] - a[axis];
+				packet.e2[axis][lane] = c[axis] - a[axis];
+			}
+			packet.triangle[lane] = items[i].triangle;
+		}
+		for (size_t lane = end - begin; lane < TRIANGLE_PACKET; lane++) packet.triangle[lane] = TRIANGLE_NONE;
+		this->packets.push_back(packet);
+	}
+
+	// Binned SAH split along the widest centroid axis, leaves costed by packets
+	size_t splitTriangles(std::vector<BuildTriangle>& items, size_t begin, size_t end)
+	{
+		glm::vec3 minCentroid(FLT_MAX), maxCentroid(-FLT_MAX);
+		for (size_t i = begin; i < end; i++)
+		{
+			minCentroid = glm::min(minCentroid, items[i].centroid);
+			maxCentroid = glm::max(maxCentroid, items[i].centroid);
+		}
+
+		glm::vec3 extent = maxCentroid - minCentroid;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		size_t middle = begin + (end - begin) / 2;
+
+		// Every centroid in one point, any even split will do
+		if (extent[axis] <= 0.0f) return middle;
+
+		float scale = TRIANGLE_BVH_BINS / extent[axis];
+		auto binOf = [&](const BuildTriangle& item) { return std::min((int)((item.centroid[axis] - minCentroid[axis]) * scale), TRIANGLE_BVH_BINS - 1); };
+
+		AABB bins[TRIANGLE_BVH_BINS];
+		size_t counts[TRIANGLE_BVH_BINS] = {};
+		for (int b = 0; b < TRIANGLE_BVH_BINS; b++) bins[b] = emptyAABB();
+		for (size_t i = begin; i < end; i++)
+		{
+			int b = binOf(items[i]);
+			bins[b] = mergeAABB(bins[b], items[i].box);
+			counts[b]++;
+		}
+
+		// Right side sweep, then the left one evaluates every split plane
+		float rightArea[TRIANGLE_BVH_BINS];
+		size_t rightCount[TRIANGLE_BVH_BINS];
+		AABB right = emptyAABB();
+		size_t count = 0;
+		for (int b = TRIANGLE_BVH_BINS - 1; b > 0; b--)
+		{
+			right = mergeAABB(right, bins[b]);
+			count += counts[b];
+			rightArea[b] = isEmpty(right) ? 0.0f : surfaceArea(right);
+			rightCount[b] = count;
+		}
+
+		auto packetsOf = [](size_t n) { return (float)((n + TRIANGLE_PACKET - 1) / TRIANGLE_PACKET); };
+		AABB left = emptyAABB();
+		count = 0;
+		float bestCost = FLT_MAX;
+		int bestBin = -1;
+		for (int b = 1; b < TRIANGLE_BVH_BINS; b++)
+		{
+			left = mergeAABB(left, bins[b - 1]);
+			count += counts[b - 1];
+			if (count == 0 || rightCount[b] == 0) continue;
+
+			float cost = surfaceArea(left) * packetsOf(count) + rightArea[b] * packetsOf(rightCount[b]);
+			if (cost < bestCost) { bestCost = cost; bestBin = b; }
+		}
+
+		if (bestBin > 0)
+		{
+			BuildTriangle* split = std::partition(items.data() + begin, items.data() + end, [&](const BuildTriangle& item) { return binOf(item) < bestBin; });
+			size_t position = split - items.data();
+			if (position > begin && position < end) return position;
+		}
+
+		std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end,
+			[axis](const BuildTriangle& a, const BuildTriangle& b) { return a.centroid[axis] < b.centroid[axis]; });
+		return middle;
+	}
+
+	// Closest hit of the packet below maxDistance, which it shortens
+	static bool intersectPacket(const TrianglePacket& packet, const glm::vec3& origin, const glm::vec3& direction, float& maxDistance, TriangleHit& hit)
+	{
+		float t[TRIANGLE_PACKET], u[TRIANGLE_PACKET], v[TRIANGLE_PACKET];
+		unsigned int mask = 0;
+
+#if defined(SIMD_AVX2)
+		__m256 dx = _mm256_set1_ps(direction.x), dy = _mm256_set1_ps(direction.y), dz = _mm256_set1_ps(direction.z);
+		__m256 e1x = _mm256_loadu_ps(packet.e1[0]), e1y = _mm256_loadu_ps(packet.e1[1]), e1z = _mm256_loadu_ps(packet.e1[2]);
+		__m256 e2x = _mm256_loadu_ps(packet.e2[0]), e2y = _mm256_loadu_ps(packet.e2[1]), e2z = _mm256_loadu_ps(packet.e2[2]);
+
+		__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+		__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+		__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+		__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+		__m256 inverse = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+		__m256 sx = _mm256_sub_ps(_mm256_set1_ps(origin.x), _mm256_loadu_ps(packet.v0[0]));
+		__m256 sy = _mm256_sub_ps(_mm256_set1_ps(origin.y), _mm256_loadu_ps(packet.v0[1]));
+		__m256 sz = _mm256_sub_ps(_mm256_set1_ps(origin.z), _mm256_loadu_ps(packet.v0[2]));
+		__m256 hitU = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), inverse);
+
+		__m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+		__m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+		__m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+		__m256 hitV = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inverse);
+		__m256 hitT = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inverse);
+
+		__m256 zero = _mm256_setzero_ps();
+		__m256 absDet = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+		__m256 valid = _mm256_cmp_ps(absDet, _mm256_set1_ps(TRIANGLE_EPSILON), _CMP_GT_OQ);
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(hitU, zero, _CMP_GE_OQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(hitV, zero, _CMP_GE_OQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(hitU, hitV), _mm256_set1_ps(1.0f), _CMP_LE_OQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(hitT, zero, _CMP_GE_OQ));
+		valid = _mm256_and_ps(valid, _mm256_cmp_ps(hitT, _mm256_set1_ps(maxDistance), _CMP_LT_OQ));
+
+		mask = (unsigned int)_mm256_movemask_ps(valid);
+		if (!mask) return false;
+		_mm256_storeu_ps(t, hitT);
+		_mm256_storeu_ps(u, hitU);
+		_mm256_storeu_ps(v, hitV);
+#elif defined(SIMD_SSE)
+		__m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+		__m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+		__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), limit = _mm_set1_ps(maxDistance);
+		__m128 epsilon = _mm_set1_ps(TRIANGLE_EPSILON), signBit = _mm_set1_ps(-0.0f);
+
+		for (int half = 0; half < TRIANGLE_PACKET; half += 4)
+		{
+			__m128 e1x = _mm_loadu_ps(packet.e1[0] + half), e1y = _mm_loadu_ps(packet.e1[1] + half), e1z = _mm_loadu_ps(packet.e1[2] + half);
+			__m128 e2x = _mm_loadu_ps(packet.e2[0] + half), e2y = _mm_loadu_ps(packet.e2[1] + half), e2z = _mm_loadu_ps(packet.e2[2] + half);
+
+			__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 inverse = _mm_div_ps(one, det);
+
+			__m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(packet.v0[0] + half));
+			__m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(packet.v0[1] + half));
+			__m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(packet.v0[2] + half));
+			__m128 hitU = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+			__m128 hitV = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+			__m128 hitT = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+			__m128 valid = _mm_cmpgt_ps(_mm_andnot_ps(signBit, det), epsilon);
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(hitU, zero));
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(hitV, zero));
+			valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(hitU, hitV), one));
+			valid = _mm_and_ps(valid, _mm_cmpge_ps(hitT, zero));
+			valid = _mm_and_ps(valid, _mm_cmplt_ps(hitT, limit));
+
+			mask |= (unsigned int)_mm_movemask_ps(valid) << half;
+			_mm_storeu_ps(t + half, hitT);
+			_mm_storeu_ps(u + half, hitU);
+			_mm_storeu_ps(v + half, hitV);
+		}
+		if (!mask) return false;
+#else
+		for (int lane = 0; lane < TRIANGLE_PACKET; lane++)
+		{
+			glm::vec3 v0(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+			glm::vec3 e1(packet.e1[0][lane], packet.e1[1][lane], packet.e1[2][lane]);
+			glm::vec3 e2(packet.e2[0][lane], packet.e2[1][lane], packet.e2[2][lane]);
+			t[lane] = intersectRayTriangle(origin, direction, v0, e1, e2, maxDistance, u[lane], v[lane]);
+			if (t[lane] >= 0.0f) mask |= 1u << lane;
+		}
+		if (!mask) return false;
+#endif
+
+		int best = -1;
+		for (int lane = 0; lane < TRIANGLE_PACKET; lane++)
+			if ((mask >> lane & 1u) && t[lane] < maxDistance) { maxDistance = t[lane]; best = lane; }
+		if (best < 0) return false;
+
+		hit.distance = t[best];
+		hit.triangle = packet.triangle[best];
+		hit.barycentrics = glm::vec2(u[best], v[best]);
+		return true;
+	}
+};
+
+#endif // !TRIANGLE_BVH_H
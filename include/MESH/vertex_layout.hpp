@@ -0,0 +1,334 @@
+/*
+*	VERTEX_LAYOUT.HPP
+*
+*	Compile time description of interleaved vertex formats.
+*
+*	A layout lists its attributes in memory order, each one a semantic and a
+*	storage format:
+*
+*		typedef VertexLayout<Attr<Position, glm::vec3>, Attr<Normal, oct16>, Attr<TexCoords, glm::vec2>> CompactLayout;
+*
+*	Offsets and the stride are constexpr (CompactLayout::offset<1>(),
+*	CompactLayout::stride) so they can be static_assert'ed against the C++
+*	struct holding the data. The semantic fixes the shader location, which
+*	means every layout feeds the same shader inputs whatever the memory order:
+*	0 position, 1 normal, 2 texture coordinates, 3 QTangent, 4 skinning
+*	joints and 5 skinning weights.
+*
+*	apply() emits the glVertexArrayAttribFormat/Binding calls for a VAO and
+*	validateVertexLayout() checks a linked program's active inputs against one
+*	or more layouts (location and GLSL type), reporting what would otherwise be
+*	garbage on screen.
+*/
+
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include <SHADER/shader_s.hpp>
+#include <MESH/vertex_pulling.hpp>
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <string>
+#include <cstddef>
+#include <cmath>
+#include <utility>
+
+// Semantics -------------------------------------------------------------------
+#pragma region "Attribute semantics"
+
+struct Position { static constexpr GLuint location = 0; static const char* name() { return "position"; } };
+struct Normal { static constexpr GLuint location = 1; static const char* name() { return "normal"; } };
+struct TexCoords { static constexpr GLuint location = 2; static const char* name() { return "texCoords"; } };
+struct Tangent { static constexpr GLuint location = 3; static const char* name() { return "tangent"; } };
+struct Joints { static constexpr GLuint location = 4; static const char* name() { return "joints"; } };
+struct Weights { static constexpr GLuint location = 5; static const char* name() { return "weights"; } };
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+// Formats ---------------------------------------------------------------------
+#pragma region "Attribute storage formats"
+
+// Octahedral unit vector in 2 snorm16, arrives in the shader as a vec2 to decode
+struct oct16
+{
+	GLshort x, y;
+};
+
+inline oct16 packOct16(const glm::vec3& n)
+{
+	glm::vec2 e = encodeOctahedral(n);
+	return { (GLshort)std::lround(glm::clamp(e.x, -1.0f, 1.0f) * 32767.0f), (GLshort)std::lround(glm::clamp(e.y, -1.0f, 1.0f) * 32767.0f) };
+}
+
+/*
+*	Storage format traits: component count and type handed to
+*	glVertexArrayAttribFormat, and the GLSL type the shader input must have.
+*/
+template<typename T> struct AttribFormat;
+
+template<> struct AttribFormat<glm::vec2>
+{
+	static constexpr GLint components = 2;
+	static constexpr GLenum type = GL_FLOAT;
+	static constexpr GLboolean normalized = GL_FALSE;
+	static constexpr GLenum shaderType = GL_FLOAT_VEC2;
+};
+
+template<> struct AttribFormat<glm::vec3>
+{
+	static constexpr GLint components = 3;
+	static constexpr GLenum type = GL_FLOAT;
+	static constexpr GLboolean normalized = GL_FALSE;
+	static constexpr GLenum shaderType = GL_FLOAT_VEC3;
+};
+
+template<> struct AttribFormat<glm::vec4>
+{
+	static constexpr GLint components = 4;
+	static constexpr GLenum type = GL_FLOAT;
+	static constexpr GLboolean normalized = GL_FALSE;
+	static constexpr GLenum shaderType = GL_FLOAT_VEC4;
+};
+
+template<> struct AttribFormat<oct16>
+{
+	static constexpr GLint components = 2;
+	static constexpr GLenum type = GL_SHORT;
+	static constexpr GLboolean normalized = GL_TRUE;
+	static constexpr GLenum shaderType = GL_FLOAT_VEC2;
+};
+
+// QTangent (see MESH/mesh_tangents.hpp)
+template<> struct AttribFormat<glm::i16vec4>
+{
+	static constexpr GLint components = 4;
+	static constexpr GLenum type = GL_SHORT;
+	static constexpr GLboolean normalized = GL_TRUE;
+	static constexpr GLenum shaderType = GL_FLOAT_VEC4;
+};
+
+// Four joint indices in bytes, converted to float (exact up to 255), the shader casts them back to int
+struct joints8
+{
+	GLubyte x, y, z, w;
+};
+
+template<> struct AttribFormat<joints8>
+{
+	static constexpr GLint components = 4;
+	static constexpr GLenum type = GL_UNSIGNED_BYTE;
+	static constexpr GLboolean normalized = GL_FALSE;
+	static constexpr GLenum shaderType = GL_FLOAT_VEC4;
+};
+
+// Four unorm8 values
+struct unorm8x4
+{
+	GLubyte x, y, z, w;
+};
+
+template<> struct AttribFormat<unorm8x4>
+{
+	static constexpr GLint components = 4;
+	static constexpr GLenum type = GL_UNSIGNED_BYTE;
+	static constexpr GLboolean normalized = GL_TRUE;
+	static constexpr GLenum shaderType = GL_FLOAT_VEC4;
+};
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+template<typename S, typename F>
+struct Attr
+{
+	typedef S Semantic;
+	typedef F Format;
+};
+
+// Runtime view of one attribute, used to emit GL calls and validate programs
+struct VertexAttribInfo
+{
+	GLuint location;
+	GLint components;
+	GLenum type;
+	GLboolean normalized;
+	GLuint offset;
+	GLenum shaderType;
+	const char* semantic;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Layout utility templates"
+
+template<typename... Attrs> struct AttribSize { static constexpr GLuint value = 0; };
+
+template<typename First, typename... Rest> struct AttribSize<First, Rest...>
+{
+	static constexpr GLuint value = (GLuint)sizeof(typename First::Format) + AttribSize<Rest...>::value;
+};
+
+// Offset of the I-th attribute, the size of everything before it
+template<size_t I, typename... Attrs> struct AttribOffset;
+
+template<typename First, typename... Rest> struct AttribOffset<0, First, Rest...>
+{
+	static constexpr GLuint value = 0;
+};
+
+template<size_t I, typename First, typename... Rest> struct AttribOffset<I, First, Rest...>
+{
+	static constexpr GLuint value = (GLuint)sizeof(typename First::Format) + AttribOffset<I - 1, Rest...>::value;
+};
+
+template<GLuint Location, typename... Attrs> struct LocationUnused { static constexpr bool value = true; };
+
+template<GLuint Location, typename First, typename... Rest> struct LocationUnused<Location, First, Rest...>
+{
+	static constexpr bool value = First::Semantic::location != Location && LocationUnused<Location, Rest...>::value;
+};
+
+template<typename... Attrs> struct DistinctLocations { static constexpr bool value = true; };
+
+template<typename First, typename... Rest> struct DistinctLocations<First, Rest...>
+{
+	static constexpr bool value = LocationUnused<First::Semantic::location, Rest...>::value && DistinctLocations<Rest...>::value;
+};
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+template<typename... Attrs>
+struct VertexLayout
+{
+	static_assert(sizeof...(Attrs) > 0, "A vertex layout needs at least one attribute");
+	static_assert(DistinctLocations<Attrs...>::value, "Two attributes of a vertex layout share a semantic");
+
+	static constexpr size_t count = sizeof...(Attrs);
+	static constexpr GLuint stride = AttribSize<Attrs...>::value;
+
+	template<size_t I>
+	static constexpr GLuint offset() { return AttribOffset<I, Attrs...>::value; }
+
+	static std::array<VertexAttribInfo, sizeof...(Attrs)> attributes()
+	{
+		return describe(std::make_index_sequence<sizeof...(Attrs)>());
+	}
+
+	// Attribute formats for every attribute, all sourced from bindingIndex
+	static void apply(GLuint VAO, GLuint bindingIndex = 0)
+	{
+		for (const VertexAttribInfo& attribute : attributes())
+		{
+			glEnableVertexArrayAttrib(VAO, attribute.location);
+			glVertexArrayAttribFormat(VAO, attribute.location, attribute.components, attribute.type, attribute.normalized, attribute.offset);
+			glVertexArrayAttribBinding(VAO, attribute.location, bindingIndex);
+		}
+	}
+
+	// Attach a buffer holding this layout to bindingIndex, with the layout stride
+	static void bindBuffer(GLuint VAO, GLuint buffer, GLuint bindingIndex = 0, GLintptr offset = 0)
+	{
+		glVertexArrayVertexBuffer(VAO, bindingIndex, buffer, offset, stride);
+	}
+
+private:
+
+	template<size_t... I>
+	static std::array<VertexAttribInfo, sizeof...(Attrs)> describe(std::index_sequence<I...>)
+	{
+		return { { VertexAttribInfo{ Attrs::Semantic::location, AttribFormat<typename Attrs::Format>::components,
+			AttribFormat<typename Attrs::Format>::type, AttribFormat<typename Attrs::Format>::normalized,
+			AttribOffset<I, Attrs...>::value, AttribFormat<typename Attrs::Format>::shaderType, Attrs::Semantic::name() }... } };
+	}
+};
+
+// Layouts of the project ------------------------------------------------------
+#pragma region "Project vertex layouts"
+
+// Mesh Vertex, interleaved
+typedef VertexLayout<Attr<Position, glm::vec3>, Attr<Normal, glm::vec3>, Attr<TexCoords, glm::vec2>> MeshVertexLayout;
+
+static_assert(MeshVertexLayout::stride == sizeof(Vertex), "MeshVertexLayout doesn't match Vertex");
+static_assert(MeshVertexLayout::offset<1>() == offsetof(Vertex, normal), "MeshVertexLayout doesn't match Vertex");
+static_assert(MeshVertexLayout::offset<2>() == offsetof(Vertex, texCoords), "MeshVertexLayout doesn't match Vertex");
+
+// Split streams (stream_split_positions) and the optional tangent stream
+typedef VertexLayout<Attr<Position, glm::vec3>> PositionLayout;
+typedef VertexLayout<Attr<Normal, glm::vec3>, Attr<TexCoords, glm::vec2>> AttributeLayout;
+typedef VertexLayout<Attr<Tangent, glm::i16vec4>> TangentLayout;
+
+static_assert(AttributeLayout::stride == sizeof(VertexAttributes), "AttributeLayout doesn't match VertexAttributes");
+
+// Skinning influences of the GPU skinning path, next to a MeshVertexLayout stream
+typedef VertexLayout<Attr<Joints, joints8>, Attr<Weights, unorm8x4>> SkinLayout;
+
+static_assert(SkinLayout::stride == sizeof(SkinWeights), "SkinLayout doesn't match SkinWeights");
+static_assert(SkinLayout::offset<1>() == offsetof(SkinWeights, weights), "SkinLayout doesn't match SkinWeights");
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+template<typename Layout>
+void appendAttributes(std::vector<VertexAttribInfo>& out)
+{
+	std::array<VertexAttribInfo, Layout::count> attributes = Layout::attributes();
+	out.insert(out.end(), attributes.begin(), attributes.end());
+}
+
+/*
+*	Checks every active vertex input of a linked program against the union of
+*	the given layouts: its location must be provided and the GLSL type must be
+*	the one the format decodes to. Built-ins (gl_VertexID...) have no location
+*	and are skipped. Layout attributes the program doesn't read are fine.
+*/
+template<typename... Layouts>
+bool validateVertexLayout(const Shader& shader, const char* label = "")
+{
+	std::vector<VertexAttribInfo> provided;
+	using expand = int[];
+	(void)expand{ 0, (appendAttributes<Layouts>(provided), 0)... };
+
+	GLuint program = shader.getID();
+	GLint inputCount = 0;
+	glGetProgramInterfaceiv(program, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &inputCount);
+
+	bool valid = true;
+	for (GLint i = 0; i < inputCount; i++)
+	{
+		const GLenum properties[2] = { GL_LOCATION, GL_TYPE };
+		GLint values[2] = { -1, 0 };
+		glGetProgramResourceiv(program, GL_PROGRAM_INPUT, (GLuint)i, 2, properties, 2, nullptr, values);
+		if (values[0] < 0) continue;
+
+		char name[128];
+		glGetProgramResourceName(program, GL_PROGRAM_INPUT, (GLuint)i, sizeof(name), nullptr, name);
+
+		const VertexAttribInfo* match = nullptr;
+		for (const VertexAttribInfo& attribute : provided)
+			if (attribute.location == (GLuint)values[0]) match = &attribute;
+
+		if (!match)
+		{
+			std::cout << "ERROR::VERTEX_LAYOUT::MISSING_ATTRIBUTE " << label << ' ' << name << " (location " << values[0] << ")" << '\n';
+			valid = false;
+		}
+		else if ((GLenum)values[1] != match->shaderType)
+		{
+			std::cout << "ERROR::VERTEX_LAYOUT::TYPE_MISMATCH " << label << ' ' << name << " (location " << values[0]
+				<< ") is not the " << match->semantic << " format" << '\n';
+			valid = false;
+		}
+	}
+
+	return valid;
+}
+
+#endif // !VERTEX_LAYOUT_H
@@ -0,0 +1,131 @@
+/*
+*	VERTEX_PULLING.HPP
+*
+*	Vertex formats for programmable vertex pulling.
+*
+*	In pulling mode geometry is not described with vertex attributes: every
+*	mesh is encoded as raw 32 bit words in one shared SSBO, and the vertex
+*	shader fetches and decodes its vertex with gl_VertexID (see
+*	shaders/vertex/model_pulling_shader.vert). Meshes with different formats
+*	then share a single VAO, which only holds the index buffer, and can be
+*	drawn by the same multi-draw call.
+*
+*	Each mesh has a PulledMeshRecord telling the shader where its words start
+*	and how to decode them. Formats:
+*	- vertex_format_float: the Vertex as is, 8 words
+*	- vertex_format_quantized: 4 words, positions as unorm16 inside the mesh
+*	  AABB, octahedral snorm16 normal, half float texture coordinates
+*/
+
+#ifndef VERTEX_PULLING_H
+#define VERTEX_PULLING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <MESH/mesh_types.hpp>
+#include <BOUNDS/bounds.hpp>
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+// SSBO bindings of the pulling shaders, 0 is the per-draw data and 1 is kept for materials
+#define PULL_VERTEX_BINDING 2
+#define PULL_MESH_BINDING 3
+
+// Values must match the FORMAT_* constants of model_pulling_shader.vert
+enum VertexFormat
+{
+	vertex_format_float = 0,
+	vertex_format_quantized = 1
+};
+
+// Per mesh decoding record, matches the std430 MeshRecord struct of the pulling shader
+struct PulledMeshRecord
+{
+	glm::vec4 positionOffset;	// Quantized positions are offset + unorm * scale
+	glm::vec4 positionScale;
+	GLuint format;
+	GLuint firstWord;			// First word of the mesh in the vertex SSBO
+	GLuint padding[2];
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Vertex encoding utility functions"
+
+inline GLuint getVertexFormatWords(VertexFormat format)
+{
+	return format == vertex_format_quantized ? 4 : 8;
+}
+
+// Unit vector to the [-1, 1]^2 octahedral map
+inline glm::vec2 encodeOctahedral(glm::vec3 n)
+{
+	float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	if (sum <= 0.0f) return glm::vec2(0.0f);
+	n /= sum;
+
+	if (n.z >= 0.0f) return glm::vec2(n.x, n.y);
+	return glm::vec2((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+		(1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+inline glm::vec3 decodeOctahedral(const glm::vec2& e)
+{
+	glm::vec3 n = glm::vec3(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+	float t = glm::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+/*
+*	Appends the encoded vertices to words and returns the record describing
+*	them. bounds is only used by vertex_format_quantized.
+*/
+inline PulledMeshRecord encodeVertices(const std::vector<Vertex>& vertices, VertexFormat format, const AABB& bounds,
+	std::vector<GLuint>& words)
+{
+	PulledMeshRecord record;
+	record.format = format;
+	record.firstWord = (GLuint)words.size();
+	record.padding[0] = record.padding[1] = 0;
+	record.positionOffset = glm::vec4(0.0f);
+	record.positionScale = glm::vec4(1.0f);
+
+	size_t first = words.size();
+	words.resize(first + vertices.size() * getVertexFormatWords(format));
+	GLuint* out = words.data() + first;
+
+	if (format == vertex_format_float)
+	{
+		std::memcpy(out, vertices.data(), vertices.size() * sizeof(Vertex));
+		return record;
+	}
+
+	// Flat axes keep a non zero scale so the decode stays finite
+	glm::vec3 extent = isEmpty(bounds) ? glm::vec3(1.0f) : glm::max(bounds.max - bounds.min, glm::vec3(1e-20f));
+	glm::vec3 origin = isEmpty(bounds) ? glm::vec3(0.0f) : bounds.min;
+	record.positionOffset = glm::vec4(origin, 0.0f);
+	record.positionScale = glm::vec4(extent, 0.0f);
+
+	for (size_t i = 0; i < vertices.size(); i++, out += 4)
+	{
+		glm::vec3 p = glm::clamp((vertices[i].position - origin) / extent, 0.0f, 1.0f);
+
+		out[0] = glm::packUnorm2x16(glm::vec2(p.x, p.y));
+		out[1] = glm::packUnorm2x16(glm::vec2(p.z, 0.0f));
+		out[2] = glm::packSnorm2x16(encodeOctahedral(vertices[i].normal));
+		out[3] = glm::packHalf2x16(vertices[i].texCoords);
+	}
+
+	return record;
+}
+
+#endif // !VERTEX_PULLING_H
@@ -0,0 +1,597 @@
+/*
+*	ANIMATED_MODEL.HPP
+*
+*	Skinned models imported with Assimp, and the instances animating them.
+*
+*	AnimatedModel is the shared part: a Skeleton built from the node tree of
+*	the file (every node is a joint, the bones of the meshes give their
+*	inverse bind matrices), the compacted AnimationClips and one SkinnedMesh
+*	per aiMesh with up to four influences per vertex (aiProcess_LimitBoneWeights).
+*	Vertices no bone touches follow the joint of the node the mesh hangs from,
+*	so meshes without bones (props parented to a joint) animate rigidly.
+*	Like Model, the constructor makes no GL call and upload() runs on the GL
+*	thread.
+*
+*	AnimatedInstance is one character: its clip, playback time, an optional
+*	cross fade from the previous clip, and the palette produced by
+*	evaluate(). updateAnimations() advances and evaluates a whole crowd as a
+*	parallelFor over the instances, each one sampling, blending and building
+*	its palette on its own, so the work scales with the cores.
+*
+*	Drawing goes through RENDER/skinned_renderer.hpp.
+*/
+
+#ifndef ANIMATED_MODEL_H
+#define ANIMATED_MODEL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <ANIMATION/skeleton.hpp>
+#include <ANIMATION/animation_clip.hpp>
+#include <MODEL/model.hpp>
+#include <SCENE/scene_graph.hpp>
+#include <MATERIAL/material.hpp>
+#include <MESH/mesh.hpp>
+#include <MESH/mesh_weld.hpp>
+#include <MESH/vertex_layout.hpp>
+#include <SHADER/shader_s.hpp>
+#include <TEXTURE/texture_s.hpp>
+#include <BOUNDS/bounds.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+
+#define ANIMATION_UPDATE_GRAIN 4
+#define ANIMATION_DEFAULT_TICKS 25.0
+
+struct AnimatedModelStats
+{
+	double importMilliseconds;
+	double processMilliseconds;		// Skeleton, clips and parallel mesh conversion
+	double uploadMilliseconds;
+	size_t joints, clips, meshCount, vertexCount, triangleCount;
+	size_t sourceKeys, storedKeys;	// Keyframes before and after compaction
+	size_t clipBytes;
+};
+
+class SkinnedMesh
+{
+public:
+
+	std::vector<Vertex> vertices;		// Bind pose, model space
+	std::vector<SkinWeights> skin;		// Per vertex
+	std::vector<GLuint> indices;
+	std::vector<Texture> textures;
+	GLuint materialIndex;
+	AABB bounds;						// Bind pose
+
+	SkinnedMesh(std::vector<Vertex> vertices, std::vector<SkinWeights> skin, std::vector<GLuint> indices)
+	{
+		this->vertices = std::move(vertices);
+		this->skin = std::move(skin);
+		this->indices = std::move(indices);
+		this->materialIndex = 0;
+		this->bounds = computeAABB(this->vertices);
+		this->VAO = this->cpuVAO = 0;
+		this->VBO = this->skinVBO = this->EBO = 0;
+	}
+
+	~SkinnedMesh()
+	{
+		GLuint arrays[2] = { this->VAO, this->cpuVAO };
+		GLuint buffers[3] = { this->VBO, this->skinVBO, this->EBO };
+		glDeleteVertexArrays(2, arrays);
+		glDeleteBuffers(3, buffers);
+	}
+
+	SkinnedMesh(const SkinnedMesh&) = delete;
+	SkinnedMesh& operator=(const SkinnedMesh&) = delete;
+
+	/*
+	*	Two VAOs share the index buffer: the GPU path one reads the bind pose and
+	*	the influences (MeshVertexLayout + SkinLayout), the CPU path one has no
+	*	vertex buffer until drawSkinned() points it at this frame's output.
+	*/
+	void upload()
+	{
+		if (this->VAO) return;
+
+		glCreateBuffers(1, &this->VBO);
+		glNamedBufferStorage(this->VBO, this->vertices.size() * sizeof(Vertex), this->vertices.data(), 0);
+		glCreateBuffers(1, &this->skinVBO);
+		glNamedBufferStorage(this->skinVBO, this->skin.size() * sizeof(SkinWeights), this->skin.data(), 0);
+		glCreateBuffers(1, &this->EBO);
+		glNamedBufferStorage(this->EBO, this->indices.size() * sizeof(GLuint), this->indices.data(), 0);
+
+		glCreateVertexArrays(1, &this->VAO);
+		MeshVertexLayout::apply(this->VAO, 0);
+		MeshVertexLayout::bindBuffer(this->VAO, this->VBO, 0);
+		SkinLayout::apply(this->VAO, 1);
+		SkinLayout::bindBuffer(this->VAO, this->skinVBO, 1);
+		glVertexArrayElementBuffer(this->VAO, this->EBO);
+
+		glCreateVertexArrays(1, &this->cpuVAO);
+		MeshVertexLayout::apply(this->cpuVAO, 0);
+		glVertexArrayElementBuffer(this->cpuVAO, this->EBO);
+	}
+
+	void bindTextures(Shader& shader, bool hasMaterial = false)
+	{
+		const std::vector<TextureBinding>& bindings = this->samplerBindings.get(shader, this->textures, hasMaterial);
+		for (const TextureBinding& binding : bindings) glBindTextureUnit(binding.unit, binding.textureID);
+	}
+
+	// GPU skinning, the palette must be bound at SKIN_PALETTE_BINDING
+	void draw()
+	{
+		glBindVertexArray(this->VAO);
+		glDrawElementsInstancedBaseInstance(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, (void*)0, 1, this->materialIndex);
+	}
+
+	// Vertices already skinned into buffer at offset (one Vertex per bind pose vertex)
+	void drawSkinned(GLuint buffer, GLintptr offset)
+	{
+		MeshVertexLayout::bindBuffer(this->cpuVAO, buffer, 0, offset);
+		glBindVertexArray(this->cpuVAO);
+		glDrawElementsInstancedBaseInstance(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, (void*)0, 1, this->materialIndex);
+	}
+
+private:
+
+	GLuint VAO, cpuVAO;
+	GLuint VBO, skinVBO, EBO;
+	SamplerBindingCache samplerBindings;
+};
+
+class AnimatedModel
+{
+public:
+
+	Skeleton skeleton;
+	std::vector<AnimationClip> clips;
+	std::vector<std::unique_ptr<SkinnedMesh>> meshes;
+	AABB bounds;						// Bind pose, model space
+
+	AnimatedModel(const std::string& path, ThreadPool& pool = ThreadPool::shared())
+	{
+		this->path = path;
+		this->stats = AnimatedModelStats();
+		this->bounds = emptyAABB();
+		this->skeleton.globalInverse = glm::mat4(1.0f);
+		this->uploaded = false;
+
+		loadModel(path, pool);
+	}
+
+	// Textures and mesh buffers creation, must run on the thread owning the context
+	void upload()
+	{
+		if (this->uploaded) return;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		GLenum textureConfig[4] = { GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR };
+
+		std::unordered_map<std::string, std::unique_ptr<Texture>> textures;
+		for (size_t i = 0; i < this->texturePaths.size(); i++)
+		{
+			if (!this->textureImages[i].pixels) std::cout << "ERROR::ANIMATED_MODEL::TEXTURE_LOADING_FAILED " << this->texturePaths[i] << '\n';
+			textures[this->texturePaths[i]].reset(new Texture(this->textureImages[i], GL_TEXTURE_2D, 0, textureConfig, texture_diffuse));
+		}
+
+		for (size_t i = 0; i < this->meshes.size(); i++)
+		{
+			for (const ModelTextureRef& ref : this->textureRefs[i])
+			{
+				Texture texture = *textures[ref.path];
+				texture.sType = ref.type;
+				this->meshes[i]->textures.push_back(texture);
+			}
+			this->meshes[i]->upload();
+		}
+
+		std::vector<TextureImage>().swap(this->textureImages);
+
+		this->uploaded = true;
+		this->stats.uploadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void bindMaterials(MaterialLibrary& library)
+	{
+		for (size_t i = 0; i < this->meshes.size(); i++) this->meshes[i]->materialIndex = library.add(this->materials[i]);
+	}
+
+	int findClip(const std::string& name) const
+	{
+		for (size_t i = 0; i < this->clips.size(); i++) if (this->clips[i].name == name) return (int)i;
+		return -1;
+	}
+
+	inline const std::string& getPath() const { return this->path; }
+	inline bool isUploaded() const { return this->uploaded; }
+	inline const AnimatedModelStats& getStats() const { return this->stats; }
+	inline const Material& getMaterial(size_t mesh) const { return this->materials[mesh]; }
+
+	// Texture files sampled by a mesh, as resolved at import
+	inline const std::vector<ModelTextureRef>& getTextureRefs(size_t mesh) const { return this->textureRefs[mesh]; }
+
+private:
+
+	std::string path;
+	bool uploaded;
+	AnimatedModelStats stats;
+
+	std::vector<Material> materials;						// Per mesh
+	std::vector<std::vector<ModelTextureRef>> textureRefs;	// Per mesh
+	std::vector<std::string> texturePaths;
+	std::vector<TextureImage> textureImages;
+
+	void loadModel(const std::string& path, ThreadPool& pool)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS | aiProcess_LimitBoneWeights);
+
+		if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode)
+		{
+			std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << '\n';
+			return;
+		}
+
+		std::chrono::steady_clock::time_point imported = std::chrono::steady_clock::now();
+		this->stats.importMilliseconds = std::chrono::duration<double, std::milli>(imported - start).count();
+
+		// Joint of the node every mesh hangs from, for the vertices no bone reaches
+		std::vector<int> meshNodes(scene->mNumMeshes, 0);
+		buildSkeleton(scene->mRootNode, -1, meshNodes);
+		if (this->skeleton.joints.size() > SKELETON_MAX_JOINTS)
+		{
+			std::cout << "ERROR::ANIMATED_MODEL::TOO_MANY_JOINTS " << this->skeleton.joints.size() << " in " << path << '\n';
+			this->skeleton = Skeleton();
+			this->skeleton.globalInverse = glm::mat4(1.0f);
+			return;
+		}
+		this->skeleton.globalInverse = glm::inverse(toGlm(scene->mRootNode->mTransformation));
+
+		std::unordered_map<std::string, int> jointIndices;
+		for (size_t j = 0; j < this->skeleton.joints.size(); j++) jointIndices.emplace(this->skeleton.joints[j].name, (int)j);
+
+		// Bones only set inverse bind matrices, shared bones agree on them
+		for (unsigned m = 0; m < scene->mNumMeshes; m++)
+		{
+			const aiMesh* mesh = scene->mMeshes[m];
+			for (unsigned b = 0; b < mesh->mNumBones; b++)
+			{
+				std::unordered_map<std::string, int>::const_iterator joint = jointIndices.find(mesh->mBones[b]->mName.C_Str());
+				if (joint != jointIndices.end()) this->skeleton.joints[joint->second].inverseBind = toGlm(mesh->mBones[b]->mOffsetMatrix);
+			}
+		}
+
+		std::string directory = path.substr(0, path.find_last_of("/\\") == std::string::npos ? 0 : path.find_last_of("/\\"));
+
+		this->meshes.resize(scene->mNumMeshes);
+		this->materials.assign(scene->mNumMeshes, defaultMaterial());
+		this->textureRefs.resize(scene->mNumMeshes);
+
+		pool.parallelFor(scene->mNumMeshes, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const aiMesh* source = scene->mMeshes[i];
+				if (source->mMaterialIndex < scene->mNumMaterials)
+				{
+					collectTextureRefs(scene->mMaterials[source->mMaterialIndex], directory, this->textureRefs[i]);
+					this->materials[i] = toMaterial(scene->mMaterials[source->mMaterialIndex]);
+				}
+
+				// A mesh without bones rides its node rigidly, in that joint's space so its palette entry places it
+				glm::mat4 rigid(1.0f);
+				if (source->mNumBones == 0) rigid = glm::inverse(this->skeleton.joints[meshNodes[i]].inverseBind);
+				this->meshes[i].reset(convertMesh(source, jointIndices, meshNodes[i], rigid));
+			}
+		});
+
+		for (unsigned a = 0; a < scene->mNumAnimations; a++) this->clips.push_back(convertAnimation(scene->mAnimations[a], jointIndices));
+
+		// Decoded here like Model, uploaded later
+		for (const std::vector<ModelTextureRef>& refs : this->textureRefs)
+			for (const ModelTextureRef& ref : refs)
+				if (std::find(this->texturePaths.begin(), this->texturePaths.end(), ref.path) == this->texturePaths.end())
+					this->texturePaths.push_back(ref.path);
+
+		this->textureImages.resize(this->texturePaths.size());
+		pool.parallelFor(this->texturePaths.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++) this->textureImages[i] = TextureImage::decode(this->texturePaths[i].c_str());
+		});
+
+		this->stats.processMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - imported).count();
+		this->stats.joints = this->skeleton.joints.size();
+		this->stats.clips = this->clips.size();
+		this->stats.meshCount = this->meshes.size();
+		for (const std::unique_ptr<SkinnedMesh>& mesh : this->meshes)
+		{
+			this->stats.vertexCount += mesh->vertices.size();
+			this->stats.triangleCount += mesh->indices.size() / 3;
+			this->bounds = mergeAABB(this->bounds, mesh->bounds);
+		}
+		for (const AnimationClip& clip : this->clips)
+		{
+			this->stats.sourceKeys += clip.sourceKeys;
+			this->stats.storedKeys += clip.keyCount();
+			this->stats.clipBytes += clip.byteSize();
+		}
+	}
+
+	// Preorder walk, every node becomes a joint with its local transform as bind pose
+	void buildSkeleton(const aiNode* source, int parent, std::vector<int>& meshNodes)
+	{
+		Joint joint;
+		joint.name = source->mName.C_Str();
+		joint.parent = parent;
+		joint.inverseBind = glm::mat4(1.0f);
+
+		glm::vec3 translation, scale;
+		glm::quat rotation;
+		decomposeTRS(toGlm(source->mTransformation), translation, rotation, scale);
+
+		int index = (int)this->skeleton.joints.size();
+		this->skeleton.joints.push_back(joint);
+		this->skeleton.bindPose.push_back(makeJointPose(translation, rotation, scale));
+		for (unsigned i = 0; i < source->mNumMeshes; i++) if (source->mMeshes[i] < meshNodes.size()) meshNodes[source->mMeshes[i]] = index;
+
+		for (unsigned i = 0; i < source->mNumChildren; i++) buildSkeleton(source->mChildren[i], index, meshNodes);
+	}
+
+	/*
+	*	Vertex packing, influences and welding. Assimp keeps one vertex per face
+	*	corner, the weld keys on the influences too so two corners only merge
+	*	when they would skin the same way.
+	*/
+	static SkinnedMesh* convertMesh(const aiMesh* source, const std::unordered_map<std::string, int>& jointIndices, int nodeJoint,
+		const glm::mat4& rigid)
+	{
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(rigid)));
+
+		std::vector<Vertex> vertices(source->mNumVertices);
+		for (unsigned v = 0; v < source->mNumVertices; v++)
+		{
+			Vertex& vertex = vertices[v];
+			vertex.position = glm::vec3(source->mVertices[v].x, source->mVertices[v].y, source->mVertices[v].z);
+			vertex.normal = source->mNormals ? glm::vec3(source->mNormals[v].x, source->mNormals[v].y, source->mNormals[v].z) : glm::vec3(0.0f);
+			vertex.texCoords = source->mTextureCoords[0] ? glm::vec2(source->mTextureCoords[0][v].x, source->mTextureCoords[0][v].y) : glm::vec2(0.0f);
+
+			if (source->mNumBones > 0) continue;
+			vertex.position = glm::vec3(rigid * glm::vec4(vertex.position, 1.0f));
+			if (vertex.normal != glm::vec3(0.0f)) vertex.normal = glm::normalize(normalMatrix * vertex.normal);
+		}
+
+		// Four strongest influences per vertex, kept sorted
+		std::vector<glm::vec4> weights(source->mNumVertices, glm::vec4(0.0f));
+		std::vector<glm::ivec4> joints(source->mNumVertices, glm::ivec4(0));
+		for (unsigned b = 0; b < source->mNumBones; b++)
+		{
+			const aiBone* bone = source->mBones[b];
+			std::unordered_map<std::string, int>::const_iterator joint = jointIndices.find(bone->mName.C_Str());
+			if (joint == jointIndices.end()) continue;
+
+			for (unsigned w = 0; w < bone->mNumWeights; w++)
+			{
+				unsigned v = bone->mWeights[w].mVertexId;
+				float weight = bone->mWeights[w].mWeight;
+				if (v >= source->mNumVertices || weight <= weights[v][3]) continue;
+
+				int k = 3;
+				for (; k > 0 && weight > weights[v][k - 1]; k--)
+				{
+					weights[v][k] = weights[v][k - 1];
+					joints[v][k] = joints[v][k - 1];
+				}
+				weights[v][k] = weight;
+				joints[v][k] = joint->second;
+			}
+		}
+
+		std::vector<SkinWeights> skin(source->mNumVertices);
+		for (unsigned v = 0; v < source->mNumVertices; v++) skin[v] = packSkinWeights(joints[v], weights[v], nodeJoint);
+
+		std::vector<GLuint> indices;
+		indices.reserve(source->mNumFaces * 3);
+		for (unsigned f = 0; f < source->mNumFaces; f++)
+		{
+			const aiFace& face = source->mFaces[f];
+			if (face.mNumIndices != 3) continue;
+			indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+		}
+		if (indices.empty()) return new SkinnedMesh(std::vector<Vertex>(), std::vector<SkinWeights>(), indices);
+
+		vertices = weldVertices(vertices, indices, 0.0f, nullptr, ThreadPool::shared(), &skin);
+		return new SkinnedMesh(std::move(vertices), std::move(skin), std::move(indices));
+	}
+
+	// unorm8 weights summing to exactly 255, unweighted vertices go to fallbackJoint
+	static SkinWeights packSkinWeights(const glm::ivec4& joints, const glm::vec4& weights, int fallbackJoint)
+	{
+		SkinWeights skin = {};
+		float total = weights.x + weights.y + weights.z + weights.w;
+		if (total <= 0.0f)
+		{
+			skin.joints[0] = (GLubyte)fallbackJoint;
+			skin.weights[0] = 255;
+			return skin;
+		}
+
+		int sum = 0;
+		for (int k = 0; k < 4; k++)
+		{
+			skin.joints[k] = (GLubyte)joints[k];
+			skin.weights[k] = (GLubyte)std::lround(weights[k] / total * 255.0f);
+			sum += skin.weights[k];
+		}
+		// Rounding error goes to the strongest influence
+		skin.weights[0] = (GLubyte)glm::clamp((int)skin.weights[0] + 255 - sum, 0, 255);
+		return skin;
+	}
+
+	AnimationClip convertAnimation(const aiAnimation* animation, const std::unordered_map<std::string, int>& jointIndices) const
+	{
+		double ticks = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : ANIMATION_DEFAULT_TICKS;
+		std::vector<RawJointTrack> tracks(this->skeleton.joints.size());
+
+		for (unsigned c = 0; c < animation->mNumChannels; c++)
+		{
+			const aiNodeAnim* channel = animation->mChannels[c];
+			std::unordered_map<std::string, int>::const_iterator joint = jointIndices.find(channel->mNodeName.C_Str());
+			if (joint == jointIndices.end()) continue;
+
+			RawJointTrack& track = tracks[joint->second];
+			for (unsigned k = 0; k < channel->mNumPositionKeys; k++)
+			{
+				const aiVectorKey& key = channel->mPositionKeys[k];
+				track.translationTimes.push_back((float)(key.mTime / ticks));
+				track.translations.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for (unsigned k = 0; k < channel->mNumRotationKeys; k++)
+			{
+				const aiQuatKey& key = channel->mRotationKeys[k];
+				track.rotationTimes.push_back((float)(key.mTime / ticks));
+				track.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for (unsigned k = 0; k < channel->mNumScalingKeys; k++)
+			{
+				const aiVectorKey& key = channel->mScalingKeys[k];
+				track.scaleTimes.push_back((float)(key.mTime / ticks));
+				track.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+		}
+
+		return buildAnimationClip(animation->mName.C_Str(), (float)(animation->mDuration / ticks), tracks, this->skeleton.joints.size());
+	}
+};
+
+class AnimatedInstance
+{
+public:
+
+	glm::mat4 transform;
+	float speed;				// Playback rate, 1 is real time
+	bool loop;
+	bool visible;
+	bool hasMaterial;			// Forwarded to SkinnedMesh::bindTextures()
+
+	AnimatedInstance() : AnimatedInstance(nullptr) {}
+
+	explicit AnimatedInstance(AnimatedModel* model, const glm::mat4& transform = glm::mat4(1.0f))
+	{
+		this->model = model;
+		this->transform = transform;
+		this->speed = 1.0f;
+		this->loop = true;
+		this->visible = true;
+		this->hasMaterial = false;
+		this->clip = this->previousClip = -1;
+		this->time = this->previousTime = 0.0f;
+		this->fadeDuration = this->fadeElapsed = 0.0f;
+
+		size_t joints = model ? model->skeleton.size() : 0;
+		this->pose.resize(joints);
+		this->fadePose.resize(joints);
+		this->globals.assign(joints, glm::mat4(1.0f));
+		this->palette.assign(joints, glm::mat4(1.0f));
+		if (model) this->pose = model->skeleton.bindPose;
+	}
+
+	// Starts a clip from its beginning, fading from the current one over fadeSeconds
+	void play(int clip, float fadeSeconds = 0.0f, float startTime = 0.0f)
+	{
+		if (fadeSeconds > 0.0f && this->clip >= 0)
+		{
+			this->previousClip = this->clip;
+			this->previousTime = this->time;
+			this->fadeDuration = fadeSeconds;
+			this->fadeElapsed = 0.0f;
+		}
+		else this->previousClip = -1;
+
+		this->clip = clip;
+		this->time = startTime;
+	}
+
+	void advance(float deltaTime)
+	{
+		float step = deltaTime * this->speed;
+		this->time += step;
+		if (this->previousClip < 0) return;
+
+		this->previousTime += step;
+		this->fadeElapsed += deltaTime;
+		if (this->fadeElapsed >= this->fadeDuration) this->previousClip = -1;
+	}
+
+	// Samples the clips, blends the fade and rebuilds the palette
+	void evaluate()
+	{
+		if (!this->model || this->pose.empty()) return;
+		const Skeleton& skeleton = this->model->skeleton;
+
+		if (this->clip >= 0 && this->clip < (int)this->model->clips.size())
+			sampleClip(this->model->clips[this->clip], skeleton, this->time, this->loop, this->pose.data());
+		else this->pose = skeleton.bindPose;
+
+		if (this->previousClip >= 0 && this->previousClip < (int)this->model->clips.size())
+		{
+			sampleClip(this->model->clips[this->previousClip], skeleton, this->previousTime, this->loop, this->fadePose.data());
+			blendPoses(this->fadePose.data(), this->pose.data(), this->fadeElapsed / this->fadeDuration, this->pose.data(), this->pose.size());
+		}
+
+		computePalette(skeleton, this->pose.data(), this->globals.data(), this->palette.data());
+	}
+
+	inline AnimatedModel* getModel() const { return this->model; }
+	inline int getClip() const { return this->clip; }
+	inline float getTime() const { return this->time; }
+	inline const std::vector<JointPose>& getPose() const { return this->pose; }
+	inline const std::vector<glm::mat4>& getPalette() const { return this->palette; }
+
+	// Model space transform of a joint in the last evaluated pose, to attach props
+	inline const glm::mat4& getJointTransform(size_t joint) const { return this->globals[joint]; }
+
+private:
+
+	AnimatedModel* model;
+	int clip, previousClip;
+	float time, previousTime;
+	float fadeDuration, fadeElapsed;
+
+	std::vector<JointPose> pose, fadePose;
+	std::vector<glm::mat4> globals;
+	std::vector<glm::mat4> palette;
+};
+
+// Advances and evaluates every instance, instances are independent so they are spread over the pool
+inline void updateAnimations(std::vector<AnimatedInstance>& instances, float deltaTime, ThreadPool& pool = ThreadPool::shared())
+{
+	pool.parallelFor(instances.size(), ANIMATION_UPDATE_GRAIN, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			instances[i].advance(deltaTime);
+			instances[i].evaluate();
+		}
+	});
+}
+
+#endif // !ANIMATED_MODEL_H
@@ -0,0 +1,465 @@
+/*
+*	BAKED_MODEL.HPP
+*
+*	Versioned binary model format and its zero-copy runtime loader.
+*
+*	Baked files are written offline by cookModel() (see model_cook.hpp) from an
+*	imported Model, so loading one needs neither Assimp nor any parsing:
+*
+*		BakedModelHeader
+*		BakedMesh[meshCount]			geometry ranges, LODs, bounds, material
+*		BakedDraw[drawCount]			mesh placed with its node transform
+*		BakedMaterial[materialCount]	surface parameters and range of the texture table
+*		BakedTexture[textureCount]		type and path in the string blob
+*		strings
+*		vertices						Vertex, the GPU layout of MeshVertexLayout
+*		indices							GLuint, local to each mesh (base vertex draws)
+*		tangents						QTangent per vertex, optional
+*		meshlets						Meshlet, index ranges local to each mesh
+*
+*	Every section starts on a BAKED_MODEL_ALIGNMENT boundary. BakedModel maps
+*	the file and hands the vertex, index and tangent ranges straight to
+*	glNamedBufferStorage, the mapping is released once they are uploaded.
+*	Before that readMesh() copies a mesh's processed geometry out, which is how
+*	Model loads a baked file into regular Meshes without processing them again.
+*
+*	Every mesh is checked before anything reaches GL: its vertex range must lie
+*	in the vertex blob and each LOD's index range in the index blob, with no
+*	index past the mesh's own vertices. Meshes failing it are reported and
+*	skipped by draw().
+*
+*	Texture files go through a TextureCache like the ones of Model, so a baked
+*	model shares them with every other model of the same cache.
+*
+*	Version 2 added the Material parameters to BakedMaterial, version 3 the
+*	meshlets, version 4 the Material flags. Older files are rejected and have
+*	to be cooked again.
+*/
+
+#ifndef BAKED_MODEL_H
+#define BAKED_MODEL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <IO/mapped_file.hpp>
+#include <MESH/mesh.hpp>
+#include <TEXTURE/texture_cache.hpp>
+#include <MESH/vertex_layout.hpp>
+#include <MATERIAL/material.hpp>
+#include <SHADER/shader_s.hpp>
+#include <TEXTURE/texture_s.hpp>
+#include <BOUNDS/bounds.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+#define BAKED_MODEL_MAGIC 0x4C444D42u	// "BMDL"
+#define BAKED_MODEL_VERSION 4
+#define BAKED_MODEL_ALIGNMENT 16
+#define BAKED_MODEL_EXTENSION ".bmdl"	// Appended to the source path by the model cache
+
+struct BakedModelHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t meshCount, drawCount, materialCount, textureCount;
+	uint64_t meshOffset, drawOffset, materialOffset, textureOffset;
+	uint64_t stringOffset, stringBytes;
+	uint64_t vertexOffset, vertexBytes;
+	uint64_t indexOffset, indexBytes;
+	uint64_t tangentOffset, tangentBytes;	// 0 bytes when no mesh is normal mapped
+	uint64_t meshletOffset, meshletBytes;
+	AABB bounds;
+	BoundingSphere boundingSphere;
+};
+
+struct BakedMesh
+{
+	uint32_t baseVertex, vertexCount;
+	uint32_t firstIndex, indexCount;		// Every LOD, see lods for the ranges
+	uint32_t lodCount;
+	uint32_t material;
+	uint32_t firstMeshlet, meshletCount;
+	MeshLod lods[LOD_MAX_LEVELS];			// firstIndex relative to the whole index blob
+	AABB bounds;
+	BoundingSphere boundingSphere;
+};
+
+struct BakedDraw
+{
+	glm::mat4 transform;
+	uint32_t mesh;
+	uint32_t padding[3];
+};
+
+struct BakedMaterial
+{
+	uint32_t firstTexture, textureCount;
+	uint32_t padding[2];
+	Material parameters;
+};
+
+struct BakedTexture
+{
+	uint32_t type;							// TextureType
+	uint32_t pathOffset, pathLength;		// In the string blob
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Baked model utility functions"
+
+inline uint64_t alignBakedOffset(uint64_t offset)
+{
+	return (offset + BAKED_MODEL_ALIGNMENT - 1) / BAKED_MODEL_ALIGNMENT * BAKED_MODEL_ALIGNMENT;
+}
+
+// Section inside the file bounds
+inline bool validBakedSection(uint64_t offset, uint64_t bytes, size_t fileSize)
+{
+	return offset <= fileSize && bytes <= fileSize - offset;
+}
+
+/*
+*	Vertex range inside the vertex (and tangent) blob, every LOD range inside
+*	the index blob and every index below the mesh's vertex count, so no draw
+*	reads past the buffers. Meshlets must lie in their blob and in the mesh's
+*	indices. indices and meshlets are the mapped blobs.
+*/
+inline bool validBakedMesh(BakedMesh& mesh, const GLuint* indices, const Meshlet* meshlets, const BakedModelHeader& header)
+{
+	uint64_t vertexCount = header.vertexBytes / sizeof(Vertex), indexCount = header.indexBytes / sizeof(GLuint);
+	uint64_t tangentCount = header.tangentBytes / sizeof(QTangent);
+	uint64_t lastVertex = (uint64_t)mesh.baseVertex + mesh.vertexCount;
+
+	if (lastVertex > vertexCount || (header.tangentBytes > 0 && lastVertex > tangentCount)) return false;
+	if ((uint64_t)mesh.firstMeshlet + mesh.meshletCount > header.meshletBytes / sizeof(Meshlet)) return false;
+	for (const Meshlet* meshlet = meshlets + mesh.firstMeshlet; meshlet < meshlets + mesh.firstMeshlet + mesh.meshletCount; meshlet++)
+		if ((uint64_t)meshlet->firstIndex + meshlet->indexCount > mesh.indexCount) return false;
+
+	mesh.lodCount = std::min<uint32_t>(mesh.lodCount, LOD_MAX_LEVELS);
+	for (uint32_t l = 0; l < mesh.lodCount; l++)
+	{
+		const MeshLod& lod = mesh.lods[l];
+		if ((uint64_t)lod.firstIndex + lod.indexCount > indexCount) return false;
+
+		GLuint maxIndex = 0;
+		for (const GLuint* index = indices + lod.firstIndex; index < indices + lod.firstIndex + lod.indexCount; index++) maxIndex = std::max(maxIndex, *index);
+		if (lod.indexCount > 0 && maxIndex >= mesh.vertexCount) return false;
+	}
+	return true;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class BakedModel
+{
+public:
+
+	// Model space bounds of every draw
+	AABB bounds;
+	BoundingSphere boundingSphere;
+
+	// Maps and validates the file and decodes the textures on the pool (unless decodeTextures is off, for readers), no GL call
+	BakedModel(const std::string& path, ThreadPool& pool = ThreadPool::shared(), TextureCache* textureCache = nullptr, bool decodeTextures = true)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		this->path = path;
+		this->bounds = emptyAABB();
+		this->boundingSphere = { glm::vec3(0.0f), 0.0f };
+		this->VAO = this->VBO = this->EBO = this->tangentVBO = 0;
+		this->uploaded = false;
+		this->loadMilliseconds = this->uploadMilliseconds = 0.0;
+		this->file.reset(new MappedFile(path));
+
+		if (!this->file->isOpen() || !validate())
+		{
+			this->file.reset();
+			return;
+		}
+
+		const BakedModelHeader& header = getHeader();
+		this->bounds = header.bounds;
+		this->boundingSphere = header.boundingSphere;
+
+		// Small tables are copied out so they outlive the mapping
+		const BakedMesh* meshTable = (const BakedMesh*)(this->file->data() + header.meshOffset);
+		const BakedDraw* drawTable = (const BakedDraw*)(this->file->data() + header.drawOffset);
+		const BakedMaterial* materialTable = (const BakedMaterial*)(this->file->data() + header.materialOffset);
+		const BakedTexture* textureTable = (const BakedTexture*)(this->file->data() + header.textureOffset);
+		const char* strings = (const char*)(this->file->data() + header.stringOffset);
+
+		this->meshes.assign(meshTable, meshTable + header.meshCount);
+		this->draws.assign(drawTable, drawTable + header.drawCount);
+		this->materials.resize(header.materialCount);
+
+		for (uint32_t t = 0; t < header.textureCount; t++)
+		{
+			bool inside = (uint64_t)textureTable[t].pathOffset + textureTable[t].pathLength <= header.stringBytes;
+			this->texturePaths.push_back(inside ? std::string(strings + textureTable[t].pathOffset, textureTable[t].pathLength) : std::string());
+			this->textureTypes.push_back((TextureType)textureTable[t].type);
+		}
+		for (uint32_t m = 0; m < header.materialCount; m++)
+		{
+			this->materials[m].parameters = materialTable[m].parameters;
+			for (uint32_t t = materialTable[m].firstTexture; t < materialTable[m].firstTexture + materialTable[m].textureCount && t < header.textureCount; t++)
+			{
+				this->materials[m].textures.push_back(t);
+				this->materials[m].types.push_back(this->textureTypes[t]);
+			}
+		}
+
+		// Meshes reading outside the blobs are dropped here so draw() and the GPU can trust the tables
+		const GLuint* indices = (const GLuint*)(this->file->data() + header.indexOffset);
+		const Meshlet* meshlets = (const Meshlet*)(this->file->data() + header.meshletOffset);
+		std::vector<char> valid(this->meshes.size());
+		pool.parallelFor(this->meshes.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t m = begin; m < end; m++) valid[m] = validBakedMesh(this->meshes[m], indices, meshlets, header);
+		});
+		for (size_t m = 0; m < this->meshes.size(); m++)
+		{
+			if (valid[m]) continue;
+			std::cout << "ERROR::BAKED_MODEL::INVALID_MESH " << this->path << " mesh " << m << '\n';
+			this->meshes[m].lodCount = 0;
+		}
+		this->draws.erase(std::remove_if(this->draws.begin(), this->draws.end(),
+			[&header](const BakedDraw& draw) { return draw.mesh >= header.meshCount; }), this->draws.end());
+
+		// The texture table can list a file once per type, the cache decodes it once
+		TextureCache modelTextures;
+		TextureCache& cache = textureCache ? *textureCache : modelTextures;
+		for (const std::string& texturePath : this->texturePaths) this->textureHandles.push_back(cache.acquire(texturePath));
+
+		if (decodeTextures)
+		{
+			pool.parallelFor(this->textureHandles.size(), 1, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++) this->textureHandles[i]->decode();
+			});
+		}
+
+		this->loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	~BakedModel()
+	{
+		// Nothing to release before upload(), so the loader can be dropped without a context
+		if (!this->VAO) return;
+
+		glDeleteVertexArrays(1, &this->VAO);
+		glDeleteBuffers(1, &this->VBO);
+		glDeleteBuffers(1, &this->EBO);
+		glDeleteBuffers(1, &this->tangentVBO);
+	}
+
+	BakedModel(const BakedModel&) = delete;
+	BakedModel& operator=(const BakedModel&) = delete;
+
+	// Buffers straight from the mapped ranges and textures, must run on the GL thread
+	void upload()
+	{
+		if (this->uploaded || !this->file) return;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		const BakedModelHeader& header = getHeader();
+		const unsigned char* data = this->file->data();
+
+		glCreateVertexArrays(1, &this->VAO);
+		glCreateBuffers(1, &this->VBO);
+		glCreateBuffers(1, &this->EBO);
+
+		glNamedBufferStorage(this->VBO, header.vertexBytes, data + header.vertexOffset, 0);
+		glNamedBufferStorage(this->EBO, header.indexBytes, data + header.indexOffset, 0);
+
+		glVertexArrayElementBuffer(this->VAO, this->EBO);
+		MeshVertexLayout::apply(this->VAO, 0);
+		MeshVertexLayout::bindBuffer(this->VAO, this->VBO, 0);
+
+		if (header.tangentBytes > 0)
+		{
+			glCreateBuffers(1, &this->tangentVBO);
+			glNamedBufferStorage(this->tangentVBO, header.tangentBytes, data + header.tangentOffset, 0);
+			TangentLayout::apply(this->VAO, 1);
+			TangentLayout::bindBuffer(this->VAO, this->tangentVBO, 1);
+		}
+
+		// Geometry lives in the GPU now, the file is no longer needed
+		this->file.reset();
+
+		for (size_t i = 0; i < this->textureHandles.size(); i++)
+		{
+			this->textures.push_back(this->textureHandles[i]->upload());
+			this->textures.back().sType = this->textureTypes[i];
+		}
+
+		for (MaterialTextures& material : this->materials)
+			for (GLuint texture : material.textures) material.IDs.push_back(this->textures[texture].getID());
+
+		this->uploaded = true;
+		this->uploadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	/*
+	*	Draws every mesh with the "model" uniform set to model * draw transform.
+	*	The shader must be in use.
+	*/
+	void draw(Shader& shader, const glm::mat4& model = glm::mat4(1.0f), bool hasMaterial = false, int lod = 0)
+	{
+		upload();
+		if (!this->uploaded) return;
+
+		glBindVertexArray(this->VAO);
+		for (const BakedDraw& draw : this->draws)
+		{
+			const BakedMesh& mesh = this->meshes[draw.mesh];
+			if (mesh.lodCount == 0) continue;
+
+			if (mesh.material < this->materials.size())
+			{
+				MaterialTextures& material = this->materials[mesh.material];
+				const std::vector<TextureBinding>& bindings = material.samplerBindings.get(shader, material.types.data(), material.IDs.data(),
+					material.types.size(), hasMaterial);
+				for (const TextureBinding& binding : bindings) glBindTextureUnit(binding.unit, binding.textureID);
+			}
+
+			// The material index reaches the shader as the base instance
+			GLuint materialIndex = mesh.material < this->materials.size() ? this->materials[mesh.material].index : 0;
+
+			const MeshLod& level = mesh.lods[glm::clamp(lod, 0, (int)mesh.lodCount - 1)];
+			shader.setMat4Uniform("model", model * draw.transform);
+			glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)(level.firstIndex * sizeof(GLuint)),
+				1, mesh.baseVertex, materialIndex);
+		}
+		glBindVertexArray(0);
+	}
+
+	/*
+	*	Copies a mesh's geometry out of the mapping, indices and meshlets local
+	*	to its vertices and LODs to its indices. False once upload() released
+	*	the file or for meshes rejected at load.
+	*/
+	bool readMesh(size_t mesh, std::vector<Vertex>& vertices, std::vector<GLuint>& indices, std::vector<MeshLod>& lods,
+		std::vector<Meshlet>& meshlets, std::vector<QTangent>& tangents) const
+	{
+		if (!this->file || mesh >= this->meshes.size() || this->meshes[mesh].lodCount == 0) return false;
+
+		const BakedModelHeader& header = getHeader();
+		const BakedMesh& source = this->meshes[mesh];
+		const unsigned char* data = this->file->data();
+
+		const Vertex* vertexBlob = (const Vertex*)(data + header.vertexOffset) + source.baseVertex;
+		const GLuint* indexBlob = (const GLuint*)(data + header.indexOffset) + source.firstIndex;
+		const Meshlet* meshletBlob = (const Meshlet*)(data + header.meshletOffset) + source.firstMeshlet;
+
+		vertices.assign(vertexBlob, vertexBlob + source.vertexCount);
+		indices.assign(indexBlob, indexBlob + source.indexCount);
+		meshlets.assign(meshletBlob, meshletBlob + source.meshletCount);
+
+		lods.assign(source.lods, source.lods + source.lodCount);
+		for (MeshLod& lod : lods) lod.firstIndex -= source.firstIndex;
+
+		// The tangent stream covers every mesh when one is normal mapped, identity frames mark the others
+		tangents.clear();
+		const QTangent* tangentBlob = (const QTangent*)(data + header.tangentOffset) + source.baseVertex;
+		if (header.tangentBytes > 0 && this->materials[source.material].types.end() !=
+			std::find(this->materials[source.material].types.begin(), this->materials[source.material].types.end(), texture_normal))
+			tangents.assign(tangentBlob, tangentBlob + source.vertexCount);
+		return true;
+	}
+
+	// Registers the baked materials in the library, draws then pass their indices
+	void bindMaterials(MaterialLibrary& library)
+	{
+		for (MaterialTextures& material : this->materials) material.index = library.add(material.parameters);
+	}
+
+	inline bool isLoaded() const { return this->uploaded || this->file; }
+	inline const std::string& getPath() const { return this->path; }
+	inline const std::vector<BakedMesh>& getMeshes() const { return this->meshes; }
+	inline const std::vector<BakedDraw>& getDraws() const { return this->draws; }
+	inline size_t getMaterialCount() const { return this->materials.size(); }
+	inline const Material& getMaterial(size_t material) const { return this->materials[material].parameters; }
+	inline const std::vector<GLuint>& getMaterialTextures(size_t material) const { return this->materials[material].textures; }
+	inline const std::string& getTexturePath(size_t texture) const { return this->texturePaths[texture]; }
+	inline TextureType getTextureType(size_t texture) const { return this->textureTypes[texture]; }
+	inline double getLoadMilliseconds() const { return this->loadMilliseconds; }
+	inline double getUploadMilliseconds() const { return this->uploadMilliseconds; }
+
+private:
+
+	struct MaterialTextures
+	{
+		Material parameters;
+		GLuint index = 0;				// In the MaterialLibrary, see bindMaterials()
+		std::vector<GLuint> textures;	// Indices in the texture table
+		std::vector<TextureType> types;
+		std::vector<GLuint> IDs;		// GL textures, filled at upload()
+		SamplerBindingCache samplerBindings;
+	};
+
+	std::string path;
+	std::unique_ptr<MappedFile> file;
+	bool uploaded;
+	double loadMilliseconds, uploadMilliseconds;
+
+	GLuint VAO, VBO, EBO, tangentVBO;
+
+	std::vector<BakedMesh> meshes;
+	std::vector<BakedDraw> draws;
+	std::vector<MaterialTextures> materials;
+	std::vector<std::string> texturePaths;
+	std::vector<TextureType> textureTypes;
+	std::vector<TextureHandle> textureHandles;	// Of texturePaths, kept so the cache doesn't purge them
+	std::vector<Texture> textures;
+
+	inline const BakedModelHeader& getHeader() const { return *(const BakedModelHeader*)this->file->data(); }
+
+	// Header, version and every section checked against the file size before use
+	bool validate() const
+	{
+		size_t size = this->file->size();
+		if (size < sizeof(BakedModelHeader))
+		{
+			std::cout << "ERROR::BAKED_MODEL::TRUNCATED " << this->path << '\n';
+			return false;
+		}
+
+		const BakedModelHeader& header = getHeader();
+		if (header.magic != BAKED_MODEL_MAGIC)
+		{
+			std::cout << "ERROR::BAKED_MODEL::NOT_A_BAKED_MODEL " << this->path << '\n';
+			return false;
+		}
+		if (header.version != BAKED_MODEL_VERSION)
+		{
+			std::cout << "ERROR::BAKED_MODEL::VERSION_MISMATCH " << this->path << " (" << header.version << ", expected "
+				<< BAKED_MODEL_VERSION << ")" << '\n';
+			return false;
+		}
+
+		bool valid = validBakedSection(header.meshOffset, (uint64_t)header.meshCount * sizeof(BakedMesh), size)
+			&& validBakedSection(header.drawOffset, (uint64_t)header.drawCount * sizeof(BakedDraw), size)
+			&& validBakedSection(header.materialOffset, (uint64_t)header.materialCount * sizeof(BakedMaterial), size)
+			&& validBakedSection(header.textureOffset, (uint64_t)header.textureCount * sizeof(BakedTexture), size)
+			&& validBakedSection(header.stringOffset, header.stringBytes, size)
+			&& validBakedSection(header.vertexOffset, header.vertexBytes, size)
+			&& validBakedSection(header.indexOffset, header.indexBytes, size)
+			&& validBakedSection(header.tangentOffset, header.tangentBytes, size)
+			&& validBakedSection(header.meshletOffset, header.meshletBytes, size);
+
+		if (!valid) std::cout << "ERROR::BAKED_MODEL::CORRUPTED " << this->path << '\n';
+		return valid;
+	}
+};
+
+#endif // !BAKED_MODEL_H
@@ -0,0 +1,570 @@
+/*
+*	MODEL.HPP
+*
+*	Model files imported with Assimp into a list of Meshes and a node hierarchy.
+*	With MODEL_OBJ_READER defined, Wavefront OBJ files go through the faster
+*	MODEL/obj_loader.hpp instead and become one mesh per material under a
+*	single root node. It is opt-in because corners without a normal get their
+*	face normal there, where aiProcess_GenSmoothNormals gives smooth ones.
+*
+*	Baked files (BAKED_MODEL_EXTENSION, see MODEL/baked_model.hpp) are read
+*	with no parsing nor geometry processing: the meshes come out of the mapped
+*	file as they were cooked, one node per baked draw under a root node.
+*
+*	Loading is split so the CPU work scales with the cores and the GL work stays
+*	on the thread owning the context:
+*	- the constructor imports the file, flattens the node tree and converts
+*	  every aiMesh concurrently on a ThreadPool (vertex packing, index
+*	  flattening, welding, texture path resolution, then the Mesh geometry
+*	  processing: meshlets, LODs, bounds, tangents). Texture files are decoded
+*	  in parallel too. No GL call is made, so it can run before the context
+*	  exists or on a loading thread.
+*	- upload() creates the textures and the mesh buffers on the GL thread.
+*	  draw() calls it if it hasn't been done yet.
+*
+*	Texture files come from a TextureCache (TEXTURE/texture_cache.hpp) keyed
+*	by resolved path. Models given the same cache, like the ones of a
+*	ModelCache, share the decode and the GL texture of every common file.
+*	Without one, files are only shared between the meshes of the model.
+*
+*	Every mesh keeps the Material of its file (.mtl Ka/Kd/Ks/Ns/d or the Assimp
+*	material keys). bindMaterials() registers them in a MaterialLibrary and
+*	stores the resulting indices in the meshes.
+*
+*	Nodes are stored parents first, each one with its transform relative to the
+*	model root and the model space bounds of its meshes and children.
+*/
+
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <MODEL/obj_loader.hpp>
+#include <MODEL/baked_model.hpp>
+#include <MATERIAL/material.hpp>
+#include <MESH/mesh.hpp>
+#include <SHADER/shader_s.hpp>
+#include <TEXTURE/texture_s.hpp>
+#include <TEXTURE/texture_cache.hpp>
+#include <BOUNDS/bounds.hpp>
+#include <SCENE/scene_graph.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <cctype>
+
+#define MODEL_IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_GenSmoothNormals)
+
+struct ModelNode
+{
+	std::string name;
+	int parent;						// -1 for the root
+	glm::mat4 localTransform;
+	glm::mat4 globalTransform;		// Relative to the model root
+	std::vector<GLuint> meshes;
+	AABB bounds;					// Model space, this node's meshes and its children
+};
+
+struct ModelLoadStats
+{
+	double importMilliseconds;		// Assimp ReadFile, or loadObj()
+	double processMilliseconds;		// Parallel aiMesh conversion and geometry processing
+	double decodeMilliseconds;		// Parallel texture decoding
+	double uploadMilliseconds;		// GL upload on the main thread
+	size_t meshCount, vertexCount, triangleCount, textureCount;
+};
+
+// Texture file a mesh samples, resolved on the workers and loaded at upload()
+struct ModelTextureRef
+{
+	std::string path;
+	TextureType type;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Model import utility functions"
+
+inline glm::mat4 toGlm(const aiMatrix4x4& m)
+{
+	// Assimp matrices are row major
+	return glm::mat4(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4, m.b4, m.c4, m.d4);
+}
+
+inline std::string resolveTexturePath(const std::string& directory, const aiString& file)
+{
+	std::string path = file.C_Str();
+	for (char& c : path) if (c == '\\') c = '/';
+
+	bool absolute = !path.empty() && (path[0] == '/' || (path.size() > 1 && path[1] == ':'));
+	return absolute || directory.empty() ? path : directory + '/' + path;
+}
+
+inline void collectTextureRefs(const aiMaterial* material, const std::string& directory, std::vector<ModelTextureRef>& refs)
+{
+	// OBJ bump maps (map_Bump) come through as height textures, they are normal maps here
+	const std::pair<aiTextureType, TextureType> mapping[] = {
+		{ aiTextureType_DIFFUSE, texture_diffuse },
+		{ aiTextureType_SPECULAR, texture_specular },
+		{ aiTextureType_NORMALS, texture_normal },
+		{ aiTextureType_HEIGHT, texture_normal },
+		{ aiTextureType_DISPLACEMENT, texture_height }
+	};
+
+	for (const std::pair<aiTextureType, TextureType>& entry : mapping)
+	{
+		for (unsigned i = 0; i < material->GetTextureCount(entry.first); i++)
+		{
+			aiString file;
+			material->GetTexture(entry.first, i, &file);
+
+			// "*N" names point to textures embedded in the file
+			if (file.length > 0 && file.C_Str()[0] == '*')
+			{
+				std::cout << "ERROR::MODEL::EMBEDDED_TEXTURE_NOT_SUPPORTED " << file.C_Str() << '\n';
+				continue;
+			}
+
+			ModelTextureRef ref = { resolveTexturePath(directory, file), entry.second };
+			bool duplicate = false;
+			for (const ModelTextureRef& other : refs) duplicate |= other.path == ref.path && other.type == ref.type;
+			if (!duplicate) refs.push_back(ref);
+		}
+	}
+}
+
+inline Material toMaterial(const ObjMaterial& material)
+{
+	return makeMaterial(material.ambient, material.diffuse, material.specular, material.shininess, material.opacity);
+}
+
+// Missing keys keep the defaults of the OBJ reader (defaultObjMaterial)
+inline Material toMaterial(const aiMaterial* material)
+{
+	aiColor3D ambient = { 1.0f, 1.0f, 1.0f }, diffuse = { 0.8f, 0.8f, 0.8f }, specular = { 0.5f, 0.5f, 0.5f };
+	float shininess = 32.0f, opacity = 1.0f;
+
+	material->Get(AI_MATKEY_COLOR_AMBIENT, ambient);
+	material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+	material->Get(AI_MATKEY_COLOR_SPECULAR, specular);
+	material->Get(AI_MATKEY_SHININESS, shininess);
+	material->Get(AI_MATKEY_OPACITY, opacity);
+
+	return makeMaterial(glm::vec3(ambient.r, ambient.g, ambient.b), glm::vec3(diffuse.r, diffuse.g, diffuse.b),
+		glm::vec3(specular.r, specular.g, specular.b), shininess, opacity);
+}
+
+// Case insensitive, extension with its dot
+inline bool hasExtension(const std::string& path, const std::string& extension)
+{
+	if (path.size() < extension.size()) return false;
+	std::string end = path.substr(path.size() - extension.size());
+	for (char& c : end) c = (char)std::tolower((unsigned char)c);
+	return end == extension;
+}
+
+inline bool isObjPath(const std::string& path)
+{
+	return hasExtension(path, ".obj");
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class Model
+{
+public:
+
+	std::vector<std::unique_ptr<Mesh>> meshes;
+	std::vector<ModelNode> nodes;
+
+	// Model space bounds of every mesh placed by its nodes
+	AABB bounds;
+	BoundingSphere boundingSphere;
+
+	Model(const std::string& path, VertexStreamLayout layout = stream_interleaved, ThreadPool& pool = ThreadPool::shared(),
+		TextureCache* textureCache = nullptr)
+	{
+		this->path = path;
+		this->stats = ModelLoadStats();
+		this->bounds = emptyAABB();
+		this->boundingSphere = { glm::vec3(0.0f), 0.0f };
+		this->uploaded = false;
+
+		loadModel(path, layout, pool, textureCache);
+	}
+
+	// Textures and mesh buffers creation, must run on the thread owning the context
+	void upload()
+	{
+		if (this->uploaded) return;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		// One GL texture per file, created by the first model uploading it, copies handed to the meshes share it
+		std::unordered_map<std::string, const Texture*> textures;
+		for (size_t i = 0; i < this->textureHandles.size(); i++) textures[this->texturePaths[i]] = &this->textureHandles[i]->upload();
+
+		for (size_t i = 0; i < this->meshes.size(); i++)
+		{
+			for (const ModelTextureRef& ref : this->textureRefs[i])
+			{
+				Texture texture = *textures[ref.path];
+				texture.sType = ref.type;
+				this->meshes[i]->textures.push_back(texture);
+			}
+			this->meshes[i]->upload();
+		}
+
+		this->uploaded = true;
+		this->stats.uploadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	/*
+	*	Draws every mesh with the "model" uniform set to model * node transform.
+	*	The shader must be in use.
+	*/
+	void draw(Shader& shader, const glm::mat4& model = glm::mat4(1.0f), bool hasMaterial = false)
+	{
+		upload();
+
+		for (const ModelNode& node : this->nodes)
+		{
+			if (node.meshes.empty()) continue;
+
+			shader.setMat4Uniform("model", model * node.globalTransform);
+			for (GLuint mesh : node.meshes) this->meshes[mesh]->render(shader, hasMaterial);
+		}
+	}
+
+	inline const std::string& getPath() const { return this->path; }
+	inline bool isUploaded() const { return this->uploaded; }
+	inline const ModelLoadStats& getStats() const { return this->stats; }
+
+	// Texture files sampled by a mesh, as resolved at import
+	inline const std::vector<ModelTextureRef>& getTextureRefs(size_t mesh) const { return this->textureRefs[mesh]; }
+
+	// Surface parameters of a mesh, as read at import
+	inline const Material& getMaterial(size_t mesh) const { return this->materials[mesh]; }
+
+	// Registers the mesh materials in the library and stores their indices in the meshes
+	void bindMaterials(MaterialLibrary& library)
+	{
+		for (size_t i = 0; i < this->meshes.size(); i++) this->meshes[i]->materialIndex = library.add(this->materials[i]);
+	}
+
+private:
+
+	std::string path;
+	bool uploaded;
+	ModelLoadStats stats;
+
+	std::vector<Material> materials;						// Per mesh
+
+	// Kept from the import until upload()
+	std::vector<std::vector<ModelTextureRef>> textureRefs;	// Per mesh
+
+	std::vector<std::string> texturePaths;					// Unique files
+	std::vector<TextureHandle> textureHandles;				// Of texturePaths, kept so the cache doesn't purge them
+
+	void loadModel(const std::string& path, VertexStreamLayout layout, ThreadPool& pool, TextureCache* textureCache)
+	{
+		TextureCache modelTextures;
+		TextureCache& cache = textureCache ? *textureCache : modelTextures;
+
+		bool loaded;
+		if (hasExtension(path, BAKED_MODEL_EXTENSION)) loaded = importBaked(path, layout, pool, cache);
+#ifdef MODEL_OBJ_READER
+		else if (isObjPath(path)) loaded = importObj(path, layout, pool);
+#endif
+		else loaded = importAssimp(path, layout, pool);
+		if (!loaded) return;
+
+		computeBounds();
+
+		std::chrono::steady_clock::time_point processed = std::chrono::steady_clock::now();
+
+		// Texture files are decoded in parallel, uploaded later. Files already decoded for another model are skipped
+		for (const std::vector<ModelTextureRef>& refs : this->textureRefs)
+			for (const ModelTextureRef& ref : refs)
+				if (std::find(this->texturePaths.begin(), this->texturePaths.end(), ref.path) == this->texturePaths.end())
+				{
+					this->texturePaths.push_back(ref.path);
+					this->textureHandles.push_back(cache.acquire(ref.path));
+				}
+
+		pool.parallelFor(this->textureHandles.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++) this->textureHandles[i]->decode();
+		});
+
+		this->stats.decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - processed).count();
+
+		this->stats.meshCount = this->meshes.size();
+		this->stats.textureCount = this->textureHandles.size();
+		for (const std::unique_ptr<Mesh>& mesh : this->meshes)
+		{
+			this->stats.vertexCount += mesh->vertices.size();
+			if (!mesh->lods.empty()) this->stats.triangleCount += mesh->lods[0].indexCount / 3;
+		}
+	}
+
+	bool importAssimp(const std::string& path, VertexStreamLayout layout, ThreadPool& pool)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+
+		if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode)
+		{
+			std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << '\n';
+			return false;
+		}
+
+		std::chrono::steady_clock::time_point imported = std::chrono::steady_clock::now();
+		this->stats.importMilliseconds = std::chrono::duration<double, std::milli>(imported - start).count();
+
+		std::string directory = path.substr(0, path.find_last_of("/\\") == std::string::npos ? 0 : path.find_last_of("/\\"));
+
+		// Hierarchy first, it is cheap and serial
+		flattenNodes(scene->mRootNode, -1);
+
+		// Every aiMesh is converted and processed on its own
+		this->meshes.resize(scene->mNumMeshes);
+		this->materials.assign(scene->mNumMeshes, defaultMaterial());
+		this->textureRefs.resize(scene->mNumMeshes);
+
+		pool.parallelFor(scene->mNumMeshes, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const aiMesh* source = scene->mMeshes[i];
+				if (source->mMaterialIndex < scene->mNumMaterials)
+				{
+					collectTextureRefs(scene->mMaterials[source->mMaterialIndex], directory, this->textureRefs[i]);
+					this->materials[i] = toMaterial(scene->mMaterials[source->mMaterialIndex]);
+				}
+
+				bool normalMapped = false;
+				for (const ModelTextureRef& ref : this->textureRefs[i]) normalMapped |= ref.type == texture_normal;
+
+				std::vector<Vertex> vertices;
+				std::vector<GLuint> indices;
+				convertMesh(source, vertices, indices);
+
+				this->meshes[i].reset(new Mesh(vertices, indices, normalMapped, layout));
+				if (normalMapped) this->materials[i].flags |= MATERIAL_NORMAL_MAPPED;
+			}
+		});
+
+		this->stats.processMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - imported).count();
+		return true;
+	}
+
+	// One mesh per OBJ material, all under an identity root node (MODEL_OBJ_READER)
+	bool importObj(const std::string& path, VertexStreamLayout layout, ThreadPool& pool)
+	{
+		ObjModelData data;
+		if (!loadObj(path, data, pool))
+		{
+			std::cout << "ERROR::MODEL::OBJ_LOADING_FAILED " << path << '\n';
+			return false;
+		}
+
+		std::chrono::steady_clock::time_point imported = std::chrono::steady_clock::now();
+		this->stats.importMilliseconds = data.stats.totalMilliseconds;
+
+		ModelNode root;
+		root.name = path.substr(path.find_last_of("/\\") == std::string::npos ? 0 : path.find_last_of("/\\") + 1);
+		root.parent = -1;
+		root.localTransform = glm::mat4(1.0f);
+		root.globalTransform = glm::mat4(1.0f);
+		root.bounds = emptyAABB();
+		for (size_t i = 0; i < data.meshes.size(); i++) root.meshes.push_back((GLuint)i);
+		this->nodes.push_back(root);
+
+		this->meshes.resize(data.meshes.size());
+		this->materials.resize(data.meshes.size());
+		this->textureRefs.resize(data.meshes.size());
+
+		pool.parallelFor(data.meshes.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				ObjMeshData& source = data.meshes[i];
+				const ObjMaterial& material = data.materials[source.material];
+				this->materials[i] = toMaterial(material);
+
+				const std::pair<const std::string*, TextureType> maps[] = {
+					{ &material.diffuseMap, texture_diffuse },
+					{ &material.specularMap, texture_specular },
+					{ &material.normalMap, texture_normal },
+					{ &material.heightMap, texture_height }
+				};
+				for (const std::pair<const std::string*, TextureType>& map : maps)
+					if (!map.first->empty()) this->textureRefs[i].push_back({ *map.first, map.second });
+
+				this->meshes[i].reset(new Mesh(std::move(source.vertices), std::move(source.indices), !material.normalMap.empty(), layout));
+				if (!material.normalMap.empty()) this->materials[i].flags |= MATERIAL_NORMAL_MAPPED;
+			}
+		});
+
+		this->stats.processMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - imported).count();
+		return true;
+	}
+
+	// Meshes straight from the mapped file, textures only acquired so they are decoded with the others
+	bool importBaked(const std::string& path, VertexStreamLayout layout, ThreadPool& pool, TextureCache& cache)
+	{
+		BakedModel baked(path, pool, &cache, false);
+		if (!baked.isLoaded()) return false;
+
+		std::chrono::steady_clock::time_point imported = std::chrono::steady_clock::now();
+		this->stats.importMilliseconds = baked.getLoadMilliseconds();
+
+		ModelNode root;
+		root.name = path.substr(path.find_last_of("/\\") == std::string::npos ? 0 : path.find_last_of("/\\") + 1);
+		root.parent = -1;
+		root.localTransform = glm::mat4(1.0f);
+		root.globalTransform = glm::mat4(1.0f);
+		root.bounds = emptyAABB();
+		this->nodes.push_back(root);
+
+		for (const BakedDraw& draw : baked.getDraws())
+		{
+			ModelNode node = root;
+			node.parent = 0;
+			node.localTransform = node.globalTransform = draw.transform;
+			node.meshes.push_back(draw.mesh);
+			this->nodes.push_back(node);
+		}
+
+		const std::vector<BakedMesh>& bakedMeshes = baked.getMeshes();
+		this->meshes.resize(bakedMeshes.size());
+		this->materials.assign(bakedMeshes.size(), defaultMaterial());
+		this->textureRefs.resize(bakedMeshes.size());
+
+		pool.parallelFor(bakedMeshes.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t material = bakedMeshes[i].material;
+				if (material < baked.getMaterialCount())
+				{
+					this->materials[i] = baked.getMaterial(material);
+					for (GLuint texture : baked.getMaterialTextures(material))
+						this->textureRefs[i].push_back({ baked.getTexturePath(texture), baked.getTextureType(texture) });
+				}
+
+				// Meshes the loader rejected stay empty
+				std::vector<Vertex> vertices;
+				std::vector<GLuint> indices;
+				std::vector<MeshLod> lods;
+				std::vector<Meshlet> meshlets;
+				std::vector<QTangent> tangents;
+				baked.readMesh(i, vertices, indices, lods, meshlets, tangents);
+
+				this->meshes[i].reset(new Mesh(std::move(vertices), std::move(indices), std::move(lods), std::move(meshlets), std::move(tangents),
+					bakedMeshes[i].bounds, bakedMeshes[i].boundingSphere, layout));
+			}
+		});
+
+		this->stats.processMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - imported).count();
+		return true;
+	}
+
+	// Preorder walk, parents always come before their children
+	void flattenNodes(const aiNode* source, int parent)
+	{
+		ModelNode node;
+		node.name = source->mName.C_Str();
+		node.parent = parent;
+		node.localTransform = toGlm(source->mTransformation);
+		node.globalTransform = parent < 0 ? node.localTransform : this->nodes[parent].globalTransform * node.localTransform;
+		node.meshes.assign(source->mMeshes, source->mMeshes + source->mNumMeshes);
+		node.bounds = emptyAABB();
+
+		int index = (int)this->nodes.size();
+		this->nodes.push_back(node);
+
+		for (unsigned i = 0; i < source->mNumChildren; i++) flattenNodes(source->mChildren[i], index);
+	}
+
+	// Vertex packing and index flattening, points and lines are dropped
+	static void convertMesh(const aiMesh* source, std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		vertices.resize(source->mNumVertices);
+		for (unsigned v = 0; v < source->mNumVertices; v++)
+		{
+			Vertex& vertex = vertices[v];
+			vertex.position = glm::vec3(source->mVertices[v].x, source->mVertices[v].y, source->mVertices[v].z);
+			vertex.normal = source->mNormals ? glm::vec3(source->mNormals[v].x, source->mNormals[v].y, source->mNormals[v].z) : glm::vec3(0.0f);
+			vertex.texCoords = source->mTextureCoords[0] ? glm::vec2(source->mTextureCoords[0][v].x, source->mTextureCoords[0][v].y) : glm::vec2(0.0f);
+		}
+
+		indices.reserve(source->mNumFaces * 3);
+		for (unsigned f = 0; f < source->mNumFaces; f++)
+		{
+			const aiFace& face = source->mFaces[f];
+			if (face.mNumIndices != 3) continue;
+			indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+		}
+
+		// Assimp keeps one vertex per face corner unless told to join them, the parallel weld is faster
+		if (!indices.empty()) vertices = weldVertices(vertices, indices);
+		else vertices.clear();
+	}
+
+	// Node bounds from their meshes, then children folded into parents (reverse preorder)
+	void computeBounds()
+	{
+		for (ModelNode& node : this->nodes)
+		{
+			for (GLuint mesh : node.meshes)
+			{
+				node.bounds = mergeAABB(node.bounds, transformAABB(this->meshes[mesh]->bounds, node.globalTransform));
+
+				BoundingSphere sphere = transformSphere(this->meshes[mesh]->boundingSphere, node.globalTransform);
+				this->boundingSphere = this->boundingSphere.radius > 0.0f ? mergeSpheres(this->boundingSphere, sphere) : sphere;
+			}
+		}
+
+		for (size_t i = this->nodes.size(); i-- > 1;)
+		{
+			ModelNode& parent = this->nodes[this->nodes[i].parent];
+			parent.bounds = mergeAABB(parent.bounds, this->nodes[i].bounds);
+		}
+
+		if (!this->nodes.empty()) this->bounds = this->nodes[0].bounds;
+	}
+};
+
+// Mirrors a Model's node hierarchy in the scene under parent, returns the id of the model root
+inline SceneNodeId addModelNodes(SceneGraph& scene, const Model& model, SceneNodeId parent = SCENE_NO_PARENT)
+{
+	std::vector<SceneNodeId> created(model.nodes.size());
+	for (size_t i = 0; i < model.nodes.size(); i++)
+	{
+		const ModelNode& node = model.nodes[i];
+		glm::vec3 translation, scale;
+		glm::quat rotation;
+		decomposeTRS(node.localTransform, translation, rotation, scale);
+
+		created[i] = scene.addNode(node.parent < 0 ? parent : created[node.parent], translation, rotation, scale);
+	}
+	return created.empty() ? SCENE_NO_PARENT : created[0];
+}
+
+#endif // !MODEL_H
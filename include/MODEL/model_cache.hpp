@@ -0,0 +1,272 @@
+/*
+*	MODEL_CACHE.HPP
+*
+*	Shared model resources and lightweight instances of them.
+*
+*	ModelCache loads every file once: load() returns the same ModelHandle
+*	(geometry, material textures, GL buffers once uploaded) for every request
+*	of a path with the same vertex stream layout. Concurrent load() calls of
+*	one path from several threads wait for a single import, different paths
+*	load in parallel. The materials of every loaded model go to the cache's
+*	MaterialLibrary, so one buffer bound at MATERIAL_BINDING serves them all.
+*	When the source has an up to date baked file next to it (path +
+*	BAKED_MODEL_EXTENSION, written offline by cookModel()) the Model is read
+*	from that file instead, with no parsing. load() never writes it.
+*
+*	loadBaked() is the same for the BakedModel loader (MODEL/baked_model.hpp),
+*	except that the file next to the source is cooked again when missing or
+*	older than it, then mapped: it is meant for tools, not for the runtime.
+*
+*	ModelInstance is what a scene places: a transform, per-instance parameters
+*	and a handle to the shared Model. Placing an asset a hundred times costs one
+*	load and a hundred matrices. Resources stay alive while an instance or the
+*	cache holds them, purge() drops the ones only the cache still references.
+*
+*	Texture files are shared across models too: every model the cache loads
+*	gets its files from one TextureCache keyed by resolved path, so a file
+*	used by several models is decoded once and uploaded as one GL texture.
+*/
+
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <glm/glm.hpp>
+
+#include <MODEL/model.hpp>
+#include <MODEL/baked_model.hpp>
+#include <MODEL/model_cook.hpp>
+#include <MATERIAL/material.hpp>
+#include <TEXTURE/texture_cache.hpp>
+#include <SHADER/shader_s.hpp>
+#include <BOUNDS/bounds.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+typedef std::shared_ptr<Model> ModelHandle;
+typedef std::shared_ptr<BakedModel> BakedModelHandle;
+
+struct ModelCacheStats
+{
+	size_t hits, misses;
+	size_t entries;
+};
+
+class ModelInstance
+{
+public:
+
+	glm::mat4 transform;
+	glm::vec4 tint;			// Multiplies the shaded colour ("tint" uniform)
+	bool visible;
+	bool hasMaterial;		// Forwarded to Mesh::render()
+
+	ModelInstance() : ModelInstance(nullptr) {}
+
+	explicit ModelInstance(const ModelHandle& model, const glm::mat4& transform = glm::mat4(1.0f))
+	{
+		this->model = model;
+		this->transform = transform;
+		this->tint = glm::vec4(1.0f);
+		this->visible = true;
+		this->hasMaterial = false;
+	}
+
+	// The shader must be in use, the shared model is uploaded on first draw
+	void draw(Shader& shader) const
+	{
+		if (!this->visible || !this->model) return;
+
+		shader.setVec4Uniform("tint", this->tint);
+		this->model->draw(shader, this->transform, this->hasMaterial);
+	}
+
+	// World space bounds of the shared model under this instance's transform
+	AABB getBounds() const
+	{
+		return this->model ? transformAABB(this->model->bounds, this->transform) : emptyAABB();
+	}
+
+	inline const ModelHandle& getModel() const { return this->model; }
+
+private:
+
+	ModelHandle model;
+};
+
+class ModelCache
+{
+public:
+
+	ModelCache()
+	{
+		this->hits = 0;
+		this->misses = 0;
+	}
+
+	ModelCache(const ModelCache&) = delete;
+	ModelCache& operator=(const ModelCache&) = delete;
+
+	/*
+	*	Shared model of a file, imported on the first request (from its baked
+	*	file when fresh). Failed imports are cached too (an empty Model) so a
+	*	missing file isn't retried every frame.
+	*/
+	ModelHandle load(const std::string& path, VertexStreamLayout layout = stream_interleaved, ThreadPool& pool = ThreadPool::shared())
+	{
+		std::shared_ptr<Entry> entry;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+
+			std::shared_ptr<Entry>& slot = this->entries[makeKey(path, layout)];
+			if (slot) this->hits++;
+			else
+			{
+				slot = std::make_shared<Entry>();
+				this->misses++;
+			}
+			entry = slot;
+		}
+
+		// Outside the map lock, only callers of this path wait for the import
+		std::call_once(entry->loaded, [&]()
+		{
+			// A baked file the loader rejects (older format version) falls back to the source
+			std::string baked = path + BAKED_MODEL_EXTENSION;
+			ModelHandle model;
+			if (!bakedModelStale(path, baked)) model = std::make_shared<Model>(baked, layout, pool, &this->textures);
+			if (!model || model->meshes.empty()) model = std::make_shared<Model>(path, layout, pool, &this->textures);
+			model->bindMaterials(this->materials);
+
+			std::lock_guard<std::mutex> lock(this->mutex);
+			entry->model = model;
+		});
+		return entry->model;
+	}
+
+	// Baked model of a source file (path + BAKED_MODEL_EXTENSION), cooked first if stale
+	BakedModelHandle loadBaked(const std::string& path, ThreadPool& pool = ThreadPool::shared())
+	{
+		std::shared_ptr<BakedEntry> entry;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+
+			std::shared_ptr<BakedEntry>& slot = this->bakedEntries[makeKey(path, stream_interleaved)];
+			if (slot) this->hits++;
+			else
+			{
+				slot = std::make_shared<BakedEntry>();
+				this->misses++;
+			}
+			entry = slot;
+		}
+
+		std::call_once(entry->loaded, [&]()
+		{
+			BakedModelHandle model = loadCookedModel(path, path + BAKED_MODEL_EXTENSION, pool, &this->textures);
+			model->bindMaterials(this->materials);
+
+			std::lock_guard<std::mutex> lock(this->mutex);
+			entry->model = model;
+		});
+		return entry->model;
+	}
+
+	ModelInstance instantiate(const std::string& path, const glm::mat4& transform = glm::mat4(1.0f), VertexStreamLayout layout = stream_interleaved)
+	{
+		return ModelInstance(load(path, layout), transform);
+	}
+
+	bool contains(const std::string& path, VertexStreamLayout layout = stream_interleaved) const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->entries.count(makeKey(path, layout)) != 0;
+	}
+
+	// Drops the models no instance holds anymore and the textures only they used (their GL objects too, call it on the context thread)
+	size_t purge()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		size_t released = 0;
+		for (std::unordered_map<std::string, std::shared_ptr<Entry>>::iterator it = this->entries.begin(); it != this->entries.end();)
+		{
+			// A null model is an import still running on another thread
+			if (it->second->model && it->second->model.use_count() == 1)
+			{
+				it = this->entries.erase(it);
+				released++;
+			}
+			else ++it;
+		}
+		for (std::unordered_map<std::string, std::shared_ptr<BakedEntry>>::iterator it = this->bakedEntries.begin(); it != this->bakedEntries.end();)
+		{
+			if (it->second->model && it->second->model.use_count() == 1)
+			{
+				it = this->bakedEntries.erase(it);
+				released++;
+			}
+			else ++it;
+		}
+		this->textures.purge();
+		return released;
+	}
+
+	// Uploads every cached model and the materials, must run on the thread owning the context
+	void upload()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (std::pair<const std::string, std::shared_ptr<Entry>>& entry : this->entries)
+			if (entry.second->model) entry.second->model->upload();
+		for (std::pair<const std::string, std::shared_ptr<BakedEntry>>& entry : this->bakedEntries)
+			if (entry.second->model) entry.second->model->upload();
+		this->materials.upload();
+	}
+
+	// Materials of every cached model, other geometry can add its own and share the buffer
+	inline MaterialLibrary& getMaterials() { return this->materials; }
+
+	// Texture files of every cached model, other loaders can share them too
+	inline TextureCache& getTextures() { return this->textures; }
+
+	ModelCacheStats getStats() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return { this->hits, this->misses, this->entries.size() + this->bakedEntries.size() };
+	}
+
+private:
+
+	struct Entry
+	{
+		std::once_flag loaded;
+		ModelHandle model;
+	};
+
+	struct BakedEntry
+	{
+		std::once_flag loaded;
+		BakedModelHandle model;
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+	std::unordered_map<std::string, std::shared_ptr<BakedEntry>> bakedEntries;
+	MaterialLibrary materials;
+	TextureCache textures;
+	size_t hits, misses;
+
+	// The same file with another stream layout is different GPU data
+	static std::string makeKey(const std::string& path, VertexStreamLayout layout)
+	{
+		std::string key = path;
+		for (char& c : key) if (c == '\\') c = '/';
+		return key + '#' + std::to_string((int)layout);
+	}
+};
+
+#endif // !MODEL_CACHE_H
@@ -0,0 +1,241 @@
+/*
+*	MODEL_COOK.HPP
+*
+*	Offline step writing an imported Model as a baked model file (format in
+*	baked_model.hpp). This is the only side of the baked path using Assimp.
+*
+*	Meshes are written with their processed geometry (welded vertices, LOD
+*	chain, meshlets, tangents, bounds), one draw per node referencing a mesh, and the
+*	materials (parameters and texture list) deduplicated into a material table.
+*
+*	loadCookedModel() is the runtime entry point: the source is imported and
+*	cooked again only when its baked file is missing, older than the source or
+*	rejected by the loader (older format version), then the baked file is mapped.
+*/
+
+#ifndef MODEL_COOK_H
+#define MODEL_COOK_H
+
+#include <MODEL/model.hpp>
+#include <MODEL/baked_model.hpp>
+#include <MATERIAL/material.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Model cook utility functions"
+
+inline void writeBakedSection(std::ofstream& out, uint64_t offset, const void* data, size_t bytes)
+{
+	// Zero padding up to the aligned section start
+	static const char zeros[BAKED_MODEL_ALIGNMENT] = {};
+	uint64_t position = (uint64_t)out.tellp();
+	if (offset > position) out.write(zeros, offset - position);
+
+	if (bytes > 0) out.write((const char*)data, bytes);
+}
+
+// Seconds since the epoch, -1 when the file doesn't exist
+inline int64_t fileModificationTime(const std::string& path)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) return -1;
+	return (int64_t)info.st_mtime;
+}
+
+// The baked file is missing or older than its source
+inline bool bakedModelStale(const std::string& sourcePath, const std::string& bakedPath)
+{
+	int64_t baked = fileModificationTime(bakedPath);
+	return baked < 0 || baked < fileModificationTime(sourcePath);
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+inline bool cookModel(const Model& model, const std::string& outputPath)
+{
+	std::vector<BakedMesh> meshes;
+	std::vector<BakedDraw> draws;
+	std::vector<BakedMaterial> materials;
+	std::vector<BakedTexture> textures;
+	std::string strings;
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+	std::vector<QTangent> tangents;
+	std::vector<Meshlet> meshlets;
+
+	bool anyTangents = false;
+	for (const std::unique_ptr<Mesh>& mesh : model.meshes) anyTangents |= !mesh->tangents.empty();
+
+	// Meshes sharing the same parameters and texture list share a material
+	std::vector<std::vector<ModelTextureRef>> materialRefs;
+	MaterialEqual sameParameters;
+
+	for (size_t m = 0; m < model.meshes.size(); m++)
+	{
+		const Mesh& mesh = *model.meshes[m];
+		const std::vector<ModelTextureRef>& refs = model.getTextureRefs(m);
+
+		size_t material = 0;
+		while (material < materialRefs.size())
+		{
+			const std::vector<ModelTextureRef>& other = materialRefs[material];
+			bool equal = other.size() == refs.size() && sameParameters(materials[material].parameters, model.getMaterial(m));
+			for (size_t t = 0; t < refs.size() && equal; t++) equal = other[t].path == refs[t].path && other[t].type == refs[t].type;
+			if (equal) break;
+			material++;
+		}
+		if (material == materialRefs.size())
+		{
+			materialRefs.push_back(refs);
+			BakedMaterial baked;
+			std::memset(&baked, 0, sizeof(baked));
+			baked.firstTexture = (uint32_t)textures.size();
+			baked.textureCount = (uint32_t)refs.size();
+			baked.parameters = model.getMaterial(m);
+			materials.push_back(baked);
+			for (const ModelTextureRef& ref : refs)
+			{
+				textures.push_back({ (uint32_t)ref.type, (uint32_t)strings.size(), (uint32_t)ref.path.size() });
+				strings += ref.path;
+			}
+		}
+
+		BakedMesh baked;
+		std::memset(&baked, 0, sizeof(baked));
+		baked.baseVertex = (uint32_t)vertices.size();
+		baked.vertexCount = (uint32_t)mesh.vertices.size();
+		baked.firstIndex = (uint32_t)indices.size();
+		baked.indexCount = (uint32_t)mesh.indices.size();
+		baked.lodCount = (uint32_t)std::min<size_t>(mesh.lods.size(), LOD_MAX_LEVELS);
+		baked.material = (uint32_t)material;
+		baked.firstMeshlet = (uint32_t)meshlets.size();
+		baked.meshletCount = (uint32_t)mesh.meshlets.size();
+		for (uint32_t l = 0; l < baked.lodCount; l++)
+		{
+			baked.lods[l] = mesh.lods[l];
+			baked.lods[l].firstIndex += baked.firstIndex;
+		}
+		baked.bounds = mesh.bounds;
+		baked.boundingSphere = mesh.boundingSphere;
+		meshes.push_back(baked);
+
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+		meshlets.insert(meshlets.end(), mesh.meshlets.begin(), mesh.meshlets.end());
+
+		// Meshes without a tangent stream get identity frames, never read by their shaders
+		if (anyTangents)
+		{
+			if (mesh.tangents.size() == mesh.vertices.size()) tangents.insert(tangents.end(), mesh.tangents.begin(), mesh.tangents.end());
+			else tangents.resize(tangents.size() + mesh.vertices.size(), QTangent(0, 0, 0, 32767));
+		}
+	}
+
+	for (const ModelNode& node : model.nodes)
+	{
+		for (GLuint mesh : node.meshes)
+		{
+			BakedDraw draw;
+			std::memset(&draw, 0, sizeof(draw));
+			draw.transform = node.globalTransform;
+			draw.mesh = mesh;
+			draws.push_back(draw);
+		}
+	}
+
+	BakedModelHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic = BAKED_MODEL_MAGIC;
+	header.version = BAKED_MODEL_VERSION;
+	header.meshCount = (uint32_t)meshes.size();
+	header.drawCount = (uint32_t)draws.size();
+	header.materialCount = (uint32_t)materials.size();
+	header.textureCount = (uint32_t)textures.size();
+	header.bounds = model.bounds;
+	header.boundingSphere = model.boundingSphere;
+
+	uint64_t offset = sizeof(BakedModelHeader);
+	header.meshOffset = offset = alignBakedOffset(offset);
+	offset += meshes.size() * sizeof(BakedMesh);
+	header.drawOffset = offset = alignBakedOffset(offset);
+	offset += draws.size() * sizeof(BakedDraw);
+	header.materialOffset = offset = alignBakedOffset(offset);
+	offset += materials.size() * sizeof(BakedMaterial);
+	header.textureOffset = offset = alignBakedOffset(offset);
+	offset += textures.size() * sizeof(BakedTexture);
+	header.stringOffset = offset = alignBakedOffset(offset);
+	header.stringBytes = strings.size();
+	offset += strings.size();
+	header.vertexOffset = offset = alignBakedOffset(offset);
+	header.vertexBytes = vertices.size() * sizeof(Vertex);
+	offset += header.vertexBytes;
+	header.indexOffset = offset = alignBakedOffset(offset);
+	header.indexBytes = indices.size() * sizeof(GLuint);
+	offset += header.indexBytes;
+	header.tangentOffset = offset = alignBakedOffset(offset);
+	header.tangentBytes = tangents.size() * sizeof(QTangent);
+	offset += header.tangentBytes;
+	header.meshletOffset = offset = alignBakedOffset(offset);
+	header.meshletBytes = meshlets.size() * sizeof(Meshlet);
+
+	std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		std::cout << "ERROR::MODEL_COOK::OPEN_FAILED " << outputPath << '\n';
+		return false;
+	}
+
+	out.write((const char*)&header, sizeof(header));
+	writeBakedSection(out, header.meshOffset, meshes.data(), meshes.size() * sizeof(BakedMesh));
+	writeBakedSection(out, header.drawOffset, draws.data(), draws.size() * sizeof(BakedDraw));
+	writeBakedSection(out, header.materialOffset, materials.data(), materials.size() * sizeof(BakedMaterial));
+	writeBakedSection(out, header.textureOffset, textures.data(), textures.size() * sizeof(BakedTexture));
+	writeBakedSection(out, header.stringOffset, strings.data(), strings.size());
+	writeBakedSection(out, header.vertexOffset, vertices.data(), header.vertexBytes);
+	writeBakedSection(out, header.indexOffset, indices.data(), header.indexBytes);
+	writeBakedSection(out, header.tangentOffset, tangents.data(), header.tangentBytes);
+	writeBakedSection(out, header.meshletOffset, meshlets.data(), header.meshletBytes);
+
+	if (!out)
+	{
+		std::cout << "ERROR::MODEL_COOK::WRITE_FAILED " << outputPath << '\n';
+		return false;
+	}
+	return true;
+}
+
+/*
+*	Baked model of a source file, cooked first when its baked file is stale or
+*	can't be loaded. With a texture cache the files the import decoded are
+*	reused by the baked model.
+*/
+inline std::shared_ptr<BakedModel> loadCookedModel(const std::string& sourcePath, const std::string& bakedPath, ThreadPool& pool = ThreadPool::shared(),
+	TextureCache* textureCache = nullptr)
+{
+	if (!bakedModelStale(sourcePath, bakedPath))
+	{
+		std::shared_ptr<BakedModel> baked = std::make_shared<BakedModel>(bakedPath, pool, textureCache);
+		if (baked->isLoaded()) return baked;
+	}
+
+	// Only this side needs Assimp, the imported model is dropped once written
+	{
+		Model source(sourcePath, stream_interleaved, pool, textureCache);
+		if (!source.meshes.empty()) cookModel(source, bakedPath);
+	}
+
+	// A failed cook leaves the previous file, if any, which reports its own errors
+	return std::make_shared<BakedModel>(bakedPath, pool, textureCache);
+}
+
+#endif // !MODEL_COOK_H
@@ -0,0 +1,178 @@
+/*
+*	OBJ_BENCHMARK.HPP
+*
+*	Times loadObj() (MODEL/obj_loader.hpp) against the Assimp import of the
+*	same file. Both sides produce deduplicated indexed triangles: Assimp runs
+*	with MODEL_IMPORT_FLAGS plus aiProcess_JoinIdenticalVertices. Each side is
+*	run several times and the best time is kept, so the first run warming the
+*	page cache doesn't count against either of them. Both are reported in MB/s
+*	of the file.
+*
+*	Small files mostly time the setup, writeSyntheticObj() makes one of
+*	hundreds of MB: patches of a wavy grid with positions, texture coordinates
+*	and normals, every quad split in two triangles, under several objects and
+*	materials like an exported scene.
+*/
+
+#ifndef OBJ_BENCHMARK_H
+#define OBJ_BENCHMARK_H
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <MODEL/model.hpp>
+#include <MODEL/obj_loader.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+#define OBJ_BENCHMARK_SYNTHETIC_MB 256
+#define OBJ_BENCHMARK_PATCH 256			// Grid vertices per side of each synthetic patch
+
+struct ObjBenchmarkResult
+{
+	double objMilliseconds;		// Best loadObj() run
+	double assimpMilliseconds;	// Best Assimp ReadFile run
+	ObjLoadStats objStats;		// Breakdown of the best loadObj() run
+	size_t objVertices, assimpVertices;
+	size_t objTriangles, assimpTriangles;
+};
+
+/*
+*	OBJ file of at least megabytes MB. Patch p is a grid of
+*	OBJ_BENCHMARK_PATCH^2 vertices, vertices are shared by the faces around
+*	them so the loaders have the usual welding to do. False when it can't be
+*	written.
+*/
+inline bool writeSyntheticObj(const std::string& path, size_t megabytes = OBJ_BENCHMARK_SYNTHETIC_MB)
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cout << "ERROR::OBJ_BENCHMARK::WRITE_FAILED " << path << '\n';
+		return false;
+	}
+
+	const int n = OBJ_BENCHMARK_PATCH;
+	const uint64_t target = (uint64_t)megabytes * 1024 * 1024;
+	uint64_t written = 0;
+	std::vector<char> buffer;
+	char line[128];
+
+	for (int patch = 0; written < target; patch++)
+	{
+		buffer.clear();
+		int length = snprintf(line, sizeof(line), "o patch%d\nusemtl material%d\n", patch, patch % 4);
+		buffer.insert(buffer.end(), line, line + length);
+
+		float offsetX = (float)(patch % 16) * n, offsetZ = (float)(patch / 16) * n;
+		for (int y = 0; y < n; y++)
+			for (int x = 0; x < n; x++)
+			{
+				float px = offsetX + x, pz = offsetZ + y;
+				float height = std::sin(px * 0.05f) * std::cos(pz * 0.07f) * 4.0f;
+				glm::vec3 normal = glm::normalize(glm::vec3(-0.2f * std::cos(px * 0.05f) * std::cos(pz * 0.07f), 1.0f, 0.28f * std::sin(px * 0.05f) * std::sin(pz * 0.07f)));
+
+				length = snprintf(line, sizeof(line), "v %.4f %.4f %.4f\nvt %.5f %.5f\nvn %.4f %.4f %.4f\n",
+					px, height, pz, (float)x / (n - 1), (float)y / (n - 1), normal.x, normal.y, normal.z);
+				buffer.insert(buffer.end(), line, line + length);
+			}
+
+		// 1 based and counting every vertex written before, like a single exported file
+		size_t base = (size_t)patch * n * n + 1;
+		for (int y = 0; y + 1 < n; y++)
+			for (int x = 0; x + 1 < n; x++)
+			{
+				size_t a = base + (size_t)y * n + x, b = a + 1, c = a + n, d = c + 1;
+				length = snprintf(line, sizeof(line), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\nf %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n",
+					a, a, a, b, b, b, d, d, d, a, a, a, d, d, d, c, c, c);
+				buffer.insert(buffer.end(), line, line + length);
+			}
+
+		out.write(buffer.data(), buffer.size());
+		written += buffer.size();
+	}
+
+	if (!out)
+	{
+		std::cout << "ERROR::OBJ_BENCHMARK::WRITE_FAILED " << path << '\n';
+		return false;
+	}
+	return true;
+}
+
+inline ObjBenchmarkResult benchmarkObjLoader(const std::string& path, int iterations = 3, ThreadPool& pool = ThreadPool::shared())
+{
+	ObjBenchmarkResult result = {};
+	result.objMilliseconds = DBL_MAX;
+	result.assimpMilliseconds = DBL_MAX;
+
+	for (int i = 0; i < iterations; i++)
+	{
+		ObjModelData data;
+		if (!loadObj(path, data, pool))
+		{
+			std::cout << "ERROR::OBJ_BENCHMARK::OBJ_LOADING_FAILED " << path << '\n';
+			return result;
+		}
+
+		if (data.stats.totalMilliseconds < result.objMilliseconds)
+		{
+			result.objMilliseconds = data.stats.totalMilliseconds;
+			result.objStats = data.stats;
+		}
+		result.objVertices = data.stats.vertices;
+		result.objTriangles = data.stats.triangles;
+	}
+
+	for (int i = 0; i < iterations; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS | aiProcess_JoinIdenticalVertices);
+
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (!scene)
+		{
+			std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << '\n';
+			return result;
+		}
+
+		result.assimpMilliseconds = std::min(result.assimpMilliseconds, milliseconds);
+		result.assimpVertices = 0;
+		result.assimpTriangles = 0;
+		for (unsigned m = 0; m < scene->mNumMeshes; m++)
+		{
+			result.assimpVertices += scene->mMeshes[m]->mNumVertices;
+			result.assimpTriangles += scene->mMeshes[m]->mNumFaces;
+		}
+	}
+
+	return result;
+}
+
+inline void printObjBenchmark(const std::string& path, const ObjBenchmarkResult& result)
+{
+	double megabytes = result.objStats.bytes / (1024.0 * 1024.0);
+
+	std::cout << "OBJ benchmark: " << path << " (" << megabytes << " MB)" << '\n';
+	std::cout << "  loadObj: " << result.objMilliseconds << " ms (map " << result.objStats.mapMilliseconds << ", parse "
+		<< result.objStats.parseMilliseconds << " over " << result.objStats.chunks << " chunks, merge " << result.objStats.mergeMilliseconds
+		<< "), " << megabytes * 1000.0 / std::max(result.objMilliseconds, 1e-3) << " MB/s, " << result.objVertices << " vertices, "
+		<< result.objTriangles << " triangles" << '\n';
+	std::cout << "  Assimp:  " << result.assimpMilliseconds << " ms, " << megabytes * 1000.0 / std::max(result.assimpMilliseconds, 1e-3)
+		<< " MB/s, " << result.assimpVertices << " vertices, " << result.assimpTriangles << " triangles" << '\n';
+	std::cout << "  speedup: " << result.assimpMilliseconds / std::max(result.objMilliseconds, 1e-3) << "x" << '\n';
+}
+
+#endif // !OBJ_BENCHMARK_H
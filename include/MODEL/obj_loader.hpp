@@ -0,0 +1,554 @@
+/*
+*	OBJ_LOADER.HPP
+*
+*	Multithreaded Wavefront OBJ/MTL reader, independent of Assimp.
+*
+*	loadObj() works in three stages:
+*	- the file is memory mapped and split into chunks ending on line breaks
+*	- chunks are parsed in parallel on a ThreadPool with a hand written number
+*	  parser: positions, normals, texture coordinates, triangulated faces
+*	  (polygons as fans) and material switches, all kept per chunk. Negative
+*	  (relative) indices are stored relative to the chunk and resolved later
+*	- chunks are merged with prefix sums, triangles are grouped by material and
+*	  each group is expanded and welded (see mesh_weld.hpp) into deduplicated
+*	  indexed Mesh data
+*
+*	Corners without a normal get the face normal. Object and group statements
+*	are ignored, meshes are split by material only. MTL files referenced with
+*	mtllib (one or more per statement) are parsed serially (they are tiny),
+*	texture paths are resolved relative to them.
+*/
+
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <IO/mapped_file.hpp>
+#include <MESH/mesh_types.hpp>
+#include <MESH/mesh_weld.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdint>
+#include <climits>
+
+// Chunks are at least this big, smaller files are parsed by a single task
+#define OBJ_MIN_CHUNK_BYTES (1u << 20)
+#define OBJ_CHUNKS_PER_THREAD 4
+
+// Corner index encoding: >= 0 absolute, negative relative to the chunk start, missing
+#define OBJ_RELATIVE_BIAS (1 << 30)
+#define OBJ_MISSING_INDEX INT32_MIN
+
+struct ObjMaterial
+{
+	std::string name;
+	glm::vec3 ambient;			// Ka
+	glm::vec3 diffuse;			// Kd
+	glm::vec3 specular;			// Ks
+	float shininess;			// Ns
+	float opacity;				// d, or 1 - Tr
+	std::string diffuseMap;		// map_Kd
+	std::string specularMap;	// map_Ks
+	std::string normalMap;		// map_Bump, bump, norm
+	std::string heightMap;		// disp, map_disp
+};
+
+struct ObjMeshData
+{
+	GLuint material;			// Index in ObjModelData::materials
+	std::vector<Vertex> vertices;
+	std::vector<GLuint> indices;
+};
+
+struct ObjLoadStats
+{
+	double mapMilliseconds;
+	double parseMilliseconds;	// Parallel chunk parsing
+	double mergeMilliseconds;	// Index resolution, grouping and welding
+	double totalMilliseconds;
+	size_t bytes, chunks;
+	size_t positions, triangles, vertices;
+};
+
+struct ObjModelData
+{
+	std::vector<ObjMaterial> materials;
+	std::vector<ObjMeshData> meshes;
+	ObjLoadStats stats;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "OBJ parsing utility functions"
+
+struct ObjCorner
+{
+	int32_t position, texCoord, normal;
+};
+
+// Everything one chunk contributes, indices still encoded
+struct ObjChunk
+{
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> texCoords;
+	std::vector<ObjCorner> corners;		// 3 per triangle
+	std::vector<std::pair<size_t, std::string>> materialSwitches;	// First triangle, material name
+	std::vector<std::string> libraries;
+};
+
+inline ObjMaterial defaultObjMaterial(const std::string& name)
+{
+	ObjMaterial material;
+	material.name = name;
+	material.ambient = glm::vec3(1.0f);
+	material.diffuse = glm::vec3(0.8f);
+	material.specular = glm::vec3(0.5f);
+	material.shininess = 32.0f;
+	material.opacity = 1.0f;
+	return material;
+}
+
+inline bool isObjSpace(char c) { return c == ' ' || c == '\t'; }
+
+inline void skipObjSpaces(const char*& p, const char* end)
+{
+	while (p < end && isObjSpace(*p)) p++;
+}
+
+inline const char* findLineEnd(const char* p, const char* end)
+{
+	while (p < end && *p != '\n') p++;
+	return p;
+}
+
+// Rest of the line without surrounding spaces or the '\r' of CRLF files
+inline std::string readObjRest(const char* p, const char* end)
+{
+	skipObjSpaces(p, end);
+	while (end > p && (isObjSpace(end[-1]) || end[-1] == '\r')) end--;
+	return std::string(p, end);
+}
+
+inline bool parseObjInt(const char*& p, const char* end, int& value)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+	if (p >= end || *p < '0' || *p > '9') return false;
+
+	int result = 0;
+	while (p < end && *p >= '0' && *p <= '9') result = result * 10 + (*p++ - '0');
+	value = negative ? -result : result;
+	return true;
+}
+
+/*
+*	Decimal float with optional sign, fraction and exponent. Digits accumulate
+*	in a 64 bit integer and one scale by a power of ten is applied at the end,
+*	exact up to 19 significant digits which is more than any exporter writes.
+*/
+inline bool parseObjFloat(const char*& p, const char* end, float& value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+	uint64_t mantissa = 0;
+	int exponent = 0, digits = 0;
+	bool any = false;
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+	{
+		if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; }
+		else exponent++;
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+		{
+			if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); exponent--; if (mantissa) digits++; }
+		}
+	}
+	if (!any) return false;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* start = p++;
+		int power;
+		if (parseObjInt(p, end, power)) exponent += power;
+		else p = start;
+	}
+
+	double result = (double)mantissa;
+	while (exponent > 22) { result *= 1e22; exponent -= 22; }
+	while (exponent < -22) { result /= 1e22; exponent += 22; }
+	result = exponent >= 0 ? result * powers[exponent] : result / powers[-exponent];
+
+	value = (float)(negative ? -result : result);
+	return true;
+}
+
+inline int parseObjFloats(const char* p, const char* end, float* values, int count)
+{
+	int parsed = 0;
+	for (; parsed < count; parsed++)
+	{
+		skipObjSpaces(p, end);
+		if (!parseObjFloat(p, end, values[parsed])) break;
+	}
+	return parsed;
+}
+
+// OBJ index (1 based or negative) to the corner encoding, localCount is the chunk's count so far
+inline int32_t encodeObjIndex(int value, size_t localCount)
+{
+	if (value > 0) return value - 1;
+	if (value < 0) return (int32_t)((long long)localCount + value - OBJ_RELATIVE_BIAS);
+	return OBJ_MISSING_INDEX;
+}
+
+inline int32_t resolveObjIndex(int32_t encoded, size_t chunkStart, size_t count)
+{
+	if (encoded == OBJ_MISSING_INDEX) return OBJ_MISSING_INDEX;
+
+	long long index = encoded >= 0 ? encoded : (long long)chunkStart + encoded + OBJ_RELATIVE_BIAS;
+	return index >= 0 && index < (long long)count ? (int32_t)index : OBJ_MISSING_INDEX;
+}
+
+// One "f" statement, polygons are triangulated as fans
+inline void parseObjFace(const char* p, const char* end, ObjChunk& chunk)
+{
+	ObjCorner first = {}, previous = {};
+	int cornerCount = 0;
+
+	while (true)
+	{
+		skipObjSpaces(p, end);
+		int value;
+		if (!parseObjInt(p, end, value)) break;
+
+		ObjCorner corner;
+		corner.position = encodeObjIndex(value, chunk.positions.size());
+		corner.texCoord = OBJ_MISSING_INDEX;
+		corner.normal = OBJ_MISSING_INDEX;
+
+		if (p < end && *p == '/')
+		{
+			p++;
+			if (parseObjInt(p, end, value)) corner.texCoord = encodeObjIndex(value, chunk.texCoords.size());
+			if (p < end && *p == '/')
+			{
+				p++;
+				if (parseObjInt(p, end, value)) corner.normal = encodeObjIndex(value, chunk.normals.size());
+			}
+		}
+
+		if (cornerCount == 0) first = corner;
+		else if (cornerCount >= 2)
+		{
+			chunk.corners.push_back(first);
+			chunk.corners.push_back(previous);
+			chunk.corners.push_back(corner);
+		}
+		previous = corner;
+		cornerCount++;
+
+		// Skip anything left in this corner token
+		while (p < end && !isObjSpace(*p)) p++;
+	}
+}
+
+inline void parseObjChunk(const char* p, const char* end, ObjChunk& chunk)
+{
+	while (p < end)
+	{
+		const char* lineEnd = findLineEnd(p, end);
+		skipObjSpaces(p, lineEnd);
+
+		if (p + 1 < lineEnd)
+		{
+			float values[3] = { 0.0f, 0.0f, 0.0f };
+
+			if (p[0] == 'v' && isObjSpace(p[1]))
+			{
+				parseObjFloats(p + 2, lineEnd, values, 3);
+				chunk.positions.push_back(glm::vec3(values[0], values[1], values[2]));
+			}
+			else if (p[0] == 'v' && p[1] == 't' && p + 2 < lineEnd && isObjSpace(p[2]))
+			{
+				parseObjFloats(p + 3, lineEnd, values, 2);
+				chunk.texCoords.push_back(glm::vec2(values[0], values[1]));
+			}
+			else if (p[0] == 'v' && p[1] == 'n' && p + 2 < lineEnd && isObjSpace(p[2]))
+			{
+				parseObjFloats(p + 3, lineEnd, values, 3);
+				chunk.normals.push_back(glm::vec3(values[0], values[1], values[2]));
+			}
+			else if (p[0] == 'f' && isObjSpace(p[1]))
+			{
+				parseObjFace(p + 2, lineEnd, chunk);
+			}
+			else if (lineEnd - p > 7 && std::equal(p, p + 7, "usemtl ") )
+			{
+				chunk.materialSwitches.push_back({ chunk.corners.size() / 3, readObjRest(p + 7, lineEnd) });
+			}
+			else if (lineEnd - p > 7 && std::equal(p, p + 7, "mtllib "))
+			{
+				// One statement can list several files, separated by spaces
+				const char* q = p + 7;
+				while (true)
+				{
+					skipObjSpaces(q, lineEnd);
+					const char* start = q;
+					while (q < lineEnd && !isObjSpace(*q) && *q != '\r') q++;
+					if (q == start) break;
+					chunk.libraries.push_back(std::string(start, q));
+				}
+			}
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+// Last token of a map statement, options like "-bm 1.0" come before the file name
+inline std::string readMtlMap(const char* p, const char* end, const std::string& directory)
+{
+	std::string rest = readObjRest(p, end);
+	size_t space = rest.find_last_of(" \t");
+	std::string file = space == std::string::npos ? rest : rest.substr(space + 1);
+	for (char& c : file) if (c == '\\') c = '/';
+
+	bool absolute = !file.empty() && (file[0] == '/' || (file.size() > 1 && file[1] == ':'));
+	return absolute || directory.empty() ? file : directory + '/' + file;
+}
+
+inline void parseMtl(const std::string& path, std::vector<ObjMaterial>& materials)
+{
+	MappedFile file(path);
+	if (!file.isOpen()) return;
+
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash);
+
+	const char* p = (const char*)file.data();
+	const char* end = p + file.size();
+	ObjMaterial* current = nullptr;
+
+	while (p < end)
+	{
+		const char* lineEnd = findLineEnd(p, end);
+		skipObjSpaces(p, lineEnd);
+
+		const char* word = p;
+		while (p < lineEnd && !isObjSpace(*p) && *p != '\r') p++;
+		std::string keyword(word, p);
+		float values[3] = { 0.0f, 0.0f, 0.0f };
+
+		if (keyword == "newmtl")
+		{
+			materials.push_back(defaultObjMaterial(readObjRest(p, lineEnd)));
+			current = &materials.back();
+		}
+		else if (current)
+		{
+			if (keyword == "Ka" && parseObjFloats(p, lineEnd, values, 3) == 3) current->ambient = glm::vec3(values[0], values[1], values[2]);
+			else if (keyword == "Kd" && parseObjFloats(p, lineEnd, values, 3) == 3) current->diffuse = glm::vec3(values[0], values[1], values[2]);
+			else if (keyword == "Ks" && parseObjFloats(p, lineEnd, values, 3) == 3) current->specular = glm::vec3(values[0], values[1], values[2]);
+			else if (keyword == "Ns" && parseObjFloats(p, lineEnd, values, 1) == 1) current->shininess = values[0];
+			else if (keyword == "d" && parseObjFloats(p, lineEnd, values, 1) == 1) current->opacity = values[0];
+			else if (keyword == "Tr" && parseObjFloats(p, lineEnd, values, 1) == 1) current->opacity = 1.0f - values[0];
+			else if (keyword == "map_Kd") current->diffuseMap = readMtlMap(p, lineEnd, directory);
+			else if (keyword == "map_Ks") current->specularMap = readMtlMap(p, lineEnd, directory);
+			else if (keyword == "map_Bump" || keyword == "map_bump" || keyword == "bump" || keyword == "norm")
+				current->normalMap = readMtlMap(p, lineEnd, directory);
+			else if (keyword == "disp" || keyword == "map_disp") current->heightMap = readMtlMap(p, lineEnd, directory);
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+inline bool loadObj(const std::string& path, ObjModelData& out, ThreadPool& pool = ThreadPool::shared())
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	out = ObjModelData();
+	MappedFile file(path);
+	if (!file.isOpen()) return false;
+
+	const char* data = (const char*)file.data();
+	size_t size = file.size();
+
+	std::chrono::steady_clock::time_point mapped = std::chrono::steady_clock::now();
+
+	// Line aligned chunks: each boundary is pushed forward to the next line start
+	size_t targetChunks = pool.getConcurrency() * OBJ_CHUNKS_PER_THREAD;
+	size_t chunkBytes = std::max<size_t>(OBJ_MIN_CHUNK_BYTES, (size + targetChunks - 1) / targetChunks);
+
+	std::vector<size_t> boundaries(1, 0);
+	while (boundaries.back() < size)
+	{
+		size_t next = std::min(size, boundaries.back() + chunkBytes);
+		while (next < size && data[next - 1] != '\n') next++;
+		boundaries.push_back(next);
+	}
+	size_t chunkCount = boundaries.size() - 1;
+
+	std::vector<ObjChunk> chunks(chunkCount);
+	pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; c++) parseObjChunk(data + boundaries[c], data + boundaries[c + 1], chunks[c]);
+	});
+
+	std::chrono::steady_clock::time_point parsed = std::chrono::steady_clock::now();
+
+	// Global attribute arrays, chunk starts are prefix sums of the counts
+	std::vector<size_t> positionStarts(chunkCount + 1, 0), texCoordStarts(chunkCount + 1, 0), normalStarts(chunkCount + 1, 0),
+		triangleStarts(chunkCount + 1, 0);
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		positionStarts[c + 1] = positionStarts[c] + chunks[c].positions.size();
+		texCoordStarts[c + 1] = texCoordStarts[c] + chunks[c].texCoords.size();
+		normalStarts[c + 1] = normalStarts[c] + chunks[c].normals.size();
+		triangleStarts[c + 1] = triangleStarts[c] + chunks[c].corners.size() / 3;
+	}
+
+	std::vector<glm::vec3> positions(positionStarts[chunkCount]), normals(normalStarts[chunkCount]);
+	std::vector<glm::vec2> texCoords(texCoordStarts[chunkCount]);
+	size_t triangleCount = triangleStarts[chunkCount];
+	std::vector<ObjCorner> corners(triangleCount * 3);
+
+	pool.parallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; c++)
+		{
+			const ObjChunk& chunk = chunks[c];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + positionStarts[c]);
+			std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), texCoords.begin() + texCoordStarts[c]);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normalStarts[c]);
+
+			ObjCorner* target = corners.data() + triangleStarts[c] * 3;
+			for (size_t i = 0; i < chunk.corners.size(); i++)
+			{
+				target[i].position = resolveObjIndex(chunk.corners[i].position, positionStarts[c], positions.size());
+				target[i].texCoord = resolveObjIndex(chunk.corners[i].texCoord, texCoordStarts[c], texCoords.size());
+				target[i].normal = resolveObjIndex(chunk.corners[i].normal, normalStarts[c], normals.size());
+			}
+		}
+	});
+
+	// Material libraries, then one material index per triangle following the usemtl switches
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	for (const ObjChunk& chunk : chunks)
+		for (const std::string& library : chunk.libraries) parseMtl(directory + library, out.materials);
+
+	std::unordered_map<std::string, GLuint> materialIndices;
+	for (size_t m = 0; m < out.materials.size(); m++) materialIndices.emplace(out.materials[m].name, (GLuint)m);
+
+	std::vector<GLuint> triangleMaterials(triangleCount);
+	{
+		GLuint current = UINT32_MAX;
+		size_t filled = 0;
+		for (size_t c = 0; c < chunkCount; c++)
+		{
+			for (const std::pair<size_t, std::string>& change : chunks[c].materialSwitches)
+			{
+				size_t at = triangleStarts[c] + change.first;
+				std::fill(triangleMaterials.begin() + filled, triangleMaterials.begin() + at, current);
+				filled = at;
+
+				std::unordered_map<std::string, GLuint>::iterator found = materialIndices.find(change.second);
+				if (found == materialIndices.end())
+				{
+					found = materialIndices.emplace(change.second, (GLuint)out.materials.size()).first;
+					out.materials.push_back(defaultObjMaterial(change.second));
+				}
+				current = found->second;
+			}
+		}
+		std::fill(triangleMaterials.begin() + filled, triangleMaterials.end(), current);
+	}
+
+	// Faces before any usemtl use a default material
+	if (std::find(triangleMaterials.begin(), triangleMaterials.end(), UINT32_MAX) != triangleMaterials.end())
+	{
+		GLuint fallback = (GLuint)out.materials.size();
+		out.materials.push_back(defaultObjMaterial("default"));
+		std::replace(triangleMaterials.begin(), triangleMaterials.end(), UINT32_MAX, fallback);
+	}
+
+	// Counting sort of the triangles by material, one mesh per used material
+	std::vector<size_t> materialStarts(out.materials.size() + 1, 0);
+	for (GLuint material : triangleMaterials) materialStarts[material + 1]++;
+	for (size_t m = 0; m < out.materials.size(); m++) materialStarts[m + 1] += materialStarts[m];
+
+	std::vector<GLuint> sortedTriangles(triangleCount);
+	{
+		std::vector<size_t> fill(materialStarts.begin(), materialStarts.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++) sortedTriangles[fill[triangleMaterials[t]]++] = (GLuint)t;
+	}
+
+	for (size_t m = 0; m < out.materials.size(); m++)
+	{
+		size_t first = materialStarts[m], count = materialStarts[m + 1] - first;
+		if (count == 0) continue;
+
+		// Expanded triangle list, then welded into indexed data
+		std::vector<Vertex> expanded(count * 3);
+		pool.parallelFor(count, WELD_GRAIN / 3, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const ObjCorner* triangle = &corners[sortedTriangles[first + i] * 3];
+				Vertex* vertex = &expanded[i * 3];
+
+				for (int k = 0; k < 3; k++)
+				{
+					vertex[k].position = triangle[k].position != OBJ_MISSING_INDEX ? positions[triangle[k].position] : glm::vec3(0.0f);
+					vertex[k].texCoords = triangle[k].texCoord != OBJ_MISSING_INDEX ? texCoords[triangle[k].texCoord] : glm::vec2(0.0f);
+				}
+
+				glm::vec3 faceNormal = glm::cross(vertex[1].position - vertex[0].position, vertex[2].position - vertex[0].position);
+				faceNormal = glm::dot(faceNormal, faceNormal) > 0.0f ? glm::normalize(faceNormal) : glm::vec3(0.0f, 0.0f, 1.0f);
+
+				for (int k = 0; k < 3; k++)
+					vertex[k].normal = triangle[k].normal != OBJ_MISSING_INDEX ? normals[triangle[k].normal] : faceNormal;
+			}
+		});
+
+		ObjMeshData mesh;
+		mesh.material = (GLuint)m;
+		mesh.vertices = weldVertices(expanded, mesh.indices, 0.0f, nullptr, pool);
+		out.meshes.push_back(std::move(mesh));
+	}
+
+	std::chrono::steady_clock::time_point merged = std::chrono::steady_clock::now();
+
+	out.stats.mapMilliseconds = std::chrono::duration<double, std::milli>(mapped - start).count();
+	out.stats.parseMilliseconds = std::chrono::duration<double, std::milli>(parsed - mapped).count();
+	out.stats.mergeMilliseconds = std::chrono::duration<double, std::milli>(merged - parsed).count();
+	out.stats.totalMilliseconds = std::chrono::duration<double, std::milli>(merged - start).count();
+	out.stats.bytes = size;
+	out.stats.chunks = chunkCount;
+	out.stats.positions = positions.size();
+	out.stats.triangles = triangleCount;
+	for (const ObjMeshData& mesh : out.meshes) out.stats.vertices += mesh.vertices.size();
+
+	return true;
+}
+
+#endif // !OBJ_LOADER_H
@@ -0,0 +1,363 @@
+/*
+*	RENDER_QUEUE.HPP
+*
+*	Per frame draw submission sorted by 64 bit keys.
+*
+*	Draws are pushed in any order between begin() and flush(). Each one gets a
+*	key packing, from the most significant bits down:
+*
+*		opaque / overlay:	pass 2 | shader 10 | material 14 | VAO 14 | depth 24
+*		transparent:		pass 2 | ~depth 24 | shader 10 | material 14 | VAO 14
+*
+*	so sorting the keys orders the passes, groups opaque draws by state and
+*	puts them front to back inside each group (early depth rejection), and
+*	sorts transparent draws back to front whatever their state. The keys are
+*	sorted with an LSD radix sort, 8 bits per pass, skipping the bytes every
+*	key shares.
+*
+*	flush() walks the sorted draws and only changes the program, the VAO and
+*	the textures when they differ from the previous draw. The material
+*	index travels as the base instance (see MATERIAL/material.hpp), so
+*	materials cost no state change at all. Per draw uniforms are "model" and,
+*	when asked for, "normalMatrixTransform". Uniforms shared by every draw of
+*	a shader (view, projection, lights) are set by the caller before flush().
+*
+*	IDs wider than their field are masked: draws still render correctly, they
+*	are just grouped less well.
+*
+*	Mesh draws pushed with RENDER_LOD_AUTO pick their LOD from the projected
+*	error (see MESH/mesh_lod.hpp), using the FOV and viewport height given to
+*	begin(). Without them every mesh draws LOD0.
+*/
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <MESH/mesh.hpp>
+#include <MODEL/model.hpp>
+#include <SHADER/shader_s.hpp>
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#define RENDER_KEY_SHADER_BITS 10
+#define RENDER_KEY_MATERIAL_BITS 14
+#define RENDER_KEY_VAO_BITS 14
+#define RENDER_KEY_DEPTH_BITS 24
+#define RENDER_LOD_AUTO -1
+#define RENDER_LOD_PIXEL_ERROR 1.0f		// Screen error allowed to auto LODs
+
+enum RenderPass
+{
+	pass_opaque = 0,		// Depth write, front to back
+	pass_transparent = 1,	// Alpha blending, no depth write, back to front
+	pass_overlay = 2		// Drawn last without depth test
+};
+
+struct RenderQueueStats
+{
+	size_t draws;
+	size_t shaderChanges;
+	size_t vaoChanges;
+	size_t textureChanges;
+	size_t materialChanges;		// Consecutive draws with different materials, free with the base instance
+	size_t sortPasses;			// Radix passes that weren't skipped
+	double sortMilliseconds;
+	double submitMilliseconds;	// State changes and draw calls in flush()
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Render queue utility functions"
+
+struct RenderKey
+{
+	uint64_t key;
+	uint32_t item;
+};
+
+inline uint64_t makeRenderKey(RenderPass pass, GLuint shader, GLuint material, GLuint VAO, uint32_t depth)
+{
+	const uint64_t shaderMask = (1ull << RENDER_KEY_SHADER_BITS) - 1;
+	const uint64_t materialMask = (1ull << RENDER_KEY_MATERIAL_BITS) - 1;
+	const uint64_t vaoMask = (1ull << RENDER_KEY_VAO_BITS) - 1;
+	const uint64_t depthMask = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+
+	uint64_t state = ((shader & shaderMask) << (RENDER_KEY_MATERIAL_BITS + RENDER_KEY_VAO_BITS))
+		| ((material & materialMask) << RENDER_KEY_VAO_BITS) | (VAO & vaoMask);
+	uint64_t key = (uint64_t)pass << 62;
+
+	if (pass == pass_transparent) key |= ((~(uint64_t)depth & depthMask) << 38) | state;
+	else key |= (state << RENDER_KEY_DEPTH_BITS) | (depth & depthMask);
+	return key;
+}
+
+/*
+*	LSD radix sort, 8 bits per pass. One histogram sweep counts every byte, a
+*	byte with a single populated bucket is the same for every key and its pass
+*	is skipped. Stable, so draws with equal keys keep their push order.
+*/
+inline size_t radixSortKeys(std::vector<RenderKey>& keys, std::vector<RenderKey>& scratch)
+{
+	size_t count = keys.size();
+	if (count < 2) return 0;
+
+	uint32_t histograms[8][256];
+	std::memset(histograms, 0, sizeof(histograms));
+	for (const RenderKey& entry : keys)
+		for (int b = 0; b < 8; b++) histograms[b][(entry.key >> (b * 8)) & 0xFF]++;
+
+	scratch.resize(count);
+	size_t passes = 0;
+	for (int b = 0; b < 8; b++)
+	{
+		uint32_t* histogram = histograms[b];
+		if (histogram[(keys[0].key >> (b * 8)) & 0xFF] == count) continue;
+
+		uint32_t offset = 0;
+		for (int i = 0; i < 256; i++)
+		{
+			uint32_t bucket = histogram[i];
+			histogram[i] = offset;
+			offset += bucket;
+		}
+
+		for (const RenderKey& entry : keys) scratch[histogram[(entry.key >> (b * 8)) & 0xFF]++] = entry;
+		keys.swap(scratch);
+		passes++;
+	}
+	return passes;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class RenderQueue
+{
+public:
+
+	RenderQueue()
+	{
+		this->view = glm::mat4(1.0f);
+		this->nearPlane = 0.1f;
+		this->farPlane = 100.0f;
+		this->viewer = glm::vec3(0.0f);
+		this->fovY = 0.0f;
+		this->viewportHeight = 0.0f;
+		this->stats = RenderQueueStats();
+	}
+
+	/*
+	*	Starts a frame, depth is measured along the view direction between the
+	*	planes. fovY (degrees) and viewportHeight (pixels) enable RENDER_LOD_AUTO.
+	*/
+	void begin(const glm::mat4& view, float nearPlane, float farPlane, float fovY = 0.0f, float viewportHeight = 0.0f)
+	{
+		this->view = view;
+		this->nearPlane = nearPlane;
+		this->farPlane = farPlane;
+		this->viewer = glm::vec3(glm::inverse(view)[3]);
+		this->fovY = fovY;
+		this->viewportHeight = viewportHeight;
+		this->items.clear();
+		this->keys.clear();
+	}
+
+	// Mesh draw, depth from its bounding sphere center
+	void pushMesh(Mesh& mesh, Shader& shader, const glm::mat4& model, RenderPass pass = pass_opaque, int lod = RENDER_LOD_AUTO,
+		bool hasMaterial = false, bool normalMatrix = false)
+	{
+		RenderItem item = makeItem(shader, model, pass, mesh.materialIndex, hasMaterial, normalMatrix);
+		item.mesh = &mesh;
+		item.VAO = mesh.getVAO();
+		item.lod = lod != RENDER_LOD_AUTO ? lod
+			: (this->fovY > 0.0f && this->viewportHeight > 0.0f ? mesh.selectLod(this->viewer, model, this->fovY, this->viewportHeight, RENDER_LOD_PIXEL_ERROR) : 0);
+		push(item, glm::vec3(model * glm::vec4(mesh.boundingSphere.center, 1.0f)));
+	}
+
+	/*
+	*	Non indexed draw of a raw VAO (glDrawArrays), depth from the model origin.
+	*	textures are bound on their own units (Texture::bind()) before the draw.
+	*/
+	void pushArrays(GLuint VAO, GLint first, GLsizei count, Shader& shader, const glm::mat4& model, GLuint materialIndex = 0,
+		RenderPass pass = pass_opaque, bool normalMatrix = false, std::vector<Texture>* textures = nullptr)
+	{
+		RenderItem item = makeItem(shader, model, pass, materialIndex, false, normalMatrix);
+		item.textures = textures;
+		item.VAO = VAO;
+		item.first = first;
+		item.count = count;
+		push(item, glm::vec3(model[3]));
+	}
+
+	// Every mesh of the model placed by its nodes, meshes with an opacity below 1 go to the transparent pass
+	void pushModel(Model& model, Shader& shader, const glm::mat4& transform = glm::mat4(1.0f), bool hasMaterial = false, int lod = RENDER_LOD_AUTO)
+	{
+		model.upload();
+
+		for (const ModelNode& node : model.nodes)
+		{
+			for (GLuint mesh : node.meshes)
+			{
+				RenderPass pass = model.getMaterial(mesh).diffuse.w < 1.0f ? pass_transparent : pass_opaque;
+				pushMesh(*model.meshes[mesh], shader, transform * node.globalTransform, pass, lod, hasMaterial);
+			}
+		}
+	}
+
+	// Sorts and draws everything pushed since begin()
+	void flush()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		this->stats = RenderQueueStats();
+		this->stats.draws = this->keys.size();
+		this->stats.sortPasses = radixSortKeys(this->keys, this->scratch);
+
+		std::chrono::steady_clock::time_point sorted = std::chrono::steady_clock::now();
+		this->stats.sortMilliseconds = std::chrono::duration<double, std::milli>(sorted - start).count();
+
+		Shader* shader = nullptr;
+		GLuint VAO = 0;
+		const void* textured = nullptr;
+		GLuint material = UINT32_MAX;
+		int pass = -1;
+
+		for (const RenderKey& entry : this->keys)
+		{
+			const RenderItem& item = this->items[entry.item];
+
+			if ((int)item.pass != pass)
+			{
+				pass = (int)item.pass;
+				applyPassState(item.pass);
+			}
+			if (item.shader != shader)
+			{
+				shader = item.shader;
+				shader->use();
+				// Sampler units are per program, textures have to be bound again
+				textured = nullptr;
+				this->stats.shaderChanges++;
+			}
+			if (item.VAO != VAO)
+			{
+				VAO = item.VAO;
+				glBindVertexArray(VAO);
+				this->stats.vaoChanges++;
+			}
+			if (item.mesh && item.mesh != textured)
+			{
+				textured = item.mesh;
+				item.mesh->bindTextures(*shader, item.hasMaterial);
+				this->stats.textureChanges++;
+			}
+			else if (item.textures && item.textures != textured)
+			{
+				textured = item.textures;
+				for (Texture& texture : *item.textures) texture.bind();
+				this->stats.textureChanges++;
+			}
+			if (item.materialIndex != material)
+			{
+				material = item.materialIndex;
+				this->stats.materialChanges++;
+			}
+
+			shader->setMat4Uniform("model", item.model);
+			if (item.normalMatrix) shader->setMat3Uniform("normalMatrixTransform", glm::transpose(glm::inverse(glm::mat3(item.model))));
+
+			if (item.mesh) item.mesh->drawBound(item.lod);
+			else glDrawArraysInstancedBaseInstance(GL_TRIANGLES, item.first, item.count, 1, item.materialIndex);
+		}
+
+		glBindVertexArray(0);
+		if (pass > pass_opaque) applyPassState(pass_opaque);
+
+		this->stats.submitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sorted).count();
+		this->items.clear();
+		this->keys.clear();
+	}
+
+	inline size_t size() const { return this->items.size(); }
+	inline const RenderQueueStats& getStats() const { return this->stats; }
+
+private:
+
+	struct RenderItem
+	{
+		RenderPass pass;
+		Shader* shader;
+		Mesh* mesh;				// Null for raw VAO draws
+		std::vector<Texture>* textures;		// Raw VAO draws only, optional
+		GLuint VAO;
+		GLint first;
+		GLsizei count;
+		int lod;
+		GLuint materialIndex;
+		bool hasMaterial;
+		bool normalMatrix;		// Also set "normalMatrixTransform"
+		glm::mat4 model;
+	};
+
+	glm::mat4 view;
+	float nearPlane, farPlane;
+	glm::vec3 viewer;				// Camera position, from the view matrix
+	float fovY, viewportHeight;		// LOD selection, 0 disables it
+	RenderQueueStats stats;
+
+	std::vector<RenderItem> items;
+	std::vector<RenderKey> keys, scratch;
+
+	static RenderItem makeItem(Shader& shader, const glm::mat4& model, RenderPass pass, GLuint materialIndex, bool hasMaterial, bool normalMatrix)
+	{
+		RenderItem item;
+		item.pass = pass;
+		item.shader = &shader;
+		item.mesh = nullptr;
+		item.textures = nullptr;
+		item.VAO = 0;
+		item.first = 0;
+		item.count = 0;
+		item.lod = 0;
+		item.materialIndex = materialIndex;
+		item.hasMaterial = hasMaterial;
+		item.normalMatrix = normalMatrix;
+		item.model = model;
+		return item;
+	}
+
+	void push(const RenderItem& item, const glm::vec3& worldPosition)
+	{
+		// View space looks down -z, depth grows away from the camera
+		float viewDepth = -(this->view * glm::vec4(worldPosition, 1.0f)).z;
+		float t = glm::clamp((viewDepth - this->nearPlane) / (this->farPlane - this->nearPlane), 0.0f, 1.0f);
+		uint32_t depth = (uint32_t)(t * (float)((1u << RENDER_KEY_DEPTH_BITS) - 1));
+
+		this->keys.push_back({ makeRenderKey(item.pass, item.shader->getSerial(), item.materialIndex, item.VAO, depth), (uint32_t)this->items.size() });
+		this->items.push_back(item);
+	}
+
+	static void applyPassState(RenderPass pass)
+	{
+		if (pass == pass_transparent)
+		{
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDepthMask(GL_FALSE);
+		}
+		else glDisable(GL_BLEND);
+
+		if (pass == pass_overlay) glDisable(GL_DEPTH_TEST);
+		else glEnable(GL_DEPTH_TEST);
+
+		if (pass != pass_transparent) glDepthMask(pass == pass_opaque ? GL_TRUE : GL_FALSE);
+	}
+};
+
+#endif // !RENDER_QUEUE_H
@@ -0,0 +1,194 @@
+/*
+*	SKINNED_RENDERER.HPP
+*
+*	Draws AnimatedInstances (MODEL/animated_model.hpp) with one of two
+*	skinning paths, both streaming their per frame data through a
+*	DynamicRingBuffer:
+*
+*	- skinning_cpu: every instance's meshes are skinned on the ThreadPool
+*	  (ANIMATION/skinning.hpp) straight into the mapped ring buffer, then drawn
+*	  as plain Vertex streams with the regular model shaders. Costs CPU time
+*	  and vertices * 32 bytes of bandwidth per instance, the vertex shader
+*	  does nothing special.
+*	- skinning_gpu: only the palettes go into the ring buffer, each instance
+*	  binds its range at SKIN_PALETTE_BINDING and skinned_model_shader.vert
+*	  blends the matrices per vertex. Costs joints * 64 bytes per instance.
+*
+*	The shader must be in use with view and projection set, "model" is set per
+*	instance. Instances are expected evaluated (updateAnimations()).
+*/
+
+#ifndef SKINNED_RENDERER_H
+#define SKINNED_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <MODEL/animated_model.hpp>
+#include <ANIMATION/skinning.hpp>
+#include <BUFFER/dynamic_ring_buffer.hpp>
+#include <SHADER/shader_s.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+
+#define SKIN_PALETTE_BINDING 4
+#define SKINNING_RING_SIZE (32 * 1024 * 1024)
+
+enum SkinningPath
+{
+	skinning_cpu,
+	skinning_gpu
+};
+
+struct SkinnedRendererStats
+{
+	size_t instances;			// Visible instances drawn
+	size_t draws;
+	size_t vertices;			// Vertices skinned on the CPU, or by the vertex shader
+	size_t uploadedBytes;		// Written to the ring buffer this frame
+	double prepareMilliseconds;	// CPU skinning or palette copies
+	double submitMilliseconds;
+};
+
+class SkinnedRenderer
+{
+public:
+
+	// frameBytes bounds what a frame can write: skinned vertices or palettes
+	explicit SkinnedRenderer(GLsizeiptr frameBytes = SKINNING_RING_SIZE) : ring(frameBytes)
+	{
+		this->stats = SkinnedRendererStats();
+	}
+
+	SkinnedRenderer(const SkinnedRenderer&) = delete;
+	SkinnedRenderer& operator=(const SkinnedRenderer&) = delete;
+
+	// One call per frame, it owns the ring buffer frame
+	void draw(std::vector<AnimatedInstance>& instances, Shader& shader, SkinningPath path, ThreadPool& pool = ThreadPool::shared())
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		this->stats = SkinnedRendererStats();
+		this->ring.beginFrame();
+
+		if (path == skinning_cpu) skinOnCpu(instances, pool);
+		else copyPalettes(instances);
+
+		std::chrono::steady_clock::time_point prepared = std::chrono::steady_clock::now();
+		this->stats.prepareMilliseconds = std::chrono::duration<double, std::milli>(prepared - start).count();
+
+		size_t current = SIZE_MAX;
+		for (const Job& job : this->jobs)
+		{
+			const AnimatedInstance& instance = instances[job.instance];
+			SkinnedMesh& mesh = *instance.getModel()->meshes[job.mesh];
+
+			if (job.instance != current)
+			{
+				current = job.instance;
+				shader.setMat4Uniform("model", instance.transform);
+				if (path == skinning_gpu) glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SKIN_PALETTE_BINDING, this->ring.getID(), job.offset, job.size);
+			}
+
+			mesh.bindTextures(shader, instance.hasMaterial);
+			if (path == skinning_cpu) mesh.drawSkinned(this->ring.getID(), job.offset);
+			else mesh.draw();
+			this->stats.draws++;
+		}
+
+		glBindVertexArray(0);
+		this->ring.endFrame();
+		this->stats.submitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prepared).count();
+	}
+
+	inline const SkinnedRendererStats& getStats() const { return this->stats; }
+	inline const DynamicRingBuffer& getRingBuffer() const { return this->ring; }
+
+private:
+
+	// One mesh of one instance, with its ring range
+	struct Job
+	{
+		size_t instance;
+		size_t mesh;
+		GLintptr offset;
+		GLsizeiptr size;
+		void* data;
+	};
+
+	DynamicRingBuffer ring;
+	SkinnedRendererStats stats;
+	std::vector<Job> jobs;
+
+	// Ranges are handed out serially, the skinning itself is spread over the pool
+	void skinOnCpu(std::vector<AnimatedInstance>& instances, ThreadPool& pool)
+	{
+		this->jobs.clear();
+		bool full = false;
+		for (size_t i = 0; i < instances.size() && !full; i++)
+		{
+			AnimatedModel* model = instances[i].getModel();
+			if (!instances[i].visible || !model) continue;
+
+			model->upload();
+			this->stats.instances++;
+			for (size_t m = 0; m < model->meshes.size(); m++)
+			{
+				GLsizeiptr size = model->meshes[m]->vertices.size() * sizeof(Vertex);
+				if (size == 0) continue;
+
+				// Out of space, what was allocated so far is still skinned and drawn
+				RingAllocation allocation = this->ring.allocate(size, sizeof(Vertex));
+				full = !allocation.data;
+				if (full) break;
+
+				this->jobs.push_back({ i, m, allocation.offset, allocation.size, allocation.data });
+				this->stats.vertices += model->meshes[m]->vertices.size();
+				this->stats.uploadedBytes += size;
+			}
+		}
+
+		pool.parallelFor(this->jobs.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t j = begin; j < end; j++)
+			{
+				const Job& job = this->jobs[j];
+				const AnimatedInstance& instance = instances[job.instance];
+				const SkinnedMesh& mesh = *instance.getModel()->meshes[job.mesh];
+				skinVertices(mesh.vertices.data(), mesh.skin.data(), instance.getPalette().data(), (Vertex*)job.data, mesh.vertices.size());
+			}
+		});
+	}
+
+	void copyPalettes(std::vector<AnimatedInstance>& instances)
+	{
+		this->jobs.clear();
+		for (size_t i = 0; i < instances.size(); i++)
+		{
+			AnimatedModel* model = instances[i].getModel();
+			if (!instances[i].visible || !model || model->meshes.empty()) continue;
+
+			model->upload();
+			const std::vector<glm::mat4>& palette = instances[i].getPalette();
+			GLsizeiptr size = palette.size() * sizeof(glm::mat4);
+
+			RingAllocation allocation = this->ring.allocate(size);
+			if (!allocation.data) return;
+			std::memcpy(allocation.data, palette.data(), size);
+
+			this->stats.instances++;
+			this->stats.uploadedBytes += size;
+			for (size_t m = 0; m < model->meshes.size(); m++)
+			{
+				this->jobs.push_back({ i, m, allocation.offset, allocation.size, allocation.data });
+				this->stats.vertices += model->meshes[m]->vertices.size();
+			}
+		}
+	}
+};
+
+#endif // !SKINNED_RENDERER_H
@@ -0,0 +1,144 @@
+/*
+*	BVH_BENCHMARK.HPP
+*
+*	Cost of the DynamicBVH operations (SCENE/dynamic_bvh.hpp) on a random
+*	field of boxes, the same one the culling benchmark uses: incremental
+*	inserts, a parallel SAH rebuild, a frame of small moves (move() and the
+*	setBounds() + refit() path), and queries. Frustum queries are compared
+*	with the linear SIMD scan of cullFrustum() over the same objects.
+*/
+
+#ifndef BVH_BENCHMARK_H
+#define BVH_BENCHMARK_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <SCENE/dynamic_bvh.hpp>
+#include <CULLING/frustum_culling.hpp>
+#include <CULLING/culling_benchmark.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#define BVH_BENCHMARK_QUERIES 1000
+
+struct BVHBenchmarkResult
+{
+	size_t objects;
+	double insertMilliseconds;			// Every object, one insert() each
+	double rebuildMilliseconds;
+	double moveMilliseconds;			// Every object nudged through move()
+	double refitMilliseconds;			// Same through setBounds() and refit()
+	double frustumMilliseconds;			// One query
+	double linearFrustumMilliseconds;	// cullFrustum() over the same objects
+	double rayMicroseconds;				// Closest hit of one ray, average
+	double sphereMicroseconds;			// Average sphere query
+	size_t visible;
+	size_t mismatches;					// Between the sorted BVH and linear frustum lists
+	size_t reinserts;
+	int insertHeight, rebuildHeight;
+	float insertCost, rebuildCost;		// SAH cost, see computeCost()
+};
+
+inline BVHBenchmarkResult benchmarkBVH(size_t objects, ThreadPool& pool = ThreadPool::shared())
+{
+	typedef std::chrono::steady_clock Clock;
+	BVHBenchmarkResult result = {};
+	result.objects = objects;
+
+	// Same field as the culling benchmark, back to boxes
+	CullingBounds bounds = makeBenchmarkField(objects);
+	std::vector<AABB> boxes(objects);
+	for (size_t i = 0; i < objects; i++)
+	{
+		glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]), extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+		boxes[i] = { center - extent, center + extent };
+	}
+
+	DynamicBVH bvh;
+	std::vector<uint32_t> proxies(objects);
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < objects; i++) proxies[i] = bvh.insert(boxes[i], (uint32_t)i);
+	result.insertMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	result.insertHeight = bvh.getHeight();
+	result.insertCost = bvh.computeCost();
+
+	bvh.rebuild(pool);
+	result.rebuildMilliseconds = bvh.getStats().rebuildMilliseconds;
+	result.rebuildHeight = bvh.getHeight();
+	result.rebuildCost = bvh.computeCost();
+
+	// A frame of motion under BVH_MARGIN, most objects stay inside their enlarged leaves
+	std::mt19937 random(99);
+	std::uniform_real_distribution<float> step(-0.05f, 0.05f);
+	for (AABB& box : boxes)
+	{
+		glm::vec3 offset(step(random), step(random), step(random));
+		box.min += offset;
+		box.max += offset;
+	}
+
+	start = Clock::now();
+	for (size_t i = 0; i < objects; i++) bvh.move(proxies[i], boxes[i]);
+	result.moveMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	result.reinserts = bvh.getStats().reinserts;
+
+	start = Clock::now();
+	for (size_t i = 0; i < objects; i++) bvh.setBounds(proxies[i], boxes[i]);
+	bvh.refit();
+	result.refitMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = extractFrustum(glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) * view);
+	std::vector<uint32_t> visible, linear;
+
+	start = Clock::now();
+	bvh.queryFrustum(frustum, visible);
+	result.frustumMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	// The tree holds the moved boxes, the linear scan has to see the same
+	for (size_t i = 0; i < objects; i++) bounds.set(i, boxes[i]);
+	start = Clock::now();
+	cullFrustum(frustum, bounds, culling_aabb, linear, pool);
+	result.linearFrustumMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	std::sort(visible.begin(), visible.end());
+	result.visible = visible.size();
+	result.mismatches = countMismatches(linear, visible);
+
+	std::uniform_real_distribution<float> position(-CULLING_BENCHMARK_FIELD, CULLING_BENCHMARK_FIELD), direction(-1.0f, 1.0f);
+	start = Clock::now();
+	for (int q = 0; q < BVH_BENCHMARK_QUERIES; q++)
+	{
+		glm::vec3 origin(position(random), position(random), position(random));
+		glm::vec3 dir = glm::normalize(glm::vec3(direction(random), direction(random), direction(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+		bvh.raycast(origin, dir, 2.0f * CULLING_BENCHMARK_FIELD, [](uint32_t, float distance) { return distance; });
+	}
+	result.rayMicroseconds = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / BVH_BENCHMARK_QUERIES;
+
+	start = Clock::now();
+	for (int q = 0; q < BVH_BENCHMARK_QUERIES; q++)
+		bvh.querySphere(glm::vec3(position(random), position(random), position(random)), 10.0f, visible);
+	result.sphereMicroseconds = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / BVH_BENCHMARK_QUERIES;
+
+	return result;
+}
+
+inline void printBVHBenchmark(const BVHBenchmarkResult& result)
+{
+	std::cout << "BVH benchmark: " << result.objects << " objects" << '\n';
+	std::cout << "  insert:  " << result.insertMilliseconds << " ms, height " << result.insertHeight << ", SAH cost " << result.insertCost << '\n';
+	std::cout << "  rebuild: " << result.rebuildMilliseconds << " ms, height " << result.rebuildHeight << ", SAH cost " << result.rebuildCost << '\n';
+	std::cout << "  move:    " << result.moveMilliseconds << " ms (" << result.reinserts << " reinserted), refit " << result.refitMilliseconds << " ms" << '\n';
+	std::cout << "  frustum: " << result.frustumMilliseconds << " ms, linear scan " << result.linearFrustumMilliseconds << " ms, "
+		<< result.visible << " visible" << '\n';
+	if (result.mismatches) std::cout << "  " << result.mismatches << " indices differ from the linear scan" << '\n';
+	std::cout << "  ray:     " << result.rayMicroseconds << " us closest hit, sphere " << result.sphereMicroseconds << " us" << '\n';
+}
+
+#endif // !BVH_BENCHMARK_H
@@ -0,0 +1,716 @@
+/*
+*	DYNAMIC_BVH.HPP
+*
+*	Bounding volume hierarchy over object AABBs, shared by every spatial query
+*	of the scene (culling, picking, light assignment, streaming).
+*
+*	Nodes live in one contiguous array, each leaf holds one object. Objects
+*	are referenced through stable proxy ids, the leaf a proxy lives in can
+*	change on every structural update.
+*
+*	- insert() / remove(): incremental, the new leaf goes next to the sibling
+*	  that minimizes the surface area (SAH) cost increase, and the path back
+*	  to the root is rebalanced with tree rotations, so the height stays
+*	  logarithmic without rebuilds.
+*	- move(): leaves are stored enlarged by BVH_MARGIN, an object moving
+*	  inside its enlarged box costs nothing, otherwise it is reinserted.
+*	- setBounds() + refit(): many objects moved in place, their leaves take
+*	  the new boxes and only the ancestors are recomputed, the structure is
+*	  kept. Cheap per frame, the quality degrades until the next rebuild.
+*	- rebuild(): full top down binned SAH build. The top levels are split
+*	  serially until there are enough independent subtrees, which are then
+*	  built in parallel straight into their reserved node ranges.
+*
+*	Queries report the object values given at insert(), tested against the
+*	exact object boxes at the leaves so the enlarged boxes never add false
+*	positives. raycast() visits the hit leaves near first and lets the
+*	callback shorten the ray, which is what picking needs.
+*/
+
+#ifndef DYNAMIC_BVH_H
+#define DYNAMIC_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <BOUNDS/bounds.hpp>
+#include <CULLING/frustum.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+
+#define BVH_NULL -1
+#define BVH_MARGIN 0.1f					// Leaf enlargement, in world units
+#define BVH_SAH_BINS 16
+#define BVH_MAX_DEPTH 64				// Rebuilds fall back to median splits below it
+#define BVH_STACK_SIZE 256				// Traversal stack, well above any height the tree reaches
+#define BVH_PARALLEL_LEAVES 4096		// Rebuild ranges below this size are built by one thread
+
+struct BVHNode
+{
+	AABB box;
+	int32_t parent;						// Next free node when unused
+	int32_t child[2];					// BVH_NULL for leaves
+	int32_t height;						// 0 for leaves, -1 when unused
+	uint32_t proxy;						// Leaves only
+};
+
+struct BVHStats
+{
+	size_t proxies;
+	size_t nodes;
+	int height;
+	size_t reinserts;					// By move() since the last rebuild
+	double rebuildMilliseconds;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "BVH utility functions"
+
+inline bool containsAABB(const AABB& outer, const AABB& inner)
+{
+	return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+}
+
+inline bool overlapsAABB(const AABB& a, const AABB& b)
+{
+	return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::greaterThanEqual(a.max, b.min));
+}
+
+inline bool overlapsSphere(const AABB& box, const glm::vec3& center, float radius)
+{
+	glm::vec3 d = center - glm::clamp(center, box.min, box.max);
+	return glm::dot(d, d) <= radius * radius;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class DynamicBVH
+{
+public:
+
+	DynamicBVH()
+	{
+		this->root = BVH_NULL;
+		this->freeNode = BVH_NULL;
+		this->freeProxy = BVH_NULL;
+		this->proxyCount = 0;
+		this->stats = BVHStats();
+	}
+
+	// Returns the proxy id of the new object
+	uint32_t insert(const AABB& box, uint32_t object)
+	{
+		uint32_t proxy;
+		if (this->freeProxy != BVH_NULL)
+		{
+			proxy = (uint32_t)this->freeProxy;
+			this->freeProxy = this->proxies[proxy].leaf;
+		}
+		else
+		{
+			proxy = (uint32_t)this->proxies.size();
+			this->proxies.push_back(Proxy());
+		}
+
+		int32_t leaf = allocateNode();
+		this->nodes[leaf].box = enlarge(box);
+		this->nodes[leaf].height = 0;
+		this->nodes[leaf].proxy = proxy;
+		this->proxies[proxy] = { box, object, leaf };
+		this->proxyCount++;
+
+		insertLeaf(leaf);
+		return proxy;
+	}
+
+	void remove(uint32_t proxy)
+	{
+		if (!isValid(proxy)) return;
+
+		removeLeaf(this->proxies[proxy].leaf);
+		freeNodeAt(this->proxies[proxy].leaf);
+
+		this->proxies[proxy].leaf = this->freeProxy;
+		this->proxies[proxy].object = UINT32_MAX;
+		this->freeProxy = (int32_t)proxy;
+		this->proxyCount--;
+	}
+
+	// New bounds of a moving object, true when it had to be reinserted
+	bool move(uint32_t proxy, const AABB& box)
+	{
+		if (!isValid(proxy)) return false;
+
+		Proxy& p = this->proxies[proxy];
+		p.box = box;
+		if (containsAABB(this->nodes[p.leaf].box, box)) return false;
+
+		removeLeaf(p.leaf);
+		this->nodes[p.leaf].box = enlarge(box);
+		insertLeaf(p.leaf);
+		this->stats.reinserts++;
+		return true;
+	}
+
+	// New bounds without restructuring, the ancestors are fixed by refit()
+	void setBounds(uint32_t proxy, const AABB& box)
+	{
+		if (!isValid(proxy)) return;
+
+		Proxy& p = this->proxies[proxy];
+		p.box = box;
+		this->nodes[p.leaf].box = box;
+		this->refitLeaves.push_back(p.leaf);
+	}
+
+	// Ancestors of the leaves given to setBounds(), each path stops where the boxes stop changing
+	void refit()
+	{
+		for (int32_t leaf : this->refitLeaves)
+		{
+			for (int32_t node = this->nodes[leaf].parent; node != BVH_NULL; node = this->nodes[node].parent)
+			{
+				AABB box = mergeAABB(this->nodes[this->nodes[node].child[0]].box, this->nodes[this->nodes[node].child[1]].box);
+				if (box.min == this->nodes[node].box.min && box.max == this->nodes[node].box.max) break;
+				this->nodes[node].box = box;
+			}
+		}
+		this->refitLeaves.clear();
+	}
+
+	// Full binned SAH build over the current objects
+	void rebuild(ThreadPool& pool = ThreadPool::shared())
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		std::vector<BuildItem> items;
+		items.reserve(this->proxyCount);
+		for (uint32_t proxy = 0; proxy < this->proxies.size(); proxy++)
+		{
+			if (!isValid(proxy)) continue;
+			AABB box = enlarge(this->proxies[proxy].box);
+			items.push_back({ box, (box.min + box.max) * 0.5f, proxy });
+		}
+
+		this->nodes.assign(items.empty() ? 0 : 2 * items.size() - 1, BVHNode());
+		this->freeNode = BVH_NULL;
+		this->refitLeaves.clear();
+		this->root = items.empty() ? BVH_NULL : 0;
+
+		if (!items.empty())
+		{
+			// Top levels serially, until the ranges are small or numerous enough to keep every thread busy
+			std::vector<BuildTask> tasks;
+			size_t wanted = pool.getConcurrency() * 4;
+			int32_t next = 0;
+			splitTop(items, 0, items.size(), BVH_NULL, 0, next, wanted, tasks);
+
+			pool.parallelFor(tasks.size(), 1, [&](size_t begin, size_t end)
+			{
+				for (size_t t = begin; t < end; t++)
+				{
+					int32_t node = tasks[t].firstNode;
+					buildRange(items, tasks[t].begin, tasks[t].end, tasks[t].parent, tasks[t].depth, node);
+				}
+			});
+
+			// Heights and boxes of the top levels, their subtrees are done
+			for (int32_t i = (int32_t)this->topNodes.size() - 1; i >= 0; i--) updateNode(this->topNodes[i]);
+			this->topNodes.clear();
+		}
+
+		this->stats.reinserts = 0;
+		this->stats.rebuildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Objects whose box overlaps box
+	void queryAABB(const AABB& box, std::vector<uint32_t>& objects) const
+	{
+		objects.clear();
+		traverse([&](const AABB& node) { return overlapsAABB(node, box); },
+			[&](const Proxy& proxy) { if (overlapsAABB(proxy.box, box)) objects.push_back(proxy.object); });
+	}
+
+	// Objects whose box touches the sphere
+	void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& objects) const
+	{
+		objects.clear();
+		traverse([&](const AABB& node) { return overlapsSphere(node, center, radius); },
+			[&](const Proxy& proxy) { if (overlapsSphere(proxy.box, center, radius)) objects.push_back(proxy.object); });
+	}
+
+	// Objects whose box intersects the frustum, subtrees fully inside are taken without further tests
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& objects) const
+	{
+		objects.clear();
+		if (this->root == BVH_NULL) return;
+
+		int32_t stack[BVH_STACK_SIZE];
+		int top = 0;
+		stack[top++] = this->root;
+		while (top > 0)
+		{
+			const BVHNode& node = this->nodes[stack[--top]];
+			glm::vec3 center = (node.box.min + node.box.max) * 0.5f, extent = (node.box.max - node.box.min) * 0.5f;
+
+			bool inside = true;
+			bool outside = false;
+			for (int p = 0; p < frustum_plane_count && !outside; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+				float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+				outside = distance + radius < 0.0f;
+				inside &= distance - radius >= 0.0f;
+			}
+			if (outside) continue;
+
+			if (node.height == 0)
+			{
+				const Proxy& proxy = this->proxies[node.proxy];
+				if (inside || intersectsFrustum(frustum, proxy.box)) objects.push_back(proxy.object);
+			}
+			else if (inside) collectLeaves(node, objects);
+			else
+			{
+				stack[top++] = node.child[0];
+				stack[top++] = node.child[1];
+			}
+		}
+	}
+
+	/*
+	*	Objects hit by the ray, near first by box entry. fn(object, entry)
+	*	returns the distance the ray goes on to: maxDistance to see every hit,
+	*	the hit distance to only look for closer ones.
+	*/
+	template<typename F>
+	void raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, F&& fn) const
+	{
+		if (this->root == BVH_NULL) return;
+		glm::vec3 inverse = inverseRayDirection(direction);
+
+		struct Entry { int32_t node; float distance; };
+		Entry stack[BVH_STACK_SIZE];
+		int top = 0;
+
+		float rootDistance = intersectRayAABB(this->nodes[this->root].box, origin, inverse, maxDistance);
+		if (rootDistance >= 0.0f) stack[top++] = { this->root, rootDistance };
+
+		while (top > 0)
+		{
+			Entry entry = stack[--top];
+			if (entry.distance > maxDistance) continue;
+
+			const BVHNode& node = this->nodes[entry.node];
+			if (node.height == 0)
+			{
+				const Proxy& proxy = this->proxies[node.proxy];
+				float distance = intersectRayAABB(proxy.box, origin, inverse, maxDistance);
+				if (distance >= 0.0f) maxDistance = std::min(maxDistance, (float)fn(proxy.object, distance));
+				continue;
+			}
+
+			float d0 = intersectRayAABB(this->nodes[node.child[0]].box, origin, inverse, maxDistance);
+			float d1 = intersectRayAABB(this->nodes[node.child[1]].box, origin, inverse, maxDistance);
+
+			// Far child first so the near one is popped next
+			if (d0 >= 0.0f && d1 >= 0.0f)
+			{
+				bool nearFirst = d0 <= d1;
+				stack[top++] = { node.child[nearFirst ? 1 : 0], nearFirst ? d1 : d0 };
+				stack[top++] = { node.child[nearFirst ? 0 : 1], nearFirst ? d0 : d1 };
+			}
+			else if (d0 >= 0.0f) stack[top++] = { node.child[0], d0 };
+			else if (d1 >= 0.0f) stack[top++] = { node.child[1], d1 };
+		}
+	}
+
+	// Every object whose box the ray crosses, near first by box entry
+	void queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<uint32_t>& objects) const
+	{
+		objects.clear();
+		raycast(origin, direction, maxDistance, [&](uint32_t object, float) { objects.push_back(object); return maxDistance; });
+	}
+
+	// Surface area heuristic cost of the tree relative to its root, lower is better
+	float computeCost() const
+	{
+		if (this->root == BVH_NULL) return 0.0f;
+		float rootArea = std::max(surfaceArea(this->nodes[this->root].box), FLT_MIN), cost = 0.0f;
+		for (const BVHNode& node : this->nodes) if (node.height > 0) cost += surfaceArea(node.box) / rootArea;
+		return cost;
+	}
+
+	inline bool isValid(uint32_t proxy) const { return proxy < this->proxies.size() && this->proxies[proxy].object != UINT32_MAX; }
+	inline uint32_t getObject(uint32_t proxy) const { return this->proxies[proxy].object; }
+	inline const AABB& getBounds(uint32_t proxy) const { return this->proxies[proxy].box; }
+	inline size_t size() const { return this->proxyCount; }
+	inline int getHeight() const { return this->root == BVH_NULL ? 0 : this->nodes[this->root].height; }
+	inline const std::vector<BVHNode>& getNodes() const { return this->nodes; }
+	inline int32_t getRoot() const { return this->root; }
+
+	const BVHStats& getStats()
+	{
+		this->stats.proxies = this->proxyCount;
+		this->stats.nodes = this->nodes.size();
+		this->stats.height = getHeight();
+		return this->stats;
+	}
+
+private:
+
+	struct Proxy
+	{
+		AABB box;						// Exact bounds
+		uint32_t object;				// UINT32_MAX when free
+		int32_t leaf;					// Next free proxy when free
+	};
+
+	struct BuildItem
+	{
+		AABB box;
+		glm::vec3 centroid;
+		uint32_t proxy;
+	};
+
+	// Range built by one thread into nodes [firstNode, firstNode + 2 * count - 1)
+	struct BuildTask
+	{
+		size_t begin, end;
+		int32_t parent;
+		int depth;
+		int32_t firstNode;
+	};
+
+	std::vector<BVHNode> nodes;
+	std::vector<Proxy> proxies;
+	std::vector<int32_t> refitLeaves;
+	std::vector<int32_t> topNodes;		// Built serially by the last rebuild, parents first
+	int32_t root;
+	int32_t freeNode;
+	int32_t freeProxy;
+	size_t proxyCount;
+	BVHStats stats;
+
+	static AABB enlarge(const AABB& box) { return { box.min - glm::vec3(BVH_MARGIN), box.max + glm::vec3(BVH_MARGIN) }; }
+	inline bool isLeaf(int32_t node) const { return this->nodes[node].height == 0; }
+
+	int32_t allocateNode()
+	{
+		if (this->freeNode == BVH_NULL)
+		{
+			this->nodes.push_back(BVHNode());
+			this->nodes.back().height = -1;
+			this->freeNode = (int32_t)this->nodes.size() - 1;
+			this->nodes.back().parent = BVH_NULL;
+		}
+
+		int32_t node = this->freeNode;
+		this->freeNode = this->nodes[node].parent;
+		this->nodes[node].parent = BVH_NULL;
+		this->nodes[node].child[0] = this->nodes[node].child[1] = BVH_NULL;
+		this->nodes[node].height = 0;
+		return node;
+	}
+
+	void freeNodeAt(int32_t node)
+	{
+		this->nodes[node].parent = this->freeNode;
+		this->nodes[node].height = -1;
+		this->freeNode = node;
+	}
+
+	void updateNode(int32_t node)
+	{
+		BVHNode& n = this->nodes[node];
+		n.height = 1 + std::max(this->nodes[n.child[0]].height, this->nodes[n.child[1]].height);
+		n.box = mergeAABB(this->nodes[n.child[0]].box, this->nodes[n.child[1]].box);
+	}
+
+	void replaceChild(int32_t parent, int32_t oldChild, int32_t newChild)
+	{
+		if (parent == BVH_NULL) this->root = newChild;
+		else if (this->nodes[parent].child[0] == oldChild) this->nodes[parent].child[0] = newChild;
+		else this->nodes[parent].child[1] = newChild;
+	}
+
+	void insertLeaf(int32_t leaf)
+	{
+		if (this->root == BVH_NULL)
+		{
+			this->root = leaf;
+			this->nodes[leaf].parent = BVH_NULL;
+			return;
+		}
+
+		// Descend while going down is cheaper than pairing the leaf with the current node
+		AABB leafBox = this->nodes[leaf].box;
+		int32_t index = this->root;
+		while (!isLeaf(index))
+		{
+			const BVHNode& node = this->nodes[index];
+			float area = surfaceArea(node.box);
+			float combinedArea = surfaceArea(mergeAABB(node.box, leafBox));
+
+			float cost = 2.0f * combinedArea;
+			float inheritance = 2.0f * (combinedArea - area);
+
+			float childCost[2];
+			for (int c = 0; c < 2; c++)
+			{
+				const BVHNode& child = this->nodes[node.child[c]];
+				float merged = surfaceArea(mergeAABB(child.box, leafBox));
+				childCost[c] = (child.height == 0 ? merged : merged - surfaceArea(child.box)) + inheritance;
+			}
+
+			if (cost < childCost[0] && cost < childCost[1]) break;
+			index = node.child[childCost[0] < childCost[1] ? 0 : 1];
+		}
+
+		int32_t sibling = index;
+		int32_t oldParent = this->nodes[sibling].parent;
+		int32_t newParent = allocateNode();
+		this->nodes[newParent].parent = oldParent;
+		this->nodes[newParent].child[0] = sibling;
+		this->nodes[newParent].child[1] = leaf;
+		this->nodes[sibling].parent = newParent;
+		this->nodes[leaf].parent = newParent;
+		replaceChild(oldParent, sibling, newParent);
+		updateNode(newParent);
+
+		fixUpwards(oldParent);
+	}
+
+	void removeLeaf(int32_t leaf)
+	{
+		if (leaf == this->root)
+		{
+			this->root = BVH_NULL;
+			return;
+		}
+
+		int32_t parent = this->nodes[leaf].parent;
+		int32_t grandParent = this->nodes[parent].parent;
+		int32_t sibling = this->nodes[parent].child[0] == leaf ? this->nodes[parent].child[1] : this->nodes[parent].child[0];
+
+		replaceChild(grandParent, parent, sibling);
+		this->nodes[sibling].parent = grandParent;
+		freeNodeAt(parent);
+
+		fixUpwards(grandParent);
+	}
+
+	// Rebalances and refits from node up to the root
+	void fixUpwards(int32_t node)
+	{
+		while (node != BVH_NULL)
+		{
+			node = balance(node);
+			updateNode(node);
+			node = this->nodes[node].parent;
+		}
+	}
+
+	/*
+	*	Rotates the taller grandchild up when the children heights differ by
+	*	more than one, returns the node now at the position of a.
+	*/
+	int32_t balance(int32_t a)
+	{
+		BVHNode& A = this->nodes[a];
+		if (A.height < 2) return a;
+
+		int32_t b = A.child[0], c = A.child[1];
+		int32_t difference = this->nodes[c].height - this->nodes[b].height;
+		if (difference > 1) return rotateUp(a, c, 1);
+		if (difference < -1) return rotateUp(a, b, 0);
+		return a;
+	}
+
+	// Child up (at side of a) takes the place of a, a keeps up's shorter child
+	int32_t rotateUp(int32_t a, int32_t up, int side)
+	{
+		BVHNode& A = this->nodes[a];
+		BVHNode& U = this->nodes[up];
+		int32_t f = U.child[0], g = U.child[1];
+
+		U.child[0] = a;
+		U.parent = A.parent;
+		A.parent = up;
+		replaceChild(U.parent, a, up);
+
+		// The taller of up's children stays with up, the other replaces up under a
+		bool fTaller = this->nodes[f].height > this->nodes[g].height;
+		int32_t keep = fTaller ? f : g, give = fTaller ? g : f;
+		U.child[1] = keep;
+		A.child[side] = give;
+		this->nodes[give].parent = a;
+
+		updateNode(a);
+		updateNode(up);
+		return up;
+	}
+
+	// Every leaf under node, no tests
+	void collectLeaves(const BVHNode& start, std::vector<uint32_t>& objects) const
+	{
+		int32_t stack[BVH_STACK_SIZE];
+		int top = 0;
+		stack[top++] = start.child[0];
+		stack[top++] = start.child[1];
+		while (top > 0)
+		{
+			const BVHNode& node = this->nodes[stack[--top]];
+			if (node.height == 0) objects.push_back(this->proxies[node.proxy].object);
+			else
+			{
+				stack[top++] = node.child[0];
+				stack[top++] = node.child[1];
+			}
+		}
+	}
+
+	template<typename NodeTest, typename LeafFn>
+	void traverse(NodeTest&& test, LeafFn&& leaf) const
+	{
+		if (this->root == BVH_NULL) return;
+
+		int32_t stack[BVH_STACK_SIZE];
+		int top = 0;
+		stack[top++] = this->root;
+		while (top > 0)
+		{
+			const BVHNode& node = this->nodes[stack[--top]];
+			if (!test(node.box)) continue;
+
+			if (node.height == 0) leaf(this->proxies[node.proxy]);
+			else
+			{
+				stack[top++] = node.child[0];
+				stack[top++] = node.child[1];
+			}
+		}
+	}
+
+	/*
+	*	Binned SAH split of items [begin, end) on the axis of largest centroid
+	*	extent, returns the first item of the right side. Falls back to a
+	*	median split when the centroids coincide, SAH finds nothing or the
+	*	tree is already BVH_MAX_DEPTH deep.
+	*/
+	size_t splitItems(std::vector<BuildItem>& items, size_t begin, size_t end, int depth)
+	{
+		AABB centroids = emptyAABB();
+		for (size_t i = begin; i < end; i++) centroids = mergeAABB(centroids, { items[i].centroid, items[i].centroid });
+
+		glm::vec3 extent = centroids.max - centroids.min;
+		int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		size_t middle = begin + (end - begin) / 2;
+
+		if (extent[axis] > 0.0f && depth < BVH_MAX_DEPTH)
+		{
+			AABB binBoxes[BVH_SAH_BINS];
+			size_t binCounts[BVH_SAH_BINS] = {};
+			for (int b = 0; b < BVH_SAH_BINS; b++) binBoxes[b] = emptyAABB();
+
+			float scale = BVH_SAH_BINS / extent[axis];
+			auto binOf = [&](const BuildItem& item) { return std::min((int)((item.centroid[axis] - centroids.min[axis]) * scale), BVH_SAH_BINS - 1); };
+			for (size_t i = begin; i < end; i++)
+			{
+				int b = binOf(items[i]);
+				binBoxes[b] = mergeAABB(binBoxes[b], items[i].box);
+				binCounts[b]++;
+			}
+
+			// Right side areas and counts swept from the end, then the left side from the start
+			float rightArea[BVH_SAH_BINS];
+			size_t rightCount[BVH_SAH_BINS];
+			AABB right = emptyAABB();
+			size_t count = 0;
+			for (int b = BVH_SAH_BINS - 1; b > 0; b--)
+			{
+				right = mergeAABB(right, binBoxes[b]);
+				count += binCounts[b];
+				rightArea[b] = isEmpty(right) ? 0.0f : surfaceArea(right);
+				rightCount[b] = count;
+			}
+
+			int bestSplit = -1;
+			float bestCost = FLT_MAX;
+			AABB left = emptyAABB();
+			count = 0;
+			for (int b = 1; b < BVH_SAH_BINS; b++)
+			{
+				left = mergeAABB(left, binBoxes[b - 1]);
+				count += binCounts[b - 1];
+				if (count == 0 || rightCount[b] == 0) continue;
+
+				float cost = surfaceArea(left) * count + rightArea[b] * rightCount[b];
+				if (cost < bestCost) { bestCost = cost; bestSplit = b; }
+			}
+
+			if (bestSplit > 0)
+				return std::partition(items.begin() + begin, items.begin() + end, [&](const BuildItem& item) { return binOf(item) < bestSplit; }) - items.begin();
+		}
+
+		std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end,
+			[axis](const BuildItem& a, const BuildItem& b) { return a.centroid[axis] < b.centroid[axis]; });
+		return middle;
+	}
+
+	// Serial top of a rebuild: splits large ranges itself, hands the others out as tasks
+	void splitTop(std::vector<BuildItem>& items, size_t begin, size_t end, int32_t parent, int depth, int32_t& next, size_t wanted,
+		std::vector<BuildTask>& tasks)
+	{
+		size_t count = end - begin;
+		if (count < BVH_PARALLEL_LEAVES || (size_t)1 << depth >= wanted)
+		{
+			tasks.push_back({ begin, end, parent, depth, next });
+			next += (int32_t)(2 * count - 1);
+			return;
+		}
+
+		int32_t node = next++;
+		this->nodes[node].parent = parent;
+		this->topNodes.push_back(node);
+
+		size_t middle = splitItems(items, begin, end, depth);
+		this->nodes[node].child[0] = next;
+		splitTop(items, begin, middle, node, depth + 1, next, wanted, tasks);
+		this->nodes[node].child[1] = next;
+		splitTop(items, middle, end, node, depth + 1, next, wanted, tasks);
+	}
+
+	// Builds items [begin, end) into consecutive nodes from node on, returns the subtree root
+	int32_t buildRange(std::vector<BuildItem>& items, size_t begin, size_t end, int32_t parent, int depth, int32_t& node)
+	{
+		int32_t index = node++;
+		BVHNode& n = this->nodes[index];
+		n.parent = parent;
+
+		if (end - begin == 1)
+		{
+			n.box = items[begin].box;
+			n.child[0] = n.child[1] = BVH_NULL;
+			n.height = 0;
+			n.proxy = items[begin].proxy;
+			this->proxies[items[begin].proxy].leaf = index;
+			return index;
+		}
+
+		size_t middle = splitItems(items, begin, end, depth);
+		n.child[0] = buildRange(items, begin, middle, index, depth + 1, node);
+		n.child[1] = buildRange(items, middle, end, index, depth + 1, node);
+		updateNode(index);
+		return index;
+	}
+};
+
+#endif // !DYNAMIC_BVH_H
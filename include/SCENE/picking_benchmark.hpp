@@ -0,0 +1,175 @@
+/*
+*	PICKING_BENCHMARK.HPP
+*
+*	Ray picking throughput (SCENE/ray_picking.hpp) on a field of spheres
+*	sharing one triangle BVH, each with its own position, rotation and scale,
+*	in the same space as the culling benchmark.
+*
+*	Rays go from random points of the field towards random objects, so most
+*	of them hit something. The batch is timed on the calling thread and over
+*	the pool, and the first hits are checked against a brute force test of
+*	every triangle of the objects whose boxes the ray crosses.
+*/
+
+#ifndef PICKING_BENCHMARK_H
+#define PICKING_BENCHMARK_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <SCENE/ray_picking.hpp>
+#include <SCENE/dynamic_bvh.hpp>
+#include <MESH/triangle_bvh.hpp>
+#include <CULLING/culling_benchmark.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+
+#define PICKING_BENCHMARK_RINGS 32		// Sphere of 2 * 32 * 64 triangles
+#define PICKING_BENCHMARK_CHECKS 500	// Rays checked against the brute force test
+
+struct PickingBenchmarkResult
+{
+	size_t objects, rays, trianglesPerObject;
+	size_t hits;
+	double buildMilliseconds;			// Triangle BVH of the sphere
+	double sceneMilliseconds;			// Inserts and rebuild of the scene BVH
+	double serialMilliseconds;			// The batch on the calling thread
+	double parallelMilliseconds;		// The batch over the pool
+	size_t mismatches;					// Checked rays whose hit differs from the brute force one
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Picking benchmark utility functions"
+
+// Unit UV sphere, positions packed and an indexed triangle list
+inline void makeBenchmarkSphere(int rings, std::vector<glm::vec3>& positions, std::vector<GLuint>& indices)
+{
+	int segments = 2 * rings;
+	positions.clear();
+	indices.clear();
+	for (int r = 0; r <= rings; r++)
+		for (int s = 0; s <= segments; s++)
+		{
+			float theta = glm::pi<float>() * r / rings, phi = 2.0f * glm::pi<float>() * s / segments;
+			positions.push_back(glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+		}
+
+	for (int r = 0; r < rings; r++)
+		for (int s = 0; s < segments; s++)
+		{
+			GLuint a = r * (segments + 1) + s, b = a + segments + 1;
+			indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+		}
+}
+
+// Closest hit among the candidates by testing all their triangles
+inline RayHit bruteForcePick(const Ray& ray, const std::vector<uint32_t>& candidates, const std::vector<glm::mat4>& transforms,
+	const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices)
+{
+	RayHit hit = missedRay();
+	float closest = ray.maxDistance;
+	for (uint32_t object : candidates)
+	{
+		glm::mat4 inverse = glm::inverse(transforms[object]);
+		glm::vec3 origin = glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)), direction = glm::mat3(inverse) * ray.direction;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			glm::vec3 v0 = positions[indices[i]];
+			float u, v, t = intersectRayTriangle(origin, direction, v0, positions[indices[i + 1]] - v0, positions[indices[i + 2]] - v0, closest, u, v);
+			if (t < 0.0f) continue;
+			closest = t;
+			hit.object = object;
+			hit.triangle = (uint32_t)(i / 3);
+			hit.distance = t;
+		}
+	}
+	return hit;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+inline PickingBenchmarkResult benchmarkPicking(size_t objects, size_t rays, ThreadPool& pool = ThreadPool::shared())
+{
+	typedef std::chrono::steady_clock Clock;
+	PickingBenchmarkResult result = {};
+	result.objects = objects;
+	result.rays = rays;
+
+	std::vector<glm::vec3> positions;
+	std::vector<GLuint> indices;
+	makeBenchmarkSphere(PICKING_BENCHMARK_RINGS, positions, indices);
+	result.trianglesPerObject = indices.size() / 3;
+
+	ScenePicker picker;
+	Clock::time_point start = Clock::now();
+	uint32_t sphere = picker.addGeometry(positions.data(), positions.size(), sizeof(glm::vec3), indices.data(), indices.size());
+	result.buildMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	std::mt19937 random(4321);
+	std::uniform_real_distribution<float> position(-CULLING_BENCHMARK_FIELD, CULLING_BENCHMARK_FIELD), unit(-1.0f, 1.0f), scale(0.5f, 2.0f);
+
+	std::vector<glm::mat4> transforms(objects);
+	for (glm::mat4& transform : transforms)
+	{
+		glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(1e-3f));
+		transform = glm::translate(glm::mat4(1.0f), glm::vec3(position(random), position(random), position(random)));
+		transform = glm::rotate(transform, glm::pi<float>() * unit(random), axis);
+		transform = glm::scale(transform, glm::vec3(scale(random), scale(random), scale(random)));
+	}
+
+	DynamicBVH bvh;
+	start = Clock::now();
+	for (uint32_t i = 0; i < objects; i++) bvh.insert(transformAABB(picker.getGeometry(sphere).getBounds(), transforms[i]), i);
+	bvh.rebuild(pool);
+	result.sceneMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	for (uint32_t i = 0; i < objects; i++) picker.setObject(i, sphere, transforms[i]);
+
+	std::vector<Ray> batch(rays);
+	std::uniform_int_distribution<size_t> target(0, objects - 1);
+	for (Ray& ray : batch)
+	{
+		ray.origin = glm::vec3(position(random), position(random), position(random));
+		glm::vec3 toward = glm::vec3(transforms[target(random)][3]) + glm::vec3(unit(random), unit(random), unit(random));
+		ray.direction = glm::normalize(toward - ray.origin);
+		ray.maxDistance = 4.0f * CULLING_BENCHMARK_FIELD;
+	}
+
+	std::vector<RayHit> hits(rays);
+	result.serialMilliseconds = bestCullingTime(3, [&]() { for (size_t i = 0; i < rays; i++) picker.pick(bvh, batch[i], hits[i]); });
+	result.parallelMilliseconds = bestCullingTime(3, [&]() { picker.pick(bvh, batch, hits, pool); });
+	for (const RayHit& hit : hits) result.hits += hit.object != PICK_NONE;
+
+	std::vector<uint32_t> candidates;
+	for (size_t i = 0; i < std::min(rays, (size_t)PICKING_BENCHMARK_CHECKS); i++)
+	{
+		bvh.queryRay(batch[i].origin, batch[i].direction, batch[i].maxDistance, candidates);
+		RayHit reference = bruteForcePick(batch[i], candidates, transforms, positions, indices);
+		bool same = reference.object == hits[i].object && reference.triangle == hits[i].triangle;
+		// Rays through a shared edge can report either triangle at the same distance
+		if (!same && reference.object != PICK_NONE && hits[i].object != PICK_NONE)
+			same = std::fabs(reference.distance - hits[i].distance) <= 1e-4f * reference.distance;
+		result.mismatches += !same;
+	}
+
+	return result;
+}
+
+inline void printPickingBenchmark(const PickingBenchmarkResult& result)
+{
+	std::cout << "Picking benchmark: " << result.objects << " objects of " << result.trianglesPerObject << " triangles, "
+		<< result.rays << " rays, " << result.hits << " hits" << '\n';
+	std::cout << "  build:    triangle BVH " << result.buildMilliseconds << " ms, scene BVH " << result.sceneMilliseconds << " ms" << '\n';
+	std::cout << "  serial:   " << result.serialMilliseconds << " ms (" << result.rays / result.serialMilliseconds << " rays/ms)" << '\n';
+	std::cout << "  parallel: " << result.parallelMilliseconds << " ms (" << result.rays / result.parallelMilliseconds << " rays/ms)" << '\n';
+	if (result.mismatches) std::cout << "  " << result.mismatches << " hits differ from the brute force test" << '\n';
+}
+
+#endif // !PICKING_BENCHMARK_H
@@ -0,0 +1,243 @@
+/*
+*	RAY_PICKING.HPP
+*
+*	Triangle exact ray queries over the scene: which object, mesh and
+*	triangle a ray hits first, where on the triangle and how far away.
+*
+*	Two levels of acceleration:
+*	- the scene DynamicBVH (SCENE/dynamic_bvh.hpp) gives the objects whose
+*	  boxes the ray crosses, near first
+*	- every geometry has a TriangleBVH (MESH/triangle_bvh.hpp) in its own
+*	  space, the ray is moved there with the part's inverse transform and
+*	  the triangles are tested a packet at a time with SIMD
+*	The closest hit so far shortens the ray, so objects and nodes behind it
+*	are never visited.
+*
+*	ScenePicker holds the geometries and what each scene BVH object is made
+*	of: addGeometry() builds a triangle BVH once (a Mesh is only built the
+*	first time it is seen, addModel() builds all meshes of a model on the
+*	pool), setObject() places an object's parts. Objects the picker does not
+*	know are skipped. Queries are const, a batch of rays is split over the
+*	thread pool.
+*
+*	screenRay() unprojects a cursor position through the camera, from the
+*	near plane to the far one.
+*/
+
+#ifndef RAY_PICKING_H
+#define RAY_PICKING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <BOUNDS/bounds.hpp>
+#include <CAMERA/base_camera.hpp>
+#include <MESH/mesh.hpp>
+#include <MESH/triangle_bvh.hpp>
+#include <MODEL/model.hpp>
+#include <SCENE/dynamic_bvh.hpp>
+#include <THREADS/thread_pool.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+#define PICK_NONE UINT32_MAX
+#define PICKING_GRAIN 64				// Rays per job of a batch
+
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;				// Normalized, so distances are world units
+	float maxDistance;
+};
+
+struct RayHit
+{
+	uint32_t object;					// Scene BVH object, PICK_NONE on a miss
+	uint32_t mesh;						// Mesh of the object's model, 0 for single geometry objects
+	uint32_t triangle;					// In the mesh's LOD0 index range
+	glm::vec2 barycentrics;				// Weights of the triangle's second and third vertices
+	float distance;
+	glm::vec3 position;					// World space
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Ray picking utility functions"
+
+// Ray through a cursor position in window coordinates (origin at the top left)
+inline Ray screenRay(BaseCamera& camera, double cursorX, double cursorY, int windowWidth, int windowHeight)
+{
+	glm::vec2 ndc(2.0f * (float)cursorX / std::max(windowWidth, 1) - 1.0f, 1.0f - 2.0f * (float)cursorY / std::max(windowHeight, 1));
+	glm::vec3 nearPoint = camera.unproject(glm::vec3(ndc, -1.0f)), farPoint = camera.unproject(glm::vec3(ndc, 1.0f));
+	return { nearPoint, glm::normalize(farPoint - nearPoint), glm::length(farPoint - nearPoint) };
+}
+
+inline RayHit missedRay()
+{
+	RayHit hit = {};
+	hit.object = hit.mesh = hit.triangle = PICK_NONE;
+	hit.distance = -1.0f;
+	return hit;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class ScenePicker
+{
+public:
+
+	/*
+	*	Triangle BVH of positions placed every stride bytes, indexed or a plain
+	*	triangle list (indices nullptr). Returns the geometry id for setObject().
+	*/
+	uint32_t addGeometry(const void* positions, size_t vertexCount, size_t stride, const GLuint* indices, size_t indexCount)
+	{
+		this->geometries.push_back(TriangleBVH());
+		this->geometries.back().build(positions, vertexCount, stride, indices, indexCount);
+		return (uint32_t)this->geometries.size() - 1;
+	}
+
+	// LOD0 of the mesh, built on first use and shared afterwards
+	uint32_t addGeometry(const Mesh& mesh)
+	{
+		std::unordered_map<const Mesh*, uint32_t>::iterator it = this->meshGeometries.find(&mesh);
+		if (it != this->meshGeometries.end()) return it->second;
+
+		uint32_t geometry = (uint32_t)this->geometries.size();
+		this->geometries.push_back(TriangleBVH());
+		buildMesh(mesh, this->geometries.back());
+		this->meshGeometries[&mesh] = geometry;
+		return geometry;
+	}
+
+	// Every mesh of the model not built yet, one per job
+	void addModel(const Model& model, ThreadPool& pool = ThreadPool::shared())
+	{
+		std::vector<const Mesh*> pending;
+		for (const std::unique_ptr<Mesh>& mesh : model.meshes)
+			if (this->meshGeometries.find(mesh.get()) == this->meshGeometries.end())
+			{
+				this->meshGeometries[mesh.get()] = (uint32_t)(this->geometries.size() + pending.size());
+				pending.push_back(mesh.get());
+			}
+
+		size_t first = this->geometries.size();
+		this->geometries.resize(first + pending.size());
+		pool.parallelFor(pending.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++) buildMesh(*pending[i], this->geometries[first + i]);
+		});
+	}
+
+	// The object is one geometry placed by transform
+	void setObject(uint32_t object, uint32_t geometry, const glm::mat4& transform)
+	{
+		std::vector<PickPart>& parts = objectParts(object);
+		parts.clear();
+		parts.push_back({ geometry, 0, glm::inverse(transform) });
+	}
+
+	// The object is every mesh of the model, each placed by its node
+	void setObject(uint32_t object, const Model& model, const glm::mat4& transform)
+	{
+		addModel(model);
+
+		std::vector<PickPart>& parts = objectParts(object);
+		parts.clear();
+		for (const ModelNode& node : model.nodes)
+			for (GLuint mesh : node.meshes)
+				parts.push_back({ this->meshGeometries[model.meshes[mesh].get()], mesh, glm::inverse(transform * node.globalTransform) });
+	}
+
+	void removeObject(uint32_t object)
+	{
+		if (object < this->objects.size()) this->objects[object].clear();
+	}
+
+	// Closest triangle hit along the ray, among the objects of the scene BVH
+	bool pick(const DynamicBVH& bvh, const Ray& ray, RayHit& hit) const
+	{
+		hit = missedRay();
+		float closest = ray.maxDistance;
+
+		bvh.raycast(ray.origin, ray.direction, ray.maxDistance, [&](uint32_t object, float) -> float
+		{
+			if (object >= this->objects.size()) return closest;
+
+			for (const PickPart& part : this->objects[object])
+			{
+				// Linear part of the transform only on the direction, distances stay in world units
+				glm::vec3 origin = glm::vec3(part.worldToLocal * glm::vec4(ray.origin, 1.0f));
+				glm::vec3 direction = glm::mat3(part.worldToLocal) * ray.direction;
+
+				TriangleHit triangleHit;
+				if (!this->geometries[part.geometry].intersect(origin, direction, closest, triangleHit)) continue;
+
+				closest = triangleHit.distance;
+				hit.object = object;
+				hit.mesh = part.mesh;
+				hit.triangle = triangleHit.triangle;
+				hit.barycentrics = triangleHit.barycentrics;
+				hit.distance = triangleHit.distance;
+			}
+			return closest;
+		});
+
+		if (hit.object == PICK_NONE) return false;
+		hit.position = ray.origin + ray.direction * hit.distance;
+		return true;
+	}
+
+	// One hit per ray, misses have object PICK_NONE
+	void pick(const DynamicBVH& bvh, const Ray* rays, size_t count, RayHit* hits, ThreadPool& pool = ThreadPool::shared()) const
+	{
+		pool.parallelFor(count, PICKING_GRAIN, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++) pick(bvh, rays[i], hits[i]);
+		});
+	}
+
+	void pick(const DynamicBVH& bvh, const std::vector<Ray>& rays, std::vector<RayHit>& hits, ThreadPool& pool = ThreadPool::shared()) const
+	{
+		hits.resize(rays.size());
+		pick(bvh, rays.data(), rays.size(), hits.data(), pool);
+	}
+
+	inline size_t getGeometryCount() const { return this->geometries.size(); }
+	inline const TriangleBVH& getGeometry(uint32_t geometry) const { return this->geometries[geometry]; }
+
+private:
+
+	struct PickPart
+	{
+		uint32_t geometry;
+		uint32_t mesh;
+		glm::mat4 worldToLocal;
+	};
+
+	std::vector<TriangleBVH> geometries;
+	std::unordered_map<const Mesh*, uint32_t> meshGeometries;
+	std::vector<std::vector<PickPart>> objects;		// Indexed by scene BVH object
+
+	std::vector<PickPart>& objectParts(uint32_t object)
+	{
+		if (object >= this->objects.size()) this->objects.resize(object + 1);
+		return this->objects[object];
+	}
+
+	static void buildMesh(const Mesh& mesh, TriangleBVH& bvh)
+	{
+		if (mesh.indices.empty() || mesh.lods.empty())
+		{
+			bvh.build(mesh.vertices.data(), mesh.vertices.size(), sizeof(Vertex), nullptr, 0);
+			return;
+		}
+		bvh.build(mesh.vertices.data(), mesh.vertices.size(), sizeof(Vertex), mesh.indices.data() + mesh.lods[0].firstIndex, mesh.lods[0].indexCount);
+	}
+};
+
+#endif // !RAY_PICKING_H
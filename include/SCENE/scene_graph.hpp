@@ -0,0 +1,274 @@
+/*
+*	SCENE_GRAPH.HPP
+*
+*	Transform hierarchy stored as flat, depth sorted arrays (SoA): parent
+*	index, local translation / rotation / scale, world matrix and dirty flags.
+*
+*	Nodes are referenced through stable SceneNodeIds, the arrays themselves
+*	are kept sorted by depth so every parent comes before its children and
+*	each depth level is a contiguous range. update() is then one linear pass
+*	over the arrays, level by level: a node is recomputed only if it was
+*	modified or its parent's world matrix changed this pass, and the nodes of
+*	a level are independent so each level is split over a ThreadPool.
+*
+*	Adding nodes appends them and marks the arrays unsorted, the counting sort
+*	by depth runs at the next update(). Nothing is done when no node is dirty.
+*/
+
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <THREADS/thread_pool.hpp>
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+
+#define SCENE_NO_PARENT UINT32_MAX		// Also the id addNode() returns on failure
+#define SCENE_UPDATE_GRAIN 1024
+
+typedef uint32_t SceneNodeId;
+
+struct SceneGraphStats
+{
+	size_t nodes;
+	size_t levels;
+	size_t updated;				// World matrices recomputed by the last update()
+	double updateMilliseconds;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Scene graph utility functions"
+
+inline glm::mat4 composeTRS(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+	glm::mat4 m = glm::mat4_cast(rotation);
+	m[0] *= scale.x;
+	m[1] *= scale.y;
+	m[2] *= scale.z;
+	m[3] = glm::vec4(translation, 1.0f);
+	return m;
+}
+
+// Inverse of composeTRS() for affine matrices without shear, a mirrored basis goes to a negative x scale
+inline void decomposeTRS(const glm::mat4& m, glm::vec3& translation, glm::quat& rotation, glm::vec3& scale)
+{
+	translation = glm::vec3(m[3]);
+
+	glm::mat3 basis(m);
+	scale = glm::vec3(glm::length(basis[0]), glm::length(basis[1]), glm::length(basis[2]));
+	if (glm::determinant(basis) < 0.0f) scale.x = -scale.x;
+
+	for (int c = 0; c < 3; c++) if (scale[c] != 0.0f) basis[c] /= scale[c];
+	rotation = glm::normalize(glm::quat_cast(basis));
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class SceneGraph
+{
+public:
+
+	SceneGraph()
+	{
+		this->sorted = true;
+		this->dirtyCount = 0;
+		this->stats = SceneGraphStats();
+	}
+
+	// The parent must already exist, new nodes are dirty. An unknown parent adds nothing and gives SCENE_NO_PARENT
+	SceneNodeId addNode(SceneNodeId parent = SCENE_NO_PARENT, const glm::vec3& translation = glm::vec3(0.0f),
+		const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f))
+	{
+		SceneNodeId id = (SceneNodeId)this->slots.size();
+		uint32_t index = (uint32_t)this->parents.size();
+		bool root = parent == SCENE_NO_PARENT;
+		if (!root && parent >= id)
+		{
+			std::cout << "ERROR::SCENE_GRAPH::INVALID_PARENT " << parent << '\n';
+			return SCENE_NO_PARENT;
+		}
+
+		this->slots.push_back(index);
+		this->ids.push_back(id);
+		this->parents.push_back(root ? -1 : (int32_t)this->slots[parent]);
+		this->depths.push_back(root ? 0 : this->depths[this->slots[parent]] + 1);
+		this->translations.push_back(translation);
+		this->rotations.push_back(rotation);
+		this->scales.push_back(scale);
+		this->worlds.push_back(glm::mat4(1.0f));
+		this->dirty.push_back(1);
+		this->changed.push_back(0);
+
+		this->dirtyCount++;
+		this->levelStarts.clear();
+		// Appending keeps the order valid only if the depth doesn't go back up
+		if (index > 0 && this->depths[index] < this->depths[index - 1]) this->sorted = false;
+		return id;
+	}
+
+	inline void setTranslation(SceneNodeId id, const glm::vec3& translation) { this->translations[this->slots[id]] = translation; markDirty(id); }
+	inline void setRotation(SceneNodeId id, const glm::quat& rotation) { this->rotations[this->slots[id]] = rotation; markDirty(id); }
+	inline void setScale(SceneNodeId id, const glm::vec3& scale) { this->scales[this->slots[id]] = scale; markDirty(id); }
+
+	void setLocalTransform(SceneNodeId id, const glm::mat4& transform)
+	{
+		uint32_t index = this->slots[id];
+		decomposeTRS(transform, this->translations[index], this->rotations[index], this->scales[index]);
+		markDirty(id);
+	}
+
+	inline const glm::vec3& getTranslation(SceneNodeId id) const { return this->translations[this->slots[id]]; }
+	inline const glm::quat& getRotation(SceneNodeId id) const { return this->rotations[this->slots[id]]; }
+	inline const glm::vec3& getScale(SceneNodeId id) const { return this->scales[this->slots[id]]; }
+
+	// Valid after update()
+	inline const glm::mat4& getWorldMatrix(SceneNodeId id) const { return this->worlds[this->slots[id]]; }
+
+	inline SceneNodeId getParent(SceneNodeId id) const
+	{
+		int32_t parent = this->parents[this->slots[id]];
+		return parent < 0 ? SCENE_NO_PARENT : this->ids[parent];
+	}
+
+	inline size_t size() const { return this->ids.size(); }
+	inline const SceneGraphStats& getStats() const { return this->stats; }
+
+	// Recomputes the world matrices of dirty nodes and their subtrees
+	void update(ThreadPool& pool = ThreadPool::shared())
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		if (!this->sorted) sortByDepth();
+		this->stats.nodes = this->ids.size();
+		this->stats.levels = this->levelStarts.empty() ? 0 : this->levelStarts.size() - 1;
+		this->stats.updated = 0;
+
+		if (this->dirtyCount == 0)
+		{
+			this->stats.updateMilliseconds = 0.0;
+			return;
+		}
+		if (this->levelStarts.empty()) buildLevels();
+
+		std::atomic<size_t> updated(0);
+		for (size_t level = 0; level + 1 < this->levelStarts.size(); level++)
+		{
+			size_t first = this->levelStarts[level];
+			pool.parallelFor(this->levelStarts[level + 1] - first, SCENE_UPDATE_GRAIN, [&](size_t begin, size_t end)
+			{
+				size_t count = 0;
+				for (size_t i = first + begin; i < first + end; i++)
+				{
+					int32_t parent = this->parents[i];
+					bool recompute = this->dirty[i] || (parent >= 0 && this->changed[parent]);
+					this->changed[i] = recompute;
+					if (!recompute) continue;
+
+					glm::mat4 local = composeTRS(this->translations[i], this->rotations[i], this->scales[i]);
+					this->worlds[i] = parent >= 0 ? this->worlds[parent] * local : local;
+					this->dirty[i] = 0;
+					count++;
+				}
+				updated += count;
+			});
+		}
+
+		this->dirtyCount = 0;
+		this->stats.levels = this->levelStarts.size() - 1;
+		this->stats.updated = updated;
+		this->stats.updateMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+
+	bool sorted;
+	size_t dirtyCount;
+	SceneGraphStats stats;
+
+	std::vector<uint32_t> slots;			// SceneNodeId -> array index
+	std::vector<SceneNodeId> ids;			// Array index -> SceneNodeId
+	std::vector<uint32_t> levelStarts;		// First index of every depth, plus the end
+
+	// Node data, parents before children
+	std::vector<int32_t> parents;
+	std::vector<uint32_t> depths;
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::mat4> worlds;
+	std::vector<uint8_t> dirty;				// Local TRS modified since the last update()
+	std::vector<uint8_t> changed;			// World matrix recomputed in the current update()
+
+	inline void markDirty(SceneNodeId id)
+	{
+		uint8_t& flag = this->dirty[this->slots[id]];
+		this->dirtyCount += !flag;
+		flag = 1;
+	}
+
+	template<typename T>
+	static void permute(std::vector<T>& data, const std::vector<uint32_t>& order)
+	{
+		std::vector<T> result(data.size());
+		for (size_t i = 0; i < order.size(); i++) result[i] = data[order[i]];
+		data.swap(result);
+	}
+
+	// Stable counting sort by depth, parent indices are remapped to the new order
+	void sortByDepth()
+	{
+		size_t count = this->ids.size();
+		uint32_t maxDepth = 0;
+		for (uint32_t depth : this->depths) maxDepth = std::max(maxDepth, depth);
+
+		std::vector<uint32_t> starts(maxDepth + 2, 0);
+		for (uint32_t depth : this->depths) starts[depth + 1]++;
+		for (uint32_t d = 0; d <= maxDepth; d++) starts[d + 1] += starts[d];
+
+		std::vector<uint32_t> order(count), remap(count);
+		{
+			std::vector<uint32_t> fill(starts.begin(), starts.end() - 1);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint32_t target = fill[this->depths[i]]++;
+				order[target] = i;
+				remap[i] = target;
+			}
+		}
+
+		for (int32_t& parent : this->parents) if (parent >= 0) parent = (int32_t)remap[parent];
+		permute(this->parents, order);
+		permute(this->ids, order);
+		permute(this->depths, order);
+		permute(this->translations, order);
+		permute(this->rotations, order);
+		permute(this->scales, order);
+		permute(this->worlds, order);
+		permute(this->dirty, order);
+		permute(this->changed, order);
+
+		for (uint32_t i = 0; i < count; i++) this->slots[this->ids[i]] = i;
+
+		this->levelStarts = starts;
+		this->sorted = true;
+	}
+
+	// Level ranges of arrays that are already in depth order
+	void buildLevels()
+	{
+		this->levelStarts.assign(1, 0);
+		for (uint32_t i = 0; i < this->depths.size(); i++)
+			while (this->levelStarts.size() <= this->depths[i]) this->levelStarts.push_back(i);
+		this->levelStarts.push_back((uint32_t)this->depths.size());
+	}
+};
+
+#endif // !SCENE_GRAPH_H
@@ -9,6 +9,9 @@
 * 
 *	The set of setUniform functions will modify the value of the shader uniform
 *	placed at the given location
+* 
+*	getSamplerUnit() assigns each sampler uniform a fixed texture unit the first
+*	time it is requested, so callers can cache the unit and only bind textures
 * 
  */
 
@@ -23,6 +26,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
 
 // Utils -----------------------------------------------------------------------
@@ -104,12 +108,35 @@ private:
 	// Shader program ID
 	GLuint ID;
 
+	// Unique per Shader object, program IDs can be recycled by the driver
+	GLuint serial;
+
+	// Sampler name -> texture unit, -1 if the program has no such sampler
+	std::unordered_map<std::string, int> samplerUnits;
+	int nextSamplerUnit;
+
+	static GLuint nextSerial()
+	{
+		static GLuint counter = 0;
+		return ++counter;
+	}
+
+	// Fragment shader texture units of the context, queried on first use
+	static int maxSamplerUnits()
+	{
+		static GLint units = 0;
+		if (units == 0) glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+		return units;
+	}
+
 public:
 
 	// The constructor will read and compile both shaders
 	Shader(const char* vertexPath, const char* fragmentPath, int stringMode = 0)
 	{
 		this->ID = 0;
+		this->serial = nextSerial();
+		this->nextSamplerUnit = 0;
 		// Vertex Shader object and fragment shader object creation
 		GLuint vertexShader, fragmentShader;
 		vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -159,6 +186,7 @@ public:
 	}
 
 	inline GLuint getID() const { return this->ID; }
+	inline GLuint getSerial() const { return this->serial; }
 
 	// Activate shader
 	void use()
@@ -217,6 +245,32 @@ public:
 		glUniformMatrix4fv(glGetUniformLocation(this->ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
 	}
 
+	/*	Sampler unit assignment:
+	*
+	*	The first request for a sampler name gives it the next free texture unit and
+	*	stores it in the program, later requests return the cached unit.
+	*	Returns -1 if the program has no active uniform with that name, or if
+	*	every unit up to GL_MAX_TEXTURE_IMAGE_UNITS is already taken.
+	*/
+	int getSamplerUnit(const std::string& name)
+	{
+		std::unordered_map<std::string, int>::iterator it = this->samplerUnits.find(name);
+		if (it != this->samplerUnits.end()) return it->second;
+
+		int unit = -1;
+		GLint location = glGetUniformLocation(this->ID, name.c_str());
+		if (location != -1 && this->nextSamplerUnit >= maxSamplerUnits())
+			std::cout << "ERROR::SHADER::SAMPLER_UNITS_EXCEEDED " << name << " needs more than " << maxSamplerUnits() << " texture units" << '\n';
+		else if (location != -1)
+		{
+			unit = this->nextSamplerUnit++;
+			glProgramUniform1i(this->ID, location, unit);
+		}
+
+		this->samplerUnits[name] = unit;
+		return unit;
+	}
+
 };
 
 #endif // !SHADERS_S_H
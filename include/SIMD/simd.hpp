@@ -0,0 +1,24 @@
+/*
+*	SIMD.HPP
+*
+*	Instruction set detection shared by the SIMD code paths of the project.
+*	Every kernel keeps a scalar version, these macros only enable the vector ones.
+*
+*	- SIMD_SSE: SSE2, always available when building for x64
+*	- SIMD_AVX2: only when the compiler targets it (/arch:AVX2, -mavx2)
+*/
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
+#endif // !SIMD_H
\ No newline at end of file
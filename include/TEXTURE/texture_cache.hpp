@@ -0,0 +1,184 @@
+/*
+*	TEXTURE_CACHE.HPP
+*
+*	Texture files shared between models.
+*
+*	TextureCache hands out one SharedTexture per resolved path (normalized, see
+*	normalizeTexturePath()), so every model sampling a file gets the same
+*	handle: the file is decoded once and becomes one GL texture, whatever
+*	number of models or meshes use it.
+*
+*	acquire() and decode() can be called from loader threads, concurrent
+*	decode() calls of one file wait for a single decode. upload() needs the GL
+*	thread, it creates the texture on the first call and frees the pixels.
+*	Models keep their handles, purge() drops the files no model holds anymore.
+*/
+
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <TEXTURE/texture_s.hpp>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+struct TextureCacheStats
+{
+	size_t hits, misses;
+	size_t textures;
+};
+
+// Utils -----------------------------------------------------------------------
+#pragma region "Texture cache utility functions"
+
+/*
+*	Lexical form of a path, so two models reaching one file through different
+*	directories get the same key: forward slashes, no "." segments and ".."
+*	folded into the segment before it. Links aren't followed.
+*/
+inline std::string normalizeTexturePath(const std::string& path)
+{
+	std::string unified = path;
+	for (char& c : unified) if (c == '\\') c = '/';
+
+	// A leading "/" or drive ("C:/") stays, ".." can't climb above it
+	size_t rootLength = !unified.empty() && unified[0] == '/' ? 1 : (unified.size() > 2 && unified[1] == ':' && unified[2] == '/' ? 3 : 0);
+
+	std::vector<std::string> segments;
+	size_t start = rootLength;
+	while (start <= unified.size())
+	{
+		size_t end = unified.find('/', start);
+		if (end == std::string::npos) end = unified.size();
+		std::string segment = unified.substr(start, end - start);
+		start = end + 1;
+
+		if (segment.empty() || segment == ".") continue;
+		if (segment == ".." && !segments.empty() && segments.back() != "..") segments.pop_back();
+		else if (segment != ".." || rootLength == 0) segments.push_back(segment);
+	}
+
+	std::string normalized = unified.substr(0, rootLength);
+	for (size_t i = 0; i < segments.size(); i++) normalized += (i ? "/" : "") + segments[i];
+	return normalized;
+}
+
+#pragma endregion
+// -----------------------------------------------------------------------------
+
+class SharedTexture
+{
+public:
+
+	explicit SharedTexture(const std::string& path)
+	{
+		this->path = path;
+	}
+
+	SharedTexture(const SharedTexture&) = delete;
+	SharedTexture& operator=(const SharedTexture&) = delete;
+
+	// Thread safe, only the first call reads the file
+	void decode()
+	{
+		std::call_once(this->decoded, [this]() { this->image = TextureImage::decode(this->path.c_str()); });
+	}
+
+	/*
+	*	GL texture of the file, created on the first call from the decoded
+	*	pixels. Copies of it share the texture, the sampler type is theirs to
+	*	set. A file that failed to decode gives an empty texture.
+	*/
+	const Texture& upload()
+	{
+		decode();
+		if (!this->texture)
+		{
+			GLenum textureConfig[4] = { GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR };
+			if (!this->image.pixels) std::cout << "ERROR::TEXTURE_CACHE::TEXTURE_LOADING_FAILED " << this->path << '\n';
+			this->texture.reset(new Texture(this->image, GL_TEXTURE_2D, 0, textureConfig, texture_diffuse));
+
+			// Pixels live in the GPU now
+			this->image = TextureImage();
+		}
+		return *this->texture;
+	}
+
+	inline const std::string& getPath() const { return this->path; }
+	inline bool isUploaded() const { return this->texture != nullptr; }
+
+private:
+
+	std::string path;
+	std::once_flag decoded;
+	TextureImage image;
+	std::unique_ptr<Texture> texture;
+};
+
+typedef std::shared_ptr<SharedTexture> TextureHandle;
+
+class TextureCache
+{
+public:
+
+	TextureCache()
+	{
+		this->hits = 0;
+		this->misses = 0;
+	}
+
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	// Handle of a file, nothing is read until decode()
+	TextureHandle acquire(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		TextureHandle& slot = this->textures[normalizeTexturePath(path)];
+		if (slot) this->hits++;
+		else
+		{
+			slot = std::make_shared<SharedTexture>(path);
+			this->misses++;
+		}
+		return slot;
+	}
+
+	// Drops the files no model holds anymore (their GL textures too, call it on the context thread)
+	size_t purge()
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		size_t released = 0;
+		for (std::unordered_map<std::string, TextureHandle>::iterator it = this->textures.begin(); it != this->textures.end();)
+		{
+			if (it->second.use_count() == 1)
+			{
+				it = this->textures.erase(it);
+				released++;
+			}
+			else ++it;
+		}
+		return released;
+	}
+
+	TextureCacheStats getStats() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return { this->hits, this->misses, this->textures.size() };
+	}
+
+private:
+
+	mutable std::mutex mutex;
+	std::unordered_map<std::string, TextureHandle> textures;	// By normalized path
+	size_t hits, misses;
+};
+
+#endif // !TEXTURE_CACHE_H
@@ -11,6 +11,12 @@
 *	Unbind() and bind() functions for using the texture when needed.
 * 
 *	LoadFromFile() overwrites the current texture with a new one.
+*
+*	Decoding and uploading are also available on their own: TextureImage::decode()
+*	only touches memory and can run on any thread, the Texture constructor taking
+*	a TextureImage then uploads it on the GL thread.
+*
+*	Copies share the same GL texture, which is deleted with the last of them.
 * 
 */
 
@@ -23,6 +29,7 @@
 #include <glad/glad.h>
 
 #include <iostream>
+#include <memory>
 
 enum TextureType
 {
@@ -32,11 +39,29 @@ enum TextureType
 	texture_height
 };
 
+// Decoded pixels waiting for their upload
+struct TextureImage
+{
+	std::shared_ptr<unsigned char> pixels;
+	int width = 0, height = 0, nrChannels = 0;
+
+	// Thread safe, the flip flag is set per thread
+	static TextureImage decode(const char* texturePath, bool flip = true)
+	{
+		TextureImage image;
+		stbi_set_flip_vertically_on_load_thread(flip);
+		unsigned char* data = stbi_load(texturePath, &image.width, &image.height, &image.nrChannels, 0);
+		if (data) image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+		return image;
+	}
+};
+
 class Texture
 {
 private:
 
 	GLuint ID;
+	std::shared_ptr<GLuint> owner;	// Shared by copies, deletes the texture with the last one
 	GLenum type;
 	int textureUnit;
 	GLenum wrapTSMinMag_filters[4];
@@ -57,9 +82,15 @@ public:
 		loadFromFile(texturePath, flip);
 	}
 
-	~Texture() 
+	// Upload of an image decoded beforehand (possibly on another thread)
+	Texture(const TextureImage& image, GLenum type, int textureUnit, GLenum wrapTSMinMag_filters[], TextureType sType)
 	{
-		glDeleteTextures(1, &this->ID);
+		this->sType = sType;
+		this->ID = -1;
+		this->type = type;
+		this->textureUnit = textureUnit;
+		for (int i = 0; i < 4; i++) { this->wrapTSMinMag_filters[i] = wrapTSMinMag_filters[i]; }
+		upload(image);
 	}
 
 	inline std::string getTextureType() const 
@@ -76,6 +107,7 @@ public:
 	}
 
 	inline GLuint getID() const { return this->ID; }
+	inline GLenum getType() const { return this->type; }
 	inline int getTextureUnit() const { return this->textureUnit; }
 	inline GLenum getFilter(int filter_pos) const { return this->wrapTSMinMag_filters[filter_pos]; }
 
@@ -107,19 +139,24 @@ public:
 
 	void loadFromFile(const char* texturePath, bool flip)
 	{
-		// If there is already a texture loaded delete it first
-		if (this->ID != (GLuint) -1)
-		{
-			glDeleteTextures(1, &this->ID);
-			this->ID = -1;
-		}
-
 		// Load the texture and flip y-axis if needed
-		if (flip) stbi_set_flip_vertically_on_load(true);
-		unsigned char* data = stbi_load(texturePath, &width, &height, &nrChannels, 0);
+		upload(TextureImage::decode(texturePath, flip));
+	}
+
+	void upload(const TextureImage& image)
+	{
+		// If there is already a texture loaded release it first
+		this->owner.reset();
+		this->ID = -1;
+
+		this->width = image.width;
+		this->height = image.height;
+		this->nrChannels = image.nrChannels;
+		unsigned char* data = image.pixels.get();
 
 		// Generate and bind the texture to be able to modify it
 		glGenTextures(1, &this->ID);
+		this->owner = std::shared_ptr<GLuint>(new GLuint(this->ID), [](GLuint* ID) { glDeleteTextures(1, ID); delete ID; });
 		glActiveTexture(GL_TEXTURE0 + this->textureUnit);
 		glBindTexture(this->type, this->ID);
 
@@ -153,7 +190,6 @@ public:
 
 		glActiveTexture(0);
 		glBindTexture(this->type, 0);
-		stbi_image_free(data);
 	}
 
 };
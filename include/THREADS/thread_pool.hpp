@@ -0,0 +1,168 @@
+/*
+*	THREAD_POOL.HPP
+*
+*	Fixed size worker pool used by the CPU heavy load time and per frame stages.
+*
+*	submit() queues a task and returns a std::future with its result.
+*
+*	parallelFor() splits [0, count) into chunks of grain items and runs
+*	fn(begin, end) on them. The calling thread works on chunks too, so it is
+*	safe to call from inside a pool task: if every worker is busy the caller
+*	simply processes all the chunks itself.
+*
+*	ThreadPool::shared() returns a process wide pool sized to the machine.
+*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+class ThreadPool
+{
+public:
+
+	// threadCount 0 uses one worker per hardware thread minus the caller's
+	explicit ThreadPool(unsigned threadCount = 0)
+	{
+		if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+		this->stopping = false;
+		for (unsigned i = 0; i < threadCount; i++) this->workers.emplace_back([this]() { workerLoop(); });
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->queueMutex);
+			this->stopping = true;
+		}
+		this->queueCondition.notify_all();
+		for (std::thread& worker : this->workers) worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	static ThreadPool& shared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	// Workers plus the calling thread
+	inline size_t getConcurrency() const { return this->workers.size() + 1; }
+
+	template<typename F>
+	std::future<typename std::result_of<F()>::type> submit(F&& task)
+	{
+		typedef typename std::result_of<F()>::type Result;
+
+		std::shared_ptr<std::packaged_task<Result()>> packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		std::future<Result> future = packaged->get_future();
+
+		if (this->workers.empty())
+		{
+			(*packaged)();
+			return future;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->queueMutex);
+			this->tasks.push([packaged]() { (*packaged)(); });
+		}
+		this->queueCondition.notify_one();
+		return future;
+	}
+
+	template<typename F>
+	void parallelFor(size_t count, size_t grain, F&& fn)
+	{
+		if (count == 0) return;
+		grain = std::max<size_t>(grain, 1);
+
+		size_t chunkCount = (count + grain - 1) / grain;
+		if (chunkCount == 1 || this->workers.empty())
+		{
+			fn((size_t)0, count);
+			return;
+		}
+
+		// Shared with the helpers, a helper that starts late finds no chunk left
+		// and leaves without touching fn
+		struct ForState
+		{
+			std::atomic<size_t> nextChunk;
+			std::atomic<size_t> doneChunks;
+			std::mutex doneMutex;
+			std::condition_variable doneCondition;
+		};
+		std::shared_ptr<ForState> state = std::make_shared<ForState>();
+		state->nextChunk = 0;
+		state->doneChunks = 0;
+
+		std::function<void()> work = [state, chunkCount, count, grain, &fn]()
+		{
+			size_t chunk;
+			while ((chunk = state->nextChunk.fetch_add(1)) < chunkCount)
+			{
+				size_t begin = chunk * grain;
+				fn(begin, std::min(begin + grain, count));
+
+				if (state->doneChunks.fetch_add(1) + 1 == chunkCount)
+				{
+					std::lock_guard<std::mutex> lock(state->doneMutex);
+					state->doneCondition.notify_all();
+				}
+			}
+		};
+
+		size_t helpers = std::min(this->workers.size(), chunkCount - 1);
+		{
+			std::lock_guard<std::mutex> lock(this->queueMutex);
+			for (size_t i = 0; i < helpers; i++) this->tasks.push(work);
+		}
+		this->queueCondition.notify_all();
+
+		work();
+
+		std::unique_lock<std::mutex> lock(state->doneMutex);
+		state->doneCondition.wait(lock, [&state, chunkCount]() { return state->doneChunks.load() == chunkCount; });
+	}
+
+private:
+
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	bool stopping;
+
+	void workerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(this->queueMutex);
+				this->queueCondition.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+				if (this->stopping && this->tasks.empty()) return;
+
+				task = std::move(this->tasks.front());
+				this->tasks.pop();
+			}
+			task();
+		}
+	}
+};
+
+#endif // !THREAD_POOL_H
@@ -1,4 +1,7 @@
 
+// Before glad, it brings windows.h and its APIENTRY on Windows
+#include <IO/mapped_file.hpp>
+
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -14,7 +17,23 @@
 #include <TEXTURE/texture_s.hpp>
 #include <CAMERA/base_camera.hpp>
 #include <MESH/mesh.hpp>
+#include <MESH/vertex_layout.hpp>
+#include <MESH/mesh_batch.hpp>
 #include <MODEL/model.hpp>
+#include <MODEL/obj_benchmark.hpp>
+#include <MODEL/model_cache.hpp>
+#include <SCENE/scene_graph.hpp>
+#include <RENDER/render_queue.hpp>
+#include <MODEL/animated_model.hpp>
+#include <ANIMATION/skinning_benchmark.hpp>
+#include <CULLING/frustum_culling.hpp>
+#include <CULLING/occlusion_culling.hpp>
+#include <CULLING/model_occluders.hpp>
+#include <CULLING/culling_benchmark.hpp>
+#include <SCENE/dynamic_bvh.hpp>
+#include <SCENE/bvh_benchmark.hpp>
+#include <SCENE/ray_picking.hpp>
+#include <SCENE/picking_benchmark.hpp>
 
 #include <iostream>
 #include <vector>
@@ -22,6 +41,10 @@
 constexpr int _WIDTH = 900;
 constexpr int _HEIGHT = (int) (0.5625*_WIDTH);
 
+// Cube vertices below: position, texture coordinates, normal
+typedef VertexLayout<Attr<Position, glm::vec3>, Attr<TexCoords, glm::vec2>, Attr<Normal, glm::vec3>> CubeVertexLayout;
+static_assert(CubeVertexLayout::stride == 8 * sizeof(float), "CubeVertexLayout doesn't match the cube vertices");
+
 
 #pragma region CAMERA VARIABLES
 BaseCamera camera(glm::vec3(-2.0f, 1.0f, 6.0f));
@@ -38,6 +61,7 @@ double previousTime = 0;
 int frameCount = 0;
 float deltaTime = 0.0f;
 float timeSinceStart = 0.0f;
+bool pickRequested = false;
 #pragma endregion
 
 #pragma region EXT FUNCTIONS DECLARATION
@@ -49,6 +73,7 @@ void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 #pragma region CALLBACKS DECLARATION
 void mouse_callback(GLFWwindow* window, double xPos, double yPos);
 void mouse_scroll_callback(GLFWwindow* window, double xOffset, double yOffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 #pragma endregion
 
 
@@ -60,7 +85,22 @@ int main()
     std::vector<GLuint> b;
     std::vector<Texture> c; 
     //Mesh x = Mesh(a,b,c);
-    Model y = Model("resources/models/backpack/backpack.obj");
+    const std::string backpackPath = "resources/models/backpack/backpack.obj";
+
+#ifdef COOK_MODELS
+    // Offline step writing the baked files next to their sources, the regular build only reads them
+    {
+        Model source(backpackPath);
+        bool cooked = !source.meshes.empty() && cookModel(source, backpackPath + BAKED_MODEL_EXTENSION);
+        std::cout << "Cook: " << backpackPath << (cooked ? " baked" : " failed") << '\n';
+        return cooked ? 0 : -1;
+    }
+#endif
+
+    // Read from its baked file when that one is up to date (see COOK_MODELS), imported from the OBJ otherwise
+    ModelCache modelCache;
+    ModelInstance y = modelCache.instantiate(backpackPath);
+    const Model& backpack = *y.getModel();
 
 
     #pragma region SETUP
@@ -84,6 +124,11 @@ int main()
     // Define and init render window and rescaling
     glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
 
+    // The projection follows the framebuffer, which can differ from the window size
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    camera.setViewport(framebufferWidth, framebufferHeight);
+
     // Try load Glad for his own OS-specific pointers
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
@@ -98,6 +143,7 @@ int main()
 
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, mouse_scroll_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     glfwSetWindowAspectRatio(window, 16, 9);
 
@@ -112,6 +158,68 @@ int main()
     Shader main_shader("shaders/vertex/vShader.vert", "shaders/fragment/fShader.frag");
     Shader light_source_shader("shaders/vertex/lightSourceVShader.vert", "shaders/fragment/lightSourceFShader.frag");
     Shader model_shader("shaders/vertex/model_shader.vert", "shaders/fragment/model_shader.frag");
+    Shader model_batch_shader("shaders/vertex/model_batch_shader.vert", "shaders/fragment/model_shader.frag");
+
+    // Report attributes the programs read but the vertex formats don't provide
+    validateVertexLayout<CubeVertexLayout>(main_shader, "main_shader");
+    validateVertexLayout<CubeVertexLayout>(light_source_shader, "light_source_shader");
+    validateVertexLayout<MeshVertexLayout, TangentLayout>(model_shader, "model_shader");
+    validateVertexLayout<MeshVertexLayout, TangentLayout>(model_batch_shader, "model_batch_shader");
+
+    // The model was imported before the context existed, its GL objects are created now
+    modelCache.upload();
+    std::cout << "Model: " << backpack.getPath() << ", " << backpack.getStats().meshCount << " meshes, " << backpack.getStats().triangleCount << " triangles, import "
+        << backpack.getStats().importMilliseconds << " ms, process " << backpack.getStats().processMilliseconds << " ms, decode "
+        << backpack.getStats().decodeMilliseconds << " ms, upload " << backpack.getStats().uploadMilliseconds << " ms" << '\n';
+
+    // The backpack's opaque meshes share one multi-draw per texture set, handles follow the mesh order
+    MeshBatch backpackBatch;
+    std::vector<int> backpackMeshes;
+    for (const std::unique_ptr<Mesh>& mesh : backpack.meshes) backpackMeshes.push_back(backpackBatch.addMesh(*mesh));
+    backpackBatch.build();
+
+#ifdef OBJ_BENCHMARK
+    // OBJ reader against Assimp on the same file, the backpack then a large one: OBJ_BENCHMARK_FILE or a synthetic file removed afterwards
+    printObjBenchmark(backpackPath, benchmarkObjLoader(backpackPath));
+#ifdef OBJ_BENCHMARK_FILE
+    printObjBenchmark(OBJ_BENCHMARK_FILE, benchmarkObjLoader(OBJ_BENCHMARK_FILE));
+#else
+    {
+        const std::string syntheticObj = "obj_benchmark_synthetic.obj";
+        if (writeSyntheticObj(syntheticObj)) printObjBenchmark(syntheticObj, benchmarkObjLoader(syntheticObj, 2));
+        std::remove(syntheticObj.c_str());
+    }
+#endif
+#endif
+
+#ifdef SKINNING_BENCHMARK
+    // Crowds of animated characters, CPU skinning against palettes for the vertex shader
+    {
+        AnimatedModel character(SKINNING_BENCHMARK);
+        for (size_t characters : { 100, 250, 500 })
+            printSkinningBenchmark(character.getPath(), benchmarkSkinning(character, characters));
+    }
+#endif
+
+#ifdef CULLING_BENCHMARK
+    // Scalar, SIMD and parallel frustum culling from a thousand to a million objects, then occlusion culling of what's left
+    for (size_t objects : { 1000, 10000, 100000, 1000000 })
+        printFrustumCullingBenchmark(benchmarkFrustumCulling(objects));
+    for (size_t objects : { 10000, 100000, 1000000 })
+        printOcclusionCullingBenchmark(benchmarkOcclusionCulling(objects));
+#endif
+
+#ifdef BVH_BENCHMARK
+    // Building, updating and querying the scene index up to hundreds of thousands of objects
+    for (size_t objects : { 10000, 100000, 300000 })
+        printBVHBenchmark(benchmarkBVH(objects));
+#endif
+
+#ifdef PICKING_BENCHMARK
+    // Batches of triangle exact rays over growing scenes
+    for (size_t objects : { 1000, 10000, 100000 })
+        printPickingBenchmark(benchmarkPicking(objects, 100000));
+#endif
 
     /*
     float triangleVertices[] = {
@@ -188,10 +296,19 @@ int main()
         glm::vec3(-1.3f, 1.0f, -1.5f)
     };
 
+    // Cube transforms, only the animated ones are recomputed each frame
+    SceneGraph scene;
+    SceneNodeId cubeNodes[10];
+    for (unsigned int i = 0; i < 10; i++) cubeNodes[i] = scene.addNode(SCENE_NO_PARENT, cubePositions[i]);
+    scene.setScale(cubeNodes[0], glm::vec3(0.4f));
+
+    // The backpack is drawn at scale(3) * translate(cubePositions[0]), three times the light's path
+    SceneNodeId backpackNode = scene.addNode(SCENE_NO_PARENT, 3.0f * cubePositions[0], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(3.0f));
+
 
     GLuint VAO, VBO;                    // Vertex array object, Vertex buffer object, Element buffer object
-    glGenVertexArrays(1, &VAO);         // Generate the buffer array for VAO
-    glGenBuffers(1, &VBO);              // Generate the buffer for VBO
+    glCreateVertexArrays(1, &VAO);      // Generate the buffer array for VAO
+    glCreateBuffers(1, &VBO);           // Generate the buffer for VBO
 
 /*  
     GLuint EBO;                         
@@ -224,31 +341,47 @@ int main()
     glEnableVertexAttribArray(2);
 */
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // texture coord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // normal vectors
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
+    glNamedBufferData(VBO, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    // Unbinding VAO, VBO AND EBO
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    //glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    // Position, texture coord and normal attributes, offsets and locations come from the layout
+    CubeVertexLayout::apply(VAO, 0);
+    CubeVertexLayout::bindBuffer(VAO, VBO, 0);
 
     main_shader.use();
     main_shader.setIntUniform("m[0].diffuse", container.getTextureUnit());
     main_shader.setIntUniform("m[0].specularMap", _container.getTextureUnit());
-    main_shader.setFloatUniform("m[0].shininess", 64.0f);
+
+    // Cube surface parameters live in the same material buffer as the model's
+    GLuint cubeMaterial = modelCache.getMaterials().add(makeMaterial(glm::vec3(1.0f), glm::vec3(1.0f), glm::vec3(1.0f), 64.0f));
+    modelCache.getMaterials().bind();
+
+    // Cube textures, bound on their units by the render queue when the cubes are drawn
+    std::vector<Texture> cubeTextures = { container, _container };
+    RenderQueue renderQueue;
+
+    // World bounds culled each frame: the backpack at 0, the cubes at their node index
+    const AABB cubeBox = { glm::vec3(-0.5f), glm::vec3(0.5f) };
+    CullingBounds sceneBounds;
+    sceneBounds.resize(10);
+    std::vector<uint32_t> visible;
+    OcclusionBuffer occlusion;
+
+    // The backpack occludes through a box inside its surface, its simplified LODs can bulge out of it
+    const AABB backpackOccluder = innerOccluderBox(backpack);
+    if (isEmpty(backpackOccluder)) std::cout << "ERROR::OCCLUSION::NO_PROXY the backpack won't occlude anything" << '\n';
+
+    // Spatial index over the same objects, their proxies follow the bounds each frame
+    DynamicBVH sceneBVH;
+    std::vector<uint32_t> sceneProxies;
+    for (uint32_t i = 0; i < 10; i++) sceneProxies.push_back(sceneBVH.insert(cubeBox, i));
+
+    // Triangles of the same objects for picking, the cube is the 36 vertex list of the VBO
+    ScenePicker picker;
+    picker.addModel(backpack);
+    uint32_t cubeGeometry = picker.addGeometry(vertices, 36, 8 * sizeof(float), nullptr, 0);
+
+    // Camera state the view dependent uniforms were last set for
+    uint64_t cameraGeneration = UINT64_MAX;
 
 
     #pragma region MAIN_RENDER_LOOP
@@ -265,87 +398,137 @@ int main()
         camera.setCamSpeed(cameraSpeed);
         if(camera.getPosition().y < -3.0f) camera.setPositionY(-3.0f);
 
-        container.bind();
-        _container.bind();
+        camera.setFOV(FOV);
 
         view = camera.getViewMatrix();
-        projection = glm::perspective(glm::radians(FOV), (float)_WIDTH / (float)_HEIGHT, 0.1f, 100.0f);
-
-        main_shader.use();
-        main_shader.setMat4Uniform("view", view);
-        main_shader.setMat4Uniform("projection", projection);
-        main_shader.setVec3Uniform("viewPos", camera.getPosition());
+        projection = camera.getProjectionMatrix();
 
-        light_source_shader.use();
-        light_source_shader.setMat4Uniform("view", view);
-        light_source_shader.setMat4Uniform("projection", projection);
+        // Cached by the camera, the uniforms only change on frames where it moved
+        if (camera.getGeneration() != cameraGeneration)
+        {
+            cameraGeneration = camera.getGeneration();
+
+            main_shader.use();
+            main_shader.setMat4Uniform("view", view);
+            main_shader.setMat4Uniform("projection", projection);
+            main_shader.setVec3Uniform("viewPos", camera.getPosition());
+
+            light_source_shader.use();
+            light_source_shader.setMat4Uniform("view", view);
+            light_source_shader.setMat4Uniform("projection", projection);
+
+            model_shader.use();
+            model_shader.setMat4Uniform("view", view);
+            model_shader.setMat4Uniform("projection", projection);
+            model_shader.setVec3Uniform("viewPos", camera.getPosition());
+
+            model_batch_shader.use();
+            model_batch_shader.setMat4Uniform("view", view);
+            model_batch_shader.setMat4Uniform("projection", projection);
+            model_batch_shader.setVec3Uniform("viewPos", camera.getPosition());
+        }
         glm::vec3 lightColor = glm::vec3(1.0f);
 
         cubePositions[0].x = (float) sin(glfwGetTime()/4) * -3;
         cubePositions[0].y = (float) sin(glfwGetTime()/4) *  2;
         cubePositions[0].z = (float) cos(glfwGetTime()/4) * -3;
-        
-        glBindVertexArray(VAO);
-
 
-        model = glm::mat4(1.0f);
-        model = glm::scale(model, glm::vec3(3.0f));
-        model = glm::translate(model, cubePositions[0]);
-
-        model_shader.use();
-        model_shader.setMat4Uniform("model", model);    
-        model_shader.setMat4Uniform("view", view);
-        model_shader.setMat4Uniform("projection", projection);
-
-        for(unsigned int i = 0; i < 10; i++)
+        scene.setTranslation(cubeNodes[0], cubePositions[0]);
+        scene.setTranslation(backpackNode, 3.0f * cubePositions[0]);
+        for (unsigned int i = 1; i < 10; i++)
         {
             //float angle = glm::radians(55.0f);
             float angle = glfwGetTime() * -1 * i/2;
             if (i % 3 == 0) angle = glfwGetTime() + i/2 * 2;
-            
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            
-            if (i == 0)
-            {
-                model = glm::scale(model, glm::vec3(0.4f));
-                model = glm::rotate(model, glm::radians(0.0f), glm::vec3(1.0f, 0.3f, 0.5f));
+            scene.setRotation(cubeNodes[i], glm::angleAxis(angle, glm::normalize(glm::vec3(1.0f*i, 0.3f*i, 0.5f*i))));
+        }
+        scene.update();
+        
+        // Uniforms shared by every draw of a shader, set once per frame
+        main_shader.use();
+        main_shader.setVec3Uniform("light.position", cubePositions[0]);
+        //main_shader.setVec3Uniform("light.position", camera.getPosition());
+        main_shader.setVec3Uniform("light.direction", camera.getFront());
+        main_shader.setFloatUniform("light.innerCutOff", glm::cos(glm::radians(15.0f)));
+        main_shader.setFloatUniform("light.outerCutOff", glm::cos(glm::radians(20.0f)));
 
-                //light_source_shader.use();
-                //light_source_shader.setMat4Uniform("model", model);
-                y.draw(model_shader);
-            }
-            else
-            {
-                model = glm::rotate(model, angle, glm::vec3(1.0f*i, 0.3f*i, 0.5f*i));
-                glm::mat3 normalMatrixTransform = glm::transpose(glm::inverse(glm::mat3(model)));
+        main_shader.setVec3Uniform("light.diffuse", lightColor);
+        main_shader.setVec3Uniform("light.specular", glm::vec3(1.0f));
+        main_shader.setVec3Uniform("light.ambient",  glm::vec3(0.1f));
+
+        main_shader.setFloatUniform("light.constant", 1.0f);
+        main_shader.setFloatUniform("light.linear", 0.05f);
+        main_shader.setFloatUniform("light.quadratic", 0.01f);
 
-                main_shader.use();
-                main_shader.setMat3Uniform("normalMatrixTransform", normalMatrixTransform);
-                main_shader.setMat4Uniform("model", model);
+        // The models are lit by the same moving light, normal mapped where their material says so
+        model_shader.use();
+        model_shader.setVec3Uniform("lightPos", cubePositions[0]);
+        model_batch_shader.use();
+        model_batch_shader.setVec3Uniform("lightPos", cubePositions[0]);
 
-                main_shader.setVec3Uniform("light.position", cubePositions[0]);
-                //main_shader.setVec3Uniform("light.position", camera.getPosition());
-                main_shader.setVec3Uniform("light.direction", camera.getFront());
-                main_shader.setFloatUniform("light.innerCutOff", glm::cos(glm::radians(15.0f)));
-                main_shader.setFloatUniform("light.outerCutOff", glm::cos(glm::radians(20.0f)));
+        // Draws go through the queue in any order, it sorts them by state and depth
+        renderQueue.begin(view, camera.getNearPlane(), camera.getFarPlane(), camera.getFOV(), (float)camera.getViewportHeight());
 
+        y.transform = scene.getWorldMatrix(backpackNode);
 
-                main_shader.setVec3Uniform("light.diffuse", lightColor);
-                main_shader.setVec3Uniform("light.specular", glm::vec3(1.0f));
-                main_shader.setVec3Uniform("light.ambient",  glm::vec3(0.1f));
+        // Only what the frustum can see reaches the queue
+        for (unsigned int i = 0; i < 10; i++)
+        {
+            AABB box = i == 0 ? transformAABB(backpack.bounds, y.transform) : transformAABB(cubeBox, scene.getWorldMatrix(cubeNodes[i]));
+            sceneBounds.set(i, box);
+            sceneBVH.move(sceneProxies[i], box);
+        }
+        sceneBVH.queryFrustum(camera.getFrustum(), visible);
 
-                main_shader.setFloatUniform("light.constant", 1.0f);
-                main_shader.setFloatUniform("light.linear", 0.05f);
-                main_shader.setFloatUniform("light.quadratic", 0.01f);
-            }
-            // Mode, num of vertices, data type of the indices, and offset 
-            //glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        // Right click picks the triangle under the cursor, or at the screen center while the camera holds it
+        if (pickRequested)
+        {
+            pickRequested = false;
+            picker.setObject(0, backpack, y.transform);
+            for (unsigned int i = 1; i < 10; i++) picker.setObject(i, cubeGeometry, scene.getWorldMatrix(cubeNodes[i]));
+
+            int windowWidth, windowHeight;
+            double cursorX, cursorY;
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+            glfwGetCursorPos(window, &cursorX, &cursorY);
+            if (windowFocus) { cursorX = windowWidth * 0.5; cursorY = windowHeight * 0.5; }
+
+            RayHit hit;
+            if (picker.pick(sceneBVH, screenRay(camera, cursorX, cursorY, windowWidth, windowHeight), hit))
+                std::cout << "Picked object " << hit.object << ", mesh " << hit.mesh << ", triangle " << hit.triangle
+                    << " at " << hit.distance << " (" << hit.position.x << " " << hit.position.y << " " << hit.position.z << ")" << '\n';
+            else
+                std::cout << "Picked nothing" << '\n';
+        }
+
+        // The backpack's proxy hides the cubes behind it, tagged with its bounds index so it never hides the backpack
+        occlusion.begin(camera.getViewProjectionMatrix());
+        occlusion.addOccluder(backpackOccluder, y.transform, 0);
+        occlusion.render();
+        occlusion.cullOccluded(sceneBounds, visible);
 
-            // Mode, starting index, num of vertices
-            glDrawArrays(GL_TRIANGLES, 0, 36); // Without EBO
+        for (uint32_t i : visible)
+        {
+            if (i == 0)
+            {
+                // Opaque meshes go to the batch with their auto LOD, transparent ones need the queue's back to front pass
+                for (const ModelNode& node : backpack.nodes)
+                    for (GLuint mesh : node.meshes)
+                    {
+                        glm::mat4 meshTransform = y.transform * node.globalTransform;
+                        Mesh& backpackMesh = *y.getModel()->meshes[mesh];
+                        if (backpack.getMaterial(mesh).diffuse.w < 1.0f) renderQueue.pushMesh(backpackMesh, model_shader, meshTransform, pass_transparent);
+                        else backpackBatch.submit(backpackMeshes[mesh], meshTransform, backpackMesh.materialIndex,
+                            backpackMesh.selectLod(camera.getPosition(), meshTransform, camera.getFOV(), (float)camera.getViewportHeight(), RENDER_LOD_PIXEL_ERROR));
+                    }
+            }
+            // 36 vertices without EBO, the material index travels as the base instance
+            else renderQueue.pushArrays(VAO, 0, 36, main_shader, scene.getWorldMatrix(cubeNodes[i]), cubeMaterial, pass_opaque, true, &cubeTextures);
         }
-        glBindVertexArray(0);
+
+        // Opaque like the queue's first pass, which left the opaque state set at the end of the last flush
+        backpackBatch.render(model_batch_shader);
+        renderQueue.flush();
 
         // Double buffer swapping and event catching
         glfwSwapBuffers(window);
@@ -366,6 +549,7 @@ int main()
 void framebufferSizeCallback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    camera.setViewport(width, height);
 }
 
 void mouse_callback(GLFWwindow* window, double xPos, double yPos)
@@ -377,6 +561,11 @@ void mouse_scroll_callback(GLFWwindow* window, double xOffset, double yOffset)
 {
     camera.processMouseScroll(yOffset);
 }
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) pickRequested = true;
+}
 #pragma endregion
 
 #pragma region EXT FUNCTIONS IMPLEMENTATION
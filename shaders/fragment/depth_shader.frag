@@ -0,0 +1,6 @@
+#version 460 core
+
+// Depth is written by the fixed function stage, nothing to output
+void main()
+{
+}
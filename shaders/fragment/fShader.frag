@@ -4,7 +4,18 @@
 struct Material {
    sampler2D diffuse;
    sampler2D specularMap;
-   float shininess;
+};
+
+// Surface parameters, indexed with the draw's base instance
+struct MaterialParameters {
+   vec4 ambient;
+   vec4 diffuse;
+   vec4 specular;
+   uint flags;
+};
+
+layout (std430, binding = 1) readonly buffer MaterialBuffer {
+   MaterialParameters materials[];
 };
 
 struct Light {
@@ -28,6 +39,7 @@ out vec4 FragColor;
 in vec2 textCoord;
 in vec3 normal;
 in vec3 fragPos;
+flat in uint materialIndex;
 
 uniform Material m[];
 uniform Light light;
@@ -36,17 +48,18 @@ uniform vec3 viewPos;
 
 void main()
 {
+   MaterialParameters parameters = materials[materialIndex];
    vec3 norm = normalize(normal);
    vec3 lightDir = normalize(light.position - fragPos);
    vec3 viewDir = normalize(viewPos - fragPos);
    vec3 reflectDir = reflect(-lightDir, norm);
 
    float diffuse = max(dot(norm, lightDir), 0.0);
-   float specular = pow(max(dot(viewDir, reflectDir), 0.0), m[0].shininess);
+   float specular = pow(max(dot(viewDir, reflectDir), 0.0), max(parameters.specular.w, 1.0));
 
-   vec3 ambientLightMod = light.ambient * vec3(texture(m[0].diffuse, textCoord));
-   vec3 diffuseLightMod = light.diffuse * (diffuse * vec3(texture(m[0].diffuse, textCoord)));
-   vec3 specularLightMod = light.specular * (specular * vec3(texture(m[0].specularMap, textCoord)));
+   vec3 ambientLightMod = light.ambient * parameters.ambient.rgb * vec3(texture(m[0].diffuse, textCoord));
+   vec3 diffuseLightMod = light.diffuse * parameters.diffuse.rgb * (diffuse * vec3(texture(m[0].diffuse, textCoord)));
+   vec3 specularLightMod = light.specular * parameters.specular.rgb * (specular * vec3(texture(m[0].specularMap, textCoord)));
 
    float distance = length(light.position - fragPos);
    float attenuation = 1.0/ (light.constant + light.linear * distance + light.quadratic * (distance * distance));
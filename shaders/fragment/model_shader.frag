@@ -1,14 +1,58 @@
 #version 460 core
 out vec4 FragColor;
 
+struct Material {
+    vec4 ambient;       // rgb
+    vec4 diffuse;       // rgb, opacity in w
+    vec4 specular;      // rgb, shininess in w
+    uint flags;         // MATERIAL_* bits of material.hpp
+};
+
+const uint MATERIAL_NORMAL_MAPPED = 1u;
+
+layout (std430, binding = 1) readonly buffer MaterialBuffer {
+    Material materials[];
+};
+
 in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+in vec4 Tangent;        // Handedness in w, zero when the draw path has no tangent frame
+flat in uint MaterialIndex;
+
+uniform sampler2D texture_diffuse1;
+uniform sampler2D texture_specular1;
+uniform sampler2D texture_normal1;
+uniform vec3 lightPos;
+uniform vec3 viewPos;
+uniform vec4 tint = vec4(1.0f);
 
-uniform sampler2D texture_diffuse[4];
-uniform sampler2D texture_specular[4];
+const float ambientStrength = 0.1f;
+
+// Normal map sample brought out of tangent space, the interpolated normal when there is none
+vec3 surfaceNormal(Material material)
+{
+    vec3 normal = normalize(Normal);
+    if ((material.flags & MATERIAL_NORMAL_MAPPED) == 0u || dot(Tangent.xyz, Tangent.xyz) < 1e-8f) return normal;
+
+    // Interpolation drifts the tangent away from the normal, orthogonalize it again
+    vec3 tangent = normalize(Tangent.xyz - normal * dot(normal, Tangent.xyz));
+    vec3 bitangent = cross(normal, tangent) * Tangent.w;
+    vec3 mapped = texture(texture_normal1, TexCoords).rgb * 2.0f - 1.0f;
+    return normalize(mat3(tangent, bitangent, normal) * mapped);
+}
 
 void main()
-{   vec4 result = vec4(0.0f);
-    for(int i = 0; i < 4; i++) result += texture(texture_diffuse[i], TexCoords);
-    for(int i = 0; i < 4; i++) result += texture(texture_specular[i], TexCoords);
-    FragColor = result;
+{   Material material = materials[MaterialIndex];
+    vec3 normal = surfaceNormal(material);
+    vec3 lightDir = normalize(lightPos - FragPos);
+    vec3 halfway = normalize(lightDir + normalize(viewPos - FragPos));
+
+    float diffuse = max(dot(normal, lightDir), 0.0f);
+    float specular = diffuse > 0.0f ? pow(max(dot(normal, halfway), 0.0f), max(material.specular.w, 1.0f)) : 0.0f;
+
+    vec3 albedo = texture(texture_diffuse1, TexCoords).rgb;
+    vec3 result = albedo * (material.ambient.rgb * ambientStrength + material.diffuse.rgb * diffuse);
+    result += texture(texture_specular1, TexCoords).rgb * material.specular.rgb * specular;
+    FragColor = vec4(result, material.diffuse.a) * tint;
 }
\ No newline at end of file
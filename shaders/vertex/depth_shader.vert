@@ -0,0 +1,13 @@
+#version 460 core
+layout (location = 0) in vec3 aPos;
+
+// Position only pass (depth prepass, shadow maps, occlusion), fed by Mesh::renderDepth
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
@@ -0,0 +1,47 @@
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aQTangent;
+
+struct DrawData {
+    mat4 model;
+    mat4 normalMatrix;
+    uint materialIndex;
+    uint meshIndex;
+};
+
+layout (std430, binding = 0) readonly buffer DrawBuffer {
+    DrawData draws[];
+};
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+out vec4 Tangent;
+flat out uint MaterialIndex;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+// Tangent of a frame stored as a quaternion, handedness in the sign of w
+vec4 decodeQTangent(vec4 q)
+{
+    q = normalize(q);
+    vec3 tangent = vec3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y));
+    return vec4(tangent, q.w < 0.0 ? -1.0 : 1.0);
+}
+
+void main()
+{
+    // One record per instance, the batch stores the first record index in the base instance
+    DrawData draw = draws[gl_BaseInstance + gl_InstanceID];
+
+    TexCoords = aTexCoords;
+    FragPos = vec3(draw.model * vec4(aPos, 1.0));
+    Normal = mat3(draw.normalMatrix) * aNormal;
+    vec4 tangent = decodeQTangent(aQTangent);
+    Tangent = vec4(mat3(draw.model) * tangent.xyz, tangent.w);
+    MaterialIndex = draw.materialIndex;
+    gl_Position = projection * view * draw.model * vec4(aPos, 1.0);
+}
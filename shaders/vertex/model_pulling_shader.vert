@@ -0,0 +1,85 @@
+#version 460 core
+
+// Vertex pulling: no vertex attributes, vertices are decoded from the shared
+// word buffer of a MeshBatch built with batch_vertex_pulling
+
+const uint FORMAT_FLOAT = 0u;
+const uint FORMAT_QUANTIZED = 1u;
+
+struct DrawData {
+    mat4 model;
+    mat4 normalMatrix;
+    uint materialIndex;
+    uint meshIndex;
+};
+
+struct MeshRecord {
+    vec4 positionOffset;
+    vec4 positionScale;
+    uint format;
+    uint firstWord;
+};
+
+layout (std430, binding = 0) readonly buffer DrawBuffer {
+    DrawData draws[];
+};
+
+layout (std430, binding = 2) readonly buffer VertexBuffer {
+    uint words[];
+};
+
+layout (std430, binding = 3) readonly buffer MeshBuffer {
+    MeshRecord meshes[];
+};
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+out vec4 Tangent;       // No tangent frame here, normal maps fall back to Normal
+flat out uint MaterialIndex;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    DrawData draw = draws[gl_BaseInstance + gl_InstanceID];
+    MeshRecord mesh = meshes[draw.meshIndex];
+
+    // Indices are local to the mesh, so gl_VertexID is the vertex inside it
+    vec3 position, normal;
+    vec2 texCoords;
+
+    if (mesh.format == FORMAT_QUANTIZED)
+    {
+        uint base = mesh.firstWord + uint(gl_VertexID) * 4u;
+        vec2 xy = unpackUnorm2x16(words[base]);
+        float z = unpackUnorm2x16(words[base + 1u]).x;
+
+        position = mesh.positionOffset.xyz + vec3(xy, z) * mesh.positionScale.xyz;
+        normal = decodeOctahedral(unpackSnorm2x16(words[base + 2u]));
+        texCoords = unpackHalf2x16(words[base + 3u]);
+    }
+    else
+    {
+        uint base = mesh.firstWord + uint(gl_VertexID) * 8u;
+        position = vec3(uintBitsToFloat(words[base]), uintBitsToFloat(words[base + 1u]), uintBitsToFloat(words[base + 2u]));
+        normal = vec3(uintBitsToFloat(words[base + 3u]), uintBitsToFloat(words[base + 4u]), uintBitsToFloat(words[base + 5u]));
+        texCoords = vec2(uintBitsToFloat(words[base + 6u]), uintBitsToFloat(words[base + 7u]));
+    }
+
+    TexCoords = texCoords;
+    FragPos = vec3(draw.model * vec4(position, 1.0));
+    Normal = mat3(draw.normalMatrix) * normal;
+    Tangent = vec4(0.0);
+    MaterialIndex = draw.materialIndex;
+    gl_Position = projection * view * draw.model * vec4(position, 1.0);
+}
@@ -2,15 +2,36 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aQTangent;
 
 out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+out vec4 Tangent;
+flat out uint MaterialIndex;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Tangent of a frame stored as a quaternion, handedness in the sign of w.
+// The fragment shader rebuilds the bitangent from the normal
+vec4 decodeQTangent(vec4 q)
+{
+    q = normalize(q);
+    vec3 tangent = vec3(1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z), 2.0 * (q.x * q.z - q.w * q.y));
+    return vec4(tangent, q.w < 0.0 ? -1.0 : 1.0);
+}
+
 void main()
 {
+    // Non batched draws pass the material index as the base instance
+    MaterialIndex = uint(gl_BaseInstance);
     TexCoords = aTexCoords;    
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(model) * aNormal;
+    // Meshes without a tangent stream read the default (0, 0, 0, 1), their materials don't sample a normal map
+    vec4 tangent = decodeQTangent(aQTangent);
+    Tangent = vec4(mat3(model) * tangent.xyz, tangent.w);
     gl_Position = projection * view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 4) in vec4 aJoints;
+layout (location = 5) in vec4 aWeights;
+
+// Skinning matrices of the instance being drawn (SKIN_PALETTE_BINDING)
+layout (std430, binding = 4) readonly buffer PaletteBuffer {
+    mat4 palette[];
+};
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+out vec4 Tangent;       // No tangent frame here, normal maps fall back to Normal
+flat out uint MaterialIndex;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    // Influences are sorted and their weights sum to one
+    mat4 skin = palette[int(aJoints.x)] * aWeights.x;
+    if (aWeights.y > 0.0) skin += palette[int(aJoints.y)] * aWeights.y;
+    if (aWeights.z > 0.0) skin += palette[int(aJoints.z)] * aWeights.z;
+    if (aWeights.w > 0.0) skin += palette[int(aJoints.w)] * aWeights.w;
+
+    // Non batched draws pass the material index as the base instance
+    MaterialIndex = uint(gl_BaseInstance);
+    TexCoords = aTexCoords;
+    FragPos = vec3(model * skin * vec4(aPos, 1.0));
+    Normal = normalize(mat3(model) * mat3(skin) * aNormal);
+    Tangent = vec4(0.0);
+    gl_Position = projection * view * model * skin * vec4(aPos, 1.0);
+}
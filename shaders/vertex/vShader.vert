@@ -2,13 +2,14 @@
 #version 460 core
 
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTextCoord;
-layout (location = 2) in vec3 aNormal;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTextCoord;
 
 
 out vec2 textCoord;
 out vec3 fragPos;
 out vec3 normal;
+flat out uint materialIndex;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -22,4 +23,5 @@ void main()
     textCoord = vec2(aTextCoord.x, aTextCoord.y);
     normal = normalMatrixTransform * aNormal;
     fragPos = vec3(model * vec4(aPos, 1.0));
+    materialIndex = uint(gl_BaseInstance);
 };
\ No newline at end of file
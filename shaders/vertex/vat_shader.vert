@@ -0,0 +1,61 @@
+#version 460 core
+layout (location = 2) in vec2 aTexCoords;
+
+// Per instance record (VERTEX_ANIMATION_INSTANCE_BINDING), see VertexAnimationInstance
+struct Instance {
+    mat4 model;
+    uvec2 frames;       // First frame and frame count of the clip
+    vec2 playback;      // Frames per second and start frame offset
+};
+
+layout (std430, binding = 5) readonly buffer InstanceBuffer {
+    Instance instances[];
+};
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+out vec4 Tangent;       // No tangent frame here, normal maps fall back to Normal
+flat out uint MaterialIndex;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform sampler2D vatPositions;    // Unorm, relative to the baked bounds
+uniform sampler2D vatNormals;
+uniform float time;
+uniform int vatWidth;
+uniform int vatRowsPerFrame;
+uniform vec3 vatBoundsMin;
+uniform vec3 vatBoundsExtent;
+
+// Texel of this vertex in a frame, frames are stacked vertically
+ivec2 frameTexel(uint frame)
+{
+    return ivec2(gl_VertexID % vatWidth, int(frame) * vatRowsPerFrame + gl_VertexID / vatWidth);
+}
+
+void main()
+{
+    Instance instance = instances[gl_InstanceID];
+
+    // Looping playback between the two frames around the current time
+    float span = float(max(instance.frames.y, 2u) - 1u);
+    float frame = mod(max(time * instance.playback.x + instance.playback.y, 0.0), span);
+    uint local = min(uint(frame), max(instance.frames.y, 1u) - 1u);
+    uint first = instance.frames.x + local;
+    uint second = instance.frames.x + min(local + 1u, max(instance.frames.y, 1u) - 1u);
+    float t = fract(frame);
+
+    vec3 position = mix(texelFetch(vatPositions, frameTexel(first), 0).xyz, texelFetch(vatPositions, frameTexel(second), 0).xyz, t);
+    position = vatBoundsMin + position * vatBoundsExtent;
+    vec3 normal = mix(texelFetch(vatNormals, frameTexel(first), 0).xyz, texelFetch(vatNormals, frameTexel(second), 0).xyz, t);
+
+    // gl_VertexID includes the base vertex, gl_BaseInstance still carries the material
+    MaterialIndex = uint(gl_BaseInstance);
+    TexCoords = aTexCoords;
+    FragPos = vec3(instance.model * vec4(position, 1.0));
+    Normal = normalize(mat3(instance.model) * normal);
+    Tangent = vec4(0.0);
+    gl_Position = projection * view * instance.model * vec4(position, 1.0);
+}